@@ -23,6 +23,7 @@
 #include <pthread.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -30,6 +31,10 @@
 #define LOG_TAG "HAL"
 #include <log/log.h>
 
+#if defined(__ANDROID__)
+#include <sys/system_properties.h>
+#endif
+
 #if !defined(__ANDROID_RECOVERY__) && defined(__ANDROID__)
 #include <vndksupport/linker.h>
 #endif
@@ -45,9 +50,16 @@
 #define HAL_LIBRARY_SUBDIR "lib/hw"
 #endif
 
+/* Tests build this file with paths of their own. */
+#ifndef HAL_LIBRARY_PATH1
 #define HAL_LIBRARY_PATH1 "/system/" HAL_LIBRARY_SUBDIR
+#endif
+#ifndef HAL_LIBRARY_PATH2
 #define HAL_LIBRARY_PATH2 "/vendor/" HAL_LIBRARY_SUBDIR
+#endif
+#ifndef HAL_LIBRARY_PATH3
 #define HAL_LIBRARY_PATH3 "/odm/" HAL_LIBRARY_SUBDIR
+#endif
 
 /**
  * There are a set of variant filename for modules. The form of the filename
@@ -71,6 +83,119 @@ static const char *variant_keys[] = {
 static const int HAL_VARIANT_KEYS_COUNT =
     (sizeof(variant_keys)/sizeof(variant_keys[0]));
 
+/**
+ * Threads loading the modules in hw_preload_modules, the caller's included:
+ * one per module, up to the number of CPUs online and to
+ * HAL_PRELOAD_DEFAULT_THREADS. The property below overrides it, up to
+ * HAL_PRELOAD_MAX_THREADS; 1 loads the modules one after the other.
+ */
+#define HAL_PRELOAD_DEFAULT_THREADS 4
+#define HAL_PRELOAD_MAX_THREADS 16
+static const char *HAL_PRELOAD_THREADS_PROPERTY = "ro.hw.preload_threads";
+
+/**
+ * Cache of the modules looked up by hw_get_module_by_class, by class and
+ * name, so that looking a module up again costs neither the property reads
+ * nor the file system probes of its resolution. Modules that were not found
+ * are cached too. An entry is valid for the properties it was resolved with:
+ * once a system property changes, the module is resolved again.
+ */
+struct module_cache_entry {
+    struct module_cache_entry *next;
+    char *class_id;
+    char *name;
+    /* NULL if the module was not found */
+    const struct hw_module_t *hmi;
+    uint32_t serial;
+};
+
+static pthread_mutex_t module_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct module_cache_entry *module_cache = NULL;
+
+/*
+ * Serial number of the system properties, which changes whenever one of
+ * them does.
+ */
+static uint32_t property_serial(void)
+{
+#if defined(__ANDROID__)
+    return __system_property_area_serial();
+#else
+    return 0;
+#endif
+}
+
+static struct module_cache_entry *module_cache_find(const char *class_id,
+        const char *name)
+{
+    struct module_cache_entry *entry;
+    for (entry = module_cache; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0 &&
+                strcmp(entry->class_id, class_id) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Look up a module in the cache. *pHmi is only set if the module is found.
+ * @return 0 if the module is cached, -ENOENT if it is cached as not found,
+ * 1 if it is not cached or its entry is stale.
+ */
+static int module_cache_get(const char *class_id, const char *name,
+        uint32_t serial, const struct hw_module_t **pHmi)
+{
+    int status = 1;
+
+    pthread_mutex_lock(&module_cache_lock);
+    struct module_cache_entry *entry = module_cache_find(class_id, name);
+    if (entry != NULL && entry->serial == serial) {
+        if (entry->hmi != NULL) {
+            *pHmi = entry->hmi;
+            status = 0;
+        } else {
+            status = -ENOENT;
+        }
+    }
+    pthread_mutex_unlock(&module_cache_lock);
+
+    return status;
+}
+
+/*
+ * Cache the module resolved with the properties of the given serial, or
+ * NULL if it was not found. The cache is best effort: entries that cannot
+ * be allocated are not cached.
+ */
+static void module_cache_put(const char *class_id, const char *name,
+        uint32_t serial, const struct hw_module_t *hmi)
+{
+    pthread_mutex_lock(&module_cache_lock);
+    struct module_cache_entry *entry = module_cache_find(class_id, name);
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(*entry));
+        if (entry != NULL) {
+            entry->class_id = strdup(class_id);
+            entry->name = strdup(name);
+            if (entry->class_id == NULL || entry->name == NULL) {
+                free(entry->class_id);
+                free(entry->name);
+                free(entry);
+                entry = NULL;
+            } else {
+                entry->next = module_cache;
+                module_cache = entry;
+            }
+        }
+    }
+    if (entry != NULL) {
+        entry->hmi = hmi;
+        entry->serial = serial;
+    }
+    pthread_mutex_unlock(&module_cache_lock);
+}
+
 /**
  * Load the file defined by the variant and if successful
  * return the dlopen handle and the hmi.
@@ -214,15 +339,47 @@ static int hw_module_exists(char *path, size_t path_len, const char *name,
     return -ENOENT;
 }
 
-int hw_get_module_by_class(const char *class_id, const char *inst,
-                           const struct hw_module_t **module)
+/*
+ * Find the module of the given name, trying the variants in order.
+ * @return 0 with its path in path, or -ENOENT if none is installed.
+ */
+static int hw_module_find(char *path, size_t path_len, const char *name)
 {
     int i = 0;
     char prop[PATH_MAX] = {0};
-    char path[PATH_MAX] = {0};
-    char name[PATH_MAX] = {0};
     char prop_name[PATH_MAX] = {0};
 
+    /* First try a property specific to the class and possibly instance */
+    snprintf(prop_name, sizeof(prop_name), "ro.hardware.%s", name);
+    if (property_get(prop_name, prop, NULL) > 0) {
+        if (hw_module_exists(path, path_len, name, prop) == 0) {
+            return 0;
+        }
+    }
+
+    /* Loop through the configuration variants looking for a module */
+    for (i=0 ; i<HAL_VARIANT_KEYS_COUNT; i++) {
+        if (property_get(variant_keys[i], prop, NULL) == 0) {
+            continue;
+        }
+        if (hw_module_exists(path, path_len, name, prop) == 0) {
+            return 0;
+        }
+    }
+
+    /* Nothing found, try the default */
+    return hw_module_exists(path, path_len, name, "default");
+}
+
+int hw_get_module_by_class(const char *class_id, const char *inst,
+                           const struct hw_module_t **module)
+{
+    int status;
+    char path[PATH_MAX] = {0};
+    char name[PATH_MAX] = {0};
+    /* Sampled first, so that a property changing while the module is
+     * resolved leaves its entry stale. */
+    const uint32_t serial = property_serial();
 
     if (inst)
         snprintf(name, PATH_MAX, "%s.%s", class_id, inst);
@@ -234,6 +391,11 @@ int hw_get_module_by_class(const char *class_id, const char *inst,
         snprintf(name, PATH_MAX, "%s", class_id);
 #endif
 
+    status = module_cache_get(class_id, name, serial, module);
+    if (status <= 0) {
+        return status;
+    }
+
     /*
      * Here we rely on the fact that calling dlopen multiple times on
      * the same .so will simply increment a refcount (and not load
@@ -241,38 +403,104 @@ int hw_get_module_by_class(const char *class_id, const char *inst,
      * We also assume that dlopen() is thread-safe.
      */
 
-    /* First try a property specific to the class and possibly instance */
-    snprintf(prop_name, sizeof(prop_name), "ro.hardware.%s", name);
-    if (property_get(prop_name, prop, NULL) > 0) {
-        if (hw_module_exists(path, sizeof(path), name, prop) == 0) {
-            goto found;
-        }
+    if (hw_module_find(path, sizeof(path), name) != 0) {
+        module_cache_put(class_id, name, serial, NULL);
+        return -ENOENT;
     }
 
-    /* Loop through the configuration variants looking for a module */
-    for (i=0 ; i<HAL_VARIANT_KEYS_COUNT; i++) {
-        if (property_get(variant_keys[i], prop, NULL) == 0) {
-            continue;
-        }
-        if (hw_module_exists(path, sizeof(path), name, prop) == 0) {
-            goto found;
-        }
+    /* load the module, if this fails, we're doomed, and we should not try
+     * to load a different variant. A module that fails to load is not
+     * cached, and is tried again on the next lookup. */
+    status = load(class_id, path, module);
+    if (status == 0) {
+        module_cache_put(class_id, name, serial, *module);
     }
+    return status;
+}
 
-    /* Nothing found, try the default */
-    if (hw_module_exists(path, sizeof(path), name, "default") == 0) {
-        goto found;
-    }
+int hw_get_module(const char *id, const struct hw_module_t **module)
+{
+    return hw_get_module_by_class(id, NULL, module);
+}
 
-    return -ENOENT;
+struct preload_work {
+    const char *const *ids;
+    size_t count;
+    atomic_size_t next;
+    int *statuses;
+};
 
-found:
-    /* load the module, if this fails, we're doomed, and we should not try
-     * to load a different variant. */
-    return load(class_id, path, module);
+static void *preload_modules(void *arg)
+{
+    struct preload_work *work = arg;
+    const struct hw_module_t *hmi;
+    size_t i;
+
+    while ((i = atomic_fetch_add(&work->next, 1)) < work->count) {
+        work->statuses[i] = hw_get_module(work->ids[i], &hmi);
+    }
+    return NULL;
 }
 
-int hw_get_module(const char *id, const struct hw_module_t **module)
+static size_t preload_threads(size_t n)
 {
-    return hw_get_module_by_class(id, NULL, module);
+    long max_threads = property_get_int32(HAL_PRELOAD_THREADS_PROPERTY, 0);
+
+    if (max_threads <= 0) {
+        max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (max_threads > HAL_PRELOAD_DEFAULT_THREADS || max_threads <= 0)
+            max_threads = HAL_PRELOAD_DEFAULT_THREADS;
+    } else if (max_threads > HAL_PRELOAD_MAX_THREADS) {
+        max_threads = HAL_PRELOAD_MAX_THREADS;
+    }
+    return (size_t)max_threads < n ? (size_t)max_threads : n;
+}
+
+int hw_preload_modules(const char *const *ids, size_t n)
+{
+    pthread_t threads[HAL_PRELOAD_MAX_THREADS];
+    size_t max_threads;
+    size_t num_threads = 0;
+    size_t i;
+    int status = 0;
+    struct preload_work work = { .ids = ids, .count = n };
+
+    if (n == 0)
+        return 0;
+
+    work.statuses = calloc(n, sizeof(*work.statuses));
+    if (work.statuses == NULL)
+        return -ENOMEM;
+    atomic_init(&work.next, 0);
+
+    /*
+     * The modules are resolved and loaded by hw_get_module, which caches
+     * them. The caller loads those no other thread does, all of them if no
+     * thread could be started.
+     */
+    max_threads = preload_threads(n);
+    while (num_threads + 1 < max_threads) {
+        if (pthread_create(&threads[num_threads], NULL, preload_modules,
+                &work) != 0) {
+            ALOGW("hw_preload_modules: could not start a thread");
+            break;
+        }
+        num_threads++;
+    }
+    preload_modules(&work);
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (work.statuses[i] != 0) {
+            ALOGW("hw_preload_modules: could not load %s: %d", ids[i],
+                    work.statuses[i]);
+            if (status == 0)
+                status = work.statuses[i];
+        }
+    }
+    free(work.statuses);
+
+    return status;
 }
@@ -17,6 +17,7 @@
 #ifndef ANDROID_INCLUDE_HARDWARE_HARDWARE_H
 #define ANDROID_INCLUDE_HARDWARE_HARDWARE_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 
@@ -239,6 +240,19 @@ int hw_get_module(const char *id, const struct hw_module_t **module);
 int hw_get_module_by_class(const char *class_id, const char *inst,
                            const struct hw_module_t **module);
 
+/**
+ * Load the modules of the 'n' ids in 'ids' ahead of time, so that getting
+ * them with hw_get_module afterwards returns without resolving or loading
+ * them. Meant for processes that need several modules as they start. The
+ * modules are loaded concurrently, on up to as many threads as there are
+ * CPUs and at most 4, or on as many as the ro.hw.preload_threads property
+ * sets; 1 loads them one after the other.
+ *
+ * @return: 0 == success, <0 == the error of the first module in 'ids' that
+ * could not be loaded; the other modules are loaded regardless
+ */
+int hw_preload_modules(const char *const *ids, size_t n);
+
 __END_DECLS
 
 #endif  /* ANDROID_INCLUDE_HARDWARE_HARDWARE_H */
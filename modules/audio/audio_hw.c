@@ -18,15 +18,20 @@
 //#define LOG_NDEBUG 0
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <malloc.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <unistd.h>
 
 #include <log/log.h>
+#include <cutils/str_parms.h>
 
 #include <hardware/audio.h>
 #include <hardware/hardware.h>
@@ -41,28 +46,339 @@
 #define STUB_OUTPUT_BUFFER_MILLISECONDS  10
 #define STUB_OUTPUT_DEFAULT_CHANNEL_MASK AUDIO_CHANNEL_OUT_STEREO
 
+#define STUB_DEFAULT_PERIOD_COUNT  2
+/* Bounds of the period parameters, which keep buffer sizes and latencies from overflowing. */
+#define STUB_MAX_PERIOD_SIZE       65536
+#define STUB_MAX_PERIOD_COUNT      32
+
+/*
+ * The stub behaves as a virtual sound card: each stream has a buffer of
+ * period_count periods that the card consumes (output) or fills (input) one
+ * period at a time, on a period clock derived from CLOCK_MONOTONIC.  Streams
+ * block on a timerfd armed with the absolute time of the period they wait
+ * for, so pacing does not drift with scheduling jitter and positions are
+ * exact.
+ *
+ * Device parameters, applied to the streams opened afterwards:
+ *   stub_period_size=<frames>   period size up to 65536, 0 for the default
+ *                               duration
+ *   stub_period_count=<count>   number of periods in the buffer, 1 to 32
+ *   stub_wav_sink=<path>        WAV file recording the audio played
+ *   stub_wav_source=<path>      WAV file played in a loop as captured audio
+ * An empty path disables the WAV sink or source.
+ */
+#define STUB_PARAMETER_PERIOD_SIZE   "stub_period_size"
+#define STUB_PARAMETER_PERIOD_COUNT  "stub_period_count"
+#define STUB_PARAMETER_WAV_SINK      "stub_wav_sink"
+#define STUB_PARAMETER_WAV_SOURCE    "stub_wav_source"
+
+#define NANOS_PER_SECOND 1000000000LL
+
 struct stub_audio_device {
     struct audio_hw_device device;
+    pthread_mutex_t lock;
+    size_t period_size;
+    size_t period_count;
+    char wav_sink[PATH_MAX];
+    char wav_source[PATH_MAX];
+};
+
+/* WAV file used as an audio sink or source, fd < 0 when unused. */
+struct stub_wav_file {
+    int fd;
+    size_t frame_size;
+    off_t data_offset;
+    /* bytes of audio data in the file, and position in it for a source */
+    uint64_t data_bytes;
+    uint64_t position;
 };
 
 struct stub_stream_out {
     struct audio_stream_out stream;
-    int64_t last_write_time_us;
+    pthread_mutex_t lock;
     uint32_t sample_rate;
     audio_channel_mask_t channel_mask;
     audio_format_t format;
     size_t frame_count;
+    size_t period_count;
+    int timer_fd;
+    bool standby;
+    /* origin of the period clock, set when the card starts after standby or an underrun */
+    int64_t start_ns;
+    /* frames written since start_ns, and frames presented before it */
+    uint64_t frames_written;
+    uint64_t frames_presented_base;
+    /* time of frames_presented_base, when the card stopped */
+    int64_t stop_ns;
+    uint32_t underruns;
+    struct stub_wav_file wav;
 };
 
 struct stub_stream_in {
     struct audio_stream_in stream;
-    int64_t last_read_time_us;
+    pthread_mutex_t lock;
     uint32_t sample_rate;
     audio_channel_mask_t channel_mask;
     audio_format_t format;
     size_t frame_count;
+    size_t period_count;
+    int timer_fd;
+    bool standby;
+    /* origin of the period clock, set when the card starts after standby */
+    int64_t start_ns;
+    /* frames read since start_ns, and frames captured before it */
+    uint64_t frames_read;
+    uint64_t frames_captured_base;
+    int64_t stop_ns;
+    /* frames overwritten before being read, since the last get_input_frames_lost() */
+    uint32_t frames_lost;
+    struct stub_wav_file wav;
 };
 
+static int64_t stub_now_ns(void)
+{
+    struct timespec t = { .tv_sec = 0, .tv_nsec = 0 };
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * NANOS_PER_SECOND + t.tv_nsec;
+}
+
+/* Conversions between frame counts and durations that don't overflow for long streams. */
+static int64_t frames_to_ns(uint64_t frames, uint32_t sample_rate)
+{
+    return (frames / sample_rate) * NANOS_PER_SECOND +
+            (frames % sample_rate) * NANOS_PER_SECOND / sample_rate;
+}
+
+static uint64_t ns_to_frames(int64_t ns, uint32_t sample_rate)
+{
+    if (ns <= 0)
+        return 0;
+    return (ns / NANOS_PER_SECOND) * sample_rate +
+            (ns % NANOS_PER_SECOND) * sample_rate / NANOS_PER_SECOND;
+}
+
+/* Number of frames the period clock started at start_ns has gone through at now_ns. */
+static uint64_t periods_elapsed_frames(int64_t start_ns, int64_t now_ns,
+                                       uint32_t sample_rate, size_t period_size)
+{
+    const uint64_t frames = ns_to_frames(now_ns - start_ns, sample_rate);
+    return frames - frames % period_size;
+}
+
+/* Sleep until the absolute CLOCK_MONOTONIC time deadline_ns. */
+static void stub_wait_until(int timer_fd, int64_t deadline_ns)
+{
+    const struct timespec deadline = {
+        .tv_sec = deadline_ns / NANOS_PER_SECOND,
+        .tv_nsec = deadline_ns % NANOS_PER_SECOND,
+    };
+    if (timer_fd >= 0) {
+        const struct itimerspec timer = { .it_interval = { 0, 0 }, .it_value = deadline };
+        if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) == 0) {
+            uint64_t expirations;
+            while (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR)
+                ;
+            return;
+        }
+        ALOGW("stub_wait_until: timerfd_settime failed: %s", strerror(errno));
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+        ;
+}
+
+/** WAV sink and source **/
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, v >> 16);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/* The format tag and bits per sample of a WAV file holding audio of the format. */
+static bool wav_format_from_audio_format(audio_format_t format, uint16_t *tag, uint16_t *bits)
+{
+    switch (format) {
+    case AUDIO_FORMAT_PCM_8_BIT:
+    case AUDIO_FORMAT_PCM_16_BIT:
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+    case AUDIO_FORMAT_PCM_32_BIT:
+        *tag = 1; /* WAVE_FORMAT_PCM */
+        break;
+    case AUDIO_FORMAT_PCM_FLOAT:
+        *tag = 3; /* WAVE_FORMAT_IEEE_FLOAT */
+        break;
+    default:
+        return false;
+    }
+    *bits = audio_bytes_per_sample(format) * 8;
+    return true;
+}
+
+static void wav_write_header(struct stub_wav_file *wav, uint32_t sample_rate,
+                             uint32_t channel_count, uint16_t tag, uint16_t bits)
+{
+    uint8_t header[44];
+    const uint32_t data_bytes = wav->data_bytes > UINT32_MAX - 36 ?
+            UINT32_MAX - 36 : (uint32_t)wav->data_bytes;
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, 36 + data_bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16);
+    put_le16(header + 20, tag);
+    put_le16(header + 22, channel_count);
+    put_le32(header + 24, sample_rate);
+    put_le32(header + 28, sample_rate * wav->frame_size);
+    put_le16(header + 32, wav->frame_size);
+    put_le16(header + 34, bits);
+    memcpy(header + 36, "data", 4);
+    put_le32(header + 40, data_bytes);
+    if (pwrite(wav->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header))
+        ALOGE("wav_write_header: %s", strerror(errno));
+}
+
+static void wav_open_sink(struct stub_wav_file *wav, const char *path, uint32_t sample_rate,
+                          uint32_t channel_count, audio_format_t format)
+{
+    uint16_t tag, bits;
+    wav->fd = -1;
+    if (path[0] == '\0')
+        return;
+    if (!wav_format_from_audio_format(format, &tag, &bits)) {
+        ALOGE("wav_open_sink: format %#x not supported", format);
+        return;
+    }
+    wav->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (wav->fd < 0) {
+        ALOGE("wav_open_sink: cannot open %s: %s", path, strerror(errno));
+        return;
+    }
+    wav->frame_size = channel_count * (bits / 8);
+    wav->data_offset = 44;
+    wav->data_bytes = 0;
+    wav->position = 0;
+    wav_write_header(wav, sample_rate, channel_count, tag, bits);
+}
+
+static void wav_write(struct stub_wav_file *wav, const void *buffer, size_t bytes)
+{
+    if (wav->fd < 0)
+        return;
+    const ssize_t written = pwrite(wav->fd, buffer, bytes, wav->data_offset + wav->data_bytes);
+    if (written > 0)
+        wav->data_bytes += written;
+}
+
+/* Patches the sizes in the header of the sink and closes it. */
+static void wav_close_sink(struct stub_wav_file *wav, uint32_t sample_rate,
+                           uint32_t channel_count, audio_format_t format)
+{
+    uint16_t tag, bits;
+    if (wav->fd < 0)
+        return;
+    if (wav_format_from_audio_format(format, &tag, &bits))
+        wav_write_header(wav, sample_rate, channel_count, tag, bits);
+    close(wav->fd);
+    wav->fd = -1;
+}
+
+/* Opens a source whose audio has the same format as the stream, ignoring its sample rate. */
+static void wav_open_source(struct stub_wav_file *wav, const char *path,
+                            uint32_t channel_count, audio_format_t format)
+{
+    uint16_t tag, bits;
+    uint8_t chunk[16];
+    bool format_found = false;
+    off_t offset = 12;
+
+    wav->fd = -1;
+    if (path[0] == '\0')
+        return;
+    if (!wav_format_from_audio_format(format, &tag, &bits)) {
+        ALOGE("wav_open_source: format %#x not supported", format);
+        return;
+    }
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("wav_open_source: cannot open %s: %s", path, strerror(errno));
+        return;
+    }
+    if (pread(fd, chunk, 12, 0) != 12 ||
+            memcmp(chunk, "RIFF", 4) != 0 || memcmp(chunk + 8, "WAVE", 4) != 0) {
+        ALOGE("wav_open_source: %s is not a WAV file", path);
+        close(fd);
+        return;
+    }
+    /* Walk the chunks up to the audio data, checking its format on the way. */
+    while (pread(fd, chunk, 8, offset) == 8) {
+        const uint32_t size = get_le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (size < 16 || pread(fd, chunk, 16, offset + 8) != 16)
+                break;
+            if (get_le16(chunk) != tag || get_le16(chunk + 2) != channel_count ||
+                    get_le16(chunk + 14) != bits) {
+                ALOGE("wav_open_source: %s has %u channels of %u bit samples with tag %u, "
+                      "expected %u channels of %u bit samples with tag %u", path,
+                      get_le16(chunk + 2), get_le16(chunk + 14), get_le16(chunk),
+                      channel_count, bits, tag);
+                break;
+            }
+            format_found = true;
+        } else if (memcmp(chunk, "data", 4) == 0 && format_found) {
+            wav->fd = fd;
+            wav->frame_size = channel_count * (bits / 8);
+            wav->data_offset = offset + 8;
+            wav->data_bytes = size - size % wav->frame_size;
+            wav->position = 0;
+            if (wav->data_bytes == 0)
+                break;
+            return;
+        }
+        offset += 8 + size + (size & 1);
+    }
+    ALOGE("wav_open_source: no usable audio in %s", path);
+    wav->fd = -1;
+    close(fd);
+}
+
+/* Fills the buffer from the source, looping at its end, or with silence without a source. */
+static void wav_read(struct stub_wav_file *wav, void *buffer, size_t bytes)
+{
+    uint8_t *data = buffer;
+    while (wav->fd >= 0 && bytes > 0) {
+        size_t count = wav->data_bytes - wav->position;
+        if (count > bytes)
+            count = bytes;
+        const ssize_t got = pread(wav->fd, data, count, wav->data_offset + wav->position);
+        if (got <= 0)
+            break;
+        data += got;
+        bytes -= got;
+        wav->position = (wav->position + got) % wav->data_bytes;
+    }
+    memset(data, 0, bytes);
+}
+
+static void wav_skip(struct stub_wav_file *wav, uint64_t bytes)
+{
+    if (wav->fd >= 0)
+        wav->position = (wav->position + bytes) % wav->data_bytes;
+}
+
 static uint32_t out_get_sample_rate(const struct audio_stream *stream)
 {
     const struct stub_stream_out *out = (const struct stub_stream_out *)stream;
@@ -115,16 +431,55 @@ static int out_set_format(struct audio_stream *stream, audio_format_t format)
     return 0;
 }
 
+/*
+ * Frames presented by the card at now_ns, and the time the last of them was presented.
+ * Must be called with out->lock held.
+ */
+static uint64_t out_get_presented_frames_l(const struct stub_stream_out *out, int64_t now_ns,
+                                           int64_t *time_ns)
+{
+    if (out->standby) {
+        *time_ns = out->stop_ns;
+        return out->frames_presented_base;
+    }
+    uint64_t played = periods_elapsed_frames(out->start_ns, now_ns, out->sample_rate,
+                                             out->frame_count);
+    if (played > out->frames_written)
+        played = out->frames_written;
+    *time_ns = out->start_ns + frames_to_ns(played, out->sample_rate);
+    return out->frames_presented_base + played;
+}
+
 static int out_standby(struct audio_stream *stream)
 {
+    struct stub_stream_out *out = (struct stub_stream_out *)stream;
+
     ALOGV("out_standby");
-    // out->last_write_time_us = 0; unnecessary as a stale write time has same effect
+    pthread_mutex_lock(&out->lock);
+    if (!out->standby) {
+        /* The card stops, dropping the audio it has not played yet. */
+        out->frames_presented_base = out_get_presented_frames_l(out, stub_now_ns(),
+                                                                &out->stop_ns);
+        out->frames_written = 0;
+        out->standby = true;
+    }
+    pthread_mutex_unlock(&out->lock);
     return 0;
 }
 
 static int out_dump(const struct audio_stream *stream, int fd)
 {
+    struct stub_stream_out *out = (struct stub_stream_out *)stream;
+    int64_t time_ns;
+
     ALOGV("out_dump");
+    pthread_mutex_lock(&out->lock);
+    dprintf(fd, "  Stub output: %u Hz, period %zu frames x %zu, standby %d\n",
+            out->sample_rate, out->frame_count, out->period_count, out->standby);
+    dprintf(fd, "    presented %llu frames, underruns %u, WAV sink %s\n",
+            (unsigned long long)out_get_presented_frames_l(out, stub_now_ns(), &time_ns),
+            out->underruns, out->wav.fd >= 0 ? "on" : "off");
+    pthread_mutex_unlock(&out->lock);
     return 0;
 }
 
@@ -142,8 +497,11 @@ static char * out_get_parameters(const struct audio_stream *stream, const char *
 
 static uint32_t out_get_latency(const struct audio_stream_out *stream)
 {
-    ALOGV("out_get_latency");
-    return STUB_OUTPUT_BUFFER_MILLISECONDS;
+    const struct stub_stream_out *out = (const struct stub_stream_out *)stream;
+    const uint32_t latency_ms = out->frame_count * out->period_count * 1000 / out->sample_rate;
+
+    ALOGV("out_get_latency: %u", latency_ms);
+    return latency_ms;
 }
 
 static int out_set_volume(struct audio_stream_out *stream, float left,
@@ -158,39 +516,69 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
 {
     ALOGV("out_write: bytes: %zu", bytes);
 
-    /* XXX: fake timing for audio output */
     struct stub_stream_out *out = (struct stub_stream_out *)stream;
-    struct timespec t = { .tv_sec = 0, .tv_nsec = 0 };
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    const int64_t now = (t.tv_sec * 1000000000LL + t.tv_nsec) / 1000;
-    const int64_t elapsed_time_since_last_write = now - out->last_write_time_us;
-    int64_t sleep_time = bytes * 1000000LL / audio_stream_out_frame_size(stream) /
-               out_get_sample_rate(&stream->common) - elapsed_time_since_last_write;
-    if (sleep_time > 0) {
-        usleep(sleep_time);
-    } else {
-        // we don't sleep when we exit standby (this is typical for a real alsa buffer).
-        sleep_time = 0;
+    const size_t frame_size = audio_stream_out_frame_size(stream);
+    const uint64_t buffer_frames = (uint64_t)out->frame_count * out->period_count;
+    size_t frames = bytes / frame_size;
+
+    pthread_mutex_lock(&out->lock);
+    const int64_t now = stub_now_ns();
+    if (out->standby || periods_elapsed_frames(out->start_ns, now, out->sample_rate,
+                                               out->frame_count) >= out->frames_written) {
+        // The card starts on the first write after standby, and restarts when it has played
+        // everything written, which is an underrun unless it just left standby.
+        if (!out->standby && out->frames_written > 0)
+            out->underruns++;
+        out->frames_presented_base += out->frames_written;
+        out->frames_written = 0;
+        out->start_ns = now;
+        out->standby = false;
     }
-    out->last_write_time_us = now + sleep_time;
-    // last_write_time_us is an approximation of when the (simulated) alsa
-    // buffer is believed completely full. The usleep above waits for more space
-    // in the buffer, but by the end of the sleep the buffer is considered
-    // topped-off.
-    //
-    // On the subsequent out_write(), we measure the elapsed time spent in
-    // the mixer. This is subtracted from the sleep estimate based on frames,
-    // thereby accounting for drain in the alsa buffer during mixing.
-    // This is a crude approximation; we don't handle underruns precisely.
+    while (frames > 0) {
+        const size_t chunk = frames < buffer_frames ? frames : buffer_frames;
+        if (out->frames_written + chunk > buffer_frames) {
+            // Wait for the end of the period which makes room for the chunk in the buffer.
+            uint64_t consumed = out->frames_written + chunk - buffer_frames;
+            consumed += (out->frame_count - consumed % out->frame_count) % out->frame_count;
+            const int64_t deadline = out->start_ns + frames_to_ns(consumed, out->sample_rate);
+            pthread_mutex_unlock(&out->lock);
+            stub_wait_until(out->timer_fd, deadline);
+            pthread_mutex_lock(&out->lock);
+        }
+        out->frames_written += chunk;
+        frames -= chunk;
+    }
+    wav_write(&out->wav, buffer, bytes);
+    pthread_mutex_unlock(&out->lock);
     return bytes;
 }
 
 static int out_get_render_position(const struct audio_stream_out *stream,
                                    uint32_t *dsp_frames)
 {
-    *dsp_frames = 0;
-    ALOGV("out_get_render_position: dsp_frames: %p", dsp_frames);
-    return -EINVAL;
+    struct stub_stream_out *out = (struct stub_stream_out *)stream;
+    int64_t time_ns;
+
+    pthread_mutex_lock(&out->lock);
+    *dsp_frames = (uint32_t)out_get_presented_frames_l(out, stub_now_ns(), &time_ns);
+    pthread_mutex_unlock(&out->lock);
+    ALOGV("out_get_render_position: dsp_frames: %u", *dsp_frames);
+    return 0;
+}
+
+static int out_get_presentation_position(const struct audio_stream_out *stream,
+                                         uint64_t *frames, struct timespec *timestamp)
+{
+    struct stub_stream_out *out = (struct stub_stream_out *)stream;
+    int64_t time_ns;
+
+    pthread_mutex_lock(&out->lock);
+    *frames = out_get_presented_frames_l(out, stub_now_ns(), &time_ns);
+    pthread_mutex_unlock(&out->lock);
+    timestamp->tv_sec = time_ns / NANOS_PER_SECOND;
+    timestamp->tv_nsec = time_ns % NANOS_PER_SECOND;
+    ALOGV("out_get_presentation_position: frames: %llu", (unsigned long long)*frames);
+    return 0;
 }
 
 static int out_add_audio_effect(const struct audio_stream *stream, effect_handle_t effect)
@@ -266,15 +654,48 @@ static int in_set_format(struct audio_stream *stream, audio_format_t format)
     return 0;
 }
 
+/*
+ * Frames captured by the card at now_ns, and the time the last of them was captured.
+ * Must be called with in->lock held.
+ */
+static uint64_t in_get_captured_frames_l(const struct stub_stream_in *in, int64_t now_ns,
+                                         int64_t *time_ns)
+{
+    if (in->standby) {
+        *time_ns = in->stop_ns;
+        return in->frames_captured_base;
+    }
+    const uint64_t captured = periods_elapsed_frames(in->start_ns, now_ns, in->sample_rate,
+                                                     in->frame_count);
+    *time_ns = in->start_ns + frames_to_ns(captured, in->sample_rate);
+    return in->frames_captured_base + captured;
+}
+
 static int in_standby(struct audio_stream *stream)
 {
     struct stub_stream_in *in = (struct stub_stream_in *)stream;
-    in->last_read_time_us = 0;
+
+    pthread_mutex_lock(&in->lock);
+    if (!in->standby) {
+        in->frames_captured_base = in_get_captured_frames_l(in, stub_now_ns(), &in->stop_ns);
+        in->standby = true;
+    }
+    pthread_mutex_unlock(&in->lock);
     return 0;
 }
 
 static int in_dump(const struct audio_stream *stream, int fd)
 {
+    struct stub_stream_in *in = (struct stub_stream_in *)stream;
+    int64_t time_ns;
+
+    pthread_mutex_lock(&in->lock);
+    dprintf(fd, "  Stub input: %u Hz, period %zu frames x %zu, standby %d\n",
+            in->sample_rate, in->frame_count, in->period_count, in->standby);
+    dprintf(fd, "    captured %llu frames, lost %u, WAV source %s\n",
+            (unsigned long long)in_get_captured_frames_l(in, stub_now_ns(), &time_ns),
+            in->frames_lost, in->wav.fd >= 0 ? "on" : "off");
+    pthread_mutex_unlock(&in->lock);
     return 0;
 }
 
@@ -299,36 +720,65 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
 {
     ALOGV("in_read: bytes %zu", bytes);
 
-    /* XXX: fake timing for audio input */
     struct stub_stream_in *in = (struct stub_stream_in *)stream;
-    struct timespec t = { .tv_sec = 0, .tv_nsec = 0 };
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    const int64_t now = (t.tv_sec * 1000000000LL + t.tv_nsec) / 1000;
-
-    // we do a full sleep when exiting standby.
-    const bool standby = in->last_read_time_us == 0;
-    const int64_t elapsed_time_since_last_read = standby ?
-            0 : now - in->last_read_time_us;
-    int64_t sleep_time = bytes * 1000000LL / audio_stream_in_frame_size(stream) /
-            in_get_sample_rate(&stream->common) - elapsed_time_since_last_read;
-    if (sleep_time > 0) {
-        usleep(sleep_time);
-    } else {
-        sleep_time = 0;
+    const size_t frame_size = audio_stream_in_frame_size(stream);
+    const uint64_t buffer_frames = (uint64_t)in->frame_count * in->period_count;
+    const size_t frames = bytes / frame_size;
+
+    pthread_mutex_lock(&in->lock);
+    if (in->standby) {
+        // The card starts capturing on the first read after standby, so that read waits for
+        // the periods it needs to be filled.
+        in->start_ns = stub_now_ns();
+        in->frames_read = 0;
+        in->standby = false;
     }
-    in->last_read_time_us = now + sleep_time;
-    // last_read_time_us is an approximation of when the (simulated) alsa
-    // buffer is drained by the read, and is empty.
-    //
-    // On the subsequent in_read(), we measure the elapsed time spent in
-    // the recording thread. This is subtracted from the sleep estimate based on frames,
-    // thereby accounting for fill in the alsa buffer during the interim.
-    memset(buffer, 0, bytes);
+    // Wait for the end of the period holding the last frame to read.
+    uint64_t captured = in->frames_read + frames;
+    captured += (in->frame_count - captured % in->frame_count) % in->frame_count;
+    const int64_t deadline = in->start_ns + frames_to_ns(captured, in->sample_rate);
+    pthread_mutex_unlock(&in->lock);
+    stub_wait_until(in->timer_fd, deadline);
+    pthread_mutex_lock(&in->lock);
+
+    // If the reader fell more than the buffer behind, the oldest frames were overwritten.
+    const uint64_t window = frames > buffer_frames ? frames : buffer_frames;
+    captured = periods_elapsed_frames(in->start_ns, stub_now_ns(), in->sample_rate,
+                                      in->frame_count);
+    if (captured > in->frames_read + window) {
+        const uint64_t lost = captured - window - in->frames_read;
+        in->frames_lost += lost;
+        in->frames_read += lost;
+        wav_skip(&in->wav, lost * frame_size);
+    }
+    wav_read(&in->wav, buffer, bytes);
+    in->frames_read += frames;
+    pthread_mutex_unlock(&in->lock);
     return bytes;
 }
 
 static uint32_t in_get_input_frames_lost(struct audio_stream_in *stream)
 {
+    struct stub_stream_in *in = (struct stub_stream_in *)stream;
+
+    pthread_mutex_lock(&in->lock);
+    const uint32_t frames_lost = in->frames_lost;
+    in->frames_lost = 0;
+    pthread_mutex_unlock(&in->lock);
+    return frames_lost;
+}
+
+static int in_get_capture_position(const struct audio_stream_in *stream,
+                                   int64_t *frames, int64_t *time)
+{
+    struct stub_stream_in *in = (struct stub_stream_in *)stream;
+
+    if (frames == NULL || time == NULL)
+        return -EINVAL;
+    pthread_mutex_lock(&in->lock);
+    *frames = in_get_captured_frames_l(in, stub_now_ns(), time);
+    pthread_mutex_unlock(&in->lock);
+    ALOGV("in_get_capture_position: frames: %lld", (long long)*frames);
     return 0;
 }
 
@@ -359,6 +809,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
 {
     ALOGV("adev_open_output_stream...");
 
+    struct stub_audio_device *adev = (struct stub_audio_device *)dev;
     *stream_out = NULL;
     struct stub_stream_out *out =
             (struct stub_stream_out *)calloc(1, sizeof(struct stub_stream_out));
@@ -382,6 +833,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     out->stream.write = out_write;
     out->stream.get_render_position = out_get_render_position;
     out->stream.get_next_write_timestamp = out_get_next_write_timestamp;
+    out->stream.get_presentation_position = out_get_presentation_position;
     out->sample_rate = config->sample_rate;
     if (out->sample_rate == 0)
         out->sample_rate = STUB_DEFAULT_SAMPLE_RATE;
@@ -391,13 +843,27 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     out->format = config->format;
     if (out->format == AUDIO_FORMAT_DEFAULT)
         out->format = STUB_DEFAULT_AUDIO_FORMAT;
-    out->frame_count = samples_per_milliseconds(
-                           STUB_OUTPUT_BUFFER_MILLISECONDS,
-                           out->sample_rate, 1);
+
+    pthread_mutex_lock(&adev->lock);
+    out->frame_count = adev->period_size;
+    if (out->frame_count == 0)
+        out->frame_count = samples_per_milliseconds(
+                               STUB_OUTPUT_BUFFER_MILLISECONDS,
+                               out->sample_rate, 1);
+    out->period_count = adev->period_count;
+    wav_open_sink(&out->wav, adev->wav_sink, out->sample_rate,
+                  audio_channel_count_from_out_mask(out->channel_mask), out->format);
+    pthread_mutex_unlock(&adev->lock);
+
+    pthread_mutex_init(&out->lock, NULL);
+    out->standby = true;
+    out->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    ALOGW_IF(out->timer_fd < 0, "adev_open_output_stream: timerfd_create failed: %s",
+             strerror(errno));
 
     ALOGV("adev_open_output_stream: sample_rate: %u, channels: %x, format: %d,"
-          " frames: %zu", out->sample_rate, out->channel_mask, out->format,
-          out->frame_count);
+          " frames: %zu x %zu", out->sample_rate, out->channel_mask, out->format,
+          out->frame_count, out->period_count);
     *stream_out = &out->stream;
     return 0;
 }
@@ -405,14 +871,69 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
 static void adev_close_output_stream(struct audio_hw_device *dev,
                                      struct audio_stream_out *stream)
 {
+    struct stub_stream_out *out = (struct stub_stream_out *)stream;
+
     ALOGV("adev_close_output_stream...");
+    wav_close_sink(&out->wav, out->sample_rate,
+                   audio_channel_count_from_out_mask(out->channel_mask), out->format);
+    if (out->timer_fd >= 0)
+        close(out->timer_fd);
+    pthread_mutex_destroy(&out->lock);
     free(stream);
 }
 
+/* Parses a parameter that must be a decimal number in [min, max]. */
+static bool parse_size_parameter(const char *value, long min, long max, size_t *result)
+{
+    char *end;
+
+    errno = 0;
+    const long number = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || number < min || number > max)
+        return false;
+    *result = number;
+    return true;
+}
+
+/* Keeps the first error of the parameters set, -ENOSYS until a parameter is known. */
+static void set_parameter_status(int *ret, int status)
+{
+    if (*ret == 0 || *ret == -ENOSYS)
+        *ret = status;
+}
+
 static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
 {
-    ALOGV("adev_set_parameters");
-    return -ENOSYS;
+    struct stub_audio_device *adev = (struct stub_audio_device *)dev;
+    struct str_parms *parms = str_parms_create_str(kvpairs);
+    char value[PATH_MAX];
+    int ret = -ENOSYS;
+
+    ALOGV("adev_set_parameters: %s", kvpairs);
+    if (parms == NULL)
+        return -EINVAL;
+    pthread_mutex_lock(&adev->lock);
+    if (str_parms_get_str(parms, STUB_PARAMETER_PERIOD_SIZE, value, sizeof(value)) >= 0) {
+        const bool valid = parse_size_parameter(value, 0, STUB_MAX_PERIOD_SIZE,
+                                                &adev->period_size);
+        set_parameter_status(&ret, valid ? 0 : -EINVAL);
+    }
+    if (str_parms_get_str(parms, STUB_PARAMETER_PERIOD_COUNT, value, sizeof(value)) >= 0) {
+        const bool valid = parse_size_parameter(value, 1, STUB_MAX_PERIOD_COUNT,
+                                                &adev->period_count);
+        set_parameter_status(&ret, valid ? 0 : -EINVAL);
+    }
+    if (str_parms_get_str(parms, STUB_PARAMETER_WAV_SINK, value, sizeof(value)) >= 0) {
+        strlcpy(adev->wav_sink, value, sizeof(adev->wav_sink));
+        set_parameter_status(&ret, 0);
+    }
+    if (str_parms_get_str(parms, STUB_PARAMETER_WAV_SOURCE, value, sizeof(value)) >= 0) {
+        strlcpy(adev->wav_source, value, sizeof(adev->wav_source));
+        set_parameter_status(&ret, 0);
+    }
+    pthread_mutex_unlock(&adev->lock);
+    str_parms_destroy(parms);
+    return ret;
 }
 
 static char * adev_get_parameters(const struct audio_hw_device *dev,
@@ -479,11 +1000,17 @@ static int adev_get_mic_mute(const struct audio_hw_device *dev, bool *state)
 static size_t adev_get_input_buffer_size(const struct audio_hw_device *dev,
                                          const struct audio_config *config)
 {
-    size_t buffer_size = samples_per_milliseconds(
-                             STUB_INPUT_BUFFER_MILLISECONDS,
-                             config->sample_rate,
-                             audio_channel_count_from_in_mask(
-                                 config->channel_mask));
+    struct stub_audio_device *adev = (struct stub_audio_device *)dev;
+    const size_t channel_count = audio_channel_count_from_in_mask(config->channel_mask);
+
+    pthread_mutex_lock(&adev->lock);
+    size_t buffer_size = adev->period_size * channel_count;
+    pthread_mutex_unlock(&adev->lock);
+    if (buffer_size == 0)
+        buffer_size = samples_per_milliseconds(
+                          STUB_INPUT_BUFFER_MILLISECONDS,
+                          config->sample_rate,
+                          channel_count);
 
     if (!audio_has_proportional_frames(config->format)) {
         // Since the audio data is not proportional choose an arbitrary size for
@@ -507,6 +1034,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
 {
     ALOGV("adev_open_input_stream...");
 
+    struct stub_audio_device *adev = (struct stub_audio_device *)dev;
     *stream_in = NULL;
     struct stub_stream_in *in = (struct stub_stream_in *)calloc(1, sizeof(struct stub_stream_in));
     if (!in)
@@ -527,6 +1055,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     in->stream.set_gain = in_set_gain;
     in->stream.read = in_read;
     in->stream.get_input_frames_lost = in_get_input_frames_lost;
+    in->stream.get_capture_position = in_get_capture_position;
     in->sample_rate = config->sample_rate;
     if (in->sample_rate == 0)
         in->sample_rate = STUB_DEFAULT_SAMPLE_RATE;
@@ -536,21 +1065,42 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     in->format = config->format;
     if (in->format == AUDIO_FORMAT_DEFAULT)
         in->format = STUB_DEFAULT_AUDIO_FORMAT;
-    in->frame_count = samples_per_milliseconds(
-                          STUB_INPUT_BUFFER_MILLISECONDS, in->sample_rate, 1);
+
+    pthread_mutex_lock(&adev->lock);
+    in->frame_count = adev->period_size;
+    if (in->frame_count == 0)
+        in->frame_count = samples_per_milliseconds(
+                              STUB_INPUT_BUFFER_MILLISECONDS, in->sample_rate, 1);
+    in->period_count = adev->period_count;
+    wav_open_source(&in->wav, adev->wav_source,
+                    audio_channel_count_from_in_mask(in->channel_mask), in->format);
+    pthread_mutex_unlock(&adev->lock);
+
+    pthread_mutex_init(&in->lock, NULL);
+    in->standby = true;
+    in->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    ALOGW_IF(in->timer_fd < 0, "adev_open_input_stream: timerfd_create failed: %s",
+             strerror(errno));
 
     ALOGV("adev_open_input_stream: sample_rate: %u, channels: %x, format: %d,"
-          "frames: %zu", in->sample_rate, in->channel_mask, in->format,
-          in->frame_count);
+          "frames: %zu x %zu", in->sample_rate, in->channel_mask, in->format,
+          in->frame_count, in->period_count);
     *stream_in = &in->stream;
     return 0;
 }
 
 static void adev_close_input_stream(struct audio_hw_device *dev,
-                                   struct audio_stream_in *in)
+                                   struct audio_stream_in *stream)
 {
+    struct stub_stream_in *in = (struct stub_stream_in *)stream;
+
     ALOGV("adev_close_input_stream...");
-    return;
+    if (in->wav.fd >= 0)
+        close(in->wav.fd);
+    if (in->timer_fd >= 0)
+        close(in->timer_fd);
+    pthread_mutex_destroy(&in->lock);
+    free(stream);
 }
 
 static int adev_dump(const audio_hw_device_t *device, int fd)
@@ -561,7 +1111,10 @@ static int adev_dump(const audio_hw_device_t *device, int fd)
 
 static int adev_close(hw_device_t *device)
 {
+    struct stub_audio_device *adev = (struct stub_audio_device *)device;
+
     ALOGV("adev_close");
+    pthread_mutex_destroy(&adev->lock);
     free(device);
     return 0;
 }
@@ -603,6 +1156,9 @@ static int adev_open(const hw_module_t* module, const char* name,
     adev->device.close_input_stream = adev_close_input_stream;
     adev->device.dump = adev_dump;
 
+    pthread_mutex_init(&adev->lock, NULL);
+    adev->period_count = STUB_DEFAULT_PERIOD_COUNT;
+
     *device = &adev->device.common;
 
     return 0;
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// To run this test (as root):
+// 1) Build it
+// 2) adb push to /vendor/bin
+// 3) adb shell /vendor/bin/audio_stub_tests
+
+#define LOG_TAG "AudioStubTest"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <log/log.h>
+
+class AudioStubTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        const hw_module_t* mod;
+        mDev = nullptr;
+        ASSERT_EQ(0, hw_get_module_by_class(AUDIO_HARDWARE_MODULE_ID, "stub", &mod));
+        ASSERT_EQ(0, audio_hw_device_open(mod, &mDev));
+        mWavPath = "/data/local/tmp/audio_stub_test_" + std::to_string(getpid()) + ".wav";
+    }
+
+    void TearDown() override {
+        unlink(mWavPath.c_str());
+        if (mDev != nullptr) {
+            ASSERT_EQ(0, audio_hw_device_close(mDev));
+        }
+    }
+
+    void OpenOutputStream(audio_stream_out_t** streamOut) {
+        struct audio_config config = {};
+        config.sample_rate = 48000;
+        config.channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+        config.format = AUDIO_FORMAT_PCM_16_BIT;
+        ASSERT_EQ(0, mDev->open_output_stream(mDev, AUDIO_IO_HANDLE_NONE, AUDIO_DEVICE_NONE,
+                AUDIO_OUTPUT_FLAG_NONE, &config, streamOut, ""));
+    }
+
+    void OpenInputStream(audio_stream_in_t** streamIn) {
+        struct audio_config config = {};
+        config.sample_rate = 48000;
+        config.channel_mask = AUDIO_CHANNEL_IN_STEREO;
+        config.format = AUDIO_FORMAT_PCM_16_BIT;
+        ASSERT_EQ(0, mDev->open_input_stream(mDev, AUDIO_IO_HANDLE_NONE, AUDIO_DEVICE_NONE,
+                &config, streamIn, AUDIO_INPUT_FLAG_NONE, "", AUDIO_SOURCE_DEFAULT));
+    }
+
+    static int64_t NowNs() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+
+    audio_hw_device_t* mDev;
+    std::string mWavPath;
+};
+
+// Periods of 10ms at 48kHz, two of them in the buffer of a stream.
+static const size_t kPeriodFrames = 480;
+static const size_t kPeriodCount = 2;
+static const int64_t kPeriodNs = 10000000;
+// Allowance for scheduling delays, pacing is never early.
+static const int64_t kLateNs = 50000000;
+
+TEST_F(AudioStubTest, PeriodParameters) {
+    ASSERT_EQ(0, mDev->set_parameters(mDev, "stub_period_size=240;stub_period_count=4"));
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(&streamOut);
+    // 16-bit stereo
+    EXPECT_EQ(240U * 4, streamOut->common.get_buffer_size(&streamOut->common));
+    EXPECT_EQ(240U * 4 * 1000 / 48000, streamOut->get_latency(streamOut));
+    mDev->close_output_stream(mDev, streamOut);
+}
+
+TEST_F(AudioStubTest, InvalidParameters) {
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_size=-1"));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_count=0"));
+    EXPECT_EQ(-ENOSYS, mDev->set_parameters(mDev, "stub_unknown=1"));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_size=abc"));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_size=240abc"));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_size="));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_size=65537"));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_size=99999999999999999999"));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_count=33"));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev, "stub_period_count=4294967297"));
+    // None of them was applied.
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(&streamOut);
+    EXPECT_EQ(480U * 4, streamOut->common.get_buffer_size(&streamOut->common));
+    EXPECT_EQ(20U, streamOut->get_latency(streamOut));
+    mDev->close_output_stream(mDev, streamOut);
+}
+
+// An invalid parameter fails the call even when valid parameters come with it, which are still
+// applied.
+TEST_F(AudioStubTest, FirstErrorIsReturned) {
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev,
+            "stub_period_size=-1;stub_period_count=4;stub_wav_sink="));
+    EXPECT_EQ(-EINVAL, mDev->set_parameters(mDev,
+            "stub_period_size=240;stub_period_count=0;stub_wav_source="));
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(&streamOut);
+    EXPECT_EQ(240U * 4, streamOut->common.get_buffer_size(&streamOut->common));
+    mDev->close_output_stream(mDev, streamOut);
+}
+
+// The audio played into the WAV sink is captured back from it as the WAV source.
+TEST_F(AudioStubTest, WavSinkAndSource) {
+    const std::string sink = "stub_period_size=480;stub_wav_sink=" + mWavPath;
+    ASSERT_EQ(0, mDev->set_parameters(mDev, sink.c_str()));
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(&streamOut);
+    const size_t bufferSize = streamOut->common.get_buffer_size(&streamOut->common);
+    std::vector<char> played(bufferSize * 4);
+    for (size_t i = 0; i < played.size(); ++i) {
+        played[i] = static_cast<char>(i * 7);
+    }
+    for (size_t offset = 0; offset < played.size(); offset += bufferSize) {
+        ASSERT_EQ(static_cast<ssize_t>(bufferSize),
+                streamOut->write(streamOut, played.data() + offset, bufferSize));
+    }
+    mDev->close_output_stream(mDev, streamOut);
+
+    int fd = open(mWavPath.c_str(), O_RDONLY | O_CLOEXEC);
+    ASSERT_GE(fd, 0);
+    char header[44];
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(header)), read(fd, header, sizeof(header)));
+    close(fd);
+    EXPECT_EQ(0, memcmp(header, "RIFF", 4));
+    EXPECT_EQ(0, memcmp(header + 36, "data", 4));
+    uint32_t dataBytes;
+    memcpy(&dataBytes, header + 40, sizeof(dataBytes));
+    EXPECT_EQ(played.size(), dataBytes);
+
+    const std::string source = "stub_wav_sink=;stub_wav_source=" + mWavPath;
+    ASSERT_EQ(0, mDev->set_parameters(mDev, source.c_str()));
+    audio_stream_in_t* streamIn;
+    OpenInputStream(&streamIn);
+    std::vector<char> captured(bufferSize);
+    ASSERT_EQ(static_cast<ssize_t>(bufferSize),
+            streamIn->read(streamIn, captured.data(), bufferSize));
+    EXPECT_EQ(0, memcmp(played.data(), captured.data(), bufferSize));
+    mDev->close_input_stream(mDev, streamIn);
+}
+
+// Writes block once the buffer is full and return as the card plays it one period at a time,
+// and the presentation position counts the frames played.
+TEST_F(AudioStubTest, OutputPacingAndPresentationPosition) {
+    ASSERT_EQ(0, mDev->set_parameters(mDev, "stub_period_size=480;stub_period_count=2"));
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(&streamOut);
+    const size_t bufferSize = streamOut->common.get_buffer_size(&streamOut->common);
+    ASSERT_EQ(kPeriodFrames * 4, bufferSize);
+    std::vector<char> buffer(bufferSize);
+    const size_t periods = 10;
+    const int64_t start = NowNs();
+    for (size_t i = 0; i < periods; ++i) {
+        ASSERT_EQ(static_cast<ssize_t>(bufferSize),
+                streamOut->write(streamOut, buffer.data(), bufferSize));
+    }
+    // The last write returns when the card has made room for it, with a full buffer left.
+    const int64_t elapsed = NowNs() - start;
+    EXPECT_GE(elapsed, static_cast<int64_t>(periods - kPeriodCount) * kPeriodNs);
+    EXPECT_LT(elapsed, static_cast<int64_t>(periods - kPeriodCount) * kPeriodNs + kLateNs);
+
+    uint64_t frames;
+    struct timespec timestamp;
+    ASSERT_EQ(0, streamOut->get_presentation_position(streamOut, &frames, &timestamp));
+    EXPECT_GE(frames, (periods - kPeriodCount) * kPeriodFrames);
+    EXPECT_LE(frames, periods * kPeriodFrames);
+
+    // Once the buffer is played, the position stops at the frames written, presented when the
+    // clock of the card says so.
+    std::this_thread::sleep_for(std::chrono::milliseconds(kPeriodCount * 10 + 10));
+    ASSERT_EQ(0, streamOut->get_presentation_position(streamOut, &frames, &timestamp));
+    EXPECT_EQ(periods * kPeriodFrames, frames);
+    const int64_t presentedNs = timestamp.tv_sec * 1000000000LL + timestamp.tv_nsec - start;
+    EXPECT_GE(presentedNs, static_cast<int64_t>(periods) * kPeriodNs);
+    EXPECT_LT(presentedNs, static_cast<int64_t>(periods) * kPeriodNs + kLateNs);
+    mDev->close_output_stream(mDev, streamOut);
+}
+
+// Reads return as the card fills each period, and the capture position counts the frames
+// captured.  The buffer holds 4 periods so that a late read loses nothing.
+TEST_F(AudioStubTest, InputPacingAndCapturePosition) {
+    ASSERT_EQ(0, mDev->set_parameters(mDev, "stub_period_size=480;stub_period_count=4"));
+    audio_stream_in_t* streamIn;
+    OpenInputStream(&streamIn);
+    const size_t bufferSize = streamIn->common.get_buffer_size(&streamIn->common);
+    ASSERT_EQ(kPeriodFrames * 4, bufferSize);
+    std::vector<char> buffer(bufferSize);
+    const size_t periods = 10;
+    const int64_t start = NowNs();
+    for (size_t i = 0; i < periods; ++i) {
+        ASSERT_EQ(static_cast<ssize_t>(bufferSize),
+                streamIn->read(streamIn, buffer.data(), bufferSize));
+    }
+    const int64_t elapsed = NowNs() - start;
+    EXPECT_GE(elapsed, static_cast<int64_t>(periods) * kPeriodNs);
+    EXPECT_LT(elapsed, static_cast<int64_t>(periods) * kPeriodNs + kLateNs);
+
+    int64_t frames, time;
+    ASSERT_EQ(0, streamIn->get_capture_position(streamIn, &frames, &time));
+    EXPECT_GE(frames, static_cast<int64_t>(periods * kPeriodFrames));
+    EXPECT_LT(frames, static_cast<int64_t>(periods * kPeriodFrames) + kLateNs * 48 / 1000000);
+    // The time is the time of the last frame captured, on the clock of the card.
+    EXPECT_GE(time - start, static_cast<int64_t>(frames / kPeriodFrames) * kPeriodNs);
+    EXPECT_LT(time - start, static_cast<int64_t>(frames / kPeriodFrames) * kPeriodNs + kLateNs);
+    EXPECT_EQ(0U, streamIn->get_input_frames_lost(streamIn));
+    mDev->close_input_stream(mDev, streamIn);
+}
+
+// Frames overwritten while the reader is late are reported lost, once.
+TEST_F(AudioStubTest, InputFramesLost) {
+    ASSERT_EQ(0, mDev->set_parameters(mDev, "stub_period_size=480;stub_period_count=2"));
+    audio_stream_in_t* streamIn;
+    OpenInputStream(&streamIn);
+    const size_t bufferSize = streamIn->common.get_buffer_size(&streamIn->common);
+    std::vector<char> buffer(bufferSize);
+    ASSERT_EQ(static_cast<ssize_t>(bufferSize),
+            streamIn->read(streamIn, buffer.data(), bufferSize));
+    // Late by 6 periods: the buffer keeps 2 of them, and the read waits for the one it needs.
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    ASSERT_EQ(static_cast<ssize_t>(bufferSize),
+            streamIn->read(streamIn, buffer.data(), bufferSize));
+    const uint32_t lost = streamIn->get_input_frames_lost(streamIn);
+    EXPECT_GE(lost, 4 * kPeriodFrames);
+    EXPECT_LE(lost, 9 * kPeriodFrames);
+    EXPECT_EQ(0U, lost % kPeriodFrames);
+    EXPECT_EQ(0U, streamIn->get_input_frames_lost(streamIn));
+
+    int64_t frames, time;
+    ASSERT_EQ(0, streamIn->get_capture_position(streamIn, &frames, &time));
+    EXPECT_GE(frames, static_cast<int64_t>(2 * kPeriodFrames + lost));
+    mDev->close_input_stream(mDev, streamIn);
+}
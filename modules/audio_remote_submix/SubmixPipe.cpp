@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "r_submix"
+//#define LOG_NDEBUG 0
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "SubmixPipe.h"
+
+namespace android {
+
+// Shortest and longest time the writer sleeps while waiting for the readers to make room.
+static const uint64_t kMinWriteSleepUs = 1000;
+static const uint64_t kMaxWriteSleepUs = 20000;
+
+static int64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static size_t roundup_pow2(size_t v)
+{
+    size_t result = 1;
+    while (result < v) {
+        result <<= 1;
+    }
+    return result;
+}
+
+SubmixPipe::SubmixPipe(size_t maxFrames, size_t frameSize, uint32_t sampleRate,
+                       bool writeCanBlock)
+    : mMaxFrames(roundup_pow2(maxFrames)),
+      mFrameSize(frameSize),
+      mSampleRate(sampleRate),
+      mWriteCanBlock(writeCanBlock),
+      mBuffer(static_cast<uint8_t *>(calloc(mMaxFrames, frameSize))),
+      mTargetFrames(mMaxFrames),
+      mRear(0),
+      mWriteEnd(0),
+      mIsShutdown(false),
+      mClockStartNs(0),
+      mClockFrames(0)
+{
+    LOG_ALWAYS_FATAL_IF(mBuffer == NULL, "SubmixPipe: failed to allocate %zu frames", mMaxFrames);
+    for (size_t i = 0; i < kMaxReaders; i++) {
+        mReaders[i].inUse.store(false, std::memory_order_relaxed);
+        mReaders[i].blocking.store(false, std::memory_order_relaxed);
+        mReaders[i].front.store(0, std::memory_order_relaxed);
+    }
+}
+
+SubmixPipe::~SubmixPipe()
+{
+    free(mBuffer);
+}
+
+size_t SubmixPipe::setTargetFrames(size_t frames)
+{
+    frames = frames < 1 ? 1 : (frames > mMaxFrames ? mMaxFrames : frames);
+    mTargetFrames.store(frames, std::memory_order_relaxed);
+    return frames;
+}
+
+void SubmixPipe::copyToRing(uint64_t position, const void *buffer, size_t count)
+{
+    const size_t index = position & (mMaxFrames - 1);
+    const size_t part1 = count < mMaxFrames - index ? count : mMaxFrames - index;
+    memcpy(mBuffer + index * mFrameSize, buffer, part1 * mFrameSize);
+    if (part1 < count) {
+        memcpy(mBuffer, static_cast<const uint8_t *>(buffer) + part1 * mFrameSize,
+               (count - part1) * mFrameSize);
+    }
+}
+
+void SubmixPipe::copyFromRing(uint64_t position, void *buffer, size_t count) const
+{
+    const size_t index = position & (mMaxFrames - 1);
+    const size_t part1 = count < mMaxFrames - index ? count : mMaxFrames - index;
+    memcpy(buffer, mBuffer + index * mFrameSize, part1 * mFrameSize);
+    if (part1 < count) {
+        memcpy(static_cast<uint8_t *>(buffer) + part1 * mFrameSize, mBuffer,
+               (count - part1) * mFrameSize);
+    }
+}
+
+ssize_t SubmixPipe::availableToWrite() const
+{
+    const uint64_t rear = mRear.load(std::memory_order_relaxed);
+    // Only the blocking readers hold the writer back.
+    uint64_t filled = 0;
+    for (size_t i = 0; i < kMaxReaders; i++) {
+        const ReaderSlot& reader = mReaders[i];
+        if (reader.inUse.load(std::memory_order_acquire) &&
+                reader.blocking.load(std::memory_order_relaxed)) {
+            const uint64_t front = reader.front.load(std::memory_order_acquire);
+            if (rear - front > filled) {
+                filled = rear - front;
+            }
+        }
+    }
+    const size_t target = targetFrames();
+    return filled < target ? target - filled : 0;
+}
+
+ssize_t SubmixPipe::write(const void *buffer, size_t count)
+{
+    const uint8_t *data = static_cast<const uint8_t *>(buffer);
+    size_t written = 0;
+    while (written < count) {
+        const size_t avail = availableToWrite();
+        const size_t frames = avail < count - written ? avail : count - written;
+        if (frames > 0) {
+            const uint64_t rear = mRear.load(std::memory_order_relaxed);
+            // Tell the readers which frames are about to be overwritten before touching them.
+            mWriteEnd.store(rear + frames, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            copyToRing(rear, data + written * mFrameSize, frames);
+            mRear.store(rear + frames, std::memory_order_release);
+            written += frames;
+            continue;
+        }
+        if (!mWriteCanBlock || isShutdown()) {
+            break;
+        }
+        // Sleep for roughly the time it takes the readers to consume what is still missing.
+        uint64_t sleepUs = (uint64_t)(count - written) * 1000000 / mSampleRate;
+        sleepUs = sleepUs < kMinWriteSleepUs ? kMinWriteSleepUs :
+                (sleepUs > kMaxWriteSleepUs ? kMaxWriteSleepUs : sleepUs);
+        usleep(sleepUs);
+    }
+    if (mWriteCanBlock && written > 0 && !isShutdown()) {
+        throttle(written);
+    }
+    return written;
+}
+
+void SubmixPipe::throttle(size_t frames)
+{
+    const int64_t now = monotonic_ns();
+    const uint64_t target = targetFrames();
+    const uint64_t elapsedFrames = (uint64_t)((now - mClockStartNs) / 1000) * mSampleRate / 1000000;
+    if (mClockFrames == 0 || elapsedFrames > mClockFrames + target) {
+        // First write, or the writer fell behind real time by more than the pipe holds, e.g.
+        // after a pause: restart the clock rather than let the writer catch up in a burst.
+        mClockStartNs = now;
+        mClockFrames = 0;
+    }
+    mClockFrames += frames;
+    if (mClockFrames <= target) {
+        return;
+    }
+    const int64_t deadline = mClockStartNs +
+            (int64_t)((mClockFrames - target) * 1000000 / mSampleRate) * 1000;
+    if (deadline > now) {
+        struct timespec ts;
+        ts.tv_sec = deadline / 1000000000;
+        ts.tv_nsec = deadline % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+}
+
+ssize_t SubmixPipe::availableToRead() const
+{
+    const uint64_t rear = mRear.load(std::memory_order_acquire);
+    const size_t target = targetFrames();
+    bool hasReader = false;
+    uint64_t filled = 0;
+    for (size_t i = 0; i < kMaxReaders; i++) {
+        const ReaderSlot& reader = mReaders[i];
+        if (reader.inUse.load(std::memory_order_acquire)) {
+            const uint64_t front = reader.front.load(std::memory_order_relaxed);
+            if (rear - front > filled) {
+                filled = rear - front;
+            }
+            hasReader = true;
+        }
+    }
+    if (!hasReader) {
+        filled = rear;
+    }
+    return filled < target ? filled : target;
+}
+
+int SubmixPipe::addReader(bool blocking)
+{
+    const uint64_t rear = mRear.load(std::memory_order_acquire);
+    const uint64_t buffered = availableToRead();
+    const uint64_t front = buffered < rear ? rear - buffered : 0;
+    for (size_t i = 0; i < kMaxReaders; i++) {
+        ReaderSlot& reader = mReaders[i];
+        bool expected = false;
+        if (reader.inUse.load(std::memory_order_relaxed) ||
+                !reader.inUse.compare_exchange_strong(expected, true,
+                                                      std::memory_order_acq_rel)) {
+            continue;
+        }
+        reader.blocking.store(blocking, std::memory_order_relaxed);
+        reader.front.store(front, std::memory_order_release);
+        ALOGV("SubmixPipe::addReader() slot %zu, front %llu, blocking %d", i,
+              (unsigned long long)front, blocking);
+        return i;
+    }
+    ALOGE("SubmixPipe::addReader() too many readers");
+    return -1;
+}
+
+void SubmixPipe::removeReader(int slot)
+{
+    ALOG_ASSERT(slot >= 0 && (size_t)slot < kMaxReaders);
+    mReaders[slot].blocking.store(false, std::memory_order_relaxed);
+    mReaders[slot].inUse.store(false, std::memory_order_release);
+}
+
+void SubmixPipe::setReaderBlocking(int slot, bool blocking)
+{
+    ALOG_ASSERT(slot >= 0 && (size_t)slot < kMaxReaders);
+    mReaders[slot].blocking.store(blocking, std::memory_order_relaxed);
+}
+
+ssize_t SubmixPipe::availableToRead(int slot) const
+{
+    const uint64_t rear = mRear.load(std::memory_order_acquire);
+    const uint64_t filled = rear - mReaders[slot].front.load(std::memory_order_relaxed);
+    const size_t target = targetFrames();
+    return filled < target ? filled : target;
+}
+
+ssize_t SubmixPipe::read(int slot, void *buffer, size_t count)
+{
+    ReaderSlot& reader = mReaders[slot];
+    uint64_t front = reader.front.load(std::memory_order_relaxed);
+    size_t frames;
+    for (;;) {
+        const uint64_t rear = mRear.load(std::memory_order_acquire);
+        const size_t target = targetFrames();
+        if (rear - front > target) {
+            // Overrun: drop the oldest frames by moving the read position.
+            ALOGV("SubmixPipe::read() slot %d dropped %llu frames", slot,
+                  (unsigned long long)(rear - front - target));
+            front = rear - target;
+        }
+        const size_t avail = rear - front;
+        frames = avail < count ? avail : count;
+        if (frames == 0) {
+            break;
+        }
+        copyFromRing(front, buffer, frames);
+        // If the writer started overwriting the frames while they were being copied, the copy
+        // may be torn: start again after the frames that are being written.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t writeEnd = mWriteEnd.load(std::memory_order_relaxed);
+        if (writeEnd <= front + mMaxFrames) {
+            break;
+        }
+        front = writeEnd - target;
+    }
+    reader.front.store(front + frames, std::memory_order_release);
+    return frames;
+}
+
+SubmixPipeReader::SubmixPipeReader(const sp<SubmixPipe>& pipe, bool blocking)
+    : mPipe(pipe),
+      mSlot(pipe->addReader(blocking))
+{
+}
+
+SubmixPipeReader::~SubmixPipeReader()
+{
+    if (mSlot >= 0) {
+        mPipe->removeReader(mSlot);
+    }
+}
+
+void SubmixPipeReader::setBlocking(bool blocking)
+{
+    if (mSlot >= 0) {
+        mPipe->setReaderBlocking(mSlot, blocking);
+    }
+}
+
+void SubmixPipeReader::setSampleRate(uint32_t sampleRate, uint32_t channelCount)
+{
+    if (sampleRate == mPipe->sampleRate()) {
+        mResampler.reset();
+        mConvertBuffer.clear();
+        return;
+    }
+    ALOG_ASSERT(mPipe->frameSize() == channelCount * sizeof(int16_t));
+    mResampler.reset(new SubmixResampler(mPipe->sampleRate(), sampleRate, channelCount));
+    mConvertBuffer.resize(SubmixResampler::kMaxPushFrames * channelCount);
+}
+
+uint32_t SubmixPipeReader::sampleRate() const
+{
+    return mResampler != nullptr ? mResampler->outRate() : mPipe->sampleRate();
+}
+
+ssize_t SubmixPipeReader::availableToRead() const
+{
+    if (mSlot < 0) {
+        return 0;
+    }
+    const ssize_t frames = mPipe->availableToRead(mSlot);
+    return mResampler != nullptr ? mResampler->outputFramesAvailable(frames) : frames;
+}
+
+ssize_t SubmixPipeReader::read(void *buffer, size_t count)
+{
+    if (mSlot < 0) {
+        return 0;
+    }
+    if (mResampler == nullptr) {
+        return mPipe->read(mSlot, buffer, count);
+    }
+    // Alternate between producing what the buffered input allows and reading the input needed
+    // for the rest from the pipe, until the pipe is empty.
+    int16_t * const out = static_cast<int16_t *>(buffer);
+    const size_t channelCount = mPipe->frameSize() / sizeof(int16_t);
+    size_t produced = 0;
+    for (;;) {
+        produced += mResampler->pull(out + produced * channelCount, count - produced);
+        if (produced == count) {
+            break;
+        }
+        size_t needed = mResampler->inputFramesNeeded(count - produced);
+        if (needed > SubmixResampler::kMaxPushFrames) {
+            needed = SubmixResampler::kMaxPushFrames;
+        }
+        const ssize_t frames = mPipe->read(mSlot, mConvertBuffer.data(), needed);
+        if (frames <= 0) {
+            break;
+        }
+        mResampler->push(mConvertBuffer.data(), frames);
+    }
+    return produced;
+}
+
+}  // namespace android
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SUBMIX_PIPE_H
+#define ANDROID_SUBMIX_PIPE_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+#include "SubmixResampler.h"
+
+namespace android {
+
+// Ring buffer of audio frames carrying the audio of a submix route from the output stream (the
+// single writer) to any number of input streams (the readers, up to kMaxReaders).
+//
+// Positions are kept as 64-bit frame counters that never wrap, the ring index being the
+// counter masked with the (power of 2) capacity.  Each reader has its own read position, so all
+// readers see every frame written and the audio is only copied once, into the buffer of each
+// reader.  Reading and writing are lock-free.
+//
+// Each reader is either blocking or not.  The writer waits for blocking readers to make room,
+// while non-blocking readers are overrun: when a reader falls more than the latency target
+// behind the writer, its oldest frames are dropped by moving its read position, without copying
+// them out of the ring.
+//
+// The latency target is the maximum number of frames the pipe holds for a reader.  It can be
+// changed at any time between one frame and the capacity of the ring.
+//
+// A writer that can block is also kept from getting more than the latency target ahead of real
+// time at the sample rate of the pipe, whether or not there are readers, as MonoPipe does.
+class SubmixPipe : public RefBase {
+public:
+    static const size_t kMaxReaders = 8;
+
+    // maxFrames is rounded up to the next power of 2 and is also the initial latency target.
+    SubmixPipe(size_t maxFrames, size_t frameSize, uint32_t sampleRate, bool writeCanBlock);
+    virtual ~SubmixPipe();
+
+    size_t maxFrames() const { return mMaxFrames; }
+    size_t frameSize() const { return mFrameSize; }
+    uint32_t sampleRate() const { return mSampleRate; }
+
+    // Clamped to [1, maxFrames()].  Returns the target actually applied.
+    size_t setTargetFrames(size_t frames);
+    size_t targetFrames() const { return mTargetFrames.load(std::memory_order_relaxed); }
+
+    // Writer side.
+    ssize_t availableToWrite() const;
+    // Writes up to count frames.  If the pipe was created blocking, waits for the blocking
+    // readers to make room until all frames are written or the pipe is shut down, then for real
+    // time to catch up with the frames written.
+    ssize_t write(const void *buffer, size_t count);
+    // Accounts for frames written, or discarded in their place, and sleeps until the frames
+    // written are no more than the latency target ahead of real time.  Called by write() on
+    // pipes that can block.
+    void throttle(size_t frames);
+
+    // Number of frames written but not yet read by the reader that is the furthest behind.  When
+    // there are no readers, the number of frames a new reader would find in the pipe.
+    ssize_t availableToRead() const;
+
+    // A shut down pipe never blocks the writer.
+    void shutdown(bool newState) { mIsShutdown.store(newState, std::memory_order_relaxed); }
+    bool isShutdown() const { return mIsShutdown.load(std::memory_order_relaxed); }
+
+private:
+    friend class SubmixPipeReader;
+
+    struct ReaderSlot {
+        std::atomic<bool> inUse;
+        std::atomic<bool> blocking;
+        // Number of frames read or dropped by this reader, only updated by the reader.
+        std::atomic<uint64_t> front;
+    };
+
+    // Returns the slot of the new reader, or -1 if there are already kMaxReaders readers.  The
+    // reader starts with the frames still buffered for the other readers, if any.
+    int addReader(bool blocking);
+    void removeReader(int slot);
+    void setReaderBlocking(int slot, bool blocking);
+    ssize_t availableToRead(int slot) const;
+    ssize_t read(int slot, void *buffer, size_t count);
+
+    // Copies count frames between buffer and the ring starting at position.
+    void copyToRing(uint64_t position, const void *buffer, size_t count);
+    void copyFromRing(uint64_t position, void *buffer, size_t count) const;
+
+    const size_t mMaxFrames;
+    const size_t mFrameSize;
+    const uint32_t mSampleRate;
+    const bool mWriteCanBlock;
+    uint8_t * const mBuffer;
+
+    std::atomic<size_t> mTargetFrames;
+    // Number of frames ever written, only updated by the writer.
+    std::atomic<uint64_t> mRear;
+    // End of the frames being written, set by the writer before it starts copying so that
+    // readers can detect the data they copied was overwritten.
+    std::atomic<uint64_t> mWriteEnd;
+    std::atomic<bool> mIsShutdown;
+    ReaderSlot mReaders[kMaxReaders];
+
+    // Clock of the writer, only used by the writer: the frames written since the time it was
+    // started at.
+    int64_t mClockStartNs;
+    uint64_t mClockFrames;
+};
+
+// Read end of a SubmixPipe, the counterpart of MonoPipeReader.  Each reader has its own read
+// position in the pipe and optionally converts the audio to its own sample rate, in which case
+// frame counts are at that rate.  Must only be used by one thread at a time.
+class SubmixPipeReader : public RefBase {
+public:
+    SubmixPipeReader(const sp<SubmixPipe>& pipe, bool blocking);
+    virtual ~SubmixPipeReader();
+
+    // NO_MEMORY if the pipe already has SubmixPipe::kMaxReaders readers.
+    status_t initCheck() const { return mSlot >= 0 ? OK : NO_MEMORY; }
+
+    // Whether the writer waits for this reader, or overruns it when it falls behind.
+    void setBlocking(bool blocking);
+
+    // Converts the 16-bit PCM audio of the pipe to the sample rate, or reads it unconverted if
+    // the rate is the rate of the pipe.  Drops the audio buffered for the previous conversion.
+    void setSampleRate(uint32_t sampleRate, uint32_t channelCount);
+    uint32_t sampleRate() const;
+
+    ssize_t availableToRead() const;
+    ssize_t read(void *buffer, size_t count);
+
+private:
+    const sp<SubmixPipe> mPipe;
+    const int mSlot;
+    std::unique_ptr<SubmixResampler> mResampler;
+    // Audio read from the pipe before conversion.
+    std::vector<int16_t> mConvertBuffer;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_SUBMIX_PIPE_H
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "r_submix"
+//#define LOG_NDEBUG 0
+
+#include <map>
+#include <math.h>
+#include <mutex>
+#include <string.h>
+#include <utility>
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include <log/log.h>
+
+#include "SubmixResampler.h"
+
+namespace android {
+
+// Number of zero crossings of the sinc on each side of its center.  Sets the steepness of the
+// transition band: 16 gives a rejection in the order of 80dB with the Kaiser window below.
+static const size_t kZeroCrossings = 16;
+static const double kKaiserBeta = 8.0;
+// Fraction of the lowest Nyquist frequency passed by the filter.
+static const double kPassband = 0.91;
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        const uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth order modified Bessel function of the first kind.
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Dot product of count (a multiple of 4) coefficients and samples.
+static inline float dot_product(const float *coefs, const float *samples, size_t count)
+{
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (size_t i = 0; i < count; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(coefs + i), vld1q_f32(samples + i));
+    }
+    const float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#elif defined(__SSE__)
+    __m128 acc = _mm_setzero_ps();
+    for (size_t i = 0; i < count; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(coefs + i), _mm_loadu_ps(samples + i)));
+    }
+    float sums[4];
+    _mm_storeu_ps(sums, acc);
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#else
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (size_t i = 0; i < count; i += 4) {
+        acc[0] += coefs[i] * samples[i];
+        acc[1] += coefs[i + 1] * samples[i + 1];
+        acc[2] += coefs[i + 2] * samples[i + 2];
+        acc[3] += coefs[i + 3] * samples[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+std::shared_ptr<const PolyphaseFilter> PolyphaseFilter::get(uint32_t inRate, uint32_t outRate)
+{
+    static std::mutex lock;
+    static std::map<std::pair<uint32_t, uint32_t>, std::weak_ptr<const PolyphaseFilter>> cache;
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::weak_ptr<const PolyphaseFilter>& entry = cache[std::make_pair(inRate, outRate)];
+    std::shared_ptr<const PolyphaseFilter> filter = entry.lock();
+    if (filter == nullptr) {
+        filter = std::make_shared<const PolyphaseFilter>(inRate, outRate);
+        entry = filter;
+        ALOGV("PolyphaseFilter::get() created %u -> %u, %u phases of %zu taps", inRate, outRate,
+              filter->upFactor(), filter->taps());
+    }
+    return filter;
+}
+
+PolyphaseFilter::PolyphaseFilter(uint32_t inRate, uint32_t outRate)
+{
+    const uint32_t divisor = gcd(inRate, outRate);
+    mUpFactor = outRate / divisor;
+    mDownFactor = inRate / divisor;
+
+    // When decimating, the sinc is stretched to cut at the output Nyquist frequency and needs
+    // proportionally more taps.
+    const double stretch = mDownFactor > mUpFactor ? (double)mDownFactor / mUpFactor : 1.0;
+    mTaps = (size_t)ceil(2 * kZeroCrossings * stretch);
+    mTaps = (mTaps + 3) & ~(size_t)3;
+
+    // Prototype filter at the upsampled rate, normalized to a gain of upFactor so that each
+    // phase has a gain of about 1.
+    const size_t length = mTaps * mUpFactor;
+    const double cutoff = kPassband * 0.5 / (mUpFactor * stretch);
+    const double center = (length - 1) / 2.0;
+    const double windowNorm = bessel_i0(kKaiserBeta);
+    std::vector<double> prototype(length);
+    double sum = 0.0;
+    for (size_t i = 0; i < length; i++) {
+        const double t = i - center;
+        const double x = 2.0 * M_PI * cutoff * t;
+        const double sinc = t == 0.0 ? 2.0 * cutoff : sin(x) / (M_PI * t);
+        const double r = 2.0 * i / (length - 1) - 1.0;
+        const double window = bessel_i0(kKaiserBeta * sqrt(fmax(0.0, 1.0 - r * r))) / windowNorm;
+        prototype[i] = sinc * window;
+        sum += prototype[i];
+    }
+
+    mCoefs.resize(length);
+    for (uint32_t p = 0; p < mUpFactor; p++) {
+        for (size_t t = 0; t < mTaps; t++) {
+            mCoefs[p * mTaps + t] =
+                    (float)(prototype[p + (mTaps - 1 - t) * mUpFactor] * mUpFactor / sum);
+        }
+    }
+}
+
+SubmixResampler::SubmixResampler(uint32_t inRate, uint32_t outRate, uint32_t channelCount)
+    : mInRate(inRate),
+      mOutRate(outRate),
+      mChannelCount(channelCount),
+      mFilter(PolyphaseFilter::get(inRate, outRate)),
+      mPhase(0)
+{
+    const size_t taps = mFilter->taps();
+    mCapacity = taps + kMaxPushFrames + mFilter->downFactor() / mFilter->upFactor() + 1;
+    mHistory.assign(mCapacity * mChannelCount, 0.0f);
+    // Start with silence so that the first output frame only depends on the first input frame.
+    mFill = taps - 1;
+    mIndex = taps - 1;
+}
+
+size_t SubmixResampler::inputFramesNeeded(size_t count) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    const size_t last = mIndex +
+            ((uint64_t)mPhase + (uint64_t)(count - 1) * mFilter->downFactor()) /
+                    mFilter->upFactor();
+    return last < mFill ? 0 : last + 1 - mFill;
+}
+
+size_t SubmixResampler::outputFramesAvailable(size_t inputFrames) const
+{
+    const size_t fill = mFill + inputFrames;
+    if (fill <= mIndex) {
+        return 0;
+    }
+    return ((uint64_t)(fill - mIndex) * mFilter->upFactor() - mPhase +
+            mFilter->downFactor() - 1) / mFilter->downFactor();
+}
+
+void SubmixResampler::push(const int16_t *buffer, size_t frames)
+{
+    ALOG_ASSERT(frames <= kMaxPushFrames);
+    const size_t taps = mFilter->taps();
+    // Drop the samples older than the window of the next output frame.
+    const size_t start = mIndex + 1 - taps;
+    const size_t dropped = start < mFill ? start : mFill;
+    if (dropped > 0) {
+        for (uint32_t c = 0; c < mChannelCount; c++) {
+            float * const history = &mHistory[c * mCapacity];
+            memmove(history, history + dropped, (mFill - dropped) * sizeof(float));
+        }
+        mFill -= dropped;
+        mIndex -= dropped;
+    }
+    if (mFill + frames > mCapacity) {
+        ALOGE("SubmixResampler::push() overflow, dropping %zu frames",
+              mFill + frames - mCapacity);
+        frames = mCapacity - mFill;
+    }
+    for (uint32_t c = 0; c < mChannelCount; c++) {
+        float * const history = &mHistory[c * mCapacity + mFill];
+        for (size_t i = 0; i < frames; i++) {
+            history[i] = buffer[i * mChannelCount + c] * (1.0f / 32768.0f);
+        }
+    }
+    mFill += frames;
+}
+
+size_t SubmixResampler::pull(int16_t *buffer, size_t count)
+{
+    const size_t taps = mFilter->taps();
+    const uint32_t upFactor = mFilter->upFactor();
+    const uint32_t downFactor = mFilter->downFactor();
+    size_t produced = 0;
+    while (produced < count && mIndex < mFill) {
+        const float * const coefs = mFilter->phase(mPhase);
+        for (uint32_t c = 0; c < mChannelCount; c++) {
+            const float * const samples = &mHistory[c * mCapacity + mIndex + 1 - taps];
+            const float sample = dot_product(coefs, samples, taps) * 32768.0f;
+            buffer[produced * mChannelCount + c] =
+                    sample >= 32767.0f ? 32767 :
+                    (sample <= -32768.0f ? -32768 : (int16_t)lrintf(sample));
+        }
+        produced++;
+        mPhase += downFactor;
+        mIndex += mPhase / upFactor;
+        mPhase %= upFactor;
+    }
+    return produced;
+}
+
+}  // namespace android
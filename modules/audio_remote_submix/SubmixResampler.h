@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SUBMIX_RESAMPLER_H
+#define ANDROID_SUBMIX_RESAMPLER_H
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace android {
+
+// Windowed-sinc polyphase filter converting from one sample rate to another, the rates being in
+// the ratio upFactor / downFactor.  The coefficients only depend on the rate pair, so a single
+// instance is shared by all the resamplers converting between the same rates.
+class PolyphaseFilter {
+public:
+    // Returns the filter for the rate pair, creating it if no resampler currently uses it.
+    static std::shared_ptr<const PolyphaseFilter> get(uint32_t inRate, uint32_t outRate);
+
+    PolyphaseFilter(uint32_t inRate, uint32_t outRate);
+
+    uint32_t upFactor() const { return mUpFactor; }
+    uint32_t downFactor() const { return mDownFactor; }
+    // Number of taps of each phase, a multiple of 4.
+    size_t taps() const { return mTaps; }
+    // Coefficients of the phase, in reverse order so that they apply to consecutive input
+    // samples, oldest first.
+    const float *phase(uint32_t phase) const { return &mCoefs[phase * mTaps]; }
+
+private:
+    uint32_t mUpFactor;
+    uint32_t mDownFactor;
+    size_t mTaps;
+    std::vector<float> mCoefs;
+};
+
+// Converts 16-bit PCM from one sample rate to another.  Input is pushed in, output is pulled out
+// as far as the input pushed so far allows.
+class SubmixResampler {
+public:
+    // Maximum number of input frames pushed at once.
+    static const size_t kMaxPushFrames = 1024;
+
+    SubmixResampler(uint32_t inRate, uint32_t outRate, uint32_t channelCount);
+
+    uint32_t inRate() const { return mInRate; }
+    uint32_t outRate() const { return mOutRate; }
+
+    // Number of input frames to push before count output frames can be pulled.
+    size_t inputFramesNeeded(size_t count) const;
+    // Number of output frames that inputFrames more input frames would produce.
+    size_t outputFramesAvailable(size_t inputFrames) const;
+
+    // Pushes up to kMaxPushFrames interleaved frames, once pull() produced all it could.
+    void push(const int16_t *buffer, size_t frames);
+    // Produces up to count interleaved frames, returns the number of frames produced.
+    size_t pull(int16_t *buffer, size_t count);
+
+private:
+    const uint32_t mInRate;
+    const uint32_t mOutRate;
+    const uint32_t mChannelCount;
+    const std::shared_ptr<const PolyphaseFilter> mFilter;
+
+    // Input samples of each channel, one channel after the other, mCapacity samples each.  The
+    // next output frame is computed from the taps() samples ending at mIndex.
+    std::vector<float> mHistory;
+    size_t mCapacity;
+    size_t mFill;
+    size_t mIndex;
+    uint32_t mPhase;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_SUBMIX_RESAMPLER_H
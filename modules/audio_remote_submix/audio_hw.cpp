@@ -24,6 +24,7 @@
 #include <sys/param.h>
 #include <sys/time.h>
 #include <sys/limits.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cutils/compiler.h>
@@ -38,8 +39,8 @@
 
 #include <media/AudioParameter.h>
 #include <media/AudioBufferProvider.h>
-#include <media/nbaio/MonoPipe.h>
-#include <media/nbaio/MonoPipeReader.h>
+
+#include "SubmixPipe.h"
 
 #define LOG_STREAMS_TO_FILES 0
 #if LOG_STREAMS_TO_FILES
@@ -62,12 +63,22 @@ namespace android {
 #define SUBMIX_ALOGE(...)
 #endif // SUBMIX_VERBOSE_LOGGING
 
-// NOTE: This value will be rounded up to the nearest power of 2 by MonoPipe().
+// NOTE: This value will be rounded up to the nearest power of 2 by SubmixPipe().
 #define DEFAULT_PIPE_SIZE_IN_FRAMES  (1024*4) // size at default sample rate
-// Value used to divide the MonoPipe() buffer into segments that are written to the source and
-// read from the sink.  The maximum latency of the device is the size of the MonoPipe's buffer
-// the minimum latency is the MonoPipe buffer size divided by this value.
+// Value used to divide the SubmixPipe() buffer into segments that are written to the source and
+// read from the sink.  The maximum latency of the device is the size of the SubmixPipe's buffer
+// the minimum latency is the SubmixPipe buffer size divided by this value.
 #define DEFAULT_PIPE_PERIOD_COUNT    4
+// Stream parameter setting the latency target of a route in milliseconds, i.e. the maximum
+// duration of audio buffered in its pipe.  It defaults to the whole pipe and can be set from
+// either the input or the output stream, between one period and the size of the pipe.
+#define SUBMIX_PARAMETER_KEY_LATENCY_MS "r_submix_latency_ms"
+// Input stream parameter selecting what happens when the input does not read fast enough:
+// "block" makes the output stream wait for it, "drop" drops the oldest frames for this input
+// only.  The first input opened on a route blocks by default, the others drop.
+#define SUBMIX_PARAMETER_KEY_OVERFLOW   "r_submix_overflow"
+#define SUBMIX_PARAMETER_VALUE_BLOCK    "block"
+#define SUBMIX_PARAMETER_VALUE_DROP     "drop"
 // The duration of MAX_READ_ATTEMPTS * READ_ATTEMPT_SLEEP_MS must be stricly inferior to
 //   the duration of a record buffer at the current record sample rate (of the device, not of
 //   the recording itself). Here we have:
@@ -75,14 +86,17 @@ namespace android {
 #define MAX_READ_ATTEMPTS            3
 #define READ_ATTEMPT_SLEEP_MS        5 // 5ms between two read attempts when pipe is empty
 #define DEFAULT_SAMPLE_RATE_HZ       48000 // default sample rate
+// Input streams can capture at a sample rate other than the rate of the output stream, the audio
+// being converted as it is read from the pipe.  Higher rates only carry IEC 61937 encapsulated
+// audio, which must be passed through unmodified.
+#define MAX_RESAMPLING_RATE_HZ       48000
 // See NBAIO_Format frameworks/av/include/media/nbaio/NBAIO.h.
 #define DEFAULT_FORMAT               AUDIO_FORMAT_PCM_16_BIT
-// A legacy user of this device does not close the input stream when it shuts down, which
-// results in the application opening a new input stream before closing the old input stream
-// handle it was previously using.  Setting this value to 1 allows multiple clients to open
-// multiple input streams from this device.  If this option is enabled, each input stream returned
-// is *the same stream* which means that readers will race to read data from these streams.
-#define ENABLE_LEGACY_INPUT_OPEN     1
+// Maximum number of input streams open at the same time on a route.  Each input stream has its
+// own read position in the pipe of the route and captures everything written by the output
+// stream.  This also supports a legacy user of this device that does not close the input stream
+// when it shuts down, and opens a new input stream before closing the old one.
+#define MAX_INPUTS_PER_ROUTE         SubmixPipe::kMaxReaders
 
 #if LOG_STREAMS_TO_FILES
 // Folder to save stream log files to.
@@ -131,6 +145,8 @@ struct submix_config {
     size_t buffer_size_frames; // Size of the audio pipe in frames.
     // Maximum number of frames buffered by the input and output streams.
     size_t buffer_period_size_frames;
+    // Latency target of the pipe in frames, at most buffer_size_frames.
+    size_t buffer_target_frames;
 };
 
 #define MAX_ROUTES 10
@@ -145,19 +161,24 @@ typedef struct route_config {
     // A usecase example is one where the component capturing the audio is then sending it over
     // Wifi for presentation on a remote Wifi Display device (e.g. a dongle attached to a TV, or a
     // TV with Wifi Display capabilities), or to a wireless audio player.
-    sp<MonoPipe> rsxSink;
-    sp<MonoPipeReader> rsxSource;
-    // Pointers to the current input and output stream instances.  rsxSink and rsxSource are
-    // destroyed if both and input and output streams are destroyed.
+    // Each input stream reads the pipe through its own SubmixPipeReader.
+    sp<SubmixPipe> rsxSink;
+    // Pointers to the current input and output stream instances.  rsxSink is destroyed if all
+    // input and output streams are destroyed.
     struct submix_stream_out *output;
-    struct submix_stream_in *input;
+    struct submix_stream_in *inputs[MAX_INPUTS_PER_ROUTE];
+    // Route lock, protects the pipe references, the stream pointers above and the state of the
+    // streams attached to this route, so that streams on different routes never contend.
+    // Fields that are only modified when streams are opened or closed are written with both the
+    // device lock and the route lock held, and can be read with either of them held.
+    pthread_mutex_t lock;
 } route_config_t;
 
 struct submix_audio_device {
     struct audio_hw_device device;
     route_config_t routes[MAX_ROUTES];
-    // Device lock, also used to protect access to submix_audio_device from the input and output
-    // streams.
+    // Device lock, protects the assignment of addresses to routes and the opening and closing of
+    // streams.  When both are needed, the device lock must be acquired before a route lock.
     pthread_mutex_t lock;
 };
 
@@ -185,10 +206,17 @@ struct submix_stream_in {
     uint64_t read_counter_frames;
     uint64_t read_counter_frames_since_standby;
 
-#if ENABLE_LEGACY_INPUT_OPEN
-    // Number of references to this input stream.
-    volatile int32_t ref_count;
-#endif // ENABLE_LEGACY_INPUT_OPEN
+    // Read end of the pipe of the route, owned by this stream.
+    sp<SubmixPipeReader> reader;
+    // Reader lock: a reader must only be used by one thread at a time, so this is held by
+    // in_read() while it reads and by the functions that query or reconfigure the reader.  Must
+    // be acquired before the route lock.
+    pthread_mutex_t reader_lock;
+    // Sample rate of the stream, which can differ from the rate of the pipe.
+    uint32_t sample_rate;
+    // Whether the output stream waits for this input stream to read, see
+    // SUBMIX_PARAMETER_KEY_OVERFLOW and submix_stream_in_update_blocking_l().
+    bool blocking_reader;
 #if LOG_STREAMS_TO_FILES
     int log_fd;
 #endif // LOG_STREAMS_TO_FILES
@@ -325,8 +353,11 @@ static bool audio_config_compare(const audio_config * const input_config,
         return false;
     }
 
-    if (input_config->sample_rate != output_config->sample_rate) {
-        ALOGE("audio_config_compare() sample rate mismatch %ul vs. %ul",
+    // Different sample rates are converted when reading from the pipe.
+    if (input_config->sample_rate != output_config->sample_rate &&
+            (input_config->sample_rate > MAX_RESAMPLING_RATE_HZ ||
+             output_config->sample_rate > MAX_RESAMPLING_RATE_HZ)) {
+        ALOGE("audio_config_compare() sample rate mismatch %u vs. %u",
               input_config->sample_rate, output_config->sample_rate);
         return false;
     }
@@ -339,9 +370,55 @@ static bool audio_config_compare(const audio_config * const input_config,
     return true;
 }
 
+// Return the number of input streams open on the route.
+// Must be called with lock held on the submix_audio_device or on the route
+static size_t submix_route_input_count_l(const route_config_t * const route)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < MAX_INPUTS_PER_ROUTE; i++) {
+        if (route->inputs[i] != NULL) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Tell the pipe whether the output stream must wait for the input stream to read.  The output
+// does not wait for an input in standby after having been active, so that the input finds the
+// most recent audio when it resumes, but it waits for an input that was never activated, to avoid
+// discarding the first frames in the pipe in case capture start was delayed.
+// Must be called with lock held on the route
+static void submix_stream_in_update_blocking_l(struct submix_stream_in * const in)
+{
+    if (in->reader == NULL) {
+        return;
+    }
+    const bool blocking = in->blocking_reader &&
+            !(in->input_standby && (in->read_counter_frames_since_standby != 0));
+    in->reader->setBlocking(blocking);
+}
+
+// Give the input stream a read end of the pipe of its route, converting to the sample rate of the
+// stream if needed.
+// Must be called with lock held on the route
+static void submix_stream_in_attach_reader_l(struct submix_stream_in * const in,
+                                             const sp<SubmixPipe>& sink)
+{
+    in->reader = new SubmixPipeReader(sink, in->blocking_reader);
+    if (in->reader->initCheck() != OK) {
+        ALOGE("submix_stream_in_attach_reader_l(): no reader available");
+        return;
+    }
+    in->reader->setSampleRate(in->sample_rate, sink->frameSize() / sizeof(int16_t));
+    ALOGV_IF(in->sample_rate != sink->sampleRate(),
+             "submix_stream_in_attach_reader_l(): converting %u to %u", sink->sampleRate(),
+             in->sample_rate);
+    submix_stream_in_update_blocking_l(in);
+}
+
 // If one doesn't exist, create a pipe for the submix audio device rsxadev of size
 // buffer_size_frames and optionally associate "in" or "out" with the submix audio device.
-// Must be called with lock held on the submix_audio_device
+// Must be called with lock held on the submix_audio_device and on the route
 static void submix_audio_device_create_pipe_l(struct submix_audio_device * const rsxadev,
                                             const struct audio_config * const config,
                                             const size_t buffer_size_frames,
@@ -360,7 +437,12 @@ static void submix_audio_device_create_pipe_l(struct submix_audio_device * const
     // mask.
     if (in) {
         in->route_handle = route_idx;
-        rsxadev->routes[route_idx].input = in;
+        for (size_t i = 0; i < MAX_INPUTS_PER_ROUTE; i++) {
+            if (rsxadev->routes[route_idx].inputs[i] == NULL) {
+                rsxadev->routes[route_idx].inputs[i] = in;
+                break;
+            }
+        }
         rsxadev->routes[route_idx].config.input_channel_mask = config->channel_mask;
     }
     if (out) {
@@ -372,7 +454,7 @@ static void submix_audio_device_create_pipe_l(struct submix_audio_device * const
     strncpy(rsxadev->routes[route_idx].address, address, AUDIO_DEVICE_MAX_ADDRESS_LEN);
     ALOGD("  now using address %s for route %d", rsxadev->routes[route_idx].address, route_idx);
     // If a pipe isn't associated with the device, create one.
-    if (rsxadev->routes[route_idx].rsxSink == NULL || rsxadev->routes[route_idx].rsxSource == NULL)
+    if (rsxadev->routes[route_idx].rsxSink == NULL)
     {
         struct submix_config * const device_config = &rsxadev->routes[route_idx].config;
         uint32_t channel_count;
@@ -383,47 +465,42 @@ static void submix_audio_device_create_pipe_l(struct submix_audio_device * const
         }
 
         const uint32_t pipe_channel_count = channel_count;
+        const size_t pipe_frame_size = audio_bytes_per_frame(pipe_channel_count, config->format);
 
-        const NBAIO_Format format = Format_from_SR_C(config->sample_rate, pipe_channel_count,
-            config->format);
-        const NBAIO_Format offers[1] = {format};
-        size_t numCounterOffers = 0;
-        // Create a MonoPipe with optional blocking set to true.
-        MonoPipe* sink = new MonoPipe(buffer_size_frames, format, true /*writeCanBlock*/);
-        // Negotiation between the source and sink cannot fail as the device open operation
-        // creates both ends of the pipe using the same audio format.
-        ssize_t index = sink->negotiate(offers, 1, NULL, numCounterOffers);
-        ALOG_ASSERT(index == 0);
-        MonoPipeReader* source = new MonoPipeReader(sink);
-        numCounterOffers = 0;
-        index = source->negotiate(offers, 1, NULL, numCounterOffers);
-        ALOG_ASSERT(index == 0);
+        // Create a SubmixPipe with optional blocking set to true.
+        SubmixPipe* sink = new SubmixPipe(buffer_size_frames, pipe_frame_size,
+                                          config->sample_rate, true /*writeCanBlock*/);
         ALOGV("submix_audio_device_create_pipe_l(): created pipe");
 
-        // Save references to the source and sink.
-        ALOG_ASSERT(rsxadev->routes[route_idx].rsxSink == NULL);
-        ALOG_ASSERT(rsxadev->routes[route_idx].rsxSource == NULL);
+        // Save a reference to the sink.
         rsxadev->routes[route_idx].rsxSink = sink;
-        rsxadev->routes[route_idx].rsxSource = source;
         // Store the sanitized audio format in the device so that it's possible to determine
         // the format of the pipe source when opening the input device.
         memcpy(&device_config->common, config, sizeof(device_config->common));
         device_config->buffer_size_frames = sink->maxFrames();
         device_config->buffer_period_size_frames = device_config->buffer_size_frames /
                 buffer_period_count;
-        if (in) device_config->pipe_frame_size = audio_stream_in_frame_size(&in->stream);
-        if (out) device_config->pipe_frame_size = audio_stream_out_frame_size(&out->stream);
+        device_config->buffer_target_frames = sink->targetFrames();
+        device_config->pipe_frame_size = pipe_frame_size;
 
         SUBMIX_ALOGV("submix_audio_device_create_pipe_l(): pipe frame size %zd, pipe size %zd, "
                      "period size %zd", device_config->pipe_frame_size,
                      device_config->buffer_size_frames, device_config->buffer_period_size_frames);
     }
+    // Give a read end of the pipe to the input streams which don't have one yet: the new input
+    // stream, and all of them if the pipe was just recreated.
+    for (size_t i = 0; i < MAX_INPUTS_PER_ROUTE; i++) {
+        struct submix_stream_in * const input = rsxadev->routes[route_idx].inputs[i];
+        if (input != NULL && input->reader == NULL) {
+            submix_stream_in_attach_reader_l(input, rsxadev->routes[route_idx].rsxSink);
+        }
+    }
 }
 
-// Release references to the sink and source.  Input and output threads may maintain references
-// to these objects via StrongPointer (sp<MonoPipe> and sp<MonoPipeReader>) which they can use
-// before they shutdown.
-// Must be called with lock held on the submix_audio_device
+// Release references to the sink and the readers of the input streams.  Input and output threads
+// may maintain references to these objects via StrongPointer (sp<SubmixPipe> and
+// sp<SubmixPipeReader>) which they can use before they shutdown.
+// Must be called with lock held on the submix_audio_device and on the route
 static void submix_audio_device_release_pipe_l(struct submix_audio_device * const rsxadev,
         int route_idx)
 {
@@ -434,40 +511,36 @@ static void submix_audio_device_release_pipe_l(struct submix_audio_device * cons
     if (rsxadev->routes[route_idx].rsxSink != 0) {
         rsxadev->routes[route_idx].rsxSink.clear();
     }
-    if (rsxadev->routes[route_idx].rsxSource != 0) {
-        rsxadev->routes[route_idx].rsxSource.clear();
+    for (size_t i = 0; i < MAX_INPUTS_PER_ROUTE; i++) {
+        if (rsxadev->routes[route_idx].inputs[i] != NULL) {
+            rsxadev->routes[route_idx].inputs[i]->reader.clear();
+        }
     }
     memset(rsxadev->routes[route_idx].address, 0, AUDIO_DEVICE_MAX_ADDRESS_LEN);
 }
 
 // Remove references to the specified input and output streams.  When the device no longer
 // references input and output streams destroy the associated pipe.
-// Must be called with lock held on the submix_audio_device
+// Must be called with lock held on the submix_audio_device and on the route
 static void submix_audio_device_destroy_pipe_l(struct submix_audio_device * const rsxadev,
-                                             const struct submix_stream_in * const in,
+                                             struct submix_stream_in * const in,
                                              const struct submix_stream_out * const out)
 {
     ALOGV("submix_audio_device_destroy_pipe_l()");
     int route_idx = -1;
     if (in != NULL) {
-        bool shut_down = false;
-#if ENABLE_LEGACY_INPUT_OPEN
-        const_cast<struct submix_stream_in*>(in)->ref_count--;
         route_idx = in->route_handle;
-        ALOG_ASSERT(rsxadev->routes[route_idx].input == in);
-        if (in->ref_count == 0) {
-            rsxadev->routes[route_idx].input = NULL;
-            shut_down = true;
+        for (size_t i = 0; i < MAX_INPUTS_PER_ROUTE; i++) {
+            if (rsxadev->routes[route_idx].inputs[i] == in) {
+                rsxadev->routes[route_idx].inputs[i] = NULL;
+            }
         }
-        ALOGV("submix_audio_device_destroy_pipe_l(): input ref_count %d", in->ref_count);
-#else
-        route_idx = in->route_handle;
-        ALOG_ASSERT(rsxadev->routes[route_idx].input == in);
-        rsxadev->routes[route_idx].input = NULL;
-        shut_down = true;
-#endif // ENABLE_LEGACY_INPUT_OPEN
-        if (shut_down) {
-            sp <MonoPipe> sink = rsxadev->routes[in->route_handle].rsxSink;
+        in->reader.clear();
+        const size_t input_count = submix_route_input_count_l(&rsxadev->routes[route_idx]);
+        ALOGV("submix_audio_device_destroy_pipe_l(): %zu inputs left", input_count);
+        // Stop blocking the output once the last input is closed.
+        if (input_count == 0) {
+            sp <SubmixPipe> sink = rsxadev->routes[in->route_handle].rsxSink;
             if (sink != NULL) {
               sink->shutdown(true);
             }
@@ -479,7 +552,8 @@ static void submix_audio_device_destroy_pipe_l(struct submix_audio_device * cons
         rsxadev->routes[route_idx].output = NULL;
     }
     if (route_idx != -1 &&
-            rsxadev->routes[route_idx].input == NULL && rsxadev->routes[route_idx].output == NULL) {
+            submix_route_input_count_l(&rsxadev->routes[route_idx]) == 0 &&
+            rsxadev->routes[route_idx].output == NULL) {
         submix_audio_device_release_pipe_l(rsxadev, route_idx);
         ALOGD("submix_audio_device_destroy_pipe_l(): pipe destroyed");
     }
@@ -507,11 +581,12 @@ static bool submix_open_validate_l(const struct submix_audio_device * const rsxa
 
     // Query the device for the current audio config and whether input and output streams are open.
     output_open = rsxadev->routes[route_idx].output != NULL;
-    input_open = rsxadev->routes[route_idx].input != NULL;
+    const size_t input_count = submix_route_input_count_l(&rsxadev->routes[route_idx]);
+    input_open = input_count > 0;
     memcpy(&pipe_config, &rsxadev->routes[route_idx].config.common, sizeof(pipe_config));
 
-    // If the stream is already open, don't open it again.
-    if (opening_input ? !ENABLE_LEGACY_INPUT_OPEN && input_open : output_open) {
+    // If the stream is already open, don't open it again.  Several input streams can be open.
+    if (opening_input ? input_count >= MAX_INPUTS_PER_ROUTE : output_open) {
         ALOGE("submix_open_validate_l(): %s stream already open.", opening_input ? "Input" :
                 "Output");
         return false;
@@ -579,6 +654,31 @@ static size_t calculate_stream_pipe_size_in_frames(const struct audio_stream *st
     return (pipe_frames * config->pipe_frame_size) / max_frame_size;
 }
 
+// Set the latency target of the pipe of the route, see SUBMIX_PARAMETER_KEY_LATENCY_MS.
+static int submix_set_latency_target(route_config_t * const route, const int latency_ms)
+{
+    if (latency_ms <= 0) {
+        ALOGE("submix_set_latency_target(latency_ms=%d) invalid latency", latency_ms);
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&route->lock);
+    sp<SubmixPipe> sink = route->rsxSink;
+    if (sink == NULL) {
+        pthread_mutex_unlock(&route->lock);
+        ALOGW("submix_set_latency_target() called on a route without a pipe");
+        return -ENODEV;
+    }
+    struct submix_config * const config = &route->config;
+    const size_t target_frames = (size_t)latency_ms * config->common.sample_rate / 1000;
+    config->buffer_target_frames =
+            sink->setTargetFrames(max(target_frames, config->buffer_period_size_frames));
+    ALOGI("submix_set_latency_target(addr=%s) latency %d ms, target %zu frames",
+          route->address, latency_ms, config->buffer_target_frames);
+    sink.clear();
+    pthread_mutex_unlock(&route->lock);
+    return 0;
+}
+
 /* audio HAL functions */
 
 static uint32_t out_get_sample_rate(const struct audio_stream *stream)
@@ -653,13 +753,14 @@ static int out_standby(struct audio_stream *stream)
     ALOGI("out_standby()");
     struct submix_stream_out * const out = audio_stream_get_submix_stream_out(stream);
     struct submix_audio_device * const rsxadev = out->dev;
+    pthread_mutex_t * const route_lock = &rsxadev->routes[out->route_handle].lock;
 
-    pthread_mutex_lock(&rsxadev->lock);
+    pthread_mutex_lock(route_lock);
 
     out->output_standby = true;
     out->frames_written_since_standby = 0;
 
-    pthread_mutex_unlock(&rsxadev->lock);
+    pthread_mutex_unlock(route_lock);
 
     return 0;
 }
@@ -681,22 +782,25 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
     //       converted to use audio HAL extensions required to support tunneling
     if ((parms.getInt(String8(AUDIO_PARAMETER_KEY_EXITING), exiting) == NO_ERROR)
             && (exiting > 0)) {
-        struct submix_audio_device * const rsxadev =
-                audio_stream_get_submix_stream_out(stream)->dev;
-        pthread_mutex_lock(&rsxadev->lock);
+        const struct submix_stream_out * const out = audio_stream_get_submix_stream_out(stream);
+        pthread_mutex_t * const route_lock = &out->dev->routes[out->route_handle].lock;
+        pthread_mutex_lock(route_lock);
         { // using the sink
-            sp<MonoPipe> sink =
-                    rsxadev->routes[audio_stream_get_submix_stream_out(stream)->route_handle]
-                                    .rsxSink;
+            sp<SubmixPipe> sink = out->dev->routes[out->route_handle].rsxSink;
             if (sink == NULL) {
-                pthread_mutex_unlock(&rsxadev->lock);
+                pthread_mutex_unlock(route_lock);
                 return 0;
             }
 
-            ALOGD("out_set_parameters(): shutting down MonoPipe sink");
+            ALOGD("out_set_parameters(): shutting down SubmixPipe sink");
             sink->shutdown(true);
         } // done using the sink
-        pthread_mutex_unlock(&rsxadev->lock);
+        pthread_mutex_unlock(route_lock);
+    }
+    int latency_ms = -1;
+    if (parms.getInt(String8(SUBMIX_PARAMETER_KEY_LATENCY_MS), latency_ms) == NO_ERROR) {
+        const struct submix_stream_out * const out = audio_stream_get_submix_stream_out(stream);
+        return submix_set_latency_target(&out->dev->routes[out->route_handle], latency_ms);
     }
     return 0;
 }
@@ -716,7 +820,7 @@ static uint32_t out_get_latency(const struct audio_stream_out *stream)
     const size_t stream_frame_size =
                             audio_stream_out_frame_size(stream);
     const size_t buffer_size_frames = calculate_stream_pipe_size_in_frames(
-            &stream->common, config, config->buffer_size_frames, stream_frame_size);
+            &stream->common, config, config->buffer_target_frames, stream_frame_size);
     const uint32_t sample_rate = out_get_sample_rate(&stream->common);
     const uint32_t latency_ms = (buffer_size_frames * 1000) / sample_rate;
     SUBMIX_ALOGV("out_get_latency() returns %u ms, size in frames %zu, sample rate %u",
@@ -741,97 +845,60 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
     const size_t frame_size = audio_stream_out_frame_size(stream);
     struct submix_stream_out * const out = audio_stream_out_get_submix_stream_out(stream);
     struct submix_audio_device * const rsxadev = out->dev;
+    pthread_mutex_t * const route_lock = &rsxadev->routes[out->route_handle].lock;
     const size_t frames = bytes / frame_size;
 
-    pthread_mutex_lock(&rsxadev->lock);
+    pthread_mutex_lock(route_lock);
 
     out->output_standby = false;
 
-    sp<MonoPipe> sink = rsxadev->routes[out->route_handle].rsxSink;
+    sp<SubmixPipe> sink = rsxadev->routes[out->route_handle].rsxSink;
     if (sink != NULL) {
         if (sink->isShutdown()) {
-            sink.clear();
-            pthread_mutex_unlock(&rsxadev->lock);
+            pthread_mutex_unlock(route_lock);
             SUBMIX_ALOGV("out_write(): pipe shutdown, ignoring the write.");
             // the pipe has already been shutdown, this buffer will be lost but we must
             //   simulate timing so we don't drain the output faster than realtime
-            usleep(frames * 1000000 / out_get_sample_rate(&stream->common));
+            sink->throttle(frames);
 
-            pthread_mutex_lock(&rsxadev->lock);
+            pthread_mutex_lock(route_lock);
+            sink.clear();
             out->frames_written += frames;
             out->frames_written_since_standby += frames;
-            pthread_mutex_unlock(&rsxadev->lock);
+            pthread_mutex_unlock(route_lock);
             return bytes;
         }
     } else {
-        pthread_mutex_unlock(&rsxadev->lock);
+        pthread_mutex_unlock(route_lock);
         ALOGE("out_write without a pipe!");
         ALOG_ASSERT("out_write without a pipe!");
         return 0;
     }
 
-    // If the write to the sink would block, flush enough frames
-    // from the pipe to make space to write the most recent data.
+    pthread_mutex_unlock(route_lock);
+
+    // The write only blocks while input streams that the output must wait for have not read
+    // enough, the oldest frames are dropped for the other input streams (without copying them).
     // We DO NOT block if:
     // - no peer input stream is present
-    // - the peer input is in standby AFTER having been active.
+    // - the peer inputs are in standby AFTER having been active, or don't block by policy.
     // We DO block if:
-    // - the input was never activated to avoid discarding first frames
+    // - a blocking input was never activated to avoid discarding first frames
     // in the pipe in case capture start was delayed
-    {
-        const size_t availableToWrite = sink->availableToWrite();
-        // NOTE: rsxSink has been checked above and sink and source life cycles are synchronized
-        sp<MonoPipeReader> source = rsxadev->routes[out->route_handle].rsxSource;
-        const struct submix_stream_in *in = rsxadev->routes[out->route_handle].input;
-        const bool dont_block = (in == NULL)
-                || (in->input_standby && (in->read_counter_frames_since_standby != 0));
-        if (dont_block && availableToWrite < frames) {
-            static uint8_t flush_buffer[64];
-            const size_t flushBufferSizeFrames = sizeof(flush_buffer) / frame_size;
-            size_t frames_to_flush_from_source = frames - availableToWrite;
-            SUBMIX_ALOGV("out_write(): flushing %llu frames from the pipe to avoid blocking",
-                    (unsigned long long)frames_to_flush_from_source);
-            while (frames_to_flush_from_source) {
-                const size_t flush_size = min(frames_to_flush_from_source, flushBufferSizeFrames);
-                frames_to_flush_from_source -= flush_size;
-                // read does not block
-                source->read(flush_buffer, flush_size);
-            }
-        }
-    }
-
-    pthread_mutex_unlock(&rsxadev->lock);
-
+    // See submix_stream_in_update_blocking_l().
     written_frames = sink->write(buffer, frames);
 
 #if LOG_STREAMS_TO_FILES
     if (out->log_fd >= 0) write(out->log_fd, buffer, written_frames * frame_size);
 #endif // LOG_STREAMS_TO_FILES
 
-    if (written_frames < 0) {
-        if (written_frames == (ssize_t)NEGOTIATE) {
-            ALOGE("out_write() write to pipe returned NEGOTIATE");
-
-            pthread_mutex_lock(&rsxadev->lock);
-            sink.clear();
-            pthread_mutex_unlock(&rsxadev->lock);
-
-            written_frames = 0;
-            return 0;
-        } else {
-            // write() returned UNDERRUN or WOULD_BLOCK, retry
-            ALOGE("out_write() write to pipe returned unexpected %zd", written_frames);
-            written_frames = sink->write(buffer, frames);
-        }
-    }
-
-    pthread_mutex_lock(&rsxadev->lock);
+    pthread_mutex_lock(route_lock);
     sink.clear();
     if (written_frames > 0) {
         out->frames_written_since_standby += written_frames;
         out->frames_written += written_frames;
     }
-    pthread_mutex_unlock(&rsxadev->lock);
+    pthread_mutex_unlock(route_lock);
 
     if (written_frames < 0) {
         ALOGE("out_write() failed writing to pipe with %zd", written_frames);
@@ -852,17 +919,19 @@ static int out_get_presentation_position(const struct audio_stream_out *stream,
     const submix_stream_out *out = audio_stream_out_get_submix_stream_out(
             const_cast<struct audio_stream_out *>(stream));
     struct submix_audio_device * const rsxadev = out->dev;
+    pthread_mutex_t * const route_lock = &rsxadev->routes[out->route_handle].lock;
 
     int ret = -EWOULDBLOCK;
-    pthread_mutex_lock(&rsxadev->lock);
-    sp<MonoPipeReader> source = rsxadev->routes[out->route_handle].rsxSource;
-    if (source == NULL) {
+    pthread_mutex_lock(route_lock);
+    sp<SubmixPipe> sink = rsxadev->routes[out->route_handle].rsxSink;
+    if (sink == NULL) {
         ALOGW("%s called on released output", __FUNCTION__);
-        pthread_mutex_unlock(&rsxadev->lock);
+        pthread_mutex_unlock(route_lock);
         return -ENODEV;
     }
 
-    const ssize_t frames_in_pipe = source->availableToRead();
+    // Frames not yet read by the input stream that is the furthest behind.
+    const ssize_t frames_in_pipe = sink->availableToRead();
     if (CC_UNLIKELY(frames_in_pipe < 0)) {
         *frames = out->frames_written;
         ret = 0;
@@ -870,7 +939,7 @@ static int out_get_presentation_position(const struct audio_stream_out *stream,
         *frames = out->frames_written - frames_in_pipe;
         ret = 0;
     }
-    pthread_mutex_unlock(&rsxadev->lock);
+    pthread_mutex_unlock(route_lock);
 
     if (ret == 0) {
         clock_gettime(CLOCK_MONOTONIC, timestamp);
@@ -893,23 +962,24 @@ static int out_get_render_position(const struct audio_stream_out *stream,
     const submix_stream_out *out = audio_stream_out_get_submix_stream_out(
             const_cast<struct audio_stream_out *>(stream));
     struct submix_audio_device * const rsxadev = out->dev;
+    pthread_mutex_t * const route_lock = &rsxadev->routes[out->route_handle].lock;
 
-    pthread_mutex_lock(&rsxadev->lock);
-    sp<MonoPipeReader> source = rsxadev->routes[out->route_handle].rsxSource;
-    if (source == NULL) {
+    pthread_mutex_lock(route_lock);
+    sp<SubmixPipe> sink = rsxadev->routes[out->route_handle].rsxSink;
+    if (sink == NULL) {
         ALOGW("%s called on released output", __FUNCTION__);
-        pthread_mutex_unlock(&rsxadev->lock);
+        pthread_mutex_unlock(route_lock);
         return -ENODEV;
     }
 
-    const ssize_t frames_in_pipe = source->availableToRead();
+    const ssize_t frames_in_pipe = sink->availableToRead();
     if (CC_UNLIKELY(frames_in_pipe < 0)) {
         *dsp_frames = (uint32_t)out->frames_written_since_standby;
     } else {
         *dsp_frames = out->frames_written_since_standby > (uint64_t) frames_in_pipe ?
                 (uint32_t)(out->frames_written_since_standby - frames_in_pipe) : 0;
     }
-    pthread_mutex_unlock(&rsxadev->lock);
+    pthread_mutex_unlock(route_lock);
 
     return 0;
 }
@@ -941,19 +1011,37 @@ static uint32_t in_get_sample_rate(const struct audio_stream *stream)
 {
     const struct submix_stream_in * const in = audio_stream_get_submix_stream_in(
         const_cast<struct audio_stream*>(stream));
-    const uint32_t rate = in->dev->routes[in->route_handle].config.common.sample_rate;
+    const uint32_t rate = in->sample_rate;
     SUBMIX_ALOGV("in_get_sample_rate() returns %u", rate);
     return rate;
 }
 
 static int in_set_sample_rate(struct audio_stream *stream, uint32_t rate)
 {
-    const struct submix_stream_in * const in = audio_stream_get_submix_stream_in(stream);
+    struct submix_stream_in * const in = audio_stream_get_submix_stream_in(stream);
     if (!sample_rate_supported(rate)) {
         ALOGE("in_set_sample_rate(rate=%u) rate unsupported", rate);
         return -ENOSYS;
     }
-    in->dev->routes[in->route_handle].config.common.sample_rate = rate;
+    pthread_mutex_t * const route_lock = &in->dev->routes[in->route_handle].lock;
+    pthread_mutex_lock(&in->reader_lock);
+    pthread_mutex_lock(route_lock);
+    const uint32_t pipe_rate = in->dev->routes[in->route_handle].config.common.sample_rate;
+    if (rate != pipe_rate && (rate > MAX_RESAMPLING_RATE_HZ || pipe_rate > MAX_RESAMPLING_RATE_HZ)) {
+        ALOGE("in_set_sample_rate(rate=%u) can't convert from %u", rate, pipe_rate);
+        pthread_mutex_unlock(route_lock);
+        pthread_mutex_unlock(&in->reader_lock);
+        return -ENOSYS;
+    }
+    in->sample_rate = rate;
+    // Reconfigure the read end in place so that it carries on from its position in the pipe,
+    // the reader lock keeps in_read() from using it meanwhile.
+    const sp<SubmixPipe> sink = in->dev->routes[in->route_handle].rsxSink;
+    if (in->reader != NULL && sink != NULL) {
+        in->reader->setSampleRate(rate, sink->frameSize() / sizeof(int16_t));
+    }
+    pthread_mutex_unlock(route_lock);
+    pthread_mutex_unlock(&in->reader_lock);
     SUBMIX_ALOGV("in_set_sample_rate() set %u", rate);
     return 0;
 }
@@ -965,8 +1053,11 @@ static size_t in_get_buffer_size(const struct audio_stream *stream)
     const struct submix_config * const config = &in->dev->routes[in->route_handle].config;
     const size_t stream_frame_size =
                             audio_stream_in_frame_size((const struct audio_stream_in *)stream);
+    // The period of the pipe, at the sample rate of the stream.
+    const size_t period_size_frames = (uint64_t)config->buffer_period_size_frames *
+            in->sample_rate / config->common.sample_rate;
     size_t buffer_size_frames = calculate_stream_pipe_size_in_frames(
-        stream, config, config->buffer_period_size_frames, stream_frame_size);
+        stream, config, period_size_frames, stream_frame_size);
     const size_t buffer_size_bytes = buffer_size_frames * stream_frame_size;
     SUBMIX_ALOGV("in_get_buffer_size() returns %zu bytes, %zu frames", buffer_size_bytes,
                  buffer_size_frames);
@@ -1008,12 +1099,14 @@ static int in_standby(struct audio_stream *stream)
     ALOGI("in_standby()");
     struct submix_stream_in * const in = audio_stream_get_submix_stream_in(stream);
     struct submix_audio_device * const rsxadev = in->dev;
+    pthread_mutex_t * const route_lock = &rsxadev->routes[in->route_handle].lock;
 
-    pthread_mutex_lock(&rsxadev->lock);
+    pthread_mutex_lock(route_lock);
 
     in->input_standby = true;
+    submix_stream_in_update_blocking_l(in);
 
-    pthread_mutex_unlock(&rsxadev->lock);
+    pthread_mutex_unlock(route_lock);
 
     return 0;
 }
@@ -1027,8 +1120,32 @@ static int in_dump(const struct audio_stream *stream, int fd)
 
 static int in_set_parameters(struct audio_stream *stream, const char *kvpairs)
 {
-    (void)stream;
-    (void)kvpairs;
+    AudioParameter parms = AudioParameter(String8(kvpairs));
+    SUBMIX_ALOGV("in_set_parameters() kvpairs='%s'", kvpairs);
+
+    struct submix_stream_in * const in = audio_stream_get_submix_stream_in(stream);
+    String8 overflow;
+    if (parms.get(String8(SUBMIX_PARAMETER_KEY_OVERFLOW), overflow) == NO_ERROR) {
+        bool blocking_reader;
+        if (strcmp(overflow.c_str(), SUBMIX_PARAMETER_VALUE_BLOCK) == 0) {
+            blocking_reader = true;
+        } else if (strcmp(overflow.c_str(), SUBMIX_PARAMETER_VALUE_DROP) == 0) {
+            blocking_reader = false;
+        } else {
+            ALOGE("in_set_parameters() invalid %s value %s", SUBMIX_PARAMETER_KEY_OVERFLOW,
+                  overflow.c_str());
+            return -EINVAL;
+        }
+        pthread_mutex_t * const route_lock = &in->dev->routes[in->route_handle].lock;
+        pthread_mutex_lock(route_lock);
+        in->blocking_reader = blocking_reader;
+        submix_stream_in_update_blocking_l(in);
+        pthread_mutex_unlock(route_lock);
+    }
+    int latency_ms = -1;
+    if (parms.getInt(String8(SUBMIX_PARAMETER_KEY_LATENCY_MS), latency_ms) == NO_ERROR) {
+        return submix_set_latency_target(&in->dev->routes[in->route_handle], latency_ms);
+    }
     return 0;
 }
 
@@ -1052,11 +1169,13 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
 {
     struct submix_stream_in * const in = audio_stream_in_get_submix_stream_in(stream);
     struct submix_audio_device * const rsxadev = in->dev;
+    pthread_mutex_t * const route_lock = &rsxadev->routes[in->route_handle].lock;
     const size_t frame_size = audio_stream_in_frame_size(stream);
     const size_t frames_to_read = bytes / frame_size;
 
     SUBMIX_ALOGV("in_read bytes=%zu", bytes);
-    pthread_mutex_lock(&rsxadev->lock);
+    pthread_mutex_lock(&in->reader_lock);
+    pthread_mutex_lock(route_lock);
 
     const bool output_standby = rsxadev->routes[in->route_handle].output == NULL
             ? true : rsxadev->routes[in->route_handle].output->output_standby;
@@ -1071,6 +1190,7 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
         if (rc == 0) {
             in->read_counter_frames_since_standby = 0;
         }
+        submix_stream_in_update_blocking_l(in);
     }
 
     in->read_counter_frames += frames_to_read;
@@ -1079,18 +1199,19 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
 
     {
         // about to read from audio source
-        sp<MonoPipeReader> source = rsxadev->routes[in->route_handle].rsxSource;
+        sp<SubmixPipeReader> source = in->reader;
         if (source == NULL) {
             in->read_error_count++;// ok if it rolls over
             ALOGE_IF(in->read_error_count < MAX_READ_ERROR_LOGS,
                     "no audio pipe yet we're trying to read! (not all errors will be logged)");
-            pthread_mutex_unlock(&rsxadev->lock);
+            pthread_mutex_unlock(route_lock);
+            pthread_mutex_unlock(&in->reader_lock);
             usleep(frames_to_read * 1000000 / in_get_sample_rate(&stream->common));
             memset(buffer, 0, bytes);
             return bytes;
         }
 
-        pthread_mutex_unlock(&rsxadev->lock);
+        pthread_mutex_unlock(route_lock);
 
         // read the data from the pipe (it's non blocking)
         int attempts = 0;
@@ -1122,9 +1243,10 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
             }
         }
         // done using the source
-        pthread_mutex_lock(&rsxadev->lock);
+        pthread_mutex_lock(route_lock);
         source.clear();
-        pthread_mutex_unlock(&rsxadev->lock);
+        pthread_mutex_unlock(route_lock);
+        pthread_mutex_unlock(&in->reader_lock);
     }
 
     if (remaining_frames > 0) {
@@ -1187,17 +1309,24 @@ static int in_get_capture_position(const struct audio_stream_in *stream,
     struct submix_stream_in * const in = audio_stream_in_get_submix_stream_in(
             (struct audio_stream_in*)stream);
     struct submix_audio_device * const rsxadev = in->dev;
+    pthread_mutex_t * const route_lock = &rsxadev->routes[in->route_handle].lock;
 
-    pthread_mutex_lock(&rsxadev->lock);
-    sp<MonoPipeReader> source = rsxadev->routes[in->route_handle].rsxSource;
+    // The reader lock keeps in_read() from changing the state of the reader, and the frame
+    // counter with it, while they are sampled.
+    pthread_mutex_lock(&in->reader_lock);
+    pthread_mutex_lock(route_lock);
+    sp<SubmixPipeReader> source = in->reader;
     if (source == NULL) {
         ALOGW("%s called on released input", __FUNCTION__);
-        pthread_mutex_unlock(&rsxadev->lock);
+        pthread_mutex_unlock(route_lock);
+        pthread_mutex_unlock(&in->reader_lock);
         return -ENODEV;
     }
     *frames = in->read_counter_frames;
     const ssize_t frames_in_pipe = source->availableToRead();
-    pthread_mutex_unlock(&rsxadev->lock);
+    source.clear();
+    pthread_mutex_unlock(route_lock);
+    pthread_mutex_unlock(&in->reader_lock);
     if (frames_in_pipe > 0) {
         *frames += frames_in_pipe;
     }
@@ -1257,14 +1386,19 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
         return res;
     }
 
+    pthread_mutex_t * const route_lock = &rsxadev->routes[route_idx].lock;
+    pthread_mutex_lock(route_lock);
+
     if (!submix_open_validate_l(rsxadev, route_idx, config, false)) {
         ALOGE("adev_open_output_stream(): Unable to open output stream for address %s", address);
+        pthread_mutex_unlock(route_lock);
         pthread_mutex_unlock(&rsxadev->lock);
         return -EINVAL;
     }
 
     out = (struct submix_stream_out *)calloc(1, sizeof(struct submix_stream_out));
     if (!out) {
+        pthread_mutex_unlock(route_lock);
         pthread_mutex_unlock(&rsxadev->lock);
         return -ENOMEM;
     }
@@ -1289,10 +1423,12 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     out->stream.get_next_write_timestamp = out_get_next_write_timestamp;
     out->stream.get_presentation_position = out_get_presentation_position;
 
-    // If the sink has been shutdown or pipe recreation is forced (see above), delete the pipe so
-    // that it's recreated.
+    // If the sink has been shutdown, or only carries audio from a previous output at another
+    // sample rate, delete the pipe so that it's recreated at the rate of this output.  The input
+    // streams get a new read end converting to their rate.
     if ((rsxadev->routes[route_idx].rsxSink != NULL
-            && rsxadev->routes[route_idx].rsxSink->isShutdown())) {
+            && (rsxadev->routes[route_idx].rsxSink->isShutdown() ||
+                rsxadev->routes[route_idx].rsxSink->sampleRate() != config->sample_rate))) {
         submix_audio_device_release_pipe_l(rsxadev, route_idx);
     }
 
@@ -1314,6 +1450,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     // Return the output stream.
     *stream_out = &out->stream;
 
+    pthread_mutex_unlock(route_lock);
     pthread_mutex_unlock(&rsxadev->lock);
     return 0;
 }
@@ -1325,13 +1462,17 @@ static void adev_close_output_stream(struct audio_hw_device *dev,
                     const_cast<struct audio_hw_device*>(dev));
     struct submix_stream_out * const out = audio_stream_out_get_submix_stream_out(stream);
 
+    pthread_mutex_t * const route_lock = &rsxadev->routes[out->route_handle].lock;
+
     pthread_mutex_lock(&rsxadev->lock);
+    pthread_mutex_lock(route_lock);
     ALOGD("adev_close_output_stream() addr = %s", rsxadev->routes[out->route_handle].address);
     submix_audio_device_destroy_pipe_l(audio_hw_device_get_submix_audio_device(dev), NULL, out);
 #if LOG_STREAMS_TO_FILES
     if (out->log_fd >= 0) close(out->log_fd);
 #endif // LOG_STREAMS_TO_FILES
 
+    pthread_mutex_unlock(route_lock);
     pthread_mutex_unlock(&rsxadev->lock);
     free(out);
 }
@@ -1476,67 +1617,51 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
         return res;
     }
 
+    pthread_mutex_t * const route_lock = &rsxadev->routes[route_idx].lock;
+    pthread_mutex_lock(route_lock);
+
     // Make sure it's possible to open the device given the current audio config.
     submix_sanitize_config(config, true);
     if (!submix_open_validate_l(rsxadev, route_idx, config, true)) {
         ALOGE("adev_open_input_stream(): Unable to open input stream.");
+        pthread_mutex_unlock(route_lock);
         pthread_mutex_unlock(&rsxadev->lock);
         return -EINVAL;
     }
 
-#if ENABLE_LEGACY_INPUT_OPEN
-    in = rsxadev->routes[route_idx].input;
-    if (in) {
-        in->ref_count++;
-        sp<MonoPipe> sink = rsxadev->routes[route_idx].rsxSink;
-        ALOG_ASSERT(sink != NULL);
-        // If the sink has been shutdown, delete the pipe.
-        if (sink != NULL) {
-            if (sink->isShutdown()) {
-                ALOGD(" Non-NULL shut down sink when opening input stream, releasing, refcount=%d",
-                        in->ref_count);
-                submix_audio_device_release_pipe_l(rsxadev, in->route_handle);
-            } else {
-                ALOGD(" Non-NULL sink when opening input stream, refcount=%d", in->ref_count);
-            }
-        } else {
-            ALOGE("NULL sink when opening input stream, refcount=%d", in->ref_count);
-        }
-    }
-#else
-    in = NULL;
-#endif // ENABLE_LEGACY_INPUT_OPEN
-
+    in = (struct submix_stream_in *)calloc(1, sizeof(struct submix_stream_in));
     if (!in) {
-        in = (struct submix_stream_in *)calloc(1, sizeof(struct submix_stream_in));
-        if (!in) return -ENOMEM;
-#if ENABLE_LEGACY_INPUT_OPEN
-        in->ref_count = 1;
-#endif
+        pthread_mutex_unlock(route_lock);
+        pthread_mutex_unlock(&rsxadev->lock);
+        return -ENOMEM;
+    }
 
-        // Initialize the function pointer tables (v-tables).
-        in->stream.common.get_sample_rate = in_get_sample_rate;
-        in->stream.common.set_sample_rate = in_set_sample_rate;
-        in->stream.common.get_buffer_size = in_get_buffer_size;
-        in->stream.common.get_channels = in_get_channels;
-        in->stream.common.get_format = in_get_format;
-        in->stream.common.set_format = in_set_format;
-        in->stream.common.standby = in_standby;
-        in->stream.common.dump = in_dump;
-        in->stream.common.set_parameters = in_set_parameters;
-        in->stream.common.get_parameters = in_get_parameters;
-        in->stream.common.add_audio_effect = in_add_audio_effect;
-        in->stream.common.remove_audio_effect = in_remove_audio_effect;
-        in->stream.set_gain = in_set_gain;
-        in->stream.read = in_read;
-        in->stream.get_input_frames_lost = in_get_input_frames_lost;
-        in->stream.get_capture_position = in_get_capture_position;
-
-        in->dev = rsxadev;
+    // Initialize the function pointer tables (v-tables).
+    in->stream.common.get_sample_rate = in_get_sample_rate;
+    in->stream.common.set_sample_rate = in_set_sample_rate;
+    in->stream.common.get_buffer_size = in_get_buffer_size;
+    in->stream.common.get_channels = in_get_channels;
+    in->stream.common.get_format = in_get_format;
+    in->stream.common.set_format = in_set_format;
+    in->stream.common.standby = in_standby;
+    in->stream.common.dump = in_dump;
+    in->stream.common.set_parameters = in_set_parameters;
+    in->stream.common.get_parameters = in_get_parameters;
+    in->stream.common.add_audio_effect = in_add_audio_effect;
+    in->stream.common.remove_audio_effect = in_remove_audio_effect;
+    in->stream.set_gain = in_set_gain;
+    in->stream.read = in_read;
+    in->stream.get_input_frames_lost = in_get_input_frames_lost;
+    in->stream.get_capture_position = in_get_capture_position;
+
+    in->dev = rsxadev;
+    pthread_mutex_init(&in->reader_lock, NULL);
+    in->sample_rate = config->sample_rate;
 #if LOG_STREAMS_TO_FILES
-        in->log_fd = -1;
+    in->log_fd = -1;
 #endif
-    }
+    // Only the first input stream of the route makes the output wait for it by default.
+    in->blocking_reader = submix_route_input_count_l(&rsxadev->routes[route_idx]) == 0;
 
     // Initialize the input stream.
     in->read_counter_frames = 0;
@@ -1556,7 +1681,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     submix_audio_device_create_pipe_l(rsxadev, config, pipeSizeInFrames,
                                     DEFAULT_PIPE_PERIOD_COUNT, in, NULL, address, route_idx);
 
-    sp <MonoPipe> sink = rsxadev->routes[route_idx].rsxSink;
+    sp <SubmixPipe> sink = rsxadev->routes[route_idx].rsxSink;
     if (sink != NULL) {
         sink->shutdown(false);
     }
@@ -1572,6 +1697,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     // Return the input stream.
     *stream_in = &in->stream;
 
+    pthread_mutex_unlock(route_lock);
     pthread_mutex_unlock(&rsxadev->lock);
     return 0;
 }
@@ -1582,18 +1708,18 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
     struct submix_audio_device * const rsxadev = audio_hw_device_get_submix_audio_device(dev);
 
     struct submix_stream_in * const in = audio_stream_in_get_submix_stream_in(stream);
+    pthread_mutex_t * const route_lock = &rsxadev->routes[in->route_handle].lock;
     ALOGD("adev_close_input_stream()");
     pthread_mutex_lock(&rsxadev->lock);
+    pthread_mutex_lock(route_lock);
     submix_audio_device_destroy_pipe_l(rsxadev, in, NULL);
 #if LOG_STREAMS_TO_FILES
     if (in->log_fd >= 0) close(in->log_fd);
 #endif // LOG_STREAMS_TO_FILES
-#if ENABLE_LEGACY_INPUT_OPEN
-    if (in->ref_count == 0) free(in);
-#else
+    pthread_mutex_destroy(&in->reader_lock);
     free(in);
-#endif // ENABLE_LEGACY_INPUT_OPEN
 
+    pthread_mutex_unlock(route_lock);
     pthread_mutex_unlock(&rsxadev->lock);
 }
 
@@ -1607,9 +1733,10 @@ static int adev_dump(const audio_hw_device_t *device, int fd)
     int n = snprintf(msg, sizeof(msg), "\nReroute submix audio module:\n");
     write(fd, &msg, n);
     for (int i=0 ; i < MAX_ROUTES ; i++) {
-        n = snprintf(msg, sizeof(msg), " route[%d], rate=%d addr=[%s]\n", i,
+        n = snprintf(msg, sizeof(msg), " route[%d], rate=%d addr=[%s] inputs=%zu\n", i,
                 rsxadev->routes[i].config.common.sample_rate,
-                rsxadev->routes[i].address);
+                rsxadev->routes[i].address,
+                submix_route_input_count_l(&rsxadev->routes[i]));
         write(fd, &msg, n);
     }
     return 0;
@@ -1618,6 +1745,12 @@ static int adev_dump(const audio_hw_device_t *device, int fd)
 static int adev_close(hw_device_t *device)
 {
     ALOGI("adev_close()");
+    struct submix_audio_device * const rsxadev = audio_hw_device_get_submix_audio_device(
+            reinterpret_cast<struct audio_hw_device *>(device));
+    for (int i=0 ; i < MAX_ROUTES ; i++) {
+        pthread_mutex_destroy(&rsxadev->routes[i].lock);
+    }
+    pthread_mutex_destroy(&rsxadev->lock);
     free(device);
     return 0;
 }
@@ -1658,9 +1791,11 @@ static int adev_open(const hw_module_t* module, const char* name,
     rsxadev->device.close_input_stream = adev_close_input_stream;
     rsxadev->device.dump = adev_dump;
 
+    pthread_mutex_init(&rsxadev->lock, NULL);
     for (int i=0 ; i < MAX_ROUTES ; i++) {
             memset(&rsxadev->routes[i], 0, sizeof(route_config));
             strcpy(rsxadev->routes[i].address, "");
+            pthread_mutex_init(&rsxadev->routes[i].lock, NULL);
         }
 
     *device = &rsxadev->device.common;
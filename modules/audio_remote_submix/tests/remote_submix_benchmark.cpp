@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the time taken to write and read audio through several routes of the remote submix
+// HAL at the same time, one thread per route. Routes that do not serialize against each other
+// take about as long together as a single route alone.
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <hardware/audio.h>
+
+static const size_t kBufferSize = 1024;
+static const size_t kRepeats = 32;
+
+static void BM_ConcurrentRoutes(benchmark::State& state) {
+    const size_t routeCount = state.range(0);
+    const hw_module_t* mod;
+    audio_hw_device_t* dev;
+    if (hw_get_module_by_class(AUDIO_HARDWARE_MODULE_ID, AUDIO_HARDWARE_MODULE_ID_REMOTE_SUBMIX,
+            &mod) != 0 || audio_hw_device_open(mod, &dev) != 0) {
+        state.SkipWithError("could not open the remote submix HAL");
+        return;
+    }
+
+    std::vector<audio_stream_out_t*> streamOut(routeCount);
+    std::vector<audio_stream_in_t*> streamIn(routeCount);
+    for (size_t i = 0; i < routeCount; ++i) {
+        const std::string address = std::to_string(i + 1);
+        struct audio_config configOut = {};
+        configOut.channel_mask = AUDIO_CHANNEL_OUT_MONO;
+        configOut.sample_rate = 48000;
+        struct audio_config configIn = {};
+        configIn.channel_mask = AUDIO_CHANNEL_IN_MONO;
+        configIn.sample_rate = 48000;
+        if (dev->open_output_stream(dev, AUDIO_IO_HANDLE_NONE, AUDIO_DEVICE_NONE,
+                    AUDIO_OUTPUT_FLAG_NONE, &configOut, &streamOut[i], address.c_str()) != 0 ||
+                dev->open_input_stream(dev, AUDIO_IO_HANDLE_NONE, AUDIO_DEVICE_NONE, &configIn,
+                    &streamIn[i], AUDIO_INPUT_FLAG_NONE, address.c_str(),
+                    AUDIO_SOURCE_DEFAULT) != 0) {
+            state.SkipWithError("could not open the streams");
+            return;
+        }
+    }
+
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < routeCount; ++i) {
+            threads.emplace_back([&, i]() {
+                std::unique_ptr<char[]> buffer(new char[kBufferSize]());
+                for (size_t repeat = 0; repeat < kRepeats; ++repeat) {
+                    streamOut[i]->write(streamOut[i], buffer.get(), kBufferSize);
+                    streamIn[i]->read(streamIn[i], buffer.get(), kBufferSize);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * routeCount * kRepeats * kBufferSize);
+
+    for (size_t i = 0; i < routeCount; ++i) {
+        dev->close_input_stream(dev, streamIn[i]);
+        dev->close_output_stream(dev, streamOut[i]);
+    }
+    audio_hw_device_close(dev);
+}
+// 10 is MAX_ROUTES in the HAL module.
+BENCHMARK(BM_ConcurrentRoutes)->Arg(1)->Arg(10)->UseRealTime();
+
+BENCHMARK_MAIN();
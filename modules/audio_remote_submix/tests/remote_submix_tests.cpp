@@ -21,7 +21,12 @@
 
 #define LOG_TAG "RemoteSubmixTest"
 
+#include <chrono>
+#include <math.h>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <hardware/audio.h>
@@ -71,6 +76,8 @@ class RemoteSubmixTest : public testing::Test {
     void OpenOutputStream(
             const char* address, bool mono, uint32_t sampleRate, audio_stream_out_t** streamOut);
     void ReadFromStream(audio_stream_in_t* streamIn, char* buffer, size_t bufferSize);
+    void ResampleSine(uint32_t outRate, uint32_t inRate, double frequency, size_t periods,
+            std::vector<int16_t>* captured);
     void VerifyBufferAllZeroes(char* buffer, size_t bufferSize);
     void VerifyBufferNotZeroes(char* buffer, size_t bufferSize);
     void VerifyOutputInput(
@@ -135,6 +142,37 @@ void RemoteSubmixTest::ReadFromStream(
     EXPECT_EQ(bufferSize, static_cast<size_t>(result));
 }
 
+// Plays a sine at the frequency through a mono route at outRate and captures it at inRate, 10ms
+// at a time.  Returns the last periods of 10ms captured, once the resampler has settled.
+void RemoteSubmixTest::ResampleSine(uint32_t outRate, uint32_t inRate, double frequency,
+        size_t periods, std::vector<int16_t>* captured) {
+    const char* address = "1";
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(address, true /*mono*/, outRate, &streamOut);
+    audio_stream_in_t* streamIn;
+    OpenInputStream(address, true /*mono*/, inRate, &streamIn);
+    const size_t settlePeriods = 5;
+    const size_t outFrames = outRate / 100, inFrames = inRate / 100;
+    std::vector<int16_t> outBuffer(outFrames), inBuffer(inFrames);
+    captured->clear();
+    size_t frame = 0;
+    for (size_t period = 0; period < settlePeriods + periods; ++period) {
+        for (size_t i = 0; i < outFrames; ++i, ++frame) {
+            outBuffer[i] = static_cast<int16_t>(
+                    lround(16384 * sin(2 * M_PI * frequency * frame / outRate)));
+        }
+        WriteIntoStream(streamOut, reinterpret_cast<char*>(outBuffer.data()),
+                outFrames * sizeof(int16_t));
+        ReadFromStream(streamIn, reinterpret_cast<char*>(inBuffer.data()),
+                inFrames * sizeof(int16_t));
+        if (period >= settlePeriods) {
+            captured->insert(captured->end(), inBuffer.begin(), inBuffer.end());
+        }
+    }
+    mDev->close_input_stream(mDev, streamIn);
+    mDev->close_output_stream(mDev, streamOut);
+}
+
 void RemoteSubmixTest::VerifyBufferAllZeroes(char* buffer, size_t bufferSize) {
     for (size_t i = 0; i < bufferSize; ++i) {
         if (buffer[i]) {
@@ -197,6 +235,48 @@ TEST_F(RemoteSubmixTest, OutputDoesNotBlockWhenNoInput) {
     mDev->close_output_stream(mDev, streamOut);
 }
 
+// Verifies that without an input, writing into an output stream still takes real time: a write
+// of more audio than the pipe holds returns about when the audio beyond the pipe has played.
+TEST_F(RemoteSubmixTest, OutputIsPacedWhenNoInput) {
+    const char* address = "1";
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(address, true /*mono*/, 48000, &streamOut);
+    ASSERT_EQ(0, streamOut->common.set_parameters(&streamOut->common, "r_submix_latency_ms=30"));
+    const uint32_t latencyMs = streamOut->get_latency(streamOut);
+    // 160ms of mono 16-bit audio at 48kHz
+    const size_t frames = 7680;
+    const auto start = std::chrono::steady_clock::now();
+    WriteSomethingIntoStream(streamOut, frames * sizeof(int16_t), 1);
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    EXPECT_GE(elapsedMs, static_cast<long long>(frames * 1000 / 48000 - latencyMs));
+    mDev->close_output_stream(mDev, streamOut);
+}
+
+// Verifies that with the input in standby after having captured, writing into the output stream
+// takes as long as the audio written takes to play.
+TEST_F(RemoteSubmixTest, OutputIsPacedWhenInputInStandby) {
+    const char* address = "1";
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(address, true /*mono*/, 48000, &streamOut);
+    audio_stream_in_t* streamIn;
+    OpenInputStream(address, true /*mono*/, 48000, &streamIn);
+    const size_t bufferSize = 1024;
+    VerifyOutputInput(streamOut, bufferSize, streamIn, bufferSize, 1);
+    EXPECT_EQ(0, streamIn->common.standby(&streamIn->common));
+    const uint32_t latencyMs = streamOut->get_latency(streamOut);
+    // 16 buffers of 512 mono 16-bit frames at 48kHz, about 170ms
+    const size_t repeats = 16;
+    const auto start = std::chrono::steady_clock::now();
+    WriteSomethingIntoStream(streamOut, bufferSize, repeats);
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    EXPECT_GE(elapsedMs,
+            static_cast<long long>(repeats * (bufferSize / 2) * 1000 / 48000 - latencyMs));
+    mDev->close_input_stream(mDev, streamIn);
+    mDev->close_output_stream(mDev, streamOut);
+}
+
 // Verifies that when input is opened but not reading, writing into an output stream does not block.
 // !!! Currently does not finish because requires setting a parameter from another thread !!!
 // TEST_F(RemoteSubmixTest, OutputDoesNotBlockWhenInputStuck) {
@@ -222,6 +302,49 @@ TEST_F(RemoteSubmixTest, OutputAndInput) {
     mDev->close_output_stream(mDev, streamOut);
 }
 
+// Verifies that every input stream open on an address captures all the output.
+TEST_F(RemoteSubmixTest, OutputToMultipleInputs) {
+    const char* address = "1";
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(address, true /*mono*/, 48000, &streamOut);
+    const size_t streamInCount = 3;
+    audio_stream_in_t* streamIn[streamInCount];
+    for (size_t i = 0; i < streamInCount; ++i) {
+        OpenInputStream(address, true /*mono*/, 48000, &streamIn[i]);
+    }
+    const size_t bufferSize = 1024;
+    std::unique_ptr<char[]> outBuffer(new char[bufferSize]), inBuffer(new char[bufferSize]);
+    for (size_t repeat = 0; repeat < 16; ++repeat) {
+        GenerateData(outBuffer.get(), bufferSize);
+        outBuffer[0] = static_cast<char>(repeat);
+        WriteIntoStream(streamOut, outBuffer.get(), bufferSize);
+        for (size_t i = 0; i < streamInCount; ++i) {
+            memset(inBuffer.get(), 0, bufferSize);
+            ReadFromStream(streamIn[i], inBuffer.get(), bufferSize);
+            ASSERT_EQ(0, memcmp(outBuffer.get(), inBuffer.get(), bufferSize));
+        }
+    }
+    for (size_t i = 0; i < streamInCount; ++i) {
+        mDev->close_input_stream(mDev, streamIn[i]);
+    }
+    mDev->close_output_stream(mDev, streamOut);
+}
+
+// Verifies that an input stream which does not read does not block the output when it is set to
+// drop the audio it does not read fast enough.
+TEST_F(RemoteSubmixTest, OutputDoesNotBlockOnDroppingInput) {
+    const char* address = "1";
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(address, true /*mono*/, 48000, &streamOut);
+    audio_stream_in_t* streamIn;
+    OpenInputStream(address, true /*mono*/, 48000, &streamIn);
+    EXPECT_EQ(0, streamIn->common.set_parameters(&streamIn->common, "r_submix_overflow=drop"));
+    EXPECT_NE(0, streamIn->common.set_parameters(&streamIn->common, "r_submix_overflow=maybe"));
+    WriteSomethingIntoStream(streamOut, 1024, 16);
+    mDev->close_input_stream(mDev, streamIn);
+    mDev->close_output_stream(mDev, streamOut);
+}
+
 // Verifies that reading and writing into a closed stream fails gracefully.
 TEST_F(RemoteSubmixTest, OutputAndInputAfterClose) {
     const char* address = "1";
@@ -300,7 +423,7 @@ TEST_F(RemoteSubmixTest, StereoToMonoConversion) {
     mDev->close_output_stream(mDev, streamOut);
 }
 
-// This requires ENABLE_RESAMPLING to be set in the HAL module
+// Verifies that an input stream can capture at a sample rate other than the rate of the output.
 TEST_F(RemoteSubmixTest, OutputAndInputResampling) {
     const char* address = "1";
     audio_stream_out_t* streamOut;
@@ -313,7 +436,38 @@ TEST_F(RemoteSubmixTest, OutputAndInputResampling) {
     mDev->close_output_stream(mDev, streamOut);
 }
 
-// This requires ENABLE_LEGACY_INPUT_OPEN to be set in the HAL module
+// Verifies that input streams at different sample rates can capture the same output, whichever
+// of the input and output streams is opened first.
+TEST_F(RemoteSubmixTest, OutputToInputsAtDifferentRates) {
+    const char* address = "1";
+    audio_stream_in_t* streamIn16k;
+    OpenInputStream(address, true /*mono*/, 16000, &streamIn16k);
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(address, true /*mono*/, 48000, &streamOut);
+    audio_stream_in_t* streamIn48k;
+    OpenInputStream(address, true /*mono*/, 48000, &streamIn48k);
+    EXPECT_EQ(16000u, streamIn16k->common.get_sample_rate(&streamIn16k->common));
+    EXPECT_EQ(48000u, streamIn48k->common.get_sample_rate(&streamIn48k->common));
+    EXPECT_LT(streamIn16k->common.get_buffer_size(&streamIn16k->common),
+              streamIn48k->common.get_buffer_size(&streamIn48k->common));
+    const size_t bufferSize = 1536;
+    std::unique_ptr<char[]> outBuffer(new char[bufferSize]), inBuffer(new char[bufferSize]);
+    GenerateData(outBuffer.get(), bufferSize);
+    for (size_t repeat = 0; repeat < 16; ++repeat) {
+        WriteIntoStream(streamOut, outBuffer.get(), bufferSize);
+        memset(inBuffer.get(), 0, bufferSize);
+        ReadFromStream(streamIn48k, inBuffer.get(), bufferSize);
+        ASSERT_EQ(0, memcmp(outBuffer.get(), inBuffer.get(), bufferSize));
+        memset(inBuffer.get(), 0, bufferSize / 3);
+        ReadFromStream(streamIn16k, inBuffer.get(), bufferSize / 3);
+        VerifyBufferNotZeroes(inBuffer.get(), bufferSize / 3);
+    }
+    mDev->close_input_stream(mDev, streamIn48k);
+    mDev->close_input_stream(mDev, streamIn16k);
+    mDev->close_output_stream(mDev, streamOut);
+}
+
+// Verifies that several input streams can be open on the same address.
 TEST_F(RemoteSubmixTest, OpenInputMultipleTimes) {
     const char* address = "1";
     audio_stream_out_t* streamOut;
@@ -330,3 +484,141 @@ TEST_F(RemoteSubmixTest, OpenInputMultipleTimes) {
     }
     mDev->close_output_stream(mDev, streamOut);
 }
+
+// Verifies that streams on different routes can be used concurrently, each input stream
+// capturing all the audio of the output stream of its route and nothing from the other routes.
+// See r_submix_benchmark for the time this takes.
+TEST_F(RemoteSubmixTest, ConcurrentRoutes) {
+    const size_t routeCount = 10;  // MAX_ROUTES in the HAL module
+    const size_t bufferSize = 1024;
+    const size_t repeats = 32;
+    audio_stream_out_t* streamOut[routeCount];
+    audio_stream_in_t* streamIn[routeCount];
+    std::vector<std::string> addresses;
+    for (size_t i = 0; i < routeCount; ++i) {
+        addresses.push_back(std::to_string(i + 1));
+    }
+    for (size_t i = 0; i < routeCount; ++i) {
+        OpenOutputStream(addresses[i].c_str(), true /*mono*/, 48000, &streamOut[i]);
+        OpenInputStream(addresses[i].c_str(), true /*mono*/, 48000, &streamIn[i]);
+    }
+
+    size_t bytesRead[routeCount] = {};
+    size_t mismatches[routeCount] = {};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < routeCount; ++i) {
+        threads.emplace_back([&, i]() {
+            std::unique_ptr<char[]> outBuffer(new char[bufferSize]),
+                    inBuffer(new char[bufferSize]);
+            for (size_t repeat = 0; repeat < repeats; ++repeat) {
+                // Tell the routes and the buffers apart.
+                memset(outBuffer.get(), static_cast<int>(i + 1), bufferSize);
+                outBuffer[0] = static_cast<char>(repeat);
+                streamOut[i]->write(streamOut[i], outBuffer.get(), bufferSize);
+                memset(inBuffer.get(), 0, bufferSize);
+                const ssize_t result = streamIn[i]->read(streamIn[i], inBuffer.get(), bufferSize);
+                if (result > 0) {
+                    bytesRead[i] += result;
+                }
+                if (memcmp(outBuffer.get(), inBuffer.get(), bufferSize) != 0) {
+                    mismatches[i]++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < routeCount; ++i) {
+        EXPECT_EQ(bufferSize * repeats, bytesRead[i]) << "route " << addresses[i];
+        EXPECT_EQ(0U, mismatches[i]) << "route " << addresses[i];
+    }
+
+    for (size_t i = 0; i < routeCount; ++i) {
+        mDev->close_input_stream(mDev, streamIn[i]);
+        mDev->close_output_stream(mDev, streamOut[i]);
+    }
+}
+
+// Verifies that the latency target of a route can be lowered, and that writing without an input
+// still does not block once the smaller pipe is full.
+TEST_F(RemoteSubmixTest, LatencyTarget) {
+    const char* address = "1";
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(address, true /*mono*/, 48000, &streamOut);
+    const uint32_t defaultLatencyMs = streamOut->get_latency(streamOut);
+    EXPECT_EQ(0, streamOut->common.set_parameters(&streamOut->common, "r_submix_latency_ms=30"));
+    const uint32_t latencyMs = streamOut->get_latency(streamOut);
+    EXPECT_LT(latencyMs, defaultLatencyMs);
+    EXPECT_LE(30U, latencyMs);
+    EXPECT_NE(0, streamOut->common.set_parameters(&streamOut->common, "r_submix_latency_ms=0"));
+    WriteSomethingIntoStream(streamOut, 1024, 16);
+    mDev->close_output_stream(mDev, streamOut);
+}
+
+// Verifies that an input stream converting the sample rate captures a sine at the frequency it
+// was played at, with harmonics and noise more than 60dB below it.
+TEST_F(RemoteSubmixTest, ResamplingPreservesSine) {
+    const uint32_t inRate = 44100;
+    const double frequency = 1000;
+    std::vector<int16_t> captured;
+    ResampleSine(48000, inRate, frequency, 40, &captured);
+    // 400 periods of the sine: fit it at the frequency it was played at, anything else is
+    // distortion, noise or a frequency error.
+    const size_t count = captured.size();
+    double sinSum = 0, cosSum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sinSum += captured[i] * sin(2 * M_PI * frequency * i / inRate);
+        cosSum += captured[i] * cos(2 * M_PI * frequency * i / inRate);
+    }
+    const double a = 2 * sinSum / count, b = 2 * cosSum / count;
+    double residualEnergy = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const double fit = a * sin(2 * M_PI * frequency * i / inRate)
+                + b * cos(2 * M_PI * frequency * i / inRate);
+        residualEnergy += (captured[i] - fit) * (captured[i] - fit);
+    }
+    const double amplitude = sqrt(a * a + b * b);
+    EXPECT_NEAR(16384, amplitude, 16384 * 0.02);
+    const double thdN = sqrt(residualEnergy / count) / (amplitude / sqrt(2));
+    EXPECT_LT(20 * log10(thdN), -60) << "THD+N";
+}
+
+// Verifies that a tone above the Nyquist frequency of the input stream is filtered out rather
+// than folded back into its band.
+TEST_F(RemoteSubmixTest, ResamplingRejectsAliases) {
+    std::vector<int16_t> captured;
+    // Would alias to 4kHz at 16kHz.
+    ResampleSine(48000, 16000, 12000, 40, &captured);
+    double energy = 0;
+    for (int16_t sample : captured) {
+        energy += static_cast<double>(sample) * sample;
+    }
+    const double rms = sqrt(energy / captured.size());
+    EXPECT_LT(20 * log10((rms + 1) / (16384 / sqrt(2))), -60) << "alias level";
+}
+
+// Verifies that changing the sample rate of an input stream carries on from the frames it read
+// rather than capturing them again.
+TEST_F(RemoteSubmixTest, SetSampleRateKeepsReadPosition) {
+    const char* address = "1";
+    audio_stream_out_t* streamOut;
+    OpenOutputStream(address, true /*mono*/, 48000, &streamOut);
+    audio_stream_in_t* streamIn;
+    OpenInputStream(address, true /*mono*/, 48000, &streamIn);
+    // Frames numbered from 0, to tell which ones are captured.
+    const size_t frames = 512;
+    std::vector<int16_t> outBuffer(frames * 2), inBuffer(frames);
+    for (size_t i = 0; i < outBuffer.size(); ++i) {
+        outBuffer[i] = static_cast<int16_t>(i);
+    }
+    const size_t bufferSize = frames * sizeof(int16_t);
+    WriteIntoStream(streamOut, reinterpret_cast<char*>(outBuffer.data()), bufferSize * 2);
+    ReadFromStream(streamIn, reinterpret_cast<char*>(inBuffer.data()), bufferSize);
+    ASSERT_EQ(0, memcmp(outBuffer.data(), inBuffer.data(), bufferSize));
+    EXPECT_EQ(0, streamIn->common.set_sample_rate(&streamIn->common, 48000));
+    ReadFromStream(streamIn, reinterpret_cast<char*>(inBuffer.data()), bufferSize);
+    EXPECT_EQ(0, memcmp(outBuffer.data() + frames, inBuffer.data(), bufferSize));
+    mDev->close_input_stream(mDev, streamIn);
+    mDev->close_output_stream(mDev, streamOut);
+}
@@ -17,10 +17,16 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <cutils/ashmem.h>
 #include <cutils/atomic.h>
@@ -45,11 +51,28 @@
 #define USE_PAN_DISPLAY 0
 #endif
 
-// Enabling page flipping by default
+// Enabling triple buffering by default, falling back to double buffering
 #ifndef NUM_BUFFERS
-#define NUM_BUFFERS 2
+#define NUM_BUFFERS 3
 #endif
 
+static const int kMaxSwapInterval = 4;
+// Copies larger than this bypass the caches, which they would only flush.
+static const size_t kNonTemporalCopyThreshold = 256 * 1024;
+
+#ifndef __has_builtin
+#define __has_builtin(x) 0
+#endif
+
+// sw_sync interface, see drivers/dma-buf/sw_sync.c
+struct sw_sync_create_fence_data {
+    uint32_t value;
+    char name[32];
+    int32_t fence;
+};
+#define SW_SYNC_IOC_MAGIC 'W'
+#define SW_SYNC_IOC_CREATE_FENCE _IOWR(SW_SYNC_IOC_MAGIC, 0, struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC _IOW(SW_SYNC_IOC_MAGIC, 1, uint32_t)
 
 enum {
     PAGE_FLIP = 0x00000001,
@@ -67,20 +90,364 @@ static int fb_setSwapInterval(struct framebuffer_device_t* dev,
 {
     if (interval < dev->minSwapInterval || interval > dev->maxSwapInterval)
         return -EINVAL;
-    // FIXME: implement fb_setSwapInterval
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+    pthread_mutex_lock(&m->flips.lock);
+    m->flips.swapInterval = interval;
+    pthread_mutex_unlock(&m->flips.lock);
     return 0;
 }
 
-static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
+static void fb_copy_nontemporal(char* dst, const char* src, size_t size)
 {
-    if (private_handle_t::validate(buffer) < 0)
+#if __has_builtin(__builtin_nontemporal_store)
+    typedef uint32_t vec_t __attribute__((vector_size(16)));
+    const size_t head = (16 - (uintptr_t(dst) & 15)) & 15;
+    if (size < head + 16) {
+        memcpy(dst, src, size);
+        return;
+    }
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+    for (; size >= 16; size -= 16, dst += 16, src += 16) {
+        vec_t v;
+        memcpy(&v, src, sizeof(v));
+        __builtin_nontemporal_store(v, reinterpret_cast<vec_t*>(dst));
+    }
+    memcpy(dst, src, size);
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+#else
+    memcpy(dst, src, size);
+#endif
+}
+
+static void fb_copy(char* dst, const char* src, size_t size, bool nonTemporal)
+{
+    if (nonTemporal) {
+        fb_copy_nontemporal(dst, src, size);
+    } else {
+        memcpy(dst, src, size);
+    }
+}
+
+static int fb_setUpdateRect(struct framebuffer_device_t* dev,
+        int left, int top, int width, int height)
+{
+    if (width <= 0 || height <= 0 || left < 0 || top < 0)
         return -EINVAL;
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+    const int rect[4] = { left, top, left + width, top + height };
+    fbSetDamage(m, 1, rect);
+    return 0;
+}
 
-    private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(buffer);
+void fbSetDamage(private_module_t* m, int numRects, const int* rects)
+{
+    private_fb_copy_t* c = &m->fbCopy;
+    const int xres = m->info.xres;
+    const int yres = m->info.yres;
+
+    pthread_mutex_lock(&m->flips.lock);
+    c->damageSet = 1;
+    c->numRects = 0;
+    for (int i = 0; i < numRects; i++) {
+        int l = rects[i * 4 + 0] < 0 ? 0 : rects[i * 4 + 0];
+        int t = rects[i * 4 + 1] < 0 ? 0 : rects[i * 4 + 1];
+        int r = rects[i * 4 + 2] > xres ? xres : rects[i * 4 + 2];
+        int b = rects[i * 4 + 3] > yres ? yres : rects[i * 4 + 3];
+        if (l >= r || t >= b) {
+            continue;
+        }
+        if (c->numRects == PRIVATE_MAX_DAMAGE_RECTS) {
+            // too many rectangles, merge the last ones into their bounds
+            int* last = c->rects[PRIVATE_MAX_DAMAGE_RECTS - 1];
+            l = l < last[0] ? l : last[0];
+            t = t < last[1] ? t : last[1];
+            r = r > last[2] ? r : last[2];
+            b = b > last[3] ? b : last[3];
+            c->numRects--;
+        }
+        int* rect = c->rects[c->numRects++];
+        rect[0] = l;
+        rect[1] = t;
+        rect[2] = r;
+        rect[3] = b;
+    }
+    pthread_mutex_unlock(&m->flips.lock);
+}
+
+void fbGetStats(private_module_t* m, private_fb_stats_t* stats)
+{
+    private_fb_copy_t* c = &m->fbCopy;
+    pthread_mutex_lock(&m->flips.lock);
+    stats->copies = c->copies;
+    stats->partialCopies = c->partialCopies;
+    stats->bytesCopied = c->bytesCopied;
+    stats->bytesSkipped = c->bytesSkipped;
+    pthread_mutex_unlock(&m->flips.lock);
+}
+
+// Copies the damage of the posted buffer to the page, with the flip queue
+// lock held. The rows of the buffer are srcLineLength bytes apart, which
+// may differ from the line length of the framebuffer.
+static void fb_copy_damage_locked(private_module_t* m, char* dst, const char* src,
+        size_t srcLineLength)
+{
+    private_fb_copy_t* c = &m->fbCopy;
+    const size_t lineLength = m->finfo.line_length;
+    const size_t bytesPerPixel = m->info.bits_per_pixel >> 3;
+    const size_t fullSize = lineLength * m->info.yres;
+
+    size_t copied = 0;
+    if (!c->damageSet) {
+        const bool nonTemporal = fullSize >= kNonTemporalCopyThreshold;
+        if (srcLineLength == lineLength) {
+            fb_copy(dst, src, fullSize, nonTemporal);
+        } else {
+            const size_t rowSize = m->info.xres * bytesPerPixel;
+            for (size_t y = 0; y < m->info.yres; y++) {
+                fb_copy(dst + y * lineLength, src + y * srcLineLength, rowSize, nonTemporal);
+            }
+        }
+        copied = fullSize;
+    } else {
+        size_t damageSize = 0;
+        for (int i = 0; i < c->numRects; i++) {
+            const int* rect = c->rects[i];
+            damageSize += (rect[2] - rect[0]) * bytesPerPixel * (rect[3] - rect[1]);
+        }
+        const bool nonTemporal = damageSize >= kNonTemporalCopyThreshold;
+        for (int i = 0; i < c->numRects; i++) {
+            const int* rect = c->rects[i];
+            const size_t offset = rect[1] * lineLength + rect[0] * bytesPerPixel;
+            const size_t srcOffset = rect[1] * srcLineLength + rect[0] * bytesPerPixel;
+            const size_t span = (rect[2] - rect[0]) * bytesPerPixel;
+            const size_t rows = rect[3] - rect[1];
+            if (rect[0] == 0 && rect[2] == int(m->info.xres) &&
+                    srcLineLength == lineLength) {
+                // whole rows are contiguous
+                fb_copy(dst + offset, src + srcOffset, rows * lineLength, nonTemporal);
+                copied += rows * lineLength;
+                continue;
+            }
+            for (size_t y = 0; y < rows; y++) {
+                fb_copy(dst + offset + y * lineLength, src + srcOffset + y * srcLineLength,
+                        span, nonTemporal);
+            }
+            copied += rows * span;
+        }
+        c->partialCopies++;
+    }
+    c->copies++;
+    c->bytesCopied += copied;
+    c->bytesSkipped += copied < fullSize ? fullSize - copied : 0;
+    // the damage only applies to one post
+    c->damageSet = 0;
+}
+
+static void fb_dump(struct framebuffer_device_t* dev, char* buff, int buff_len)
+{
     private_module_t* m = reinterpret_cast<private_module_t*>(
             dev->common.module);
+    private_fb_stats_t stats;
+    fbGetStats(m, &stats);
+    const uint64_t total = stats.bytesCopied + stats.bytesSkipped;
+    snprintf(buff, buff_len,
+            "framebuffer copies: %" PRIu64 " (%" PRIu64 " partial), "
+            "%" PRIu64 " KiB copied, %" PRIu64 " KiB skipped (%" PRIu64 "%%)\n",
+            stats.copies, stats.partialCopies,
+            stats.bytesCopied / 1024, stats.bytesSkipped / 1024,
+            total ? stats.bytesSkipped * 100 / total : 0);
+}
+
+static void fb_wait_vsyncs(private_module_t* m, int count, struct timespec* lastVsync)
+{
+    const long periodNs = (long)(1000000000 / m->fps);
+    for (int i = 0; i < count; i++) {
+        uint32_t crtc = 0;
+        if (ioctl(m->framebuffer->fd, FBIO_WAITFORVSYNC, &crtc) == 0) {
+            clock_gettime(CLOCK_MONOTONIC, lastVsync);
+            continue;
+        }
+        // Without vsync events, pace on the nominal refresh period.
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        lastVsync->tv_nsec += periodNs;
+        if (lastVsync->tv_nsec >= 1000000000) {
+            lastVsync->tv_nsec -= 1000000000;
+            lastVsync->tv_sec++;
+        }
+        if (lastVsync->tv_sec < now.tv_sec ||
+                (lastVsync->tv_sec == now.tv_sec && lastVsync->tv_nsec < now.tv_nsec)) {
+            *lastVsync = now;
+        } else {
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, lastVsync, NULL);
+        }
+    }
+}
 
-    if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
+static void* fb_flip_thread(void* arg)
+{
+    private_module_t* m = reinterpret_cast<private_module_t*>(arg);
+    private_flip_queue_t* q = &m->flips;
+    struct fb_var_screeninfo info = m->info;
+    bool usePan = true;
+    struct timespec lastVsync;
+    clock_gettime(CLOCK_MONOTONIC, &lastVsync);
+
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (q->count == 0) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        const uint32_t page = q->pages[q->head];
+        const int interval = q->swapInterval;
+        pthread_mutex_unlock(&q->lock);
+
+        // The new page is scanned out from the next vsync on.
+        info.activate = FB_ACTIVATE_VBL;
+        info.yoffset = page * m->info.yres;
+        if (usePan && ioctl(m->framebuffer->fd, FBIOPAN_DISPLAY, &info) == -1) {
+            ALOGW("FBIOPAN_DISPLAY failed (%s), using FBIOPUT_VSCREENINFO",
+                    strerror(errno));
+            usePan = false;
+        }
+        if (!usePan && ioctl(m->framebuffer->fd, FBIOPUT_VSCREENINFO, &info) == -1) {
+            ALOGE("FBIOPUT_VSCREENINFO failed");
+        }
+        fb_wait_vsyncs(m, interval, &lastVsync);
+
+        pthread_mutex_lock(&q->lock);
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        // The page displayed until now is released.
+        if (page != q->frontPage && q->timelineFd >= 0) {
+            uint32_t increment = 1;
+            ioctl(q->timelineFd, SW_SYNC_IOC_INC, &increment);
+        }
+        q->frontPage = page;
+        pthread_cond_broadcast(&q->cond);
+    }
+    return NULL;
+}
+
+static void fb_start_flips_locked(private_module_t* m)
+{
+    private_flip_queue_t* q = &m->flips;
+    q->swapInterval = 1;
+    q->frontPage = 0;
+    q->lastQueuedPage = 0;
+    q->timelineFd = open("/dev/sw_sync", O_RDWR | O_CLOEXEC);
+    if (q->timelineFd < 0) {
+        q->timelineFd = open("/sys/kernel/debug/sync/sw_sync", O_RDWR | O_CLOEXEC);
+    }
+    ALOGW_IF(q->timelineFd < 0, "sw_sync not available, posts won't return release fences");
+    // Each page is queued at most once.
+    q->capacity = m->numBuffers;
+    q->pages = (uint32_t*)calloc(q->capacity, sizeof(*q->pages));
+    if (q->pages == NULL) {
+        ALOGE("Could not allocate the flip queue, flips will be synchronous");
+        return;
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, fb_flip_thread, m) == 0) {
+        pthread_setname_np(thread, "fb_flip");
+        q->started = 1;
+    } else {
+        ALOGE("Could not start the flip thread, flips will be synchronous");
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static bool fb_page_queued_locked(private_flip_queue_t* q, uint32_t page)
+{
+    for (uint32_t i = 0; i < q->count; i++) {
+        if (q->pages[(q->head + i) % q->capacity] == page) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A page is busy while it is queued, or displayed with a flip to another page
+// pending, after which drawing to it would tear.
+static bool fb_page_busy_locked(private_flip_queue_t* q, uint32_t page)
+{
+    return (page == q->frontPage && q->count > 0) || fb_page_queued_locked(q, page);
+}
+
+void fbWaitForPage(private_module_t* m, private_handle_t const* hnd)
+{
+    private_flip_queue_t* q = &m->flips;
+    const size_t bufferSize = m->finfo.line_length * m->info.yres;
+    const uint32_t page = (hnd->base - m->framebuffer->base) / bufferSize;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->started && fb_page_busy_locked(q, page)) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+int fbPost(private_module_t* m, buffer_handle_t buffer, int* releaseFence)
+{
+    if (releaseFence)
+        *releaseFence = -1;
+    if (private_handle_t::validate(buffer) < 0)
+        return -EINVAL;
+
+    private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(buffer);
+    private_flip_queue_t* q = &m->flips;
+
+    if ((hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) && q->started) {
+        const size_t bufferSize = m->finfo.line_length * m->info.yres;
+        const uint32_t page = (hnd->base - m->framebuffer->base) / bufferSize;
+
+        pthread_mutex_lock(&q->lock);
+        while (fb_page_queued_locked(q, page)) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        // the page holds the whole buffer, the damage doesn't apply
+        m->fbCopy.damageSet = 0;
+        q->pages[(q->head + q->count) % q->capacity] = page;
+        q->count++;
+        // The page is released by the first flip to another page after this
+        // one, the next release once the queued flips are done.
+        if (page != q->lastQueuedPage) {
+            q->queuedReleases++;
+            q->lastQueuedPage = page;
+        }
+        bool fenced = false;
+        if (releaseFence && q->timelineFd >= 0) {
+            struct sw_sync_create_fence_data data;
+            memset(&data, 0, sizeof(data));
+            data.value = q->queuedReleases + 1;
+            strlcpy(data.name, "fb-release", sizeof(data.name));
+            if (ioctl(q->timelineFd, SW_SYNC_IOC_CREATE_FENCE, &data) == 0) {
+                *releaseFence = data.fence;
+                fenced = true;
+            }
+        }
+        pthread_cond_broadcast(&q->cond);
+        // Without a fence, return once a page is left to draw the next frame
+        // to, neither queued nor displayed, so that the producer never draws
+        // to a page the display still reads.
+        while (!fenced && q->count >= m->numBuffers - 1) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        pthread_mutex_unlock(&q->lock);
+        m->currentBuffer = buffer;
+
+    } else if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
         const size_t offset = hnd->base - m->framebuffer->base;
         m->info.activate = FB_ACTIVATE_VBL;
         m->info.yoffset = offset / m->finfo.line_length;
@@ -92,11 +459,18 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
         m->currentBuffer = buffer;
         
     } else {
-        // If we can't do the page_flip, just copy the buffer to the front 
+        // If we can't do the page_flip, just copy the buffer to the page
+        // on screen once the queued flips are done
         // FIXME: use copybit HAL instead of memcpy
         
         void* fb_vaddr;
         void* buffer_vaddr;
+
+        pthread_mutex_lock(&q->lock);
+        while (q->count > 0) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        const uint32_t page = q->frontPage;
         
         m->base.lock(&m->base, m->framebuffer, 
                 GRALLOC_USAGE_SW_WRITE_RARELY, 
@@ -108,7 +482,13 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
                 0, 0, m->info.xres, m->info.yres,
                 &buffer_vaddr);
 
-        memcpy(fb_vaddr, buffer_vaddr, m->finfo.line_length * m->info.yres);
+        const size_t bufferSize = m->finfo.line_length * m->info.yres;
+        // Buffers allocated for the CPU have their own stride alignment.
+        const size_t srcLineLength = hnd->stride > 0 ?
+                hnd->stride * (m->info.bits_per_pixel >> 3) : m->finfo.line_length;
+        fb_copy_damage_locked(m, (char*)fb_vaddr + page * bufferSize,
+                (const char*)buffer_vaddr, srcLineLength);
+        pthread_mutex_unlock(&q->lock);
         
         m->base.unlock(&m->base, buffer); 
         m->base.unlock(&m->base, m->framebuffer); 
@@ -117,6 +497,13 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
     return 0;
 }
 
+static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
+{
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+    return fbPost(m, buffer, NULL);
+}
+
 /*****************************************************************************/
 
 int mapFrameBufferLocked(struct private_module_t* module, int format)
@@ -162,6 +549,7 @@ int mapFrameBufferLocked(struct private_module_t* module, int format)
      * Request NUM_BUFFERS screens
      * To enable page flipping, NUM_BUFFERS should be at least 2.
      */
+    const uint32_t yres = info.yres;
     info.yres_virtual = info.yres * NUM_BUFFERS;
 
     switch (format) {
@@ -180,15 +568,24 @@ int mapFrameBufferLocked(struct private_module_t* module, int format)
     }
 
     uint32_t flags = PAGE_FLIP;
+    for (;;) {
 #if USE_PAN_DISPLAY
-    if (ioctl(fd, FBIOPAN_DISPLAY, &info) == -1) {
-        ALOGW("FBIOPAN_DISPLAY failed, page flipping not supported");
+        if (ioctl(fd, FBIOPAN_DISPLAY, &info) != -1)
+            break;
 #else
-    if (ioctl(fd, FBIOPUT_VSCREENINFO, &info) == -1) {
-        ALOGW("FBIOPUT_VSCREENINFO failed, page flipping not supported");
+        if (ioctl(fd, FBIOPUT_VSCREENINFO, &info) != -1)
+            break;
 #endif
+        if (info.yres_virtual > yres * 2) {
+            // fall back to fewer pages
+            info.yres_virtual -= yres;
+            continue;
+        }
+        ALOGW("Setting %u pages failed, page flipping not supported",
+                info.yres_virtual / yres);
         info.yres_virtual = info.yres;
         flags &= ~PAGE_FLIP;
+        break;
     }
 
     if (info.yres_virtual < info.yres * 2) {
@@ -291,6 +688,10 @@ int mapFrameBufferLocked(struct private_module_t* module, int format)
     }
     module->framebuffer->base = intptr_t(vaddr);
     memset(vaddr, 0, fbSize);
+
+    if ((flags & PAGE_FLIP) && module->numBuffers > 1) {
+        fb_start_flips_locked(module);
+    }
     return 0;
 }
 
@@ -330,7 +731,8 @@ int fb_device_open(hw_module_t const* module, const char* name,
         dev->device.common.close = fb_close;
         dev->device.setSwapInterval = fb_setSwapInterval;
         dev->device.post            = fb_post;
-        dev->device.setUpdateRect = 0;
+        dev->device.setUpdateRect = fb_setUpdateRect;
+        dev->device.dump          = fb_dump;
 
         private_module_t* m = (private_module_t*)module;
         status = mapFrameBuffer(m);
@@ -347,8 +749,9 @@ int fb_device_open(hw_module_t const* module, const char* name,
             const_cast<float&>(dev->device.xdpi) = m->xdpi;
             const_cast<float&>(dev->device.ydpi) = m->ydpi;
             const_cast<float&>(dev->device.fps) = m->fps;
-            const_cast<int&>(dev->device.minSwapInterval) = 1;
-            const_cast<int&>(dev->device.maxSwapInterval) = 1;
+            const_cast<int&>(dev->device.minSwapInterval) = m->flips.started ? 0 : 1;
+            const_cast<int&>(dev->device.maxSwapInterval) = m->flips.started ? kMaxSwapInterval : 1;
+            const_cast<int&>(dev->device.numFramebuffers) = m->numBuffers;
             *device = &dev->device.common;
         } else {
             free(dev);
@@ -40,9 +40,39 @@ inline size_t roundUpToPageSize(size_t x) {
 }
 
 int mapFrameBufferLocked(struct private_module_t* module, int format);
+int fbPost(struct private_module_t* module, buffer_handle_t buffer, int* releaseFence);
+void fbSetDamage(struct private_module_t* module, int numRects, const int* rects);
+void fbGetStats(struct private_module_t* module, struct private_fb_stats_t* stats);
+/* Waits until a framebuffer page can be drawn to without tearing. */
+void fbWaitForPage(struct private_module_t* module, private_handle_t const* hnd);
 int terminateBuffer(gralloc_module_t const* module, private_handle_t* hnd);
 int mapBuffer(gralloc_module_t const* module, private_handle_t* hnd);
 
+size_t bufferPoolSizeClass(size_t size);
+/* Returns the fd of a pooled buffer of size bytes, mapped at *base, or -1. */
+int bufferPoolAcquire(struct private_module_t* module, size_t size, void** base);
+/* Takes ownership of the fd and mapping of a freed buffer, returns -1 if rejected. */
+int bufferPoolRelease(struct private_module_t* module, int fd, void* base, size_t size);
+void bufferPoolTrim(struct private_module_t* module, size_t bytes);
+void bufferPoolSetBudget(struct private_module_t* module, size_t budget);
+void bufferPoolGetStats(struct private_module_t* module, struct private_pool_stats_t* stats);
+
+struct private_yuv_layout_t {
+    size_t cStride;
+    size_t chromaStep;
+    size_t cbOffset;
+    size_t crOffset;
+    size_t size;
+};
+
+/* Computes the chroma planes of a YUV buffer, returns false for other formats. */
+bool getYuvLayout(int format, size_t yStride, int height, private_yuv_layout_t* layout);
+
+void trimMappings(size_t bytes);
+void getMappingStats(struct private_mapping_stats_t* stats);
+/* Whether a handle registered in this process may use the buffer. */
+bool isBufferRegistered(int fd, size_t size);
+
 /*****************************************************************************/
 
 class Locker {
@@ -16,8 +16,11 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -28,6 +31,7 @@
 
 #include <cutils/ashmem.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include <log/log.h>
 
 #include <hardware/gralloc.h>
@@ -59,6 +63,11 @@ extern int gralloc_lock(gralloc_module_t const* module,
         int l, int t, int w, int h,
         void** vaddr);
 
+extern int gralloc_lock_ycbcr(gralloc_module_t const* module,
+        buffer_handle_t handle, int usage,
+        int l, int t, int w, int h,
+        struct android_ycbcr* ycbcr);
+
 extern int gralloc_unlock(gralloc_module_t const* module, 
         buffer_handle_t handle);
 
@@ -68,6 +77,9 @@ extern int gralloc_register_buffer(gralloc_module_t const* module,
 extern int gralloc_unregister_buffer(gralloc_module_t const* module,
         buffer_handle_t handle);
 
+static int gralloc_perform(gralloc_module_t const* module,
+        int operation, ... );
+
 /*****************************************************************************/
 
 static struct hw_module_methods_t gralloc_module_methods = {
@@ -78,8 +90,8 @@ struct private_module_t HAL_MODULE_INFO_SYM = {
     .base = {
         .common = {
             .tag = HARDWARE_MODULE_TAG,
-            .version_major = 1,
-            .version_minor = 0,
+            .module_api_version = GRALLOC_MODULE_API_VERSION_0_2,
+            .hal_api_version = HARDWARE_HAL_API_VERSION,
             .id = GRALLOC_HARDWARE_MODULE_ID,
             .name = "Graphics Memory Allocator Module",
             .author = "The Android Open Source Project",
@@ -89,6 +101,8 @@ struct private_module_t HAL_MODULE_INFO_SYM = {
         .unregisterBuffer = gralloc_unregister_buffer,
         .lock = gralloc_lock,
         .unlock = gralloc_unlock,
+        .perform = gralloc_perform,
+        .lock_ycbcr = gralloc_lock_ycbcr,
     },
     .framebuffer = 0,
     .flags = 0,
@@ -96,6 +110,13 @@ struct private_module_t HAL_MODULE_INFO_SYM = {
     .bufferMask = 0,
     .lock = PTHREAD_MUTEX_INITIALIZER,
     .currentBuffer = 0,
+    .pool = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+    },
+    .flips = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    },
 };
 
 /*****************************************************************************/
@@ -165,13 +186,32 @@ static int gralloc_alloc_framebuffer(alloc_device_t* dev,
 }
 
 static int gralloc_alloc_buffer(alloc_device_t* dev,
-        size_t size, int /*usage*/, buffer_handle_t* pHandle)
+        size_t size, int usage, buffer_handle_t* pHandle)
 {
     int err = 0;
     int fd = -1;
+    int flags = 0;
+
+    if (usage & GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL) {
+        // only buffers that never leave this process can be recycled, the
+        // other ones can still be mapped elsewhere once freed
+        private_module_t* m = reinterpret_cast<private_module_t*>(
+                dev->common.module);
+        flags = private_handle_t::PRIV_FLAGS_PROCESS_LOCAL;
+        size = bufferPoolSizeClass(size);
+
+        void* base;
+        fd = bufferPoolAcquire(m, size, &base);
+        if (fd >= 0) {
+            private_handle_t* hnd = new private_handle_t(fd, size, flags);
+            hnd->base = uintptr_t(base);
+            *pHandle = hnd;
+            return 0;
+        }
+    } else {
+        size = roundUpToPageSize(size);
+    }
 
-    size = roundUpToPageSize(size);
-    
     fd = ashmem_create_region("gralloc-buffer", size);
     if (fd < 0) {
         ALOGE("couldn't create ashmem (%s)", strerror(-errno));
@@ -179,7 +219,7 @@ static int gralloc_alloc_buffer(alloc_device_t* dev,
     }
 
     if (err == 0) {
-        private_handle_t* hnd = new private_handle_t(fd, size, 0);
+        private_handle_t* hnd = new private_handle_t(fd, size, flags);
         gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
                 dev->common.module);
         err = mapBuffer(module, hnd);
@@ -195,11 +235,85 @@ static int gralloc_alloc_buffer(alloc_device_t* dev,
 
 /*****************************************************************************/
 
+// Row alignment in bytes of buffers written or read by the CPU, so that SIMD
+// code runs its aligned paths, and of the other buffers.
+static const size_t kDefaultCpuStrideAlignment = 64;
+static const char kCpuStrideAlignmentProperty[] = "ro.vendor.gralloc.stride_align.cpu";
+static const size_t kDefaultHwStrideAlignment = 1;
+static const char kHwStrideAlignmentProperty[] = "ro.vendor.gralloc.stride_align.hw";
+
 inline size_t align(size_t value, size_t alignment)
 {
     return ((value + alignment - 1) / alignment) * alignment;
 }
 
+static size_t gcd(size_t a, size_t b)
+{
+    while (b != 0) {
+        const size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static size_t readStrideAlignment(const char* property, size_t defaultAlignment)
+{
+    const int64_t alignment = property_get_int64(property, defaultAlignment);
+    if (alignment < 1 || (alignment & (alignment - 1)) != 0) {
+        ALOGE("%s must be a power of 2, ignoring %" PRId64, property, alignment);
+        return defaultAlignment;
+    }
+    return alignment;
+}
+
+static size_t strideAlignment(int usage)
+{
+    static const size_t cpuAlignment = readStrideAlignment(
+            kCpuStrideAlignmentProperty, kDefaultCpuStrideAlignment);
+    static const size_t hwAlignment = readStrideAlignment(
+            kHwStrideAlignmentProperty, kDefaultHwStrideAlignment);
+    if (usage & (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK)) {
+        return cpuAlignment > hwAlignment ? cpuAlignment : hwAlignment;
+    }
+    return hwAlignment;
+}
+
+bool getYuvLayout(int format, size_t yStride, int height, private_yuv_layout_t* layout)
+{
+    const size_t chromaHeight = align(height, 2) / 2;
+    const size_t lumaSize = yStride * chromaHeight * 2;
+    switch (format) {
+        case HAL_PIXEL_FORMAT_YV12:
+            // Y, then Cr, then Cb, the chroma stride being defined as
+            // ALIGN(y_stride / 2, 16)
+            layout->cStride = align(yStride / 2, 16);
+            layout->chromaStep = 1;
+            layout->crOffset = lumaSize;
+            layout->cbOffset = lumaSize + layout->cStride * chromaHeight;
+            layout->size = layout->cbOffset + layout->cStride * chromaHeight;
+            return true;
+        case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+            // NV21: Y, then interleaved Cr and Cb
+            layout->cStride = yStride;
+            layout->chromaStep = 2;
+            layout->crOffset = lumaSize;
+            layout->cbOffset = lumaSize + 1;
+            layout->size = lumaSize + yStride * chromaHeight;
+            return true;
+        case HAL_PIXEL_FORMAT_YCBCR_420_888:
+            // I420: Y, then Cb, then Cr
+            layout->cStride = yStride / 2;
+            layout->chromaStep = 1;
+            layout->cbOffset = lumaSize;
+            layout->crOffset = lumaSize + layout->cStride * chromaHeight;
+            layout->size = layout->crOffset + layout->cStride * chromaHeight;
+            return true;
+        default:
+            return false;
+    }
+}
+
 static int gralloc_alloc(alloc_device_t* dev,
         int width, int height, int format, int usage,
         buffer_handle_t* pHandle, int* pStride)
@@ -208,6 +322,9 @@ static int gralloc_alloc(alloc_device_t* dev,
         return -EINVAL;
 
     int bytesPerPixel = 0;
+    // alignment of the luma stride that aligns all the planes of YUV formats
+    size_t lumaAlignment = 0;
+    const size_t alignment = strideAlignment(usage);
     switch (format) {
         case HAL_PIXEL_FORMAT_RGBA_FP16:
             bytesPerPixel = 8;
@@ -227,16 +344,41 @@ static int gralloc_alloc(alloc_device_t* dev,
         case HAL_PIXEL_FORMAT_BLOB:
             bytesPerPixel = 1;
             break;
+        case HAL_PIXEL_FORMAT_YV12:
+            lumaAlignment = alignment * 2 > 16 ? alignment * 2 : 16;
+            break;
+        case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+            lumaAlignment = alignment > 2 ? alignment : 2;
+            break;
+        case HAL_PIXEL_FORMAT_YCBCR_420_888:
+            lumaAlignment = alignment * 2;
+            break;
         default:
             ALOGE("gralloc_alloc bad format %d", format);
             return -EINVAL;
     }
 
-    const size_t tileWidth = 2;
-    const size_t tileHeight = 2;
-
-    size_t stride = align(width, tileWidth);
-    size_t size = align(height, tileHeight) * stride * bytesPerPixel + 4;
+    size_t stride;
+    size_t size;
+    if (lumaAlignment) {
+        if (usage & GRALLOC_USAGE_HW_FB) {
+            ALOGE("gralloc_alloc bad framebuffer format %d", format);
+            return -EINVAL;
+        }
+        private_yuv_layout_t layout;
+        stride = align(width, lumaAlignment);
+        getYuvLayout(format, stride, height, &layout);
+        size = layout.size;
+    } else {
+        const size_t tileWidth = 2;
+        const size_t tileHeight = 2;
+
+        // the stride in pixels of rows aligned to the alignment in bytes
+        const size_t pixelAlignment = alignment / gcd(alignment, bytesPerPixel);
+        const size_t tileAlignment = pixelAlignment * tileWidth / gcd(pixelAlignment, tileWidth);
+        stride = align(width, (usage & GRALLOC_USAGE_HW_FB) ? tileWidth : tileAlignment);
+        size = align(height, tileHeight) * stride * bytesPerPixel + 4;
+    }
 
     int err;
     if (usage & GRALLOC_USAGE_HW_FB) {
@@ -249,7 +391,14 @@ static int gralloc_alloc(alloc_device_t* dev,
         return err;
     }
 
-    *pStride = stride;
+    private_handle_t* hnd = (private_handle_t*)*pHandle;
+    hnd->format = format;
+    hnd->width = width;
+    hnd->height = height;
+    hnd->stride = stride;
+
+    // The strides of flexible YUV buffers are only given by lock_ycbcr().
+    *pStride = format == HAL_PIXEL_FORMAT_YCBCR_420_888 ? 0 : stride;
     return 0;
 }
 
@@ -268,6 +417,18 @@ static int gralloc_free(alloc_device_t* dev,
         int index = (hnd->base - m->framebuffer->base) / bufferSize;
         m->bufferMask &= ~(1<<index); 
     } else { 
+        // keep a process-local buffer mapped in the pool for the next
+        // allocation of its size, unless a handle registered in this process
+        // still uses it
+        private_module_t* m = reinterpret_cast<private_module_t*>(
+                dev->common.module);
+        if ((hnd->flags & private_handle_t::PRIV_FLAGS_PROCESS_LOCAL) &&
+                hnd->base && !isBufferRegistered(hnd->fd, hnd->size) &&
+                bufferPoolRelease(m, hnd->fd,
+                    (void*)(uintptr_t)hnd->base, hnd->size) == 0) {
+            delete hnd;
+            return 0;
+        }
         gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
                 dev->common.module);
         terminateBuffer(module, const_cast<private_handle_t*>(hnd));
@@ -280,6 +441,96 @@ static int gralloc_free(alloc_device_t* dev,
 
 /*****************************************************************************/
 
+static void gralloc_dump(alloc_device_t* dev, char* buff, int buff_len)
+{
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+    private_pool_stats_t stats;
+    bufferPoolGetStats(m, &stats);
+    const uint64_t requests = stats.hits + stats.misses;
+    snprintf(buff, buff_len,
+            "gralloc buffer pool: %u buffers, %zu/%zu KiB, "
+            "%" PRIu64 " hits, %" PRIu64 " misses (%" PRIu64 "%% hit rate), "
+            "%" PRIu64 " evictions\n",
+            stats.cachedBuffers, stats.cachedBytes / 1024, stats.budget / 1024,
+            stats.hits, stats.misses,
+            requests ? stats.hits * 100 / requests : 0, stats.evictions);
+
+    private_mapping_stats_t mappings;
+    getMappingStats(&mappings);
+    const uint64_t registrations = mappings.hits + mappings.misses;
+    const size_t len = strlen(buff);
+    snprintf(buff + len, buff_len - len,
+            "gralloc registered mappings: %u mapped, %u idle (%zu KiB), "
+            "%" PRIu64 " hits, %" PRIu64 " misses (%" PRIu64 "%% hit rate)\n",
+            mappings.mappings, mappings.idleMappings, mappings.idleBytes / 1024,
+            mappings.hits, mappings.misses,
+            registrations ? mappings.hits * 100 / registrations : 0);
+}
+
+static int gralloc_perform(gralloc_module_t const* module,
+        int operation, ... )
+{
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            const_cast<gralloc_module_t*>(module));
+    int err = 0;
+    va_list args;
+    va_start(args, operation);
+    switch (operation) {
+        case GRALLOC_MODULE_PERFORM_PRIVATE_SET_POOL_BUDGET:
+            bufferPoolSetBudget(m, va_arg(args, size_t));
+            break;
+        case GRALLOC_MODULE_PERFORM_PRIVATE_TRIM_POOL:
+            bufferPoolTrim(m, va_arg(args, size_t));
+            break;
+        case GRALLOC_MODULE_PERFORM_PRIVATE_GET_POOL_STATS:
+            bufferPoolGetStats(m, va_arg(args, private_pool_stats_t*));
+            break;
+        case GRALLOC_MODULE_PERFORM_PRIVATE_TRIM_MAPPINGS:
+            trimMappings(va_arg(args, size_t));
+            break;
+        case GRALLOC_MODULE_PERFORM_PRIVATE_GET_MAPPING_STATS:
+            getMappingStats(va_arg(args, private_mapping_stats_t*));
+            break;
+        case GRALLOC_DEFAULT_PERFORM_FB_POST: {
+            buffer_handle_t buffer = va_arg(args, buffer_handle_t);
+            int* releaseFence = va_arg(args, int*);
+            err = fbPost(m, buffer, releaseFence);
+            break;
+        }
+        case GRALLOC_DEFAULT_PERFORM_FB_SET_DAMAGE: {
+            int numRects = va_arg(args, int);
+            const int* rects = va_arg(args, const int*);
+            fbSetDamage(m, numRects, rects);
+            break;
+        }
+        case GRALLOC_DEFAULT_PERFORM_GET_BUFFER_INFO: {
+            buffer_handle_t buffer = va_arg(args, buffer_handle_t);
+            gralloc_default_buffer_info_t* info =
+                    va_arg(args, gralloc_default_buffer_info_t*);
+            if (private_handle_t::validate(buffer) < 0) {
+                err = -EINVAL;
+                break;
+            }
+            const private_handle_t* hnd =
+                    reinterpret_cast<const private_handle_t*>(buffer);
+            info->width = hnd->width;
+            info->height = hnd->height;
+            info->format = hnd->format;
+            info->stride = hnd->stride;
+            break;
+        }
+        case GRALLOC_MODULE_PERFORM_PRIVATE_GET_FB_STATS:
+            fbGetStats(m, va_arg(args, private_fb_stats_t*));
+            break;
+        default:
+            err = -EINVAL;
+            break;
+    }
+    va_end(args);
+    return err;
+}
+
 static int gralloc_close(struct hw_device_t *dev)
 {
     gralloc_context_t* ctx = reinterpret_cast<gralloc_context_t*>(dev);
@@ -311,6 +562,7 @@ int gralloc_device_open(const hw_module_t* module, const char* name,
 
         dev->device.alloc   = gralloc_alloc;
         dev->device.free    = gralloc_free;
+        dev->device.dump    = gralloc_dump;
 
         *device = &dev->device.common;
         status = 0;
@@ -29,10 +29,128 @@
 
 #include <linux/fb.h>
 
+#include <gralloc_default.h>
+
 /*****************************************************************************/
 
 struct private_module_t;
 struct private_handle_t;
+struct private_pool_entry_t;
+
+/*
+ * Buffers allocated with GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL and freed by
+ * gralloc_free are kept here, still mapped, to be handed out again by
+ * gralloc_alloc instead of creating and mapping a new ashmem region, cleared.
+ * Other buffers are never pooled: their handle may have been sent to another
+ * process that still maps them. Buffers are allocated in size classes so that
+ * similar sizes share entries. The pool holds at most budget bytes, evicting
+ * the least recently freed buffers first.
+ */
+struct private_buffer_pool_t {
+    pthread_mutex_t lock;
+    /* most recently freed first */
+    struct private_pool_entry_t* head;
+    struct private_pool_entry_t* tail;
+    size_t budget;
+    int budgetInitialized;
+    size_t cachedBytes;
+    uint32_t cachedBuffers;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+struct private_pool_stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t cachedBytes;
+    uint32_t cachedBuffers;
+    size_t budget;
+};
+
+/*
+ * Framebuffer pages posted and not yet displayed. A thread pans the display
+ * to each page in turn, at most once every swapInterval vsyncs. A page stays
+ * in use until the flip to another page completes, which increments the
+ * sw_sync timeline: the timeline counts page releases, and the release fence
+ * of a post waits for the release of its page. Posting without a fence
+ * returns once fewer than numBuffers - 1 flips are pending instead, so one
+ * page is always free to draw to.
+ */
+struct private_flip_queue_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int swapInterval;
+    /* page indices, oldest first, the oldest one being flipped to */
+    uint32_t* pages;
+    /* numBuffers, a page is queued at most once */
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+    /* page scanned out */
+    uint32_t frontPage;
+    /* -1 when sw_sync isn't available */
+    int timelineFd;
+    /* page scanned out and releases done once the queued flips are done */
+    uint32_t lastQueuedPage;
+    uint32_t queuedReleases;
+};
+
+#define PRIVATE_MAX_DAMAGE_RECTS 16
+
+/*
+ * Damage of the next buffer copied to the framebuffer by post(), and
+ * statistics of these copies. Rows and spans outside of the damage are left
+ * as copied by the previous posts.
+ */
+struct private_fb_copy_t {
+    /* 0 when the whole screen must be copied */
+    int damageSet;
+    int numRects;
+    /* left, top, right, bottom */
+    int rects[PRIVATE_MAX_DAMAGE_RECTS][4];
+    uint64_t copies;
+    uint64_t partialCopies;
+    uint64_t bytesCopied;
+    uint64_t bytesSkipped;
+};
+
+struct private_fb_stats_t {
+    uint64_t copies;
+    uint64_t partialCopies;
+    uint64_t bytesCopied;
+    uint64_t bytesSkipped;
+};
+
+struct private_mapping_stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint32_t mappings;
+    uint32_t idleMappings;
+    size_t idleBytes;
+};
+
+/*
+ * Private operations of gralloc_module_t::perform() controlling the buffer
+ * pool and reading statistics, in addition to those of gralloc_default.h.
+ */
+enum {
+    /* (size_t budget): sets the budget in bytes, 0 disables the pool */
+    GRALLOC_MODULE_PERFORM_PRIVATE_SET_POOL_BUDGET = 0x08000001,
+    /* (size_t bytes): evicts the least recently used buffers down to bytes */
+    GRALLOC_MODULE_PERFORM_PRIVATE_TRIM_POOL = 0x08000002,
+    /* (struct private_pool_stats_t* stats) */
+    GRALLOC_MODULE_PERFORM_PRIVATE_GET_POOL_STATS = 0x08000003,
+    /* (size_t bytes): unmaps the least recently unregistered buffers down to
+     * bytes of idle mappings */
+    GRALLOC_MODULE_PERFORM_PRIVATE_TRIM_MAPPINGS = 0x08000004,
+    /* (struct private_mapping_stats_t* stats) */
+    GRALLOC_MODULE_PERFORM_PRIVATE_GET_MAPPING_STATS = 0x08000005,
+    /* (struct private_fb_stats_t* stats) */
+    GRALLOC_MODULE_PERFORM_PRIVATE_GET_FB_STATS = 0x08000008,
+};
 
 struct private_module_t {
     gralloc_module_t base;
@@ -51,6 +169,10 @@ struct private_module_t {
     float xdpi;
     float ydpi;
     float fps;
+
+    struct private_buffer_pool_t pool;
+    struct private_flip_queue_t flips;
+    struct private_fb_copy_t fbCopy;
 };
 
 /*****************************************************************************/
@@ -63,7 +185,9 @@ struct private_handle_t {
 #endif
 
     enum {
-        PRIV_FLAGS_FRAMEBUFFER = 0x00000001
+        PRIV_FLAGS_FRAMEBUFFER = 0x00000001,
+        /* allocated with GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL */
+        PRIV_FLAGS_PROCESS_LOCAL = 0x00000002
     };
 
     // file-descriptors
@@ -77,6 +201,11 @@ struct private_handle_t {
     // FIXME: the attributes below should be out-of-line
     uint64_t base __attribute__((aligned(8)));
     int     pid;
+    // layout of the buffer, stride in pixels, of the luma plane for YUV
+    int     format;
+    int     width;
+    int     height;
+    int     stride;
 
 #ifdef __cplusplus
     static inline int sNumInts() {
@@ -87,7 +216,7 @@ struct private_handle_t {
 
     private_handle_t(int fd, int size, int flags) :
         fd(fd), magic(sMagic), flags(flags), size(size), offset(0),
-        base(0), pid(getpid())
+        base(0), pid(getpid()), format(0), width(0), height(0), stride(0)
     {
         version = sizeof(native_handle);
         numInts = sNumInts();
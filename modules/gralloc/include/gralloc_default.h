@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_DEFAULT_H_
+#define GRALLOC_DEFAULT_H_
+
+#include <sys/cdefs.h>
+
+#include <hardware/gralloc.h>
+
+__BEGIN_DECLS
+
+/*
+ * Usage of buffers whose handle never leaves the allocating process, which
+ * gralloc.default recycles once freed. Other processes can't register them.
+ */
+#define GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL GRALLOC_USAGE_PRIVATE_0
+
+/*
+ * Operations of gralloc_module_t::perform() that gralloc.default implements
+ * for other modules. Other gralloc modules return an error for them, or have
+ * no perform(), so callers must handle both.
+ */
+
+/* Layout of a buffer given by GRALLOC_DEFAULT_PERFORM_GET_BUFFER_INFO. */
+struct gralloc_default_buffer_info_t {
+    int width;
+    int height;
+    int format;
+    /* in pixels, of the luma plane for YUV formats */
+    int stride;
+};
+
+enum {
+    /* (buffer_handle_t buffer, int* releaseFence): like
+     * framebuffer_device_t::post(), without waiting for the flip, returning a
+     * fence signalled once the buffer isn't displayed anymore, or -1 if the
+     * buffer can be reused already */
+    GRALLOC_DEFAULT_PERFORM_FB_POST = 0x08000006,
+    /* (int numRects, const int* rects): damage of the next buffer posted,
+     * as left, top, right, bottom quadruples */
+    GRALLOC_DEFAULT_PERFORM_FB_SET_DAMAGE = 0x08000007,
+    /* (buffer_handle_t buffer, struct gralloc_default_buffer_info_t* info):
+     * -EINVAL if the buffer isn't a buffer of this module */
+    GRALLOC_DEFAULT_PERFORM_GET_BUFFER_INFO = 0x08000009,
+};
+
+__END_DECLS
+
+#endif /* GRALLOC_DEFAULT_H_ */
@@ -18,18 +18,24 @@
 #include <limits.h>
 #include <pthread.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <unordered_map>
+
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
+#include <linux/ashmem.h>
 #include <log/log.h>
 
 #include <hardware/hardware.h>
 #include <hardware/gralloc.h>
 
 #include "gralloc_priv.h"
+#include "gr.h"
 
 
 /*****************************************************************************/
@@ -73,6 +79,246 @@ static int gralloc_unmap(gralloc_module_t const* /*module*/,
 
 /*****************************************************************************/
 
+/*
+ * Registry of the mappings of registered buffers, shared by all the handles
+ * of a buffer in this process. Consumers register and unregister the same
+ * buffers over and over, so mappings without handles are kept, up to a
+ * budget, and reused when a buffer is registered again.
+ *
+ * A buffer is identified by the inode backing its fd. Regions of the legacy
+ * ashmem driver all share the inode of /dev/ashmem and are told apart with
+ * ASHMEM_GET_FILE_ID instead; when neither works, the buffer is mapped
+ * without the registry. A mapping holds a reference to its inode, so the
+ * identity can't be reused while the mapping is in the registry.
+ */
+
+static const size_t kDefaultIdleMappingBudget = 32 * 1024 * 1024;
+static const char kIdleMappingBudgetProperty[] =
+        "ro.vendor.gralloc.idle_mappings_kb";
+
+struct mapping_key_t {
+    dev_t dev;
+    uint64_t id;
+    size_t size;
+
+    bool operator==(const mapping_key_t& other) const {
+        return dev == other.dev && id == other.id && size == other.size;
+    }
+};
+
+struct mapping_key_hash_t {
+    size_t operator()(const mapping_key_t& key) const {
+        return std::hash<uint64_t>()(key.id) ^
+                (std::hash<uint64_t>()(key.dev) << 1) ^ (key.size >> 12);
+    }
+};
+
+struct mapping_t {
+    mapping_key_t key;
+    void* base;
+    int refs;
+    // links in the list of idle mappings, while refs is 0
+    mapping_t* prev;
+    mapping_t* next;
+};
+
+static Locker sMappingLock;
+static std::unordered_map<mapping_key_t, mapping_t*, mapping_key_hash_t> sMappings;
+static std::unordered_map<void*, mapping_t*> sMappingsByBase;
+// least recently unregistered at the tail
+static mapping_t* sIdleHead;
+static mapping_t* sIdleTail;
+static size_t sIdleBytes;
+static uint32_t sIdleMappings;
+static size_t sIdleBudget;
+static bool sIdleBudgetInitialized;
+static uint64_t sMappingHits;
+static uint64_t sMappingMisses;
+
+static bool getMappingKey(int fd, size_t size, mapping_key_t* key)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return false;
+    }
+    key->size = size;
+    if (S_ISREG(st.st_mode)) {
+        key->dev = st.st_dev;
+        key->id = st.st_ino;
+        return true;
+    }
+#ifdef ASHMEM_GET_FILE_ID
+    unsigned long id;
+    if (S_ISCHR(st.st_mode) && ioctl(fd, ASHMEM_GET_FILE_ID, &id) == 0) {
+        key->dev = st.st_rdev;
+        key->id = id;
+        return true;
+    }
+#endif
+    return false;
+}
+
+static void unlinkIdleLocked(mapping_t* m)
+{
+    if (m->prev) m->prev->next = m->next;
+    else         sIdleHead = m->next;
+    if (m->next) m->next->prev = m->prev;
+    else         sIdleTail = m->prev;
+    sIdleBytes -= m->key.size;
+    sIdleMappings--;
+}
+
+// Removes the least recently unregistered mappings down to bytes and returns
+// them, to be unmapped outside of the lock.
+static mapping_t* trimIdleLocked(size_t bytes)
+{
+    mapping_t* evicted = NULL;
+    while (sIdleBytes > bytes && sIdleTail) {
+        mapping_t* m = sIdleTail;
+        unlinkIdleLocked(m);
+        sMappings.erase(m->key);
+        sMappingsByBase.erase(m->base);
+        m->next = evicted;
+        evicted = m;
+    }
+    return evicted;
+}
+
+static void destroyMappings(mapping_t* m)
+{
+    while (m) {
+        mapping_t* next = m->next;
+        if (munmap(m->base, m->key.size) < 0) {
+            ALOGE("Could not unmap %s", strerror(errno));
+        }
+        delete m;
+        m = next;
+    }
+}
+
+static int acquireMapping(int fd, size_t size, void** base)
+{
+    mapping_key_t key;
+    if (!getMappingKey(fd, size, &key)) {
+        return -ENOENT;
+    }
+
+    {
+        Locker::Autolock _l(sMappingLock);
+        auto it = sMappings.find(key);
+        if (it != sMappings.end()) {
+            mapping_t* m = it->second;
+            if (m->refs++ == 0) {
+                unlinkIdleLocked(m);
+            }
+            sMappingHits++;
+            *base = m->base;
+            return 0;
+        }
+        sMappingMisses++;
+    }
+
+    void* mappedAddress = mmap(0, size,
+            PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mappedAddress == MAP_FAILED && errno == ENOMEM) {
+        // Out of address space or memory: give back the idle mappings.
+        trimMappings(0);
+        mappedAddress = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mappedAddress == MAP_FAILED) {
+        ALOGE("Could not mmap %s", strerror(errno));
+        return -errno;
+    }
+
+    Locker::Autolock _l(sMappingLock);
+    auto it = sMappings.find(key);
+    if (it != sMappings.end()) {
+        // Another thread registered the same buffer meanwhile.
+        mapping_t* m = it->second;
+        if (m->refs++ == 0) {
+            unlinkIdleLocked(m);
+        }
+        munmap(mappedAddress, size);
+        *base = m->base;
+        return 0;
+    }
+    mapping_t* m = new mapping_t;
+    m->key = key;
+    m->base = mappedAddress;
+    m->refs = 1;
+    m->prev = m->next = NULL;
+    sMappings[key] = m;
+    sMappingsByBase[mappedAddress] = m;
+    *base = mappedAddress;
+    return 0;
+}
+
+// Returns false if base isn't a mapping of the registry.
+static bool releaseMapping(void* base)
+{
+    mapping_t* evicted;
+    {
+        Locker::Autolock _l(sMappingLock);
+        auto it = sMappingsByBase.find(base);
+        if (it == sMappingsByBase.end()) {
+            return false;
+        }
+        mapping_t* m = it->second;
+        if (--m->refs > 0) {
+            return true;
+        }
+        if (!sIdleBudgetInitialized) {
+            sIdleBudget = property_get_int64(kIdleMappingBudgetProperty,
+                    kDefaultIdleMappingBudget / 1024) * 1024;
+            sIdleBudgetInitialized = true;
+        }
+        m->prev = NULL;
+        m->next = sIdleHead;
+        if (sIdleHead) sIdleHead->prev = m;
+        else           sIdleTail = m;
+        sIdleHead = m;
+        sIdleBytes += m->key.size;
+        sIdleMappings++;
+        evicted = trimIdleLocked(sIdleBudget);
+    }
+    destroyMappings(evicted);
+    return true;
+}
+
+void trimMappings(size_t bytes)
+{
+    mapping_t* evicted;
+    {
+        Locker::Autolock _l(sMappingLock);
+        evicted = trimIdleLocked(bytes);
+    }
+    destroyMappings(evicted);
+}
+
+bool isBufferRegistered(int fd, size_t size)
+{
+    mapping_key_t key;
+    if (!getMappingKey(fd, size, &key)) {
+        // could be mapped outside of the registry
+        return true;
+    }
+    Locker::Autolock _l(sMappingLock);
+    auto it = sMappings.find(key);
+    return it != sMappings.end() && it->second->refs > 0;
+}
+
+void getMappingStats(private_mapping_stats_t* stats)
+{
+    Locker::Autolock _l(sMappingLock);
+    stats->hits = sMappingHits;
+    stats->misses = sMappingMisses;
+    stats->mappings = sMappings.size();
+    stats->idleMappings = sIdleMappings;
+    stats->idleBytes = sIdleBytes;
+}
+
+/*****************************************************************************/
+
 int gralloc_register_buffer(gralloc_module_t const* module,
         buffer_handle_t handle)
 {
@@ -115,10 +361,28 @@ int gralloc_register_buffer(gralloc_module_t const* module,
     //   problems. Most modern L1 caches fit that description.
 
     private_handle_t* hnd = (private_handle_t*)handle;
+    if ((hnd->flags & private_handle_t::PRIV_FLAGS_PROCESS_LOCAL) &&
+            hnd->pid != getpid()) {
+        // the allocator recycles it once freed, with new contents
+        ALOGE("process-local buffer of pid %d registered in pid %d",
+                hnd->pid, getpid());
+        return -EPERM;
+    }
     ALOGD_IF(hnd->pid == getpid(),
             "Registering a buffer in the process that created it. "
             "This may cause memory ordering problems.");
 
+    if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
+        void* base;
+        int err = acquireMapping(hnd->fd, hnd->size, &base);
+        if (err != -ENOENT) {
+            if (err == 0) {
+                hnd->base = uintptr_t(base) + hnd->offset;
+            }
+            return err;
+        }
+    }
+
     void *vaddr;
     return gralloc_map(module, handle, &vaddr);
 }
@@ -130,8 +394,14 @@ int gralloc_unregister_buffer(gralloc_module_t const* module,
         return -EINVAL;
 
     private_handle_t* hnd = (private_handle_t*)handle;
-    if (hnd->base)
-        gralloc_unmap(module, handle);
+    if (hnd->base) {
+        if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) &&
+                releaseMapping((void*)(hnd->base - hnd->offset))) {
+            hnd->base = 0;
+        } else {
+            gralloc_unmap(module, handle);
+        }
+    }
 
     return 0;
 }
@@ -154,7 +424,7 @@ int terminateBuffer(gralloc_module_t const* module,
     return 0;
 }
 
-int gralloc_lock(gralloc_module_t const* /*module*/,
+int gralloc_lock(gralloc_module_t const* module,
         buffer_handle_t handle, int /*usage*/,
         int /*l*/, int /*t*/, int /*w*/, int /*h*/,
         void** vaddr)
@@ -171,10 +441,41 @@ int gralloc_lock(gralloc_module_t const* /*module*/,
         return -EINVAL;
 
     private_handle_t* hnd = (private_handle_t*)handle;
+    if (hnd->format == HAL_PIXEL_FORMAT_YCBCR_420_888) {
+        // the layout of flexible YUV buffers is only given by lock_ycbcr()
+        return -EINVAL;
+    }
+    if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
+        fbWaitForPage((private_module_t*)module, hnd);
+    }
     *vaddr = (void*)hnd->base;
     return 0;
 }
 
+int gralloc_lock_ycbcr(gralloc_module_t const* /*module*/,
+        buffer_handle_t handle, int /*usage*/,
+        int /*l*/, int /*t*/, int /*w*/, int /*h*/,
+        struct android_ycbcr* ycbcr)
+{
+    if (private_handle_t::validate(handle) < 0)
+        return -EINVAL;
+
+    private_handle_t* hnd = (private_handle_t*)handle;
+    private_yuv_layout_t layout;
+    if (!getYuvLayout(hnd->format, hnd->stride, hnd->height, &layout))
+        return -EINVAL;
+
+    uint8_t* base = (uint8_t*)(uintptr_t)hnd->base;
+    ycbcr->y = base;
+    ycbcr->cb = base + layout.cbOffset;
+    ycbcr->cr = base + layout.crOffset;
+    ycbcr->ystride = hnd->stride;
+    ycbcr->cstride = layout.cStride;
+    ycbcr->chroma_step = layout.chromaStep;
+    memset(ycbcr->reserved, 0, sizeof(ycbcr->reserved));
+    return 0;
+}
+
 int gralloc_unlock(gralloc_module_t const* /*module*/,
         buffer_handle_t handle)
 {
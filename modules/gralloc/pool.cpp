@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/properties.h>
+#include <log/log.h>
+
+#include <hardware/gralloc.h>
+
+#include "gralloc_priv.h"
+#include "gr.h"
+
+/*****************************************************************************/
+
+// Sizes up to this are only rounded to pages, larger sizes to an eighth of
+// their power of 2 range, wasting at most 12.5%.
+static const size_t kSmallSizeLimit = 64 * 1024;
+static const size_t kDefaultPoolBudget = 16 * 1024 * 1024;
+static const char kPoolBudgetProperty[] = "ro.vendor.gralloc.pool_budget_kb";
+
+struct private_pool_entry_t {
+    private_pool_entry_t* prev;
+    private_pool_entry_t* next;
+    int fd;
+    void* base;
+    size_t size;
+};
+
+size_t bufferPoolSizeClass(size_t size)
+{
+    size = roundUpToPageSize(size);
+    if (size <= kSmallSizeLimit) {
+        return size;
+    }
+    size_t range = kSmallSizeLimit;
+    while (range * 2 <= size) {
+        range *= 2;
+    }
+    const size_t step = range / 8;
+    return roundUpToPageSize((size + step - 1) / step * step);
+}
+
+static void initBudgetLocked(private_buffer_pool_t* pool)
+{
+    if (!pool->budgetInitialized) {
+        pool->budget = property_get_int64(kPoolBudgetProperty,
+                kDefaultPoolBudget / 1024) * 1024;
+        pool->budgetInitialized = 1;
+    }
+}
+
+static void unlinkEntryLocked(private_buffer_pool_t* pool, private_pool_entry_t* e)
+{
+    if (e->prev) e->prev->next = e->next;
+    else         pool->head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else         pool->tail = e->prev;
+    pool->cachedBytes -= e->size;
+    pool->cachedBuffers--;
+}
+
+static void destroyEntry(private_pool_entry_t* e)
+{
+    if (munmap(e->base, e->size) < 0) {
+        ALOGE("Could not unmap %s", strerror(errno));
+    }
+    close(e->fd);
+    delete e;
+}
+
+// Unlinks the least recently used entries down to bytes and returns them, to
+// be destroyed outside of the lock.
+static private_pool_entry_t* trimLocked(private_buffer_pool_t* pool, size_t bytes)
+{
+    private_pool_entry_t* evicted = NULL;
+    while (pool->cachedBytes > bytes && pool->tail) {
+        private_pool_entry_t* e = pool->tail;
+        unlinkEntryLocked(pool, e);
+        pool->evictions++;
+        e->next = evicted;
+        evicted = e;
+    }
+    return evicted;
+}
+
+static void destroyEntries(private_pool_entry_t* e)
+{
+    while (e) {
+        private_pool_entry_t* next = e->next;
+        destroyEntry(e);
+        e = next;
+    }
+}
+
+int bufferPoolAcquire(private_module_t* module, size_t size, void** base)
+{
+    private_buffer_pool_t* pool = &module->pool;
+    private_pool_entry_t* e;
+
+    pthread_mutex_lock(&pool->lock);
+    for (e = pool->head; e; e = e->next) {
+        if (e->size == size) {
+            unlinkEntryLocked(pool, e);
+            break;
+        }
+    }
+    if (e) {
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (!e) {
+        return -1;
+    }
+
+    // New buffers are zero-filled, and the previous contents must not leak
+    // to the next user. Pages purged while unpinned already read as zero.
+    if (ashmem_pin_region(e->fd, 0, 0) != ASHMEM_WAS_PURGED) {
+        memset(e->base, 0, e->size);
+    }
+    const int fd = e->fd;
+    *base = e->base;
+    delete e;
+    return fd;
+}
+
+int bufferPoolRelease(private_module_t* module, int fd, void* base, size_t size)
+{
+    private_buffer_pool_t* pool = &module->pool;
+
+    // Let the kernel reclaim the pages of pooled buffers under memory
+    // pressure.
+    ashmem_unpin_region(fd, 0, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    initBudgetLocked(pool);
+    if (size > pool->budget / 2) {
+        pthread_mutex_unlock(&pool->lock);
+        ashmem_pin_region(fd, 0, 0);
+        return -1;
+    }
+    private_pool_entry_t* e = new private_pool_entry_t;
+    e->prev = NULL;
+    e->next = pool->head;
+    e->fd = fd;
+    e->base = base;
+    e->size = size;
+    if (pool->head) pool->head->prev = e;
+    else            pool->tail = e;
+    pool->head = e;
+    pool->cachedBytes += size;
+    pool->cachedBuffers++;
+    private_pool_entry_t* evicted = trimLocked(pool, pool->budget);
+    pthread_mutex_unlock(&pool->lock);
+    destroyEntries(evicted);
+    return 0;
+}
+
+void bufferPoolTrim(private_module_t* module, size_t bytes)
+{
+    private_buffer_pool_t* pool = &module->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    private_pool_entry_t* evicted = trimLocked(pool, bytes);
+    pthread_mutex_unlock(&pool->lock);
+    destroyEntries(evicted);
+}
+
+void bufferPoolSetBudget(private_module_t* module, size_t budget)
+{
+    private_buffer_pool_t* pool = &module->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->budget = budget;
+    pool->budgetInitialized = 1;
+    private_pool_entry_t* evicted = trimLocked(pool, budget);
+    pthread_mutex_unlock(&pool->lock);
+    destroyEntries(evicted);
+}
+
+void bufferPoolGetStats(private_module_t* module, private_pool_stats_t* stats)
+{
+    private_buffer_pool_t* pool = &module->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    initBudgetLocked(pool);
+    stats->hits = pool->hits;
+    stats->misses = pool->misses;
+    stats->evictions = pool->evictions;
+    stats->cachedBytes = pool->cachedBytes;
+    stats->cachedBuffers = pool->cachedBuffers;
+    stats->budget = pool->budget;
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the latency of allocating, filling and freeing process-local
+// buffers with gralloc.default with and without its buffer pool, the way
+// in-process pipelines reallocate buffers of the same size on each
+// reconfiguration.
+
+#include <string.h>
+
+#include <benchmark/benchmark.h>
+#include <hardware/gralloc.h>
+#include <hardware/hardware.h>
+#include <log/log.h>
+
+#include "../gralloc_priv.h"
+
+// Large enough to pool a round of the largest buffers.
+static const size_t kPoolBudget = 256 * 1024 * 1024;
+// Buffers allocated at once, as by a stream reconfiguration.
+static const int kBuffersPerRound = 4;
+
+static gralloc_module_t const* sModule;
+static alloc_device_t* sDevice;
+
+static bool openGralloc() {
+    if (sDevice != nullptr) {
+        return true;
+    }
+    const hw_module_t* module;
+    if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module) != 0) {
+        return false;
+    }
+    // The private perform() operations are only understood by gralloc.default.
+    if (strcmp(module->name, "Graphics Memory Allocator Module") != 0) {
+        return false;
+    }
+    if (gralloc_open(module, &sDevice) != 0) {
+        return false;
+    }
+    sModule = reinterpret_cast<gralloc_module_t const*>(module);
+    return true;
+}
+
+// Args: width, height, whether the pool is enabled.
+static void BM_AllocFillFree(benchmark::State& state) {
+    if (!openGralloc()) {
+        state.SkipWithError("gralloc.default is not the gralloc module");
+        return;
+    }
+    const int width = state.range(0);
+    const int height = state.range(1);
+    const bool pooled = state.range(2) != 0;
+    sModule->perform(sModule, GRALLOC_MODULE_PERFORM_PRIVATE_SET_POOL_BUDGET,
+            pooled ? kPoolBudget : size_t(0));
+
+    private_pool_stats_t before;
+    sModule->perform(sModule, GRALLOC_MODULE_PERFORM_PRIVATE_GET_POOL_STATS, &before);
+    const int usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN |
+            GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL;
+    buffer_handle_t handles[kBuffersPerRound];
+    int stride;
+    for (auto _ : state) {
+        for (int i = 0; i < kBuffersPerRound; i++) {
+            if (sDevice->alloc(sDevice, width, height, HAL_PIXEL_FORMAT_RGBA_8888, usage,
+                        &handles[i], &stride) != 0) {
+                state.SkipWithError("alloc failed");
+                return;
+            }
+            void* vaddr;
+            sModule->lock(sModule, handles[i], usage, 0, 0, width, height, &vaddr);
+            memset(vaddr, 0xff, size_t(stride) * height * 4);
+            sModule->unlock(sModule, handles[i]);
+        }
+        for (int i = 0; i < kBuffersPerRound; i++) {
+            sDevice->free(sDevice, handles[i]);
+        }
+    }
+
+    private_pool_stats_t after;
+    sModule->perform(sModule, GRALLOC_MODULE_PERFORM_PRIVATE_GET_POOL_STATS, &after);
+    const double requests = (after.hits - before.hits) + (after.misses - before.misses);
+    state.counters["hit_rate"] = requests ? (after.hits - before.hits) / requests : 0;
+    state.SetItemsProcessed(state.iterations() * kBuffersPerRound);
+    sModule->perform(sModule, GRALLOC_MODULE_PERFORM_PRIVATE_TRIM_POOL, size_t(0));
+}
+BENCHMARK(BM_AllocFillFree)
+        ->ArgNames({"width", "height", "pooled"})
+        ->Args({640, 480, 0})->Args({640, 480, 1})
+        ->Args({1920, 1080, 0})->Args({1920, 1080, 1})
+        ->Args({3840, 2160, 0})->Args({3840, 2160, 1});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// To run this test (as root):
+// 1) Build it
+// 2) adb push to /vendor/bin
+// 3) adb shell /vendor/bin/gralloc_default_tests
+
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <cutils/native_handle.h>
+#include <hardware/gralloc.h>
+#include <hardware/hardware.h>
+#include <log/log.h>
+
+#include "../gralloc_priv.h"
+
+class GrallocDefaultTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        const hw_module_t* module;
+        mDevice = nullptr;
+        ASSERT_EQ(0, hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module));
+        // The private perform() operations are only understood by gralloc.default.
+        if (strcmp(module->name, "Graphics Memory Allocator Module") != 0) {
+            GTEST_SKIP() << "gralloc.default is not the gralloc module";
+        }
+        mModule = reinterpret_cast<gralloc_module_t const*>(module);
+        ASSERT_EQ(0, gralloc_open(module, &mDevice));
+        ASSERT_EQ(0, mModule->perform(mModule, GRALLOC_MODULE_PERFORM_PRIVATE_SET_POOL_BUDGET,
+                size_t(16 * 1024 * 1024)));
+    }
+
+    void TearDown() override {
+        if (mDevice != nullptr) {
+            mModule->perform(mModule, GRALLOC_MODULE_PERFORM_PRIVATE_TRIM_POOL, size_t(0));
+            mModule->perform(mModule, GRALLOC_MODULE_PERFORM_PRIVATE_TRIM_MAPPINGS, size_t(0));
+            gralloc_close(mDevice);
+        }
+    }
+
+    buffer_handle_t Allocate(int usage) {
+        buffer_handle_t handle = nullptr;
+        int stride;
+        EXPECT_EQ(0, mDevice->alloc(mDevice, kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888,
+                usage | kCpuUsage, &handle, &stride));
+        return handle;
+    }
+
+    // Fills the buffer with value.
+    void Fill(buffer_handle_t handle, uint8_t value) {
+        void* vaddr;
+        ASSERT_EQ(0, mModule->lock(mModule, handle, kCpuUsage, 0, 0, kWidth, kHeight, &vaddr));
+        memset(vaddr, value, kBytes);
+        mModule->unlock(mModule, handle);
+    }
+
+    // Checks that the buffer only holds value.
+    void ExpectFilledWith(buffer_handle_t handle, uint8_t value) {
+        void* vaddr;
+        ASSERT_EQ(0, mModule->lock(mModule, handle, kCpuUsage, 0, 0, kWidth, kHeight, &vaddr));
+        const uint8_t* bytes = static_cast<const uint8_t*>(vaddr);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < kBytes; ++i) {
+            mismatches += bytes[i] != value;
+        }
+        EXPECT_EQ(0U, mismatches);
+        mModule->unlock(mModule, handle);
+    }
+
+    private_pool_stats_t PoolStats() {
+        private_pool_stats_t stats = {};
+        mModule->perform(mModule, GRALLOC_MODULE_PERFORM_PRIVATE_GET_POOL_STATS, &stats);
+        return stats;
+    }
+
+    private_mapping_stats_t MappingStats() {
+        private_mapping_stats_t stats = {};
+        mModule->perform(mModule, GRALLOC_MODULE_PERFORM_PRIVATE_GET_MAPPING_STATS, &stats);
+        return stats;
+    }
+
+    // 64-pixel wide, so that the stride is the width whatever the alignment.
+    static const int kWidth = 64;
+    static const int kHeight = 64;
+    static const size_t kBytes = kWidth * kHeight * 4;
+    static const int kCpuUsage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+    gralloc_module_t const* mModule;
+    alloc_device_t* mDevice;
+};
+
+// A freed process-local buffer is handed out again, cleared.
+TEST_F(GrallocDefaultTest, ProcessLocalBufferIsRecycledCleared) {
+    buffer_handle_t first = Allocate(GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL);
+    ASSERT_NE(nullptr, first);
+    Fill(first, 0xa5);
+    ASSERT_EQ(0, mDevice->free(mDevice, first));
+    EXPECT_EQ(1U, PoolStats().cachedBuffers);
+
+    const private_pool_stats_t before = PoolStats();
+    buffer_handle_t second = Allocate(GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL);
+    ASSERT_NE(nullptr, second);
+    EXPECT_EQ(before.hits + 1, PoolStats().hits);
+    ExpectFilledWith(second, 0);
+    mDevice->free(mDevice, second);
+}
+
+// Buffers that may be shared with other processes are never recycled.
+TEST_F(GrallocDefaultTest, SharedBufferIsNotRecycled) {
+    buffer_handle_t handle = Allocate(0);
+    ASSERT_NE(nullptr, handle);
+    ASSERT_EQ(0, mDevice->free(mDevice, handle));
+    EXPECT_EQ(0U, PoolStats().cachedBuffers);
+}
+
+// A process-local buffer still registered through another handle isn't recycled.
+TEST_F(GrallocDefaultTest, RegisteredBufferIsNotRecycled) {
+    buffer_handle_t handle = Allocate(GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL);
+    ASSERT_NE(nullptr, handle);
+    native_handle_t* clone = native_handle_clone(handle);
+    ASSERT_NE(nullptr, clone);
+    ASSERT_EQ(0, mModule->registerBuffer(mModule, clone));
+    ASSERT_EQ(0, mDevice->free(mDevice, handle));
+    EXPECT_EQ(0U, PoolStats().cachedBuffers);
+    mModule->unregisterBuffer(mModule, clone);
+    native_handle_close(clone);
+    native_handle_delete(clone);
+}
+
+// Other processes can't map a process-local buffer, whose contents change once recycled.
+TEST_F(GrallocDefaultTest, ProcessLocalBufferIsNotRegisteredElsewhere) {
+    buffer_handle_t handle = Allocate(GRALLOC_DEFAULT_USAGE_PROCESS_LOCAL);
+    ASSERT_NE(nullptr, handle);
+    const pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        _exit(mModule->registerBuffer(mModule, handle) == -EPERM ? 0 : 1);
+    }
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    mDevice->free(mDevice, handle);
+}
+
+// Registering a buffer again after unregistering it reuses its idle mapping.
+TEST_F(GrallocDefaultTest, ReregisteredBufferIsNotMappedAgain) {
+    buffer_handle_t handle = Allocate(0);
+    ASSERT_NE(nullptr, handle);
+    native_handle_t* clone = native_handle_clone(handle);
+    ASSERT_NE(nullptr, clone);
+    ASSERT_EQ(0, mModule->registerBuffer(mModule, clone));
+    ASSERT_EQ(0, mModule->unregisterBuffer(mModule, clone));
+    const private_mapping_stats_t idle = MappingStats();
+    EXPECT_EQ(1U, idle.idleMappings);
+
+    ASSERT_EQ(0, mModule->registerBuffer(mModule, clone));
+    const private_mapping_stats_t reregistered = MappingStats();
+    EXPECT_EQ(idle.misses, reregistered.misses);
+    EXPECT_EQ(idle.hits + 1, reregistered.hits);
+    EXPECT_EQ(0U, reregistered.idleMappings);
+    ExpectFilledWith(clone, 0);
+
+    // Trimming drops the idle mapping, and the next registration maps again.
+    ASSERT_EQ(0, mModule->unregisterBuffer(mModule, clone));
+    ASSERT_EQ(0, mModule->perform(mModule, GRALLOC_MODULE_PERFORM_PRIVATE_TRIM_MAPPINGS,
+            size_t(0)));
+    EXPECT_EQ(0U, MappingStats().idleMappings);
+    ASSERT_EQ(0, mModule->registerBuffer(mModule, clone));
+    EXPECT_EQ(idle.misses + 1, MappingStats().misses);
+    mModule->unregisterBuffer(mModule, clone);
+    native_handle_close(clone);
+    native_handle_delete(clone);
+    mDevice->free(mDevice, handle);
+}
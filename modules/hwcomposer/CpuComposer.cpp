@@ -0,0 +1,626 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <log/log.h>
+
+#include "CpuComposer.h"
+
+namespace android {
+
+// x * a / 255 rounded to nearest, for x and a in [0, 255].
+static inline uint32_t mul255(uint32_t x, uint32_t a)
+{
+    const uint32_t t = x * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// Pixels are composed as RGBA 8888, R in the low byte.
+static inline uint32_t swap_red_blue(uint32_t p)
+{
+    return (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+}
+
+static inline uint32_t from_rgb565(uint16_t v)
+{
+    const uint32_t r = (v >> 11) & 0x1F;
+    const uint32_t g = (v >> 5) & 0x3F;
+    const uint32_t b = v & 0x1F;
+    return 0xFF000000 | (((b << 3) | (b >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) |
+            ((r << 3) | (r >> 2));
+}
+
+static inline uint16_t to_rgb565(uint32_t p)
+{
+    return (uint16_t)(((p & 0xF8) << 8) | ((p >> 5) & 0x7E0) | ((p >> 19) & 0x1F));
+}
+
+static inline uint32_t blend_pixel(uint32_t d, uint32_t s, int32_t blending, uint32_t planeAlpha)
+{
+    if (blending == HWC_BLENDING_NONE) {
+        s |= 0xFF000000;
+    } else if (blending == HWC_BLENDING_COVERAGE) {
+        const uint32_t a = s >> 24;
+        s = (a << 24) | (mul255((s >> 16) & 0xFF, a) << 16) | (mul255((s >> 8) & 0xFF, a) << 8) |
+                mul255(s & 0xFF, a);
+    }
+    if (planeAlpha != 255) {
+        s = (mul255(s >> 24, planeAlpha) << 24) | (mul255((s >> 16) & 0xFF, planeAlpha) << 16) |
+                (mul255((s >> 8) & 0xFF, planeAlpha) << 8) | mul255(s & 0xFF, planeAlpha);
+    }
+    const uint32_t ia = 255 - (s >> 24);
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t c = ((s >> shift) & 0xFF) + mul255((d >> shift) & 0xFF, ia);
+        result |= (c > 255 ? 255 : c) << shift;
+    }
+    return result;
+}
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+
+static inline uint8x8_t mul255_u8(uint8x8_t x, uint8x8_t a)
+{
+    const uint16x8_t t = vmull_u8(x, a);
+    return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+}
+
+// Blends 8 pixels, returns the number of pixels blended.
+static inline size_t blend_simd(uint32_t *dst, const uint32_t *src, size_t count,
+        int32_t blending, uint32_t planeAlpha)
+{
+    const uint8x8_t pa = vdup_n_u8(planeAlpha);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8_t *>(src + i));
+        if (blending == HWC_BLENDING_NONE) {
+            s.val[3] = vdup_n_u8(255);
+        } else if (blending == HWC_BLENDING_COVERAGE) {
+            for (int c = 0; c < 3; c++) {
+                s.val[c] = mul255_u8(s.val[c], s.val[3]);
+            }
+        }
+        if (planeAlpha != 255) {
+            for (int c = 0; c < 4; c++) {
+                s.val[c] = mul255_u8(s.val[c], pa);
+            }
+        }
+        uint8x8x4_t d = vld4_u8(reinterpret_cast<const uint8_t *>(dst + i));
+        const uint8x8_t ia = vmvn_u8(s.val[3]);
+        for (int c = 0; c < 4; c++) {
+            d.val[c] = vqadd_u8(s.val[c], mul255_u8(d.val[c], ia));
+        }
+        vst4_u8(reinterpret_cast<uint8_t *>(dst + i), d);
+    }
+    return i;
+}
+
+#elif defined(__SSE2__)
+
+static inline __m128i mul255_epi16(__m128i x, __m128i a)
+{
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Broadcasts the alpha of the 2 pixels unpacked to 16-bit lanes.
+static inline __m128i alpha_epi16(__m128i x)
+{
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)),
+            _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static inline __m128i blend_epi16(__m128i d, __m128i s, int32_t blending, __m128i pa,
+        bool scale)
+{
+    if (blending == HWC_BLENDING_COVERAGE) {
+        const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        const __m128i factor = _mm_or_si128(_mm_andnot_si128(alphaLanes, alpha_epi16(s)),
+                _mm_and_si128(alphaLanes, _mm_set1_epi16(255)));
+        s = mul255_epi16(s, factor);
+    }
+    if (scale) {
+        s = mul255_epi16(s, pa);
+    }
+    const __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), alpha_epi16(s));
+    return _mm_add_epi16(s, mul255_epi16(d, ia));
+}
+
+// Blends 4 pixels at a time, returns the number of pixels blended.
+static inline size_t blend_simd(uint32_t *dst, const uint32_t *src, size_t count,
+        int32_t blending, uint32_t planeAlpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32(0xFF000000);
+    const __m128i pa = _mm_set1_epi16(planeAlpha);
+    const bool scale = planeAlpha != 255;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (blending == HWC_BLENDING_NONE) {
+            s = _mm_or_si128(s, opaque);
+        } else if (!scale) {
+            // Skip the arithmetic for runs of opaque or transparent pixels.
+            const __m128i alpha = _mm_and_si128(s, opaque);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, opaque)) == 0xFFFF) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), s);
+                continue;
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(
+                        blending == HWC_BLENDING_COVERAGE ? alpha : s, zero)) == 0xFFFF) {
+                continue;
+            }
+        }
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+        const __m128i lo = blend_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero),
+                blending, pa, scale);
+        const __m128i hi = blend_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero),
+                blending, pa, scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+#else
+
+static inline size_t blend_simd(uint32_t * /*dst*/, const uint32_t * /*src*/, size_t /*count*/,
+        int32_t /*blending*/, uint32_t /*planeAlpha*/)
+{
+    return 0;
+}
+
+#endif
+
+static void blend_span(uint32_t *dst, const uint32_t *src, size_t count, int32_t blending,
+        uint32_t planeAlpha)
+{
+    if (blending == HWC_BLENDING_NONE && planeAlpha == 255) {
+        // The alpha of opaque formats is undefined, the layer covers what is below.
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = src[i] | 0xFF000000;
+        }
+        return;
+    }
+    for (size_t i = blend_simd(dst, src, count, blending, planeAlpha); i < count; i++) {
+        dst[i] = blend_pixel(dst[i], src[i], blending, planeAlpha);
+    }
+}
+
+static void store_row(uint8_t *dst, const uint32_t *row, int width, int format)
+{
+    switch (format) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+        memcpy(dst, row, width * sizeof(uint32_t));
+        break;
+    case HAL_PIXEL_FORMAT_BGRA_8888: {
+        uint32_t *out = reinterpret_cast<uint32_t *>(dst);
+        for (int x = 0; x < width; x++) {
+            out[x] = swap_red_blue(row[x]);
+        }
+        break;
+    }
+    case HAL_PIXEL_FORMAT_RGB_565: {
+        uint16_t *out = reinterpret_cast<uint16_t *>(dst);
+        for (int x = 0; x < width; x++) {
+            out[x] = to_rgb565(row[x]);
+        }
+        break;
+    }
+    }
+}
+
+// BT.601 limited range, as video encoders expect.
+static inline uint8_t to_luma(uint32_t p)
+{
+    const int32_t r = p & 0xFF;
+    const int32_t g = (p >> 8) & 0xFF;
+    const int32_t b = (p >> 16) & 0xFF;
+    return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+// Converts two composed rows, the second being the first again at the bottom of odd heights.
+static void store_yuv_rows(const android_ycbcr &dst, int y, const uint32_t *row0,
+        const uint32_t *row1, bool secondRow, int left, int right)
+{
+    uint8_t *luma0 = static_cast<uint8_t *>(dst.y) + (size_t)y * dst.ystride;
+    for (int x = left; x < right; x++) {
+        luma0[x] = to_luma(row0[x]);
+    }
+    if (secondRow) {
+        uint8_t *luma1 = luma0 + dst.ystride;
+        for (int x = left; x < right; x++) {
+            luma1[x] = to_luma(row1[x]);
+        }
+    }
+    const size_t chromaOffset = (size_t)(y / 2) * dst.cstride;
+    uint8_t *cb = static_cast<uint8_t *>(dst.cb) + chromaOffset;
+    uint8_t *cr = static_cast<uint8_t *>(dst.cr) + chromaOffset;
+    for (int x = left; x < right; x += 2) {
+        const int x1 = x + 1 < right ? x + 1 : x;
+        const uint32_t p[4] = { row0[x], row0[x1], row1[x], row1[x1] };
+        int32_t r = 0, g = 0, b = 0;
+        for (uint32_t q : p) {
+            r += q & 0xFF;
+            g += (q >> 8) & 0xFF;
+            b += (q >> 16) & 0xFF;
+        }
+        // The sums of 4 pixels, hence the 2 more bits shifted.
+        const size_t i = (size_t)(x / 2) * dst.chroma_step;
+        cb[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+        cr[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+    }
+}
+
+static int bytes_per_pixel(int format)
+{
+    return format == HAL_PIXEL_FORMAT_RGB_565 ? 2 : 4;
+}
+
+template <int format>
+static inline uint32_t read_pixel(const uint8_t *pixels, int stride, int x, int y)
+{
+    if (format == HAL_PIXEL_FORMAT_RGB_565) {
+        return from_rgb565(reinterpret_cast<const uint16_t *>(pixels)[(size_t)y * stride + x]);
+    }
+    const uint32_t p = reinterpret_cast<const uint32_t *>(pixels)[(size_t)y * stride + x];
+    return format == HAL_PIXEL_FORMAT_BGRA_8888 ? swap_red_blue(p) : p;
+}
+
+template <int format>
+static void sample_span(const CpuLayer &layer, int64_t minX, int64_t minY, int64_t maxX,
+        int64_t maxY, int64_t x, int64_t y, int64_t stepX, int64_t stepY, int count,
+        uint32_t *out)
+{
+    for (int i = 0; i < count; i++, x += stepX, y += stepY) {
+        const int64_t cx = x < minX ? minX : (x > maxX ? maxX : x);
+        const int64_t cy = y < minY ? minY : (y > maxY ? maxY : y);
+        out[i] = read_pixel<format>(layer.pixels, layer.stride, cx >> 16, cy >> 16);
+    }
+}
+
+CpuComposer::CpuComposer(size_t threadCount)
+    : mGeneration(0),
+      mBusyThreads(0),
+      mExiting(false),
+      mLayers(nullptr),
+      mDst(nullptr),
+      mDstStride(0),
+      mDstFormat(0),
+      mYuv(false),
+      mDstYuv(),
+      mWidth(0),
+      mHeight(0),
+      mRect(),
+      mNextBand(0)
+{
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    mScratch.resize(threadCount);
+    for (size_t i = 1; i < threadCount; i++) {
+        mThreads.emplace_back(&CpuComposer::worker, this, i);
+    }
+}
+
+CpuComposer::~CpuComposer()
+{
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mExiting = true;
+    }
+    mWorkCond.notify_all();
+    for (std::thread &thread : mThreads) {
+        thread.join();
+    }
+}
+
+bool CpuComposer::supportsFormat(int format)
+{
+    switch (format) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+    case HAL_PIXEL_FORMAT_RGB_565:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void CpuComposer::compose(const std::vector<CpuLayer> &layers, uint8_t *dst, int stride,
+        int format, int width, int height, const hwc_rect_t *rects, size_t numRects)
+{
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    prepare(layers, width, height);
+    mDst = dst;
+    mDstStride = stride;
+    mDstFormat = format;
+    mYuv = false;
+    composeRects(rects, numRects);
+}
+
+void CpuComposer::composeYuv(const std::vector<CpuLayer> &layers, const android_ycbcr &dst,
+        int width, int height, const hwc_rect_t *rects, size_t numRects)
+{
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    prepare(layers, width, height);
+    mDstYuv = dst;
+    mYuv = true;
+    if (numRects == 0) {
+        composeRects(nullptr, 0);
+        return;
+    }
+    std::vector<hwc_rect_t> aligned(rects, rects + numRects);
+    for (hwc_rect_t &rect : aligned) {
+        rect.left &= ~1;
+        rect.top &= ~1;
+        rect.right = (rect.right + 1) & ~1;
+        rect.bottom = (rect.bottom + 1) & ~1;
+    }
+    composeRects(aligned.data(), aligned.size());
+}
+
+void CpuComposer::prepare(const std::vector<CpuLayer> &layers, int width, int height)
+{
+    mStates.resize(layers.size());
+    for (size_t i = 0; i < layers.size(); i++) {
+        const CpuLayer &layer = layers[i];
+        LayerState &state = mStates[i];
+        const double frameLeft = layer.frame.left;
+        const double frameTop = layer.frame.top;
+        const double frameWidth = layer.frame.right - layer.frame.left;
+        const double frameHeight = layer.frame.bottom - layer.frame.top;
+        const double cropWidth = layer.crop.right - layer.crop.left;
+        const double cropHeight = layer.crop.bottom - layer.crop.top;
+        // The source is flipped, then rotated, then scaled to the frame: undo it in reverse.
+        auto map = [&](double x, double y, double *sx, double *sy) {
+            const double u = (x + 0.5 - frameLeft) / frameWidth;
+            const double v = (y + 0.5 - frameTop) / frameHeight;
+            double s = u;
+            double t = v;
+            if (layer.transform & HAL_TRANSFORM_ROT_90) {
+                s = v;
+                t = 1.0 - u;
+            }
+            if (layer.transform & HAL_TRANSFORM_FLIP_H) {
+                s = 1.0 - s;
+            }
+            if (layer.transform & HAL_TRANSFORM_FLIP_V) {
+                t = 1.0 - t;
+            }
+            *sx = layer.crop.left + s * cropWidth;
+            *sy = layer.crop.top + t * cropHeight;
+        };
+        double x0, y0, x1, y1, x2, y2;
+        map(0, 0, &x0, &y0);
+        map(1, 0, &x1, &y1);
+        map(0, 1, &x2, &y2);
+        state.originX = llround(x0 * 65536.0);
+        state.originY = llround(y0 * 65536.0);
+        state.stepXX = llround((x1 - x0) * 65536.0);
+        state.stepXY = llround((y1 - y0) * 65536.0);
+        state.stepYX = llround((x2 - x0) * 65536.0);
+        state.stepYY = llround((y2 - y0) * 65536.0);
+        state.minX = (int64_t)floor(layer.crop.left) << 16;
+        state.minY = (int64_t)floor(layer.crop.top) << 16;
+        state.maxX = ((int64_t)ceil(layer.crop.right) << 16) - 1;
+        state.maxY = ((int64_t)ceil(layer.crop.bottom) << 16) - 1;
+        state.identity = layer.transform == 0 && cropWidth == frameWidth &&
+                cropHeight == frameHeight && layer.crop.left == floor(layer.crop.left) &&
+                layer.crop.top == floor(layer.crop.top);
+        state.blending = layer.format == HAL_PIXEL_FORMAT_RGBX_8888 ||
+                layer.format == HAL_PIXEL_FORMAT_RGB_565 ? HWC_BLENDING_NONE : layer.blending;
+        state.opaque = state.blending == HWC_BLENDING_NONE && layer.planeAlpha == 255;
+    }
+
+    mLayers = &layers;
+    mWidth = width;
+    mHeight = height;
+    for (std::vector<uint32_t> &scratch : mScratch) {
+        scratch.resize(width * 3);
+    }
+}
+
+void CpuComposer::composeRects(const hwc_rect_t *rects, size_t numRects)
+{
+    const int width = mWidth;
+    const int height = mHeight;
+    if (numRects == 0) {
+        const hwc_rect_t screen = { 0, 0, width, height };
+        composeRect(screen);
+        return;
+    }
+    for (size_t i = 0; i < numRects; i++) {
+        hwc_rect_t rect = rects[i];
+        rect.left = rect.left > 0 ? rect.left : 0;
+        rect.top = rect.top > 0 ? rect.top : 0;
+        rect.right = rect.right < width ? rect.right : width;
+        rect.bottom = rect.bottom < height ? rect.bottom : height;
+        if (rect.left < rect.right && rect.top < rect.bottom) {
+            composeRect(rect);
+        }
+    }
+}
+
+void CpuComposer::composeRect(const hwc_rect_t &rect)
+{
+    mRect = rect;
+    mNextBand = 0;
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mGeneration++;
+        mBusyThreads = mThreads.size();
+    }
+    mWorkCond.notify_all();
+    composeBands(0);
+    std::unique_lock<std::mutex> lock(mLock);
+    mDoneCond.wait(lock, [this] { return mBusyThreads == 0; });
+}
+
+void CpuComposer::worker(size_t scratchIndex)
+{
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(mLock);
+    for (;;) {
+        mWorkCond.wait(lock, [&] { return mExiting || mGeneration != generation; });
+        if (mExiting) {
+            return;
+        }
+        generation = mGeneration;
+        lock.unlock();
+        composeBands(scratchIndex);
+        lock.lock();
+        if (--mBusyThreads == 0) {
+            mDoneCond.notify_one();
+        }
+    }
+}
+
+void CpuComposer::composeBands(size_t scratchIndex)
+{
+    uint32_t *row = mScratch[scratchIndex].data();
+    uint32_t *secondRow = row + mWidth;
+    uint32_t *fetchBuffer = secondRow + mWidth;
+    const hwc_rect_t &rect = mRect;
+    const int bands = (rect.bottom - rect.top + kBandHeight - 1) / kBandHeight;
+    const size_t bpp = bytes_per_pixel(mDstFormat);
+    const size_t rowBytes = (size_t)mDstStride * bpp;
+    for (int band = mNextBand++; band < bands; band = mNextBand++) {
+        const int top = rect.top + band * kBandHeight;
+        const int bottom = top + kBandHeight < rect.bottom ? top + kBandHeight : rect.bottom;
+        if (mYuv) {
+            // Bands start on even rows, pairs of rows share their chroma.
+            for (int y = top; y < bottom; y += 2) {
+                composeRow(y, rect.left, rect.right, row, fetchBuffer);
+                const bool second = y + 1 < bottom;
+                if (second) {
+                    composeRow(y + 1, rect.left, rect.right, secondRow, fetchBuffer);
+                }
+                store_yuv_rows(mDstYuv, y, row, second ? secondRow : row, second, rect.left,
+                        rect.right);
+            }
+            continue;
+        }
+        for (int y = top; y < bottom; y++) {
+            composeRow(y, rect.left, rect.right, row, fetchBuffer);
+            store_row(mDst + y * rowBytes + rect.left * bpp, row + rect.left,
+                    rect.right - rect.left, mDstFormat);
+        }
+    }
+}
+
+void CpuComposer::composeRow(int y, int left, int right, uint32_t *row, uint32_t *fetchBuffer)
+{
+    const std::vector<CpuLayer> &layers = *mLayers;
+
+    // Start from the topmost layer hiding the whole span.
+    size_t first = layers.size();
+    while (first > 0) {
+        const CpuLayer &layer = layers[first - 1];
+        if (mStates[first - 1].opaque && layer.frame.left <= left &&
+                layer.frame.right >= right && y >= layer.frame.top && y < layer.frame.bottom) {
+            break;
+        }
+        first--;
+    }
+    if (first == 0) {
+        memset(row + left, 0, (right - left) * sizeof(uint32_t));
+    } else {
+        first--;
+    }
+
+    for (size_t i = first; i < layers.size(); i++) {
+        const CpuLayer &layer = layers[i];
+        if (y < layer.frame.top || y >= layer.frame.bottom) {
+            continue;
+        }
+        const int spanLeft = layer.frame.left > left ? layer.frame.left : left;
+        const int spanRight = layer.frame.right < right ? layer.frame.right : right;
+        if (spanLeft >= spanRight) {
+            continue;
+        }
+        const uint32_t *src = fetch(layer, mStates[i], y, spanLeft, spanRight, fetchBuffer);
+        blend_span(row + spanLeft, src, spanRight - spanLeft, mStates[i].blending,
+                layer.planeAlpha);
+    }
+}
+
+const uint32_t *CpuComposer::fetch(const CpuLayer &layer, const LayerState &state, int y,
+        int left, int right, uint32_t *buffer)
+{
+    const int count = right - left;
+    if (state.identity) {
+        const int sx = (int)layer.crop.left + (left - layer.frame.left);
+        const int sy = (int)layer.crop.top + (y - layer.frame.top);
+        switch (layer.format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+            // Read in place.
+            return reinterpret_cast<const uint32_t *>(layer.pixels) + (size_t)sy * layer.stride +
+                    sx;
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            for (int i = 0; i < count; i++) {
+                buffer[i] = read_pixel<HAL_PIXEL_FORMAT_BGRA_8888>(layer.pixels, layer.stride,
+                        sx + i, sy);
+            }
+            return buffer;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            for (int i = 0; i < count; i++) {
+                buffer[i] = read_pixel<HAL_PIXEL_FORMAT_RGB_565>(layer.pixels, layer.stride,
+                        sx + i, sy);
+            }
+            return buffer;
+        }
+    }
+
+    const int64_t x = state.originX + left * state.stepXX + y * state.stepYX;
+    const int64_t sy = state.originY + left * state.stepXY + y * state.stepYY;
+    switch (layer.format) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+        sample_span<HAL_PIXEL_FORMAT_RGBA_8888>(layer, state.minX, state.minY, state.maxX,
+                state.maxY, x, sy, state.stepXX, state.stepXY, count, buffer);
+        break;
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+        sample_span<HAL_PIXEL_FORMAT_BGRA_8888>(layer, state.minX, state.minY, state.maxX,
+                state.maxY, x, sy, state.stepXX, state.stepXY, count, buffer);
+        break;
+    case HAL_PIXEL_FORMAT_RGB_565:
+        sample_span<HAL_PIXEL_FORMAT_RGB_565>(layer, state.minX, state.minY, state.maxX,
+                state.maxY, x, sy, state.stepXX, state.stepXY, count, buffer);
+        break;
+    default:
+        ALOGE("CpuComposer::fetch() unsupported format %d", layer.format);
+        memset(buffer, 0, count * sizeof(uint32_t));
+        break;
+    }
+    return buffer;
+}
+
+}  // namespace android
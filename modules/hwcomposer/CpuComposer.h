@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWC_CPU_COMPOSER_H
+#define ANDROID_HWC_CPU_COMPOSER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include <hardware/hwcomposer.h>
+
+namespace android {
+
+// A layer to compose, its buffer mapped for reading.
+struct CpuLayer {
+    const uint8_t *pixels;
+    // in pixels
+    int stride;
+    int format;
+    // area of the buffer composed, not empty
+    hwc_frect_t crop;
+    // where the crop is composed in the destination, scaled as needed
+    hwc_rect_t frame;
+    uint32_t transform;
+    int32_t blending;
+    uint8_t planeAlpha;
+};
+
+// Composes layers into a buffer with the CPU, sampling the sources with the nearest pixel and
+// blending them as the hwcomposer.h blending modes and plane alpha specify.  The destination is
+// split in bands of rows composed in parallel by a pool of threads, the calling thread included.
+class CpuComposer {
+public:
+    explicit CpuComposer(size_t threadCount);
+    ~CpuComposer();
+
+    // Formats of both the layers and the destination.
+    static bool supportsFormat(int format);
+
+    size_t threadCount() const { return mThreads.size() + 1; }
+
+    // Composes the layers, bottom first, over black.  stride is in pixels.  Only the pixels in
+    // rects are written, all of them when numRects is 0.
+    void compose(const std::vector<CpuLayer> &layers, uint8_t *dst, int stride, int format,
+            int width, int height, const hwc_rect_t *rects = nullptr, size_t numRects = 0);
+
+    // Composes into the planes of a YUV 4:2:0 buffer as described by lock_ycbcr(), converted to
+    // BT.601 limited range as the rows are composed.  The rects are extended to even bounds, for
+    // the chroma to be computed from whole blocks of 2x2 pixels.
+    void composeYuv(const std::vector<CpuLayer> &layers, const android_ycbcr &dst, int width,
+            int height, const hwc_rect_t *rects = nullptr, size_t numRects = 0);
+
+private:
+    // Rows of each band, small enough to balance the bands between threads and large enough to
+    // amortize fetching the next one.
+    static const int kBandHeight = 16;
+
+    // Per layer state derived once per composition.
+    struct LayerState {
+        // Source position of the center of destination pixel (x, y), in 16.16 fixed point:
+        // origin + x * stepX + y * stepY.
+        int64_t originX;
+        int64_t originY;
+        int64_t stepXX;
+        int64_t stepXY;
+        int64_t stepYX;
+        int64_t stepYY;
+        // Pixels sampled, inclusive, in 16.16 fixed point.
+        int64_t minX;
+        int64_t minY;
+        int64_t maxX;
+        int64_t maxY;
+        // The crop is composed at the same size and orientation.
+        bool identity;
+        // Blending with the alpha of opaque formats ignored.
+        int32_t blending;
+        // The layer hides the layers below it.
+        bool opaque;
+    };
+
+    void prepare(const std::vector<CpuLayer> &layers, int width, int height);
+    void composeRects(const hwc_rect_t *rects, size_t numRects);
+    void composeRect(const hwc_rect_t &rect);
+    void worker(size_t scratchIndex);
+    void composeBands(size_t scratchIndex);
+    void composeRow(int y, int left, int right, uint32_t *row, uint32_t *fetchBuffer);
+    const uint32_t *fetch(const CpuLayer &layer, const LayerState &state, int y, int left,
+            int right, uint32_t *buffer);
+
+    std::vector<std::thread> mThreads;
+    std::mutex mLock;
+    std::condition_variable mWorkCond;
+    std::condition_variable mDoneCond;
+    uint64_t mGeneration;
+    size_t mBusyThreads;
+    bool mExiting;
+
+    // Current composition, set by compose() while the workers are idle.
+    const std::vector<CpuLayer> *mLayers;
+    std::vector<LayerState> mStates;
+    uint8_t *mDst;
+    int mDstStride;
+    int mDstFormat;
+    // The destination is YUV, in mDstYuv instead of mDst.
+    bool mYuv;
+    android_ycbcr mDstYuv;
+    int mWidth;
+    int mHeight;
+    hwc_rect_t mRect;
+    std::atomic<int> mNextBand;
+    // Three rows of scratch pixels for each thread: two composed, for the pairs of rows sharing
+    // the chroma of YUV destinations, and the fetched source.
+    std::vector<std::vector<uint32_t>> mScratch;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_HWC_CPU_COMPOSER_H
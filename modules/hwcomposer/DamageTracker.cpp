@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "DamageTracker.h"
+
+namespace android {
+
+static bool is_empty(const hwc_rect_t &r)
+{
+    return r.left >= r.right || r.top >= r.bottom;
+}
+
+static bool contains(const hwc_rect_t &outer, const hwc_rect_t &inner)
+{
+    return outer.left <= inner.left && outer.top <= inner.top && outer.right >= inner.right &&
+            outer.bottom >= inner.bottom;
+}
+
+static bool same_crop(const hwc_frect_t &a, const hwc_frect_t &b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+static bool same_rect(const hwc_rect_t &a, const hwc_rect_t &b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+DamageTracker::DamageTracker(size_t numBuffers, int width, int height)
+    : mWidth(width), mHeight(height), mValid(false), mBufferDamage(numBuffers)
+{
+    invalidate();
+}
+
+void DamageTracker::invalidate()
+{
+    const hwc_rect_t screen = { 0, 0, mWidth, mHeight };
+    mValid = false;
+    mLayers.clear();
+    for (std::vector<hwc_rect_t> &damage : mBufferDamage) {
+        damage.assign(1, screen);
+    }
+}
+
+void DamageTracker::addDamage(std::vector<hwc_rect_t> *region, const hwc_rect_t &rect) const
+{
+    hwc_rect_t r = rect;
+    r.left = std::max(r.left, 0);
+    r.top = std::max(r.top, 0);
+    r.right = std::min(r.right, mWidth);
+    r.bottom = std::min(r.bottom, mHeight);
+    if (is_empty(r)) {
+        return;
+    }
+    for (hwc_rect_t &other : *region) {
+        if (contains(other, r)) {
+            return;
+        }
+        if (contains(r, other)) {
+            other = r;
+            return;
+        }
+    }
+    if (region->size() < kMaxRects) {
+        region->push_back(r);
+        return;
+    }
+    for (const hwc_rect_t &other : *region) {
+        r.left = std::min(r.left, other.left);
+        r.top = std::min(r.top, other.top);
+        r.right = std::max(r.right, other.right);
+        r.bottom = std::max(r.bottom, other.bottom);
+    }
+    region->assign(1, r);
+}
+
+// Maps the surface damage from the buffer to the display, through the crop and the transform.
+void DamageTracker::addLayerDamage(const hwc_layer_1_t &layer, bool newBuffer)
+{
+    const hwc_region_t &damage = layer.surfaceDamage;
+    const hwc_rect_t &frame = layer.displayFrame;
+    if (damage.numRects == 0 || !damage.rects) {
+        addDamage(&mFrameDamage, frame);
+        return;
+    }
+    if (damage.numRects == 1 && is_empty(damage.rects[0])) {
+        // Unchanged contents, which a new buffer shouldn't claim.
+        if (newBuffer) {
+            addDamage(&mFrameDamage, frame);
+        }
+        return;
+    }
+
+    const hwc_frect_t &crop = layer.sourceCropf;
+    const double cropWidth = crop.right - crop.left;
+    const double cropHeight = crop.bottom - crop.top;
+    const double frameWidth = frame.right - frame.left;
+    const double frameHeight = frame.bottom - frame.top;
+    for (size_t i = 0; i < damage.numRects; i++) {
+        const hwc_rect_t &r = damage.rects[i];
+        double s0 = std::max(0.0, (r.left - crop.left) / cropWidth);
+        double s1 = std::min(1.0, (r.right - crop.left) / cropWidth);
+        double t0 = std::max(0.0, (r.top - crop.top) / cropHeight);
+        double t1 = std::min(1.0, (r.bottom - crop.top) / cropHeight);
+        if (s0 >= s1 || t0 >= t1) {
+            continue;
+        }
+        if (layer.transform & HAL_TRANSFORM_FLIP_H) {
+            std::swap(s0, s1);
+            s0 = 1.0 - s0;
+            s1 = 1.0 - s1;
+        }
+        if (layer.transform & HAL_TRANSFORM_FLIP_V) {
+            std::swap(t0, t1);
+            t0 = 1.0 - t0;
+            t1 = 1.0 - t1;
+        }
+        double u0 = s0, u1 = s1, v0 = t0, v1 = t1;
+        if (layer.transform & HAL_TRANSFORM_ROT_90) {
+            u0 = 1.0 - t1;
+            u1 = 1.0 - t0;
+            v0 = s0;
+            v1 = s1;
+        }
+        // A pixel further on each side, for the rounding of the nearest sampling.
+        hwc_rect_t mapped;
+        mapped.left = std::max(frame.left, (int)floor(frame.left + u0 * frameWidth) - 1);
+        mapped.top = std::max(frame.top, (int)floor(frame.top + v0 * frameHeight) - 1);
+        mapped.right = std::min(frame.right, (int)ceil(frame.left + u1 * frameWidth) + 1);
+        mapped.bottom = std::min(frame.bottom, (int)ceil(frame.top + v1 * frameHeight) + 1);
+        addDamage(&mFrameDamage, mapped);
+    }
+}
+
+bool DamageTracker::update(const std::vector<const hwc_layer_1_t *> &layers)
+{
+    mFrameDamage.clear();
+    if (!mValid || layers.size() != mLayers.size()) {
+        const hwc_rect_t screen = { 0, 0, mWidth, mHeight };
+        mFrameDamage.push_back(screen);
+    } else {
+        for (size_t i = 0; i < layers.size(); i++) {
+            const hwc_layer_1_t &layer = *layers[i];
+            const LayerSnapshot &previous = mLayers[i];
+            if (!same_crop(layer.sourceCropf, previous.crop) ||
+                    !same_rect(layer.displayFrame, previous.frame) ||
+                    layer.transform != previous.transform ||
+                    layer.blending != previous.blending ||
+                    layer.planeAlpha != previous.planeAlpha) {
+                addDamage(&mFrameDamage, previous.frame);
+                addDamage(&mFrameDamage, layer.displayFrame);
+            } else {
+                addLayerDamage(layer, layer.handle != previous.handle);
+            }
+        }
+    }
+
+    mValid = true;
+    mLayers.resize(layers.size());
+    for (size_t i = 0; i < layers.size(); i++) {
+        const hwc_layer_1_t &layer = *layers[i];
+        LayerSnapshot &snapshot = mLayers[i];
+        snapshot.handle = layer.handle;
+        snapshot.crop = layer.sourceCropf;
+        snapshot.frame = layer.displayFrame;
+        snapshot.transform = layer.transform;
+        snapshot.blending = layer.blending;
+        snapshot.planeAlpha = layer.planeAlpha;
+    }
+
+    for (std::vector<hwc_rect_t> &damage : mBufferDamage) {
+        for (const hwc_rect_t &rect : mFrameDamage) {
+            addDamage(&damage, rect);
+        }
+    }
+    return !mFrameDamage.empty();
+}
+
+void DamageTracker::takeBufferDamage(size_t buffer, std::vector<hwc_rect_t> *rects)
+{
+    rects->swap(mBufferDamage[buffer]);
+    mBufferDamage[buffer].clear();
+}
+
+}  // namespace android
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWC_DAMAGE_TRACKER_H
+#define ANDROID_HWC_DAMAGE_TRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <hardware/hwcomposer.h>
+
+namespace android {
+
+// Finds the area of the display changed by a frame from the layers composed in the previous one,
+// and the area of each output buffer to recompose, which adds up the damage of the frames since
+// the buffer was last composed.
+class DamageTracker {
+public:
+    DamageTracker(size_t numBuffers, int width, int height);
+
+    // Compares the layers with the previous frame, returns false when the frame is the same.
+    // The damage of the layers is read from their surfaceDamage.
+    bool update(const std::vector<const hwc_layer_1_t *> &layers);
+
+    // The next frame is fully damaged, for when the previous one wasn't composed as tracked.
+    void invalidate();
+
+    const std::vector<hwc_rect_t> &frameDamage() const { return mFrameDamage; }
+
+    // Returns the damage of a buffer about to be composed and resets it.
+    void takeBufferDamage(size_t buffer, std::vector<hwc_rect_t> *rects);
+
+private:
+    // Regions with more rects are reduced to their bounds.
+    static const size_t kMaxRects = 8;
+
+    struct LayerSnapshot {
+        buffer_handle_t handle;
+        hwc_frect_t crop;
+        hwc_rect_t frame;
+        uint32_t transform;
+        int32_t blending;
+        uint8_t planeAlpha;
+    };
+
+    void addDamage(std::vector<hwc_rect_t> *region, const hwc_rect_t &rect) const;
+    void addLayerDamage(const hwc_layer_1_t &layer, bool newBuffer);
+
+    const int mWidth;
+    const int mHeight;
+    bool mValid;
+    std::vector<LayerSnapshot> mLayers;
+    std::vector<hwc_rect_t> mFrameDamage;
+    std::vector<std::vector<hwc_rect_t>> mBufferDamage;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_HWC_DAMAGE_TRACKER_H
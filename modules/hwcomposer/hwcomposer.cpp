@@ -16,22 +16,95 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <malloc.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include <log/log.h>
+#include <sync/sync.h>
 
+#include <hardware/fb.h>
+#include <hardware/gralloc.h>
 #include <hardware/hardware.h>
 #include <hardware/hwcomposer.h>
 
 #include <EGL/egl.h>
+#include <gralloc_default.h>
+
+#include "CpuComposer.h"
+#include "DamageTracker.h"
+
+using android::CpuComposer;
+using android::CpuLayer;
+using android::DamageTracker;
 
 /*****************************************************************************/
 
+// Composes the layers with the CPU into buffers posted to the framebuffer instead of leaving
+// them to GLES, for devices without a GPU.
+static const char kCpuCompositionProperty[] = "ro.vendor.hwc.cpu_composition";
+static const char kCpuThreadsProperty[] = "ro.vendor.hwc.cpu_composition.threads";
+static const int kMaxCpuThreads = 4;
+// Buffers composed into in turn and posted, which post() copies to the framebuffer. Two, in case
+// post() reads the buffer last posted until the next one.
+static const int kNumOutputBuffers = 2;
+static const int kFenceTimeoutMs = 1000;
+
 struct hwc_context_t {
     hwc_composer_device_1_t device;
     /* our private state goes below here */
+
+    // CPU composition, NULL when composing with GLES
+    CpuComposer* composer;
+    const gralloc_module_t* gralloc;
+    framebuffer_device_t* fb;
+    alloc_device_t* alloc;
+    std::vector<buffer_handle_t> outputs;
+    std::vector<int> outputStrides;
+    size_t nextOutput;
+    // Damage of the frames and of the outputs
+    DamageTracker* damage;
+    // post() copies only the damage into the framebuffer, as with gralloc.default
+    bool fbDamage;
+    // The framebuffer posts without waiting for the flip and returns a release fence, as with
+    // gralloc.default
+    bool fbPostFence;
+    // All the layers are composed by the composer, as decided by prepare()
+    bool composeLayers;
+    std::vector<const hwc_layer_1_t*> composed;
+    std::vector<CpuLayer> layers;
+    std::vector<hwc_rect_t> rects;
+    // Same for the virtual display, composed into its output buffer in full
+    bool composeVirtualLayers;
+    uint64_t virtualFrames;
+    uint64_t virtualComposeNs;
+
+    const hwc_procs_t* procs;
+    std::thread vsyncThread;
+    std::mutex vsyncLock;
+    std::condition_variable vsyncCond;
+    bool vsyncEnabled;
+    bool exiting;
+    int64_t vsyncPeriodNs;
+
+    uint64_t frames;
+    // frames left as they were, composed in part and composed in full
+    uint64_t unchangedFrames;
+    uint64_t partialFrames;
+    uint64_t fullFrames;
+    uint64_t composedPixels;
+    uint64_t composeNs;
+    uint64_t maxComposeNs;
 };
 
 static int hwc_device_open(const struct hw_module_t* module, const char* name,
@@ -70,6 +143,13 @@ static void dump_layer(hwc_layer_1_t const* l) {
 }
 #endif
 
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 static int hwc_prepare(hwc_composer_device_1_t * /*dev*/,
         size_t /*numDisplays*/, hwc_display_contents_1_t** displays) {
     if (displays && (displays[0]->flags & HWC_GEOMETRY_CHANGED)) {
@@ -96,11 +176,590 @@ static int hwc_set(hwc_composer_device_1_t * /*dev*/,
     return 0;
 }
 
+/*****************************************************************************/
+
+// The layout of the buffers is only known from gralloc.default, the buffers of other gralloc
+// modules are left to GLES.
+static bool get_buffer_info(const gralloc_module_t* gralloc, buffer_handle_t buffer,
+        gralloc_default_buffer_info_t* info)
+{
+    return buffer && gralloc->perform &&
+            gralloc->perform(gralloc, GRALLOC_DEFAULT_PERFORM_GET_BUFFER_INFO, buffer, info) == 0;
+}
+
+static bool cpu_can_compose(const gralloc_module_t* gralloc, const hwc_layer_1_t* l)
+{
+    if (l->flags & HWC_SKIP_LAYER) {
+        return false;
+    }
+    gralloc_default_buffer_info_t info;
+    if (!get_buffer_info(gralloc, l->handle, &info)) {
+        return false;
+    }
+    const hwc_frect_t& crop = l->sourceCropf;
+    const hwc_rect_t& frame = l->displayFrame;
+    return CpuComposer::supportsFormat(info.format) &&
+            crop.left >= 0 && crop.top >= 0 &&
+            crop.right <= info.width && crop.bottom <= info.height &&
+            crop.left < crop.right && crop.top < crop.bottom &&
+            frame.left < frame.right && frame.top < frame.bottom;
+}
+
+// Virtual display outputs the composer writes, RGB or YUV 4:2:0 for video encoders.
+static bool cpu_can_write(const gralloc_module_t* gralloc, buffer_handle_t outbuf)
+{
+    gralloc_default_buffer_info_t info;
+    if (!get_buffer_info(gralloc, outbuf, &info)) {
+        return false;
+    }
+    switch (info.format) {
+    case HAL_PIXEL_FORMAT_YV12:
+    case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+    case HAL_PIXEL_FORMAT_YCBCR_420_888:
+        return gralloc->lock_ycbcr != NULL;
+    default:
+        return CpuComposer::supportsFormat(info.format);
+    }
+}
+
+// Compose everything, or leave everything but the target to GLES.
+static bool hwc_prepare_layers(const gralloc_module_t* gralloc, hwc_display_contents_1_t* list,
+        bool canCompose)
+{
+    bool composeLayers = canCompose;
+    for (size_t i=0 ; composeLayers && i<list->numHwLayers ; i++) {
+        const hwc_layer_1_t* l = &list->hwLayers[i];
+        if (l->compositionType != HWC_FRAMEBUFFER_TARGET && !cpu_can_compose(gralloc, l)) {
+            composeLayers = false;
+        }
+    }
+    for (size_t i=0 ; i<list->numHwLayers ; i++) {
+        hwc_layer_1_t* l = &list->hwLayers[i];
+        if (l->compositionType != HWC_FRAMEBUFFER_TARGET) {
+            l->compositionType = composeLayers ? HWC_OVERLAY : HWC_FRAMEBUFFER;
+        }
+    }
+    return composeLayers;
+}
+
+static int hwc_prepare_cpu(hwc_composer_device_1_t *dev,
+        size_t numDisplays, hwc_display_contents_1_t** displays) {
+    hwc_context_t* ctx = (hwc_context_t*)dev;
+    if (!displays) {
+        return 0;
+    }
+    hwc_display_contents_1_t* list = displays[HWC_DISPLAY_PRIMARY];
+    if (list && (list->flags & HWC_GEOMETRY_CHANGED)) {
+        const bool composeLayers = hwc_prepare_layers(ctx->gralloc, list, true);
+        if (composeLayers != ctx->composeLayers) {
+            ctx->damage->invalidate();
+        }
+        ctx->composeLayers = composeLayers;
+    }
+    // The output buffer of the virtual display is known by now, and may change format.
+    list = numDisplays > HWC_DISPLAY_VIRTUAL ? displays[HWC_DISPLAY_VIRTUAL] : NULL;
+    if (list) {
+        ctx->composeVirtualLayers =
+                hwc_prepare_layers(ctx->gralloc, list, cpu_can_write(ctx->gralloc, list->outbuf));
+    }
+    return 0;
+}
+
+static void close_acquire_fence(hwc_layer_1_t* l)
+{
+    if (l->acquireFenceFd >= 0) {
+        if (sync_wait(l->acquireFenceFd, kFenceTimeoutMs) < 0) {
+            ALOGW("layer %p: acquire fence timed out", l->handle);
+        }
+        close(l->acquireFenceFd);
+        l->acquireFenceFd = -1;
+    }
+}
+
+// Waits for the layers, and lists those composed: with GLES composing, only the target,
+// untransformed.
+static void hwc_collect_layers(hwc_context_t* ctx, hwc_display_contents_1_t* list,
+        bool composeLayers)
+{
+    ctx->composed.clear();
+    for (size_t i=0 ; i<list->numHwLayers ; i++) {
+        hwc_layer_1_t* l = &list->hwLayers[i];
+        close_acquire_fence(l);
+        l->releaseFenceFd = -1;
+        const bool composed = composeLayers ?
+                l->compositionType == HWC_OVERLAY :
+                l->compositionType == HWC_FRAMEBUFFER_TARGET;
+        if (composed && cpu_can_compose(ctx->gralloc, l)) {
+            ctx->composed.push_back(l);
+        }
+    }
+    list->retireFenceFd = -1;
+}
+
+// Maps the buffers of the layers collected, returns those to unlock.
+static std::vector<buffer_handle_t> hwc_lock_layers(hwc_context_t* ctx)
+{
+    ctx->layers.clear();
+    std::vector<buffer_handle_t> locked;
+    for (const hwc_layer_1_t* l : ctx->composed) {
+        gralloc_default_buffer_info_t info;
+        void* vaddr;
+        if (!get_buffer_info(ctx->gralloc, l->handle, &info) ||
+                ctx->gralloc->lock(ctx->gralloc, l->handle, GRALLOC_USAGE_SW_READ_OFTEN,
+                        0, 0, info.width, info.height, &vaddr) != 0) {
+            continue;
+        }
+        locked.push_back(l->handle);
+        CpuLayer layer;
+        layer.pixels = (const uint8_t*)vaddr;
+        layer.stride = info.stride;
+        layer.format = info.format;
+        layer.crop = l->sourceCropf;
+        layer.frame = l->displayFrame;
+        layer.transform = l->transform;
+        layer.blending = l->blending;
+        layer.planeAlpha = l->planeAlpha;
+        ctx->layers.push_back(layer);
+    }
+    return locked;
+}
+
+static void hwc_unlock_layers(hwc_context_t* ctx, const std::vector<buffer_handle_t>& locked)
+{
+    for (buffer_handle_t handle : locked) {
+        ctx->gralloc->unlock(ctx->gralloc, handle);
+    }
+    ctx->layers.clear();
+}
+
+// Passes the damage of the frame to post().
+static void hwc_set_fb_damage(hwc_context_t* ctx)
+{
+    if (!ctx->fbDamage) {
+        return;
+    }
+    // When post() copies, it only needs to copy what changed since the last post.
+    std::vector<int> rects;
+    for (const hwc_rect_t& r : ctx->damage->frameDamage()) {
+        rects.insert(rects.end(), { r.left, r.top, r.right, r.bottom });
+    }
+    ctx->gralloc->perform(ctx->gralloc, GRALLOC_DEFAULT_PERFORM_FB_SET_DAMAGE,
+            (int)(rects.size() / 4), rects.data());
+}
+
+static hwc_layer_1_t* hwc_find_target(hwc_display_contents_1_t* list)
+{
+    for (size_t i=0 ; i<list->numHwLayers ; i++) {
+        if (list->hwLayers[i].compositionType == HWC_FRAMEBUFFER_TARGET) {
+            return &list->hwLayers[i];
+        }
+    }
+    return NULL;
+}
+
+// Posts the client target GLES composed into as it is, instead of copying it into an output
+// buffer first.
+static int hwc_post_target(hwc_context_t* ctx, hwc_display_contents_1_t* list)
+{
+    hwc_layer_1_t* target = hwc_find_target(list);
+    if (!target || !target->handle) {
+        return 0;
+    }
+    if (ctx->composed.empty()) {
+        // The damage of targets the composer can't read isn't tracked.
+        ctx->damage->invalidate();
+    } else if (!ctx->damage->update(ctx->composed)) {
+        // The framebuffer still shows the same frame.
+        ctx->unchangedFrames++;
+        return 0;
+    } else {
+        hwc_set_fb_damage(ctx);
+    }
+    if (ctx->fbPostFence) {
+        // GLES draws the next frame into the target once the page is off the screen.
+        return ctx->gralloc->perform(ctx->gralloc, GRALLOC_DEFAULT_PERFORM_FB_POST,
+                target->handle, &target->releaseFenceFd);
+    }
+    return ctx->fb->post(ctx->fb, target->handle);
+}
+
+static int hwc_set_primary(hwc_context_t* ctx, hwc_display_contents_1_t* list)
+{
+    hwc_collect_layers(ctx, list, ctx->composeLayers);
+    ctx->frames++;
+    if (!ctx->composeLayers) {
+        return hwc_post_target(ctx, list);
+    }
+
+    // The framebuffer still shows the same frame.
+    if (!ctx->damage->update(ctx->composed)) {
+        ctx->unchangedFrames++;
+        return 0;
+    }
+    const std::vector<buffer_handle_t> locked = hwc_lock_layers(ctx);
+
+    const size_t output = ctx->nextOutput;
+    ctx->nextOutput = (ctx->nextOutput + 1) % ctx->outputs.size();
+    buffer_handle_t buffer = ctx->outputs[output];
+    const int width = ctx->fb->width;
+    const int height = ctx->fb->height;
+    void* vaddr;
+    int err = ctx->gralloc->lock(ctx->gralloc, buffer, GRALLOC_USAGE_SW_WRITE_OFTEN,
+            0, 0, width, height, &vaddr);
+    if (err == 0) {
+        // Only what changed since the buffer was last composed.
+        ctx->damage->takeBufferDamage(output, &ctx->rects);
+        uint64_t pixels = 0;
+        for (const hwc_rect_t& r : ctx->rects) {
+            pixels += (uint64_t)(r.right - r.left) * (r.bottom - r.top);
+        }
+        const int64_t start = now_ns();
+        ctx->composer->compose(ctx->layers, (uint8_t*)vaddr, ctx->outputStrides[output],
+                ctx->fb->format, width, height, ctx->rects.data(), ctx->rects.size());
+        const uint64_t elapsed = now_ns() - start;
+        ctx->composeNs += elapsed;
+        ctx->maxComposeNs = std::max(ctx->maxComposeNs, elapsed);
+        ctx->composedPixels += pixels;
+        if (pixels < (uint64_t)width * height) {
+            ctx->partialFrames++;
+        } else {
+            ctx->fullFrames++;
+        }
+        ctx->gralloc->unlock(ctx->gralloc, buffer);
+    }
+    hwc_unlock_layers(ctx, locked);
+    if (err || locked.size() != ctx->composed.size()) {
+        // The frame isn't the one tracked, compose the next one in full.
+        ctx->damage->invalidate();
+    }
+    if (err == 0) {
+        hwc_set_fb_damage(ctx);
+        err = ctx->fb->post(ctx->fb, buffer);
+    }
+    return err;
+}
+
+// Writes the frame directly into the output buffer, for its consumer to encode as it is.  The
+// buffers of a virtual display come from its consumer in any order, so they are composed in full.
+static int hwc_set_virtual(hwc_context_t* ctx, hwc_display_contents_1_t* list)
+{
+    const bool composeLayers = ctx->composeVirtualLayers;
+    hwc_collect_layers(ctx, list, composeLayers);
+    int err = 0;
+    if (list->outbufAcquireFenceFd >= 0) {
+        if (sync_wait(list->outbufAcquireFenceFd, kFenceTimeoutMs) < 0) {
+            ALOGW("virtual display: output buffer fence timed out");
+        }
+        close(list->outbufAcquireFenceFd);
+        list->outbufAcquireFenceFd = -1;
+    }
+    if (!list->outbuf) {
+        return 0;
+    }
+    if (!composeLayers) {
+        // GLES composed everything into the output buffer already, or into a target the
+        // composer can't read, which is left to the consumer rather than composing black.
+        const hwc_layer_1_t* target = hwc_find_target(list);
+        if ((target && target->handle == list->outbuf) || ctx->composed.empty()) {
+            return 0;
+        }
+    }
+    if (!cpu_can_write(ctx->gralloc, list->outbuf)) {
+        return -EINVAL;
+    }
+
+    gralloc_default_buffer_info_t info;
+    get_buffer_info(ctx->gralloc, list->outbuf, &info);
+    const std::vector<buffer_handle_t> locked = hwc_lock_layers(ctx);
+    const int64_t start = now_ns();
+    if (CpuComposer::supportsFormat(info.format)) {
+        void* vaddr;
+        err = ctx->gralloc->lock(ctx->gralloc, list->outbuf, GRALLOC_USAGE_SW_WRITE_OFTEN,
+                0, 0, info.width, info.height, &vaddr);
+        if (err == 0) {
+            ctx->composer->compose(ctx->layers, (uint8_t*)vaddr, info.stride, info.format,
+                    info.width, info.height);
+        }
+    } else {
+        // Converted as composed, instead of by the encoder in another pass.
+        android_ycbcr ycbcr;
+        err = ctx->gralloc->lock_ycbcr(ctx->gralloc, list->outbuf,
+                GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, info.width, info.height, &ycbcr);
+        if (err == 0) {
+            ctx->composer->composeYuv(ctx->layers, ycbcr, info.width, info.height);
+        }
+    }
+    if (err == 0) {
+        ctx->virtualComposeNs += now_ns() - start;
+        ctx->virtualFrames++;
+        ctx->gralloc->unlock(ctx->gralloc, list->outbuf);
+    }
+    hwc_unlock_layers(ctx, locked);
+    return err;
+}
+
+static int hwc_set_cpu(hwc_composer_device_1_t *dev,
+        size_t numDisplays, hwc_display_contents_1_t** displays)
+{
+    hwc_context_t* ctx = (hwc_context_t*)dev;
+    if (!displays) {
+        return 0;
+    }
+    int err = 0;
+    if (displays[HWC_DISPLAY_PRIMARY]) {
+        err = hwc_set_primary(ctx, displays[HWC_DISPLAY_PRIMARY]);
+    }
+    // Written with no fence to return: the frame is complete once set() returns.
+    if (numDisplays > HWC_DISPLAY_VIRTUAL && displays[HWC_DISPLAY_VIRTUAL]) {
+        const int virtualErr = hwc_set_virtual(ctx, displays[HWC_DISPLAY_VIRTUAL]);
+        err = err ? err : virtualErr;
+    }
+    return err;
+}
+
+static void hwc_vsync_loop(hwc_context_t* ctx)
+{
+    int64_t next = now_ns();
+    std::unique_lock<std::mutex> lock(ctx->vsyncLock);
+    for (;;) {
+        ctx->vsyncCond.wait(lock, [ctx] { return ctx->exiting || ctx->vsyncEnabled; });
+        if (ctx->exiting) {
+            return;
+        }
+        lock.unlock();
+
+        // Absolute deadlines, so that the period doesn't drift.
+        const int64_t now = now_ns();
+        next += ctx->vsyncPeriodNs;
+        if (next < now) {
+            next = now + ctx->vsyncPeriodNs - (now - next) % ctx->vsyncPeriodNs;
+        }
+        struct timespec deadline;
+        deadline.tv_sec = next / 1000000000;
+        deadline.tv_nsec = next % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        }
+
+        lock.lock();
+        const hwc_procs_t* procs = ctx->vsyncEnabled ? ctx->procs : NULL;
+        if (procs && procs->vsync) {
+            // Not under the lock, the callback may enable or disable vsync.
+            lock.unlock();
+            procs->vsync(procs, HWC_DISPLAY_PRIMARY, next);
+            lock.lock();
+        }
+    }
+}
+
+static int hwc_event_control(hwc_composer_device_1_t* dev, int disp, int event, int enabled)
+{
+    hwc_context_t* ctx = (hwc_context_t*)dev;
+    if (disp != HWC_DISPLAY_PRIMARY || event != HWC_EVENT_VSYNC) {
+        return -EINVAL;
+    }
+    std::lock_guard<std::mutex> guard(ctx->vsyncLock);
+    ctx->vsyncEnabled = enabled != 0;
+    ctx->vsyncCond.notify_all();
+    return 0;
+}
+
+static int hwc_set_power_mode(hwc_composer_device_1_t* /*dev*/, int disp, int /*mode*/)
+{
+    return disp == HWC_DISPLAY_PRIMARY ? 0 : -EINVAL;
+}
+
+static int hwc_query(hwc_composer_device_1_t* dev, int what, int* value)
+{
+    hwc_context_t* ctx = (hwc_context_t*)dev;
+    switch (what) {
+    case HWC_BACKGROUND_LAYER_SUPPORTED:
+        *value = 0;
+        return 0;
+    case HWC_VSYNC_PERIOD:
+        *value = ctx->vsyncPeriodNs;
+        return 0;
+    case HWC_DISPLAY_TYPES_SUPPORTED:
+        *value = HWC_DISPLAY_PRIMARY_BIT | HWC_DISPLAY_VIRTUAL_BIT;
+        return 0;
+    }
+    return -EINVAL;
+}
+
+static void hwc_register_procs(hwc_composer_device_1_t* dev, hwc_procs_t const* procs)
+{
+    hwc_context_t* ctx = (hwc_context_t*)dev;
+    std::lock_guard<std::mutex> guard(ctx->vsyncLock);
+    ctx->procs = procs;
+}
+
+static void hwc_dump(hwc_composer_device_1_t* dev, char* buff, int buff_len)
+{
+    hwc_context_t* ctx = (hwc_context_t*)dev;
+    const uint64_t frames = ctx->frames;
+    const uint64_t composedFrames = ctx->partialFrames + ctx->fullFrames;
+    const uint64_t screenPixels = (uint64_t)ctx->fb->width * ctx->fb->height;
+    snprintf(buff, buff_len,
+            "CPU composition: %zu threads, %s, %" PRIu64 " frames, "
+            "%.2f ms average, %.2f ms max\n"
+            "  %" PRIu64 " unchanged (%.1f%% hit rate), %" PRIu64 " partial, "
+            "%" PRIu64 " full, %.1f%% of the pixels composed\n"
+            "  virtual display: %s, %" PRIu64 " frames written, %.2f ms average\n",
+            ctx->composer->threadCount(),
+            ctx->composeLayers ? "all layers" : "client target only", frames,
+            composedFrames ? ctx->composeNs / 1e6 / composedFrames : 0.0,
+            ctx->maxComposeNs / 1e6,
+            ctx->unchangedFrames, frames ? 100.0 * ctx->unchangedFrames / frames : 0.0,
+            ctx->partialFrames, ctx->fullFrames,
+            frames ? 100.0 * ctx->composedPixels / (screenPixels * frames) : 0.0,
+            ctx->composeVirtualLayers ? "all layers" : "client target only",
+            ctx->virtualFrames,
+            ctx->virtualFrames ? ctx->virtualComposeNs / 1e6 / ctx->virtualFrames : 0.0);
+}
+
+static int hwc_get_display_configs(hwc_composer_device_1_t* /*dev*/, int disp,
+        uint32_t* configs, size_t* numConfigs)
+{
+    if (disp != HWC_DISPLAY_PRIMARY) {
+        return -EINVAL;
+    }
+    if (*numConfigs > 0) {
+        configs[0] = 0;
+        *numConfigs = 1;
+    }
+    return 0;
+}
+
+static int hwc_get_display_attributes(hwc_composer_device_1_t* dev, int disp,
+        uint32_t config, const uint32_t* attributes, int32_t* values)
+{
+    hwc_context_t* ctx = (hwc_context_t*)dev;
+    if (disp != HWC_DISPLAY_PRIMARY || config != 0) {
+        return -EINVAL;
+    }
+    for (size_t i=0 ; attributes[i] != HWC_DISPLAY_NO_ATTRIBUTE ; i++) {
+        switch (attributes[i]) {
+        case HWC_DISPLAY_VSYNC_PERIOD:
+            values[i] = ctx->vsyncPeriodNs;
+            break;
+        case HWC_DISPLAY_WIDTH:
+            values[i] = ctx->fb->width;
+            break;
+        case HWC_DISPLAY_HEIGHT:
+            values[i] = ctx->fb->height;
+            break;
+        case HWC_DISPLAY_DPI_X:
+            values[i] = ctx->fb->xdpi * 1000;
+            break;
+        case HWC_DISPLAY_DPI_Y:
+            values[i] = ctx->fb->ydpi * 1000;
+            break;
+        default:
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+static int hwc_get_active_config(hwc_composer_device_1_t* /*dev*/, int disp)
+{
+    return disp == HWC_DISPLAY_PRIMARY ? 0 : -1;
+}
+
+static int hwc_set_active_config(hwc_composer_device_1_t* /*dev*/, int disp, int index)
+{
+    return disp == HWC_DISPLAY_PRIMARY && index == 0 ? 0 : -EINVAL;
+}
+
+static void hwc_close_cpu(hwc_context_t* ctx)
+{
+    if (ctx->vsyncThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(ctx->vsyncLock);
+            ctx->exiting = true;
+        }
+        ctx->vsyncCond.notify_all();
+        ctx->vsyncThread.join();
+    }
+    delete ctx->composer;
+    ctx->composer = NULL;
+    delete ctx->damage;
+    ctx->damage = NULL;
+    for (buffer_handle_t buffer : ctx->outputs) {
+        ctx->alloc->free(ctx->alloc, buffer);
+    }
+    ctx->outputs.clear();
+    if (ctx->alloc) {
+        gralloc_close(ctx->alloc);
+        ctx->alloc = NULL;
+    }
+    if (ctx->fb) {
+        framebuffer_close(ctx->fb);
+        ctx->fb = NULL;
+    }
+}
+
+static int hwc_open_cpu(hwc_context_t* ctx)
+{
+    const hw_module_t* module;
+    int err = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
+    if (err) {
+        return err;
+    }
+    ctx->gralloc = reinterpret_cast<const gralloc_module_t*>(module);
+    err = framebuffer_open(module, &ctx->fb);
+    if (err) {
+        ALOGE("could not open the framebuffer: %s", strerror(-err));
+        return err;
+    }
+    if (!CpuComposer::supportsFormat(ctx->fb->format)) {
+        ALOGE("framebuffer format %d is not supported", ctx->fb->format);
+        return -EINVAL;
+    }
+    err = gralloc_open(module, &ctx->alloc);
+    if (err) {
+        return err;
+    }
+    for (int i = 0; i < kNumOutputBuffers; i++) {
+        buffer_handle_t buffer;
+        int stride;
+        // Not framebuffer pages, which the framebuffer target of GLES composition uses.
+        if (ctx->alloc->alloc(ctx->alloc, ctx->fb->width, ctx->fb->height, ctx->fb->format,
+                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_RARELY,
+                &buffer, &stride) != 0) {
+            break;
+        }
+        ctx->outputs.push_back(buffer);
+        ctx->outputStrides.push_back(stride);
+    }
+    if (ctx->outputs.empty()) {
+        ALOGE("could not allocate the output buffers");
+        return -ENOMEM;
+    }
+
+    const int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const int threads = property_get_int32(kCpuThreadsProperty,
+            std::min(std::max(cpus, 1), kMaxCpuThreads));
+    ctx->composer = new CpuComposer(std::max(threads, 1));
+    ctx->damage = new DamageTracker(ctx->outputs.size(), ctx->fb->width, ctx->fb->height);
+    // Modules not implementing the operation return an error for it. Damage covering the whole
+    // screen has no effect on the next post().
+    const int screen[4] = { 0, 0, (int)ctx->fb->width, (int)ctx->fb->height };
+    ctx->fbDamage = ctx->gralloc->perform && ctx->gralloc->perform(ctx->gralloc,
+            GRALLOC_DEFAULT_PERFORM_FB_SET_DAMAGE, 1, screen) == 0;
+    ctx->fbPostFence = ctx->fbDamage;
+    ctx->vsyncPeriodNs = 1e9 / (ctx->fb->fps > 0 ? ctx->fb->fps : 60);
+    ctx->vsyncThread = std::thread(hwc_vsync_loop, ctx);
+    ALOGI("CPU composition with %zu threads into %zu buffers",
+            ctx->composer->threadCount(), ctx->outputs.size());
+    return 0;
+}
+
 static int hwc_device_close(struct hw_device_t *dev)
 {
     struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
     if (ctx) {
-        free(ctx);
+        hwc_close_cpu(ctx);
+        delete ctx;
     }
     return 0;
 }
@@ -112,11 +771,7 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
 {
     int status = -EINVAL;
     if (!strcmp(name, HWC_HARDWARE_COMPOSER)) {
-        struct hwc_context_t *dev;
-        dev = (hwc_context_t*)malloc(sizeof(*dev));
-
-        /* initialize our state here */
-        memset(dev, 0, sizeof(*dev));
+        struct hwc_context_t *dev = new hwc_context_t();
 
         /* initialize the procs */
         dev->device.common.tag = HARDWARE_DEVICE_TAG;
@@ -127,6 +782,27 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
         dev->device.prepare = hwc_prepare;
         dev->device.set = hwc_set;
 
+        if (property_get_bool(kCpuCompositionProperty, false)) {
+            status = hwc_open_cpu(dev);
+            if (status) {
+                hwc_device_close(&dev->device.common);
+                return status;
+            }
+            // planeAlpha is only set from 1.2, surfaceDamage from 1.5.
+            dev->device.common.version = HWC_DEVICE_API_VERSION_1_5;
+            dev->device.prepare = hwc_prepare_cpu;
+            dev->device.set = hwc_set_cpu;
+            dev->device.eventControl = hwc_event_control;
+            dev->device.setPowerMode = hwc_set_power_mode;
+            dev->device.query = hwc_query;
+            dev->device.registerProcs = hwc_register_procs;
+            dev->device.dump = hwc_dump;
+            dev->device.getDisplayConfigs = hwc_get_display_configs;
+            dev->device.getDisplayAttributes = hwc_get_display_attributes;
+            dev->device.getActiveConfig = hwc_get_active_config;
+            dev->device.setActiveConfig = hwc_set_active_config;
+        }
+
         *device = &dev->device.common;
         status = 0;
     }
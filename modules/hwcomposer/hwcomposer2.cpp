@@ -0,0 +1,1329 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A HWC2 device with a single display that isn't scanned out, for running the
+// display pipeline on machines without a screen.  Layers are composed with the
+// CPU into memory, vsync is driven by a timerfd, and present and release fences
+// are sw_sync fences signalled at the vsync after each present, as a display
+// taking a new frame would.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <sync/sync.h>
+
+#include <hardware/gralloc.h>
+#include <hardware/hardware.h>
+#include <hardware/hwcomposer2.h>
+
+#include <gralloc_default.h>
+
+#include "CpuComposer.h"
+#include "DamageTracker.h"
+
+using android::CpuComposer;
+using android::CpuLayer;
+using android::DamageTracker;
+
+/*****************************************************************************/
+
+static const char kWidthProperty[] = "ro.vendor.hwc2.display.width";
+static const char kHeightProperty[] = "ro.vendor.hwc2.display.height";
+static const char kRefreshRateProperty[] = "ro.vendor.hwc2.display.refresh_rate";
+static const char kDpiProperty[] = "ro.vendor.hwc2.display.dpi";
+static const char kCpuThreadsProperty[] = "ro.vendor.hwc.cpu_composition.threads";
+static const int kMaxCpuThreads = 4;
+static const int kFenceTimeoutMs = 1000;
+
+static const hwc2_display_t kDisplayId = 1;
+static const hwc2_config_t kConfigId = 1;
+
+// surfaceDamage of contents unchanged since the previous frame
+static const hwc_rect_t kUnchanged = { 0, 0, 0, 0 };
+
+// sw_sync interface, see drivers/dma-buf/sw_sync.c
+struct sw_sync_create_fence_data {
+    uint32_t value;
+    char name[32];
+    int32_t fence;
+};
+#define SW_SYNC_IOC_MAGIC 'W'
+#define SW_SYNC_IOC_CREATE_FENCE _IOWR(SW_SYNC_IOC_MAGIC, 0, struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC _IOW(SW_SYNC_IOC_MAGIC, 1, uint32_t)
+
+struct hwc2_layer_state_t {
+    // as set by the client, and as validated
+    int32_t requestedType;
+    int32_t type;
+    uint32_t z;
+    // The layer as HWC 1.5 describes it, its surfaceDamage pointing to damage.
+    hwc_layer_1_t state;
+    std::vector<hwc_rect_t> damage;
+    // The buffer, damage or color was set since the last present.
+    bool contentsChanged;
+    bool colorChanged;
+    // A buffer replaced the one last presented, which will need a release fence.
+    bool bufferReplaced;
+    int acquireFence;
+    // RGBA 8888, for solid color layers
+    uint32_t color;
+};
+
+struct hwc2_context_t : public hwc2_device_t {
+    std::mutex lock;
+    const gralloc_module_t* gralloc;
+
+    int width;
+    int height;
+    int dpi;
+    int64_t vsyncPeriodNs;
+    int32_t powerMode;
+    bool colorTransformIdentity;
+
+    std::map<hwc2_layer_t, hwc2_layer_state_t> layers;
+    hwc2_layer_t nextLayerId;
+    hwc2_layer_state_t clientTarget;
+
+    // validated and not changed since, as required to present
+    bool validated;
+    bool validatedSincePresent;
+    bool clientComposition;
+    std::vector<std::pair<hwc2_layer_t, int32_t>> changes;
+
+    // Frames are composed into memory, only where they changed.
+    CpuComposer* composer;
+    DamageTracker* damage;
+    bool composedClient;
+    std::vector<uint32_t> frame;
+    std::vector<const hwc_layer_1_t*> composed;
+    std::vector<const hwc2_layer_state_t*> composedLayers;
+    std::vector<CpuLayer> cpuLayers;
+    std::vector<hwc_rect_t> rects;
+
+    // Frames presented, and signalled on the timeline at the following vsync.
+    std::mutex fenceLock;
+    int timelineFd;
+    uint32_t presented;
+    uint32_t signalled;
+    std::vector<std::pair<hwc2_layer_t, int32_t>> releaseFences;
+
+    std::mutex callbackLock;
+    hwc2_callback_data_t vsyncData;
+    HWC2_PFN_VSYNC vsyncCallback;
+    bool vsyncEnabled;
+    std::thread vsyncThread;
+    int timerFd;
+    int exitFd;
+    int64_t vsyncBase;
+    uint64_t vsyncCount;
+
+    uint64_t validates;
+    uint64_t presents;
+    uint64_t skippedValidates;
+    uint64_t unchangedFrames;
+    uint64_t composeNs;
+    std::string dumpText;
+};
+
+static int hwc2_device_open(const struct hw_module_t* module, const char* name,
+        struct hw_device_t** device);
+
+static struct hw_module_methods_t hwc2_module_methods = {
+    .open = hwc2_device_open
+};
+
+hwc_module_t HAL_MODULE_INFO_SYM = {
+    .common = {
+        .tag = HARDWARE_MODULE_TAG,
+        .version_major = 2,
+        .version_minor = 0,
+        .id = HWC_HARDWARE_MODULE_ID,
+        .name = "Headless HWC2 module",
+        .author = "The Android Open Source Project",
+        .methods = &hwc2_module_methods,
+    }
+};
+
+/*****************************************************************************/
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static hwc2_context_t* to_context(hwc2_device_t* device)
+{
+    return static_cast<hwc2_context_t*>(device);
+}
+
+template <typename F>
+static int32_t on_display(hwc2_device_t* device, hwc2_display_t display, F f)
+{
+    hwc2_context_t* ctx = to_context(device);
+    std::lock_guard<std::mutex> guard(ctx->lock);
+    if (display != kDisplayId) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+    return f(ctx);
+}
+
+template <typename F>
+static int32_t on_layer(hwc2_device_t* device, hwc2_display_t display, hwc2_layer_t layer, F f)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        auto it = ctx->layers.find(layer);
+        if (it == ctx->layers.end()) {
+            return HWC2_ERROR_BAD_LAYER;
+        }
+        return f(ctx, &it->second);
+    });
+}
+
+static void close_fence(int* fence)
+{
+    if (*fence >= 0) {
+        close(*fence);
+        *fence = -1;
+    }
+}
+
+static void wait_fence(int* fence)
+{
+    if (*fence >= 0) {
+        if (sync_wait(*fence, kFenceTimeoutMs) < 0) {
+            ALOGW("acquire fence timed out");
+        }
+        close_fence(fence);
+    }
+}
+
+static int create_fence(hwc2_context_t* ctx, uint32_t value, const char* name)
+{
+    if (ctx->timelineFd < 0) {
+        return -1;
+    }
+    struct sw_sync_create_fence_data data;
+    memset(&data, 0, sizeof(data));
+    data.value = value;
+    snprintf(data.name, sizeof(data.name), "%s", name);
+    if (ioctl(ctx->timelineFd, SW_SYNC_IOC_CREATE_FENCE, &data) < 0) {
+        ALOGE("could not create a fence: %s", strerror(errno));
+        return -1;
+    }
+    return data.fence;
+}
+
+static void close_release_fences(hwc2_context_t* ctx)
+{
+    for (auto& entry : ctx->releaseFences) {
+        close_fence(&entry.second);
+    }
+    ctx->releaseFences.clear();
+}
+
+static bool get_buffer_info(const gralloc_module_t* gralloc, buffer_handle_t buffer,
+        gralloc_default_buffer_info_t* info)
+{
+    return buffer && gralloc->perform &&
+            gralloc->perform(gralloc, GRALLOC_DEFAULT_PERFORM_GET_BUFFER_INFO, buffer, info) == 0;
+}
+
+static bool buffer_composable(const gralloc_module_t* gralloc, buffer_handle_t buffer,
+        const hwc_frect_t& crop)
+{
+    gralloc_default_buffer_info_t info;
+    if (!get_buffer_info(gralloc, buffer, &info)) {
+        return false;
+    }
+    return CpuComposer::supportsFormat(info.format) &&
+            crop.left >= 0 && crop.top >= 0 &&
+            crop.right <= info.width && crop.bottom <= info.height &&
+            crop.left < crop.right && crop.top < crop.bottom;
+}
+
+static bool layer_composable(const gralloc_module_t* gralloc, const hwc2_layer_state_t& layer)
+{
+    const hwc_rect_t& frame = layer.state.displayFrame;
+    if (frame.left >= frame.right || frame.top >= frame.bottom) {
+        return false;
+    }
+    switch (layer.requestedType) {
+    case HWC2_COMPOSITION_SOLID_COLOR:
+        return true;
+    case HWC2_COMPOSITION_DEVICE:
+    case HWC2_COMPOSITION_CURSOR:
+        return buffer_composable(gralloc, layer.state.handle, layer.state.sourceCropf);
+    default:
+        return false;
+    }
+}
+
+static void init_layer(hwc2_layer_state_t* layer)
+{
+    layer->requestedType = HWC2_COMPOSITION_INVALID;
+    layer->type = HWC2_COMPOSITION_INVALID;
+    layer->z = 0;
+    memset(&layer->state, 0, sizeof(layer->state));
+    layer->state.blending = HWC_BLENDING_PREMULT;
+    layer->state.planeAlpha = 0xFF;
+    layer->contentsChanged = true;
+    layer->colorChanged = false;
+    layer->bufferReplaced = false;
+    layer->acquireFence = -1;
+    layer->color = 0;
+}
+
+/*****************************************************************************/
+
+static void hwc2_vsync_loop(hwc2_context_t* ctx)
+{
+    struct pollfd fds[2] = {
+        { ctx->timerFd, POLLIN, 0 },
+        { ctx->exitFd, POLLIN, 0 },
+    };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("vsync poll failed: %s", strerror(errno));
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        uint64_t expirations;
+        if (read(ctx->timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            continue;
+        }
+        ctx->vsyncCount += expirations;
+        const int64_t timestamp = ctx->vsyncBase + ctx->vsyncCount * ctx->vsyncPeriodNs;
+
+        // The frames presented since the previous vsync are displayed.
+        {
+            std::lock_guard<std::mutex> guard(ctx->fenceLock);
+            if (ctx->signalled != ctx->presented) {
+                uint32_t increment = ctx->presented - ctx->signalled;
+                if (ctx->timelineFd >= 0) {
+                    ioctl(ctx->timelineFd, SW_SYNC_IOC_INC, &increment);
+                }
+                ctx->signalled = ctx->presented;
+            }
+        }
+
+        HWC2_PFN_VSYNC callback;
+        hwc2_callback_data_t data;
+        {
+            std::lock_guard<std::mutex> guard(ctx->callbackLock);
+            callback = ctx->vsyncEnabled ? ctx->vsyncCallback : NULL;
+            data = ctx->vsyncData;
+        }
+        if (callback) {
+            callback(data, kDisplayId, timestamp);
+        }
+    }
+}
+
+/*****************************************************************************/
+
+static int32_t hwc2_validate_display(hwc2_device_t* device, hwc2_display_t display,
+        uint32_t* outNumTypes, uint32_t* outNumRequests)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        // Compose everything, or leave everything to the client.
+        bool client = !ctx->colorTransformIdentity;
+        for (const auto& entry : ctx->layers) {
+            if (!layer_composable(ctx->gralloc, entry.second)) {
+                client = true;
+                break;
+            }
+        }
+        ctx->changes.clear();
+        for (auto& entry : ctx->layers) {
+            hwc2_layer_state_t& layer = entry.second;
+            layer.type = client ? HWC2_COMPOSITION_CLIENT : layer.requestedType;
+            if (layer.type != layer.requestedType) {
+                ctx->changes.push_back(std::make_pair(entry.first, layer.type));
+            }
+        }
+        ctx->clientComposition = client;
+        ctx->validated = true;
+        ctx->validatedSincePresent = true;
+        ctx->validates++;
+        *outNumTypes = ctx->changes.size();
+        *outNumRequests = 0;
+        return ctx->changes.empty() ? HWC2_ERROR_NONE : HWC2_ERROR_HAS_CHANGES;
+    });
+}
+
+static int32_t hwc2_get_changed_composition_types(hwc2_device_t* device,
+        hwc2_display_t display, uint32_t* outNumElements, hwc2_layer_t* outLayers,
+        int32_t* outTypes)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        if (!ctx->validated) {
+            return HWC2_ERROR_NOT_VALIDATED;
+        }
+        if (!outLayers || !outTypes) {
+            *outNumElements = ctx->changes.size();
+            return HWC2_ERROR_NONE;
+        }
+        const uint32_t count = std::min<uint32_t>(*outNumElements, ctx->changes.size());
+        for (uint32_t i = 0; i < count; i++) {
+            outLayers[i] = ctx->changes[i].first;
+            outTypes[i] = ctx->changes[i].second;
+        }
+        *outNumElements = count;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_get_display_requests(hwc2_device_t* device, hwc2_display_t display,
+        int32_t* outDisplayRequests, uint32_t* outNumElements, hwc2_layer_t* /*outLayers*/,
+        int32_t* /*outLayerRequests*/)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        if (!ctx->validated) {
+            return HWC2_ERROR_NOT_VALIDATED;
+        }
+        *outDisplayRequests = 0;
+        *outNumElements = 0;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_accept_display_changes(hwc2_device_t* device, hwc2_display_t display)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        if (!ctx->validated) {
+            return HWC2_ERROR_NOT_VALIDATED;
+        }
+        ctx->changes.clear();
+        return HWC2_ERROR_NONE;
+    });
+}
+
+// Composes the frame into memory, where it changed since the previous one.
+static void hwc2_compose(hwc2_context_t* ctx)
+{
+    ctx->composed.clear();
+    ctx->composedLayers.clear();
+    if (ctx->clientComposition) {
+        hwc2_layer_state_t& target = ctx->clientTarget;
+        wait_fence(&target.acquireFence);
+        for (auto& entry : ctx->layers) {
+            close_fence(&entry.second.acquireFence);
+        }
+        if (buffer_composable(ctx->gralloc, target.state.handle, target.state.sourceCropf)) {
+            ctx->composedLayers.push_back(&target);
+        }
+    } else {
+        for (auto& entry : ctx->layers) {
+            wait_fence(&entry.second.acquireFence);
+            ctx->composedLayers.push_back(&entry.second);
+        }
+        std::stable_sort(ctx->composedLayers.begin(), ctx->composedLayers.end(),
+                [](const hwc2_layer_state_t* a, const hwc2_layer_state_t* b) {
+                    return a->z < b->z;
+                });
+    }
+    for (const hwc2_layer_state_t* layer : ctx->composedLayers) {
+        // The damage set applies to the frame it was set for only.
+        hwc_layer_1_t& state = const_cast<hwc_layer_1_t&>(layer->state);
+        if (!layer->contentsChanged) {
+            state.surfaceDamage.numRects = 1;
+            state.surfaceDamage.rects = &kUnchanged;
+        } else if (layer->colorChanged) {
+            state.surfaceDamage.numRects = 0;
+            state.surfaceDamage.rects = NULL;
+        } else {
+            state.surfaceDamage.numRects = layer->damage.size();
+            state.surfaceDamage.rects = layer->damage.data();
+        }
+        ctx->composed.push_back(&layer->state);
+    }
+    if (ctx->clientComposition != ctx->composedClient) {
+        ctx->damage->invalidate();
+        ctx->composedClient = ctx->clientComposition;
+    }
+    if (!ctx->damage->update(ctx->composed)) {
+        ctx->unchangedFrames++;
+        return;
+    }
+
+    ctx->cpuLayers.clear();
+    std::vector<buffer_handle_t> locked;
+    for (const hwc2_layer_state_t* layer : ctx->composedLayers) {
+        CpuLayer cpuLayer;
+        if (layer->type == HWC2_COMPOSITION_SOLID_COLOR) {
+            // A single pixel scaled to the frame.
+            cpuLayer.pixels = (const uint8_t*)&layer->color;
+            cpuLayer.stride = 0;
+            cpuLayer.format = HAL_PIXEL_FORMAT_RGBA_8888;
+            cpuLayer.crop = { 0.0f, 0.0f, 1.0f, 1.0f };
+        } else {
+            gralloc_default_buffer_info_t info;
+            void* vaddr;
+            if (!get_buffer_info(ctx->gralloc, layer->state.handle, &info) ||
+                    ctx->gralloc->lock(ctx->gralloc, layer->state.handle,
+                            GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, info.width, info.height,
+                            &vaddr) != 0) {
+                continue;
+            }
+            locked.push_back(layer->state.handle);
+            cpuLayer.pixels = (const uint8_t*)vaddr;
+            cpuLayer.stride = info.stride;
+            cpuLayer.format = info.format;
+            cpuLayer.crop = layer->state.sourceCropf;
+        }
+        cpuLayer.frame = layer->state.displayFrame;
+        cpuLayer.transform = layer->state.transform;
+        cpuLayer.blending = layer->state.blending;
+        cpuLayer.planeAlpha = layer->state.planeAlpha;
+        ctx->cpuLayers.push_back(cpuLayer);
+    }
+
+    ctx->damage->takeBufferDamage(0, &ctx->rects);
+    const int64_t start = now_ns();
+    ctx->composer->compose(ctx->cpuLayers, (uint8_t*)ctx->frame.data(), ctx->width,
+            HAL_PIXEL_FORMAT_RGBA_8888, ctx->width, ctx->height, ctx->rects.data(),
+            ctx->rects.size());
+    ctx->composeNs += now_ns() - start;
+
+    for (buffer_handle_t handle : locked) {
+        ctx->gralloc->unlock(ctx->gralloc, handle);
+    }
+    if (ctx->cpuLayers.size() != ctx->composedLayers.size()) {
+        ctx->damage->invalidate();
+    }
+}
+
+static int32_t hwc2_present_display(hwc2_device_t* device, hwc2_display_t display,
+        int32_t* outPresentFence)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        // Buffers and damage may change without validating again, not the rest.
+        if (!ctx->validated) {
+            return HWC2_ERROR_NOT_VALIDATED;
+        }
+        if (!ctx->validatedSincePresent) {
+            ctx->skippedValidates++;
+        }
+        ctx->validatedSincePresent = false;
+        ctx->presents++;
+
+        hwc2_compose(ctx);
+
+        uint32_t frame;
+        {
+            std::lock_guard<std::mutex> guard(ctx->fenceLock);
+            frame = ++ctx->presented;
+        }
+        *outPresentFence = create_fence(ctx, frame, "hwc2-present");
+
+        // The buffers replaced stop being displayed along with this frame.
+        close_release_fences(ctx);
+        for (auto& entry : ctx->layers) {
+            hwc2_layer_state_t& layer = entry.second;
+            if (layer.bufferReplaced) {
+                ctx->releaseFences.push_back(std::make_pair(entry.first,
+                        create_fence(ctx, frame, "hwc2-release")));
+            }
+            layer.bufferReplaced = false;
+            layer.contentsChanged = false;
+            layer.colorChanged = false;
+        }
+        ctx->clientTarget.contentsChanged = false;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_get_release_fences(hwc2_device_t* device, hwc2_display_t display,
+        uint32_t* outNumElements, hwc2_layer_t* outLayers, int32_t* outFences)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        if (!outLayers || !outFences) {
+            *outNumElements = ctx->releaseFences.size();
+            return HWC2_ERROR_NONE;
+        }
+        // The caller owns the fences returned.
+        const uint32_t count = std::min<uint32_t>(*outNumElements, ctx->releaseFences.size());
+        for (uint32_t i = 0; i < count; i++) {
+            outLayers[i] = ctx->releaseFences[i].first;
+            outFences[i] = ctx->releaseFences[i].second;
+            ctx->releaseFences[i].second = -1;
+        }
+        *outNumElements = count;
+        close_release_fences(ctx);
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_client_target(hwc2_device_t* device, hwc2_display_t display,
+        buffer_handle_t target, int32_t acquireFence, int32_t /*dataspace*/,
+        hwc_region_t damage)
+{
+    hwc2_context_t* ctx = to_context(device);
+    std::lock_guard<std::mutex> guard(ctx->lock);
+    if (display != kDisplayId) {
+        if (acquireFence >= 0) {
+            close(acquireFence);
+        }
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+    hwc2_layer_state_t& layer = ctx->clientTarget;
+    close_fence(&layer.acquireFence);
+    layer.acquireFence = acquireFence;
+    layer.state.handle = target;
+    layer.damage.assign(damage.rects, damage.rects + damage.numRects);
+    layer.contentsChanged = true;
+    return HWC2_ERROR_NONE;
+}
+
+static int32_t hwc2_get_client_target_support(hwc2_device_t* device, hwc2_display_t display,
+        uint32_t width, uint32_t height, int32_t format, int32_t /*dataspace*/)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        if ((int)width != ctx->width || (int)height != ctx->height ||
+                !CpuComposer::supportsFormat(format)) {
+            return HWC2_ERROR_UNSUPPORTED;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+/*****************************************************************************/
+
+static int32_t hwc2_create_layer(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t* outLayer)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        const hwc2_layer_t id = ctx->nextLayerId++;
+        init_layer(&ctx->layers[id]);
+        ctx->validated = false;
+        *outLayer = id;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_destroy_layer(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        close_fence(&l->acquireFence);
+        ctx->layers.erase(layer);
+        ctx->validated = false;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_buffer(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, buffer_handle_t buffer, int32_t acquireFence)
+{
+    int32_t err = on_layer(device, display, layer,
+            [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        close_fence(&l->acquireFence);
+        l->acquireFence = acquireFence;
+        acquireFence = -1;
+        if (l->state.handle && l->state.handle != buffer) {
+            l->bufferReplaced = true;
+        }
+        l->state.handle = buffer;
+        l->contentsChanged = true;
+        // A buffer the device can't compose needs the client again.
+        if (l->type == HWC2_COMPOSITION_DEVICE || l->type == HWC2_COMPOSITION_CURSOR) {
+            if (!buffer_composable(ctx->gralloc, buffer, l->state.sourceCropf)) {
+                ctx->validated = false;
+            }
+        }
+        return HWC2_ERROR_NONE;
+    });
+    if (acquireFence >= 0) {
+        close(acquireFence);
+    }
+    return err;
+}
+
+static int32_t hwc2_set_layer_surface_damage(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, hwc_region_t damage)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t*, hwc2_layer_state_t* l) {
+        l->damage.assign(damage.rects, damage.rects + damage.numRects);
+        l->contentsChanged = true;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_composition_type(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, int32_t type)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        if (type < HWC2_COMPOSITION_CLIENT || type > HWC2_COMPOSITION_SIDEBAND) {
+            return HWC2_ERROR_BAD_PARAMETER;
+        }
+        if (l->requestedType != type) {
+            l->requestedType = type;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_blend_mode(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, int32_t mode)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        int32_t blending;
+        switch (mode) {
+        case HWC2_BLEND_MODE_NONE:
+            blending = HWC_BLENDING_NONE;
+            break;
+        case HWC2_BLEND_MODE_PREMULTIPLIED:
+            blending = HWC_BLENDING_PREMULT;
+            break;
+        case HWC2_BLEND_MODE_COVERAGE:
+            blending = HWC_BLENDING_COVERAGE;
+            break;
+        default:
+            return HWC2_ERROR_BAD_PARAMETER;
+        }
+        if (l->state.blending != blending) {
+            l->state.blending = blending;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_color(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, hwc_color_t color)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        const uint32_t rgba = color.r | (color.g << 8) | (color.b << 16) |
+                ((uint32_t)color.a << 24);
+        if (rgba != l->color) {
+            l->color = rgba;
+            l->contentsChanged = true;
+            l->colorChanged = true;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_dataspace(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, int32_t /*dataspace*/)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t*, hwc2_layer_state_t*) {
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_display_frame(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, hwc_rect_t frame)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        hwc_rect_t& current = l->state.displayFrame;
+        if (current.left != frame.left || current.top != frame.top ||
+                current.right != frame.right || current.bottom != frame.bottom) {
+            current = frame;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_plane_alpha(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, float alpha)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        const uint8_t planeAlpha = (uint8_t)(std::min(std::max(alpha, 0.0f), 1.0f) * 255.0f + 0.5f);
+        if (l->state.planeAlpha != planeAlpha) {
+            l->state.planeAlpha = planeAlpha;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_sideband_stream(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, const native_handle_t* /*stream*/)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t*, hwc2_layer_state_t*) {
+        return HWC2_ERROR_UNSUPPORTED;
+    });
+}
+
+static int32_t hwc2_set_layer_source_crop(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, hwc_frect_t crop)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        hwc_frect_t& current = l->state.sourceCropf;
+        if (current.left != crop.left || current.top != crop.top ||
+                current.right != crop.right || current.bottom != crop.bottom) {
+            current = crop;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_transform(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, int32_t transform)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        if (l->state.transform != (uint32_t)transform) {
+            l->state.transform = transform;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_visible_region(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, hwc_region_t /*visible*/)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t*, hwc2_layer_state_t*) {
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_layer_z_order(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, uint32_t z)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t* ctx, hwc2_layer_state_t* l) {
+        if (l->z != z) {
+            l->z = z;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_cursor_position(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_layer_t layer, int32_t x, int32_t y)
+{
+    return on_layer(device, display, layer, [&](hwc2_context_t*, hwc2_layer_state_t* l) {
+        if (l->type != HWC2_COMPOSITION_CURSOR) {
+            return HWC2_ERROR_BAD_LAYER;
+        }
+        // Moved at the next present, without validating again.
+        hwc_rect_t& frame = l->state.displayFrame;
+        frame.right += x - frame.left;
+        frame.bottom += y - frame.top;
+        frame.left = x;
+        frame.top = y;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+/*****************************************************************************/
+
+static int32_t hwc2_get_display_configs(hwc2_device_t* device, hwc2_display_t display,
+        uint32_t* outNumConfigs, hwc2_config_t* outConfigs)
+{
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        if (outConfigs && *outNumConfigs > 0) {
+            outConfigs[0] = kConfigId;
+        }
+        *outNumConfigs = (outConfigs && *outNumConfigs == 0) ? 0 : 1;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_get_display_attribute(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_config_t config, int32_t attribute, int32_t* outValue)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        if (config != kConfigId) {
+            return HWC2_ERROR_BAD_CONFIG;
+        }
+        switch (attribute) {
+        case HWC2_ATTRIBUTE_WIDTH:
+            *outValue = ctx->width;
+            break;
+        case HWC2_ATTRIBUTE_HEIGHT:
+            *outValue = ctx->height;
+            break;
+        case HWC2_ATTRIBUTE_VSYNC_PERIOD:
+            *outValue = ctx->vsyncPeriodNs;
+            break;
+        case HWC2_ATTRIBUTE_DPI_X:
+        case HWC2_ATTRIBUTE_DPI_Y:
+            *outValue = ctx->dpi * 1000;
+            break;
+        case HWC2_ATTRIBUTE_CONFIG_GROUP:
+            *outValue = 0;
+            break;
+        default:
+            *outValue = -1;
+            break;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_get_active_config(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_config_t* outConfig)
+{
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        *outConfig = kConfigId;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_active_config(hwc2_device_t* device, hwc2_display_t display,
+        hwc2_config_t config)
+{
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        return config == kConfigId ? HWC2_ERROR_NONE : HWC2_ERROR_BAD_CONFIG;
+    });
+}
+
+static int32_t hwc2_get_display_name(hwc2_device_t* device, hwc2_display_t display,
+        uint32_t* outSize, char* outName)
+{
+    static const char kName[] = "Headless";
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        if (!outName) {
+            *outSize = sizeof(kName) - 1;
+            return HWC2_ERROR_NONE;
+        }
+        *outSize = std::min<uint32_t>(*outSize, sizeof(kName) - 1);
+        memcpy(outName, kName, *outSize);
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_get_display_type(hwc2_device_t* device, hwc2_display_t display,
+        int32_t* outType)
+{
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        *outType = HWC2_DISPLAY_TYPE_PHYSICAL;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_get_doze_support(hwc2_device_t* device, hwc2_display_t display,
+        int32_t* outSupport)
+{
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        *outSupport = 0;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_get_hdr_capabilities(hwc2_device_t* device, hwc2_display_t display,
+        uint32_t* outNumTypes, int32_t* /*outTypes*/, float* /*outMaxLuminance*/,
+        float* /*outMaxAverageLuminance*/, float* /*outMinLuminance*/)
+{
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        *outNumTypes = 0;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_get_color_modes(hwc2_device_t* device, hwc2_display_t display,
+        uint32_t* outNumModes, int32_t* outModes)
+{
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        if (outModes && *outNumModes > 0) {
+            outModes[0] = HAL_COLOR_MODE_NATIVE;
+        }
+        *outNumModes = (outModes && *outNumModes == 0) ? 0 : 1;
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_color_mode(hwc2_device_t* device, hwc2_display_t display, int32_t mode)
+{
+    return on_display(device, display, [&](hwc2_context_t*) -> int32_t {
+        return mode == HAL_COLOR_MODE_NATIVE ? HWC2_ERROR_NONE : HWC2_ERROR_UNSUPPORTED;
+    });
+}
+
+static int32_t hwc2_set_color_transform(hwc2_device_t* device, hwc2_display_t display,
+        const float* /*matrix*/, int32_t hint)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        // Only the client applies color transforms.
+        const bool identity = hint == HAL_COLOR_TRANSFORM_IDENTITY;
+        if (identity != ctx->colorTransformIdentity) {
+            ctx->colorTransformIdentity = identity;
+            ctx->validated = false;
+        }
+        return HWC2_ERROR_NONE;
+    });
+}
+
+static int32_t hwc2_set_power_mode(hwc2_device_t* device, hwc2_display_t display, int32_t mode)
+{
+    return on_display(device, display, [&](hwc2_context_t* ctx) -> int32_t {
+        switch (mode) {
+        case HWC2_POWER_MODE_OFF:
+        case HWC2_POWER_MODE_ON:
+            ctx->powerMode = mode;
+            return HWC2_ERROR_NONE;
+        case HWC2_POWER_MODE_DOZE:
+        case HWC2_POWER_MODE_DOZE_SUSPEND:
+            return HWC2_ERROR_UNSUPPORTED;
+        default:
+            return HWC2_ERROR_BAD_PARAMETER;
+        }
+    });
+}
+
+static int32_t hwc2_set_vsync_enabled(hwc2_device_t* device, hwc2_display_t display,
+        int32_t enabled)
+{
+    if (display != kDisplayId) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+    if (enabled != HWC2_VSYNC_ENABLE && enabled != HWC2_VSYNC_DISABLE) {
+        return HWC2_ERROR_BAD_PARAMETER;
+    }
+    hwc2_context_t* ctx = to_context(device);
+    std::lock_guard<std::mutex> guard(ctx->callbackLock);
+    ctx->vsyncEnabled = enabled == HWC2_VSYNC_ENABLE;
+    return HWC2_ERROR_NONE;
+}
+
+/*****************************************************************************/
+
+static int32_t hwc2_create_virtual_display(hwc2_device_t* /*device*/, uint32_t /*width*/,
+        uint32_t /*height*/, int32_t* /*format*/, hwc2_display_t* /*outDisplay*/)
+{
+    return HWC2_ERROR_NO_RESOURCES;
+}
+
+static int32_t hwc2_destroy_virtual_display(hwc2_device_t* /*device*/, hwc2_display_t /*display*/)
+{
+    return HWC2_ERROR_BAD_DISPLAY;
+}
+
+static uint32_t hwc2_get_max_virtual_display_count(hwc2_device_t* /*device*/)
+{
+    return 0;
+}
+
+static int32_t hwc2_set_output_buffer(hwc2_device_t* /*device*/, hwc2_display_t display,
+        buffer_handle_t /*buffer*/, int32_t releaseFence)
+{
+    if (releaseFence >= 0) {
+        close(releaseFence);
+    }
+    // There are no virtual displays to output to.
+    return display == kDisplayId ? HWC2_ERROR_UNSUPPORTED : HWC2_ERROR_BAD_DISPLAY;
+}
+
+static int32_t hwc2_register_callback(hwc2_device_t* device, int32_t descriptor,
+        hwc2_callback_data_t callbackData, hwc2_function_pointer_t pointer)
+{
+    hwc2_context_t* ctx = to_context(device);
+    switch (descriptor) {
+    case HWC2_CALLBACK_HOTPLUG:
+        // The display is always connected.
+        if (pointer) {
+            reinterpret_cast<HWC2_PFN_HOTPLUG>(pointer)(callbackData, kDisplayId,
+                    HWC2_CONNECTION_CONNECTED);
+        }
+        return HWC2_ERROR_NONE;
+    case HWC2_CALLBACK_VSYNC: {
+        std::lock_guard<std::mutex> guard(ctx->callbackLock);
+        ctx->vsyncCallback = reinterpret_cast<HWC2_PFN_VSYNC>(pointer);
+        ctx->vsyncData = callbackData;
+        return HWC2_ERROR_NONE;
+    }
+    case HWC2_CALLBACK_REFRESH:
+        // Nothing ever needs the client to refresh.
+        return HWC2_ERROR_NONE;
+    default:
+        return HWC2_ERROR_BAD_PARAMETER;
+    }
+}
+
+static void hwc2_dump(hwc2_device_t* device, uint32_t* outSize, char* outBuffer)
+{
+    hwc2_context_t* ctx = to_context(device);
+    std::lock_guard<std::mutex> guard(ctx->lock);
+    if (!outBuffer) {
+        char text[512];
+        const uint64_t composedFrames = ctx->presents - ctx->unchangedFrames;
+        snprintf(text, sizeof(text),
+                "Headless HWC2: %dx%d, %.2f Hz, %zu layers, %s composition, %zu threads\n"
+                "  %" PRIu64 " validates, %" PRIu64 " presents, %" PRIu64 " without validating\n"
+                "  %" PRIu64 " frames unchanged, %.2f ms average composition\n"
+                "  sw_sync fences %s, %" PRIu32 " presented, %" PRIu32 " signalled\n",
+                ctx->width, ctx->height, 1e9 / ctx->vsyncPeriodNs, ctx->layers.size(),
+                ctx->clientComposition ? "client" : "device", ctx->composer->threadCount(),
+                ctx->validates, ctx->presents, ctx->skippedValidates,
+                ctx->unchangedFrames,
+                composedFrames ? ctx->composeNs / 1e6 / composedFrames : 0.0,
+                ctx->timelineFd >= 0 ? "enabled" : "unavailable",
+                ctx->presented, ctx->signalled);
+        ctx->dumpText = text;
+        *outSize = ctx->dumpText.size();
+        return;
+    }
+    *outSize = std::min<uint32_t>(*outSize, ctx->dumpText.size());
+    memcpy(outBuffer, ctx->dumpText.data(), *outSize);
+}
+
+/*****************************************************************************/
+
+template <typename PFN, typename T>
+static hwc2_function_pointer_t as_fp(T function)
+{
+    static_assert(std::is_same<PFN, T>::value, "incompatible function pointer");
+    return reinterpret_cast<hwc2_function_pointer_t>(function);
+}
+
+static hwc2_function_pointer_t hwc2_get_function(hwc2_device_t* /*device*/, int32_t descriptor)
+{
+    switch (descriptor) {
+    case HWC2_FUNCTION_ACCEPT_DISPLAY_CHANGES:
+        return as_fp<HWC2_PFN_ACCEPT_DISPLAY_CHANGES>(hwc2_accept_display_changes);
+    case HWC2_FUNCTION_CREATE_LAYER:
+        return as_fp<HWC2_PFN_CREATE_LAYER>(hwc2_create_layer);
+    case HWC2_FUNCTION_CREATE_VIRTUAL_DISPLAY:
+        return as_fp<HWC2_PFN_CREATE_VIRTUAL_DISPLAY>(hwc2_create_virtual_display);
+    case HWC2_FUNCTION_DESTROY_LAYER:
+        return as_fp<HWC2_PFN_DESTROY_LAYER>(hwc2_destroy_layer);
+    case HWC2_FUNCTION_DESTROY_VIRTUAL_DISPLAY:
+        return as_fp<HWC2_PFN_DESTROY_VIRTUAL_DISPLAY>(hwc2_destroy_virtual_display);
+    case HWC2_FUNCTION_DUMP:
+        return as_fp<HWC2_PFN_DUMP>(hwc2_dump);
+    case HWC2_FUNCTION_GET_ACTIVE_CONFIG:
+        return as_fp<HWC2_PFN_GET_ACTIVE_CONFIG>(hwc2_get_active_config);
+    case HWC2_FUNCTION_GET_CHANGED_COMPOSITION_TYPES:
+        return as_fp<HWC2_PFN_GET_CHANGED_COMPOSITION_TYPES>(
+                hwc2_get_changed_composition_types);
+    case HWC2_FUNCTION_GET_CLIENT_TARGET_SUPPORT:
+        return as_fp<HWC2_PFN_GET_CLIENT_TARGET_SUPPORT>(hwc2_get_client_target_support);
+    case HWC2_FUNCTION_GET_COLOR_MODES:
+        return as_fp<HWC2_PFN_GET_COLOR_MODES>(hwc2_get_color_modes);
+    case HWC2_FUNCTION_GET_DISPLAY_ATTRIBUTE:
+        return as_fp<HWC2_PFN_GET_DISPLAY_ATTRIBUTE>(hwc2_get_display_attribute);
+    case HWC2_FUNCTION_GET_DISPLAY_CONFIGS:
+        return as_fp<HWC2_PFN_GET_DISPLAY_CONFIGS>(hwc2_get_display_configs);
+    case HWC2_FUNCTION_GET_DISPLAY_NAME:
+        return as_fp<HWC2_PFN_GET_DISPLAY_NAME>(hwc2_get_display_name);
+    case HWC2_FUNCTION_GET_DISPLAY_REQUESTS:
+        return as_fp<HWC2_PFN_GET_DISPLAY_REQUESTS>(hwc2_get_display_requests);
+    case HWC2_FUNCTION_GET_DISPLAY_TYPE:
+        return as_fp<HWC2_PFN_GET_DISPLAY_TYPE>(hwc2_get_display_type);
+    case HWC2_FUNCTION_GET_DOZE_SUPPORT:
+        return as_fp<HWC2_PFN_GET_DOZE_SUPPORT>(hwc2_get_doze_support);
+    case HWC2_FUNCTION_GET_HDR_CAPABILITIES:
+        return as_fp<HWC2_PFN_GET_HDR_CAPABILITIES>(hwc2_get_hdr_capabilities);
+    case HWC2_FUNCTION_GET_MAX_VIRTUAL_DISPLAY_COUNT:
+        return as_fp<HWC2_PFN_GET_MAX_VIRTUAL_DISPLAY_COUNT>(
+                hwc2_get_max_virtual_display_count);
+    case HWC2_FUNCTION_GET_RELEASE_FENCES:
+        return as_fp<HWC2_PFN_GET_RELEASE_FENCES>(hwc2_get_release_fences);
+    case HWC2_FUNCTION_PRESENT_DISPLAY:
+        return as_fp<HWC2_PFN_PRESENT_DISPLAY>(hwc2_present_display);
+    case HWC2_FUNCTION_REGISTER_CALLBACK:
+        return as_fp<HWC2_PFN_REGISTER_CALLBACK>(hwc2_register_callback);
+    case HWC2_FUNCTION_SET_ACTIVE_CONFIG:
+        return as_fp<HWC2_PFN_SET_ACTIVE_CONFIG>(hwc2_set_active_config);
+    case HWC2_FUNCTION_SET_CLIENT_TARGET:
+        return as_fp<HWC2_PFN_SET_CLIENT_TARGET>(hwc2_set_client_target);
+    case HWC2_FUNCTION_SET_COLOR_MODE:
+        return as_fp<HWC2_PFN_SET_COLOR_MODE>(hwc2_set_color_mode);
+    case HWC2_FUNCTION_SET_COLOR_TRANSFORM:
+        return as_fp<HWC2_PFN_SET_COLOR_TRANSFORM>(hwc2_set_color_transform);
+    case HWC2_FUNCTION_SET_CURSOR_POSITION:
+        return as_fp<HWC2_PFN_SET_CURSOR_POSITION>(hwc2_set_cursor_position);
+    case HWC2_FUNCTION_SET_LAYER_BLEND_MODE:
+        return as_fp<HWC2_PFN_SET_LAYER_BLEND_MODE>(hwc2_set_layer_blend_mode);
+    case HWC2_FUNCTION_SET_LAYER_BUFFER:
+        return as_fp<HWC2_PFN_SET_LAYER_BUFFER>(hwc2_set_layer_buffer);
+    case HWC2_FUNCTION_SET_LAYER_COLOR:
+        return as_fp<HWC2_PFN_SET_LAYER_COLOR>(hwc2_set_layer_color);
+    case HWC2_FUNCTION_SET_LAYER_COMPOSITION_TYPE:
+        return as_fp<HWC2_PFN_SET_LAYER_COMPOSITION_TYPE>(hwc2_set_layer_composition_type);
+    case HWC2_FUNCTION_SET_LAYER_DATASPACE:
+        return as_fp<HWC2_PFN_SET_LAYER_DATASPACE>(hwc2_set_layer_dataspace);
+    case HWC2_FUNCTION_SET_LAYER_DISPLAY_FRAME:
+        return as_fp<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(hwc2_set_layer_display_frame);
+    case HWC2_FUNCTION_SET_LAYER_PLANE_ALPHA:
+        return as_fp<HWC2_PFN_SET_LAYER_PLANE_ALPHA>(hwc2_set_layer_plane_alpha);
+    case HWC2_FUNCTION_SET_LAYER_SIDEBAND_STREAM:
+        return as_fp<HWC2_PFN_SET_LAYER_SIDEBAND_STREAM>(hwc2_set_layer_sideband_stream);
+    case HWC2_FUNCTION_SET_LAYER_SOURCE_CROP:
+        return as_fp<HWC2_PFN_SET_LAYER_SOURCE_CROP>(hwc2_set_layer_source_crop);
+    case HWC2_FUNCTION_SET_LAYER_SURFACE_DAMAGE:
+        return as_fp<HWC2_PFN_SET_LAYER_SURFACE_DAMAGE>(hwc2_set_layer_surface_damage);
+    case HWC2_FUNCTION_SET_LAYER_TRANSFORM:
+        return as_fp<HWC2_PFN_SET_LAYER_TRANSFORM>(hwc2_set_layer_transform);
+    case HWC2_FUNCTION_SET_LAYER_VISIBLE_REGION:
+        return as_fp<HWC2_PFN_SET_LAYER_VISIBLE_REGION>(hwc2_set_layer_visible_region);
+    case HWC2_FUNCTION_SET_LAYER_Z_ORDER:
+        return as_fp<HWC2_PFN_SET_LAYER_Z_ORDER>(hwc2_set_layer_z_order);
+    case HWC2_FUNCTION_SET_OUTPUT_BUFFER:
+        return as_fp<HWC2_PFN_SET_OUTPUT_BUFFER>(hwc2_set_output_buffer);
+    case HWC2_FUNCTION_SET_POWER_MODE:
+        return as_fp<HWC2_PFN_SET_POWER_MODE>(hwc2_set_power_mode);
+    case HWC2_FUNCTION_SET_VSYNC_ENABLED:
+        return as_fp<HWC2_PFN_SET_VSYNC_ENABLED>(hwc2_set_vsync_enabled);
+    case HWC2_FUNCTION_VALIDATE_DISPLAY:
+        return as_fp<HWC2_PFN_VALIDATE_DISPLAY>(hwc2_validate_display);
+    default:
+        return NULL;
+    }
+}
+
+static void hwc2_get_capabilities(hwc2_device_t* /*device*/, uint32_t* outCount,
+        int32_t* outCapabilities)
+{
+    if (outCapabilities && *outCount > 0) {
+        outCapabilities[0] = HWC2_CAPABILITY_SKIP_VALIDATE;
+    }
+    *outCount = (outCapabilities && *outCount == 0) ? 0 : 1;
+}
+
+/*****************************************************************************/
+
+static int hwc2_device_close(struct hw_device_t* dev)
+{
+    hwc2_context_t* ctx = to_context(reinterpret_cast<hwc2_device_t*>(dev));
+    if (ctx->vsyncThread.joinable()) {
+        const uint64_t exit = 1;
+        if (write(ctx->exitFd, &exit, sizeof(exit)) != sizeof(exit)) {
+            ALOGE("could not stop the vsync thread: %s", strerror(errno));
+        }
+        ctx->vsyncThread.join();
+    }
+    for (auto& entry : ctx->layers) {
+        close_fence(&entry.second.acquireFence);
+    }
+    close_fence(&ctx->clientTarget.acquireFence);
+    close_release_fences(ctx);
+    close_fence(&ctx->timerFd);
+    close_fence(&ctx->exitFd);
+    close_fence(&ctx->timelineFd);
+    delete ctx->composer;
+    delete ctx->damage;
+    delete ctx;
+    return 0;
+}
+
+static int hwc2_init(hwc2_context_t* ctx)
+{
+    const hw_module_t* module;
+    int err = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
+    if (err) {
+        return err;
+    }
+    ctx->gralloc = reinterpret_cast<const gralloc_module_t*>(module);
+
+    ctx->width = std::max(property_get_int32(kWidthProperty, 1920), 1);
+    ctx->height = std::max(property_get_int32(kHeightProperty, 1080), 1);
+    ctx->dpi = std::max(property_get_int32(kDpiProperty, 160), 1);
+    const int refreshRate = std::max(property_get_int32(kRefreshRateProperty, 60), 1);
+    ctx->vsyncPeriodNs = 1000000000LL / refreshRate;
+    ctx->powerMode = HWC2_POWER_MODE_OFF;
+    ctx->colorTransformIdentity = true;
+    ctx->nextLayerId = 1;
+    init_layer(&ctx->clientTarget);
+    ctx->clientTarget.requestedType = HWC2_COMPOSITION_CLIENT;
+    ctx->clientTarget.type = HWC2_COMPOSITION_CLIENT;
+    ctx->clientTarget.state.sourceCropf = { 0.0f, 0.0f, (float)ctx->width, (float)ctx->height };
+    ctx->clientTarget.state.displayFrame = { 0, 0, ctx->width, ctx->height };
+
+    const int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const int threads = property_get_int32(kCpuThreadsProperty,
+            std::min(std::max(cpus, 1), kMaxCpuThreads));
+    ctx->composer = new CpuComposer(std::max(threads, 1));
+    ctx->damage = new DamageTracker(1, ctx->width, ctx->height);
+    ctx->frame.resize((size_t)ctx->width * ctx->height);
+
+    ctx->timelineFd = open("/dev/sw_sync", O_RDWR | O_CLOEXEC);
+    if (ctx->timelineFd < 0) {
+        ctx->timelineFd = open("/sys/kernel/debug/sync/sw_sync", O_RDWR | O_CLOEXEC);
+    }
+    ALOGW_IF(ctx->timelineFd < 0, "sw_sync not available, fences will be -1");
+
+    ctx->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    ctx->exitFd = eventfd(0, EFD_CLOEXEC);
+    if (ctx->timerFd < 0 || ctx->exitFd < 0) {
+        ALOGE("could not create the vsync timer: %s", strerror(errno));
+        return -errno;
+    }
+    ctx->vsyncBase = now_ns();
+    const int64_t first = ctx->vsyncBase + ctx->vsyncPeriodNs;
+    struct itimerspec spec;
+    spec.it_value.tv_sec = first / 1000000000;
+    spec.it_value.tv_nsec = first % 1000000000;
+    spec.it_interval.tv_sec = ctx->vsyncPeriodNs / 1000000000;
+    spec.it_interval.tv_nsec = ctx->vsyncPeriodNs % 1000000000;
+    if (timerfd_settime(ctx->timerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        ALOGE("could not start the vsync timer: %s", strerror(errno));
+        return -errno;
+    }
+    ctx->vsyncThread = std::thread(hwc2_vsync_loop, ctx);
+    ALOGI("headless display %dx%d at %d Hz, composed with %zu threads",
+            ctx->width, ctx->height, refreshRate, ctx->composer->threadCount());
+    return 0;
+}
+
+static int hwc2_device_open(const struct hw_module_t* module, const char* name,
+        struct hw_device_t** device)
+{
+    if (strcmp(name, HWC_HARDWARE_COMPOSER)) {
+        return -EINVAL;
+    }
+    hwc2_context_t* ctx = new hwc2_context_t();
+    ctx->common.tag = HARDWARE_DEVICE_TAG;
+    ctx->common.version = HWC_DEVICE_API_VERSION_2_0;
+    ctx->common.module = const_cast<hw_module_t*>(module);
+    ctx->common.close = hwc2_device_close;
+    ctx->getCapabilities = hwc2_get_capabilities;
+    ctx->getFunction = hwc2_get_function;
+    ctx->timelineFd = -1;
+    ctx->timerFd = -1;
+    ctx->exitFd = -1;
+
+    const int status = hwc2_init(ctx);
+    if (status) {
+        hwc2_device_close(&ctx->common);
+        return status;
+    }
+    *device = &ctx->common;
+    return 0;
+}
@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the CpuComposer, SIMD paths and threads included, with a scalar composition of one
+// pixel at a time written after the hwcomposer.h definitions.
+
+#include <math.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "CpuComposer.h"
+
+namespace android {
+namespace {
+
+const int kWidth = 37;
+const int kHeight = 29;
+const uint8_t kSentinel = 0xAB;
+
+struct TestBuffer {
+    std::vector<uint8_t> data;
+    int width;
+    int height;
+    // in pixels
+    int stride;
+    int format;
+};
+
+int bytesPerPixel(int format)
+{
+    return format == HAL_PIXEL_FORMAT_RGB_565 ? 2 : 4;
+}
+
+TestBuffer makeBuffer(int width, int height, int format, uint32_t seed)
+{
+    TestBuffer buffer;
+    buffer.width = width;
+    buffer.height = height;
+    // Padded, for the stride to matter.
+    buffer.stride = width + 3;
+    buffer.format = format;
+    buffer.data.resize((size_t)buffer.stride * height * bytesPerPixel(format));
+    std::mt19937 random(seed);
+    for (uint8_t &byte : buffer.data) {
+        byte = random();
+    }
+    return buffer;
+}
+
+// RGBA 8888, R in the low byte, of pixel (x, y).
+uint32_t readPixel(const TestBuffer &buffer, int x, int y)
+{
+    const size_t index = (size_t)y * buffer.stride + x;
+    if (buffer.format == HAL_PIXEL_FORMAT_RGB_565) {
+        uint16_t v;
+        memcpy(&v, &buffer.data[index * 2], sizeof(v));
+        const uint32_t r5 = v >> 11;
+        const uint32_t g6 = (v >> 5) & 0x3F;
+        const uint32_t b5 = v & 0x1F;
+        const uint32_t r = (r5 << 3) | (r5 >> 2);
+        const uint32_t g = (g6 << 2) | (g6 >> 4);
+        const uint32_t b = (b5 << 3) | (b5 >> 2);
+        return 0xFF000000 | (b << 16) | (g << 8) | r;
+    }
+    uint8_t c[4];
+    memcpy(c, &buffer.data[index * 4], sizeof(c));
+    if (buffer.format == HAL_PIXEL_FORMAT_BGRA_8888) {
+        std::swap(c[0], c[2]);
+    }
+    return c[0] | (c[1] << 8) | (c[2] << 16) | ((uint32_t)c[3] << 24);
+}
+
+CpuLayer makeLayer(const TestBuffer &buffer, hwc_frect_t crop, hwc_rect_t frame,
+        uint32_t transform = 0, int32_t blending = HWC_BLENDING_NONE, uint8_t planeAlpha = 255)
+{
+    CpuLayer layer;
+    layer.pixels = buffer.data.data();
+    layer.stride = buffer.stride;
+    layer.format = buffer.format;
+    layer.crop = crop;
+    layer.frame = frame;
+    layer.transform = transform;
+    layer.blending = blending;
+    layer.planeAlpha = planeAlpha;
+    return layer;
+}
+
+// x / 255 rounded to nearest.
+uint32_t div255(uint32_t x)
+{
+    return (2 * x + 255) / 510;
+}
+
+uint32_t channel(uint32_t p, int c)
+{
+    return (p >> (c * 8)) & 0xFF;
+}
+
+uint32_t referenceBlend(uint32_t dst, uint32_t src, int32_t blending, uint32_t planeAlpha)
+{
+    uint32_t s[4];
+    for (int c = 0; c < 4; c++) {
+        s[c] = channel(src, c);
+    }
+    if (blending == HWC_BLENDING_NONE) {
+        s[3] = 255;
+    } else if (blending == HWC_BLENDING_COVERAGE) {
+        for (int c = 0; c < 3; c++) {
+            s[c] = div255(s[c] * s[3]);
+        }
+    }
+    for (int c = 0; c < 4; c++) {
+        s[c] = div255(s[c] * planeAlpha);
+    }
+    uint32_t result = 0;
+    for (int c = 0; c < 4; c++) {
+        const uint32_t v = s[c] + div255(channel(dst, c) * (255 - s[3]));
+        result |= std::min(v, 255u) << (c * 8);
+    }
+    return result;
+}
+
+// Pixel (x, y) of the crop as displayed in the frame: flipped, rotated 90 degrees clockwise,
+// then scaled with the nearest pixel.  Integer crops only.
+uint32_t referenceSample(const TestBuffer &buffer, const CpuLayer &layer, int x, int y)
+{
+    const int cropLeft = (int)layer.crop.left;
+    const int cropTop = (int)layer.crop.top;
+    const int cropWidth = (int)layer.crop.right - cropLeft;
+    const int cropHeight = (int)layer.crop.bottom - cropTop;
+    const bool rotated = layer.transform & HAL_TRANSFORM_ROT_90;
+    const int width = rotated ? cropHeight : cropWidth;
+    const int height = rotated ? cropWidth : cropHeight;
+    const int frameWidth = layer.frame.right - layer.frame.left;
+    const int frameHeight = layer.frame.bottom - layer.frame.top;
+    int tx = (int)floor((x - layer.frame.left + 0.5) * width / frameWidth);
+    int ty = (int)floor((y - layer.frame.top + 0.5) * height / frameHeight);
+    // Pixel (tx, ty) of the rotated crop is pixel (ty, cropHeight - 1 - tx) of the flipped one.
+    if (rotated) {
+        const int t = tx;
+        tx = ty;
+        ty = cropHeight - 1 - t;
+    }
+    if (layer.transform & HAL_TRANSFORM_FLIP_H) {
+        tx = cropWidth - 1 - tx;
+    }
+    if (layer.transform & HAL_TRANSFORM_FLIP_V) {
+        ty = cropHeight - 1 - ty;
+    }
+    return readPixel(buffer, cropLeft + tx, cropTop + ty);
+}
+
+// Composes the layers, whose buffers are listed in the same order, over transparent black.
+std::vector<uint32_t> referenceCompose(const std::vector<const TestBuffer *> &buffers,
+        const std::vector<CpuLayer> &layers, int width, int height)
+{
+    std::vector<uint32_t> image((size_t)width * height, 0);
+    for (size_t i = 0; i < layers.size(); i++) {
+        const CpuLayer &layer = layers[i];
+        const bool opaqueFormat = layer.format == HAL_PIXEL_FORMAT_RGBX_8888 ||
+                layer.format == HAL_PIXEL_FORMAT_RGB_565;
+        const int32_t blending = opaqueFormat ? HWC_BLENDING_NONE : layer.blending;
+        for (int y = std::max(layer.frame.top, 0); y < std::min(layer.frame.bottom, height);
+                y++) {
+            for (int x = std::max(layer.frame.left, 0); x < std::min(layer.frame.right, width);
+                    x++) {
+                uint32_t &d = image[(size_t)y * width + x];
+                d = referenceBlend(d, referenceSample(*buffers[i], layer, x, y), blending,
+                        layer.planeAlpha);
+            }
+        }
+    }
+    return image;
+}
+
+uint32_t toStored(uint32_t p, int format)
+{
+    switch (format) {
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+        return (p & 0xFF00FF00) | (channel(p, 0) << 16) | channel(p, 2);
+    case HAL_PIXEL_FORMAT_RGB_565:
+        return ((channel(p, 0) >> 3) << 11) | ((channel(p, 1) >> 2) << 5) | (channel(p, 2) >> 3);
+    default:
+        return p;
+    }
+}
+
+uint32_t readStored(const std::vector<uint8_t> &dst, int stride, int format, int x, int y)
+{
+    const size_t bpp = bytesPerPixel(format);
+    uint32_t v = 0;
+    memcpy(&v, &dst[((size_t)y * stride + x) * bpp], bpp);
+    return v;
+}
+
+bool inRects(const std::vector<hwc_rect_t> &rects, int x, int y)
+{
+    for (const hwc_rect_t &r : rects) {
+        if (x >= r.left && x < r.right && y >= r.top && y < r.bottom) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Expects the pixels in rects, all when empty, to be the reference, and the others untouched.
+void expectComposed(const std::vector<uint8_t> &dst, int stride, int format,
+        const std::vector<uint32_t> &reference, const std::vector<hwc_rect_t> &rects = {})
+{
+    const uint32_t bytes = bytesPerPixel(format);
+    uint32_t sentinel = 0;
+    memset(&sentinel, kSentinel, bytes);
+    for (int y = 0; y < kHeight; y++) {
+        for (int x = 0; x < kWidth; x++) {
+            const uint32_t expected = rects.empty() || inRects(rects, x, y) ?
+                    toStored(reference[(size_t)y * kWidth + x], format) : sentinel;
+            ASSERT_EQ(expected, readStored(dst, stride, format, x, y))
+                    << "at (" << x << ", " << y << ")";
+        }
+    }
+}
+
+class CpuComposerTest : public testing::TestWithParam<size_t> {
+  protected:
+    CpuComposerTest() : mComposer(GetParam()) {}
+
+    // Composes into a destination filled with kSentinel, rows of stride pixels.
+    std::vector<uint8_t> compose(const std::vector<CpuLayer> &layers, int format, int stride,
+            const std::vector<hwc_rect_t> &rects = {}) {
+        std::vector<uint8_t> dst((size_t)stride * kHeight * bytesPerPixel(format), kSentinel);
+        mComposer.compose(layers, dst.data(), stride, format, kWidth, kHeight, rects.data(),
+                rects.size());
+        return dst;
+    }
+
+    CpuComposer mComposer;
+};
+
+TEST_P(CpuComposerTest, ThreadCount) {
+    EXPECT_EQ(GetParam(), mComposer.threadCount());
+}
+
+TEST(CpuComposerFormatTest, SupportsFormat) {
+    EXPECT_TRUE(CpuComposer::supportsFormat(HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_TRUE(CpuComposer::supportsFormat(HAL_PIXEL_FORMAT_RGBX_8888));
+    EXPECT_TRUE(CpuComposer::supportsFormat(HAL_PIXEL_FORMAT_BGRA_8888));
+    EXPECT_TRUE(CpuComposer::supportsFormat(HAL_PIXEL_FORMAT_RGB_565));
+    EXPECT_FALSE(CpuComposer::supportsFormat(HAL_PIXEL_FORMAT_RGB_888));
+    EXPECT_FALSE(CpuComposer::supportsFormat(HAL_PIXEL_FORMAT_RGBA_FP16));
+    EXPECT_FALSE(CpuComposer::supportsFormat(HAL_PIXEL_FORMAT_YV12));
+    EXPECT_FALSE(CpuComposer::supportsFormat(HAL_PIXEL_FORMAT_YCBCR_420_888));
+}
+
+TEST_P(CpuComposerTest, NoLayersIsTransparentBlack) {
+    const std::vector<uint8_t> dst = compose({}, HAL_PIXEL_FORMAT_RGBA_8888, kWidth);
+    expectComposed(dst, kWidth, HAL_PIXEL_FORMAT_RGBA_8888,
+            std::vector<uint32_t>((size_t)kWidth * kHeight, 0));
+}
+
+TEST_P(CpuComposerTest, BlendingAndPlaneAlpha) {
+    const TestBuffer background = makeBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBX_8888, 1);
+    const int formats[] = { HAL_PIXEL_FORMAT_RGBA_8888, HAL_PIXEL_FORMAT_RGBX_8888,
+            HAL_PIXEL_FORMAT_BGRA_8888, HAL_PIXEL_FORMAT_RGB_565 };
+    const int32_t blendings[] = { HWC_BLENDING_NONE, HWC_BLENDING_PREMULT,
+            HWC_BLENDING_COVERAGE };
+    const uint8_t planeAlphas[] = { 255, 128, 0 };
+    for (int format : formats) {
+        const TestBuffer buffer = makeBuffer(24, 20, format, format);
+        for (int32_t blending : blendings) {
+            for (uint8_t planeAlpha : planeAlphas) {
+                SCOPED_TRACE(testing::Message() << "format " << format << ", blending "
+                        << blending << ", plane alpha " << (int)planeAlpha);
+                // Over the right edge of the destination.
+                const std::vector<CpuLayer> layers = {
+                    makeLayer(background, { 0, 0, kWidth, kHeight }, { 0, 0, kWidth, kHeight }),
+                    makeLayer(buffer, { 2, 3, 22, 19 }, { 25, 6, 45, 22 }, 0, blending,
+                            planeAlpha),
+                };
+                const std::vector<uint8_t> dst =
+                        compose(layers, HAL_PIXEL_FORMAT_RGBA_8888, kWidth);
+                expectComposed(dst, kWidth, HAL_PIXEL_FORMAT_RGBA_8888,
+                        referenceCompose({ &background, &buffer }, layers, kWidth, kHeight));
+            }
+        }
+    }
+}
+
+TEST_P(CpuComposerTest, DestinationFormats) {
+    const TestBuffer bottom = makeBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888, 2);
+    const TestBuffer top = makeBuffer(16, 16, HAL_PIXEL_FORMAT_RGBA_8888, 3);
+    const std::vector<CpuLayer> layers = {
+        makeLayer(bottom, { 0, 0, kWidth, kHeight }, { 0, 0, kWidth, kHeight }, 0,
+                HWC_BLENDING_PREMULT),
+        makeLayer(top, { 0, 0, 16, 16 }, { 3, 4, 19, 20 }, 0, HWC_BLENDING_COVERAGE, 200),
+    };
+    const std::vector<uint32_t> reference =
+            referenceCompose({ &bottom, &top }, layers, kWidth, kHeight);
+    const int formats[] = { HAL_PIXEL_FORMAT_RGBA_8888, HAL_PIXEL_FORMAT_RGBX_8888,
+            HAL_PIXEL_FORMAT_BGRA_8888, HAL_PIXEL_FORMAT_RGB_565 };
+    for (int format : formats) {
+        SCOPED_TRACE(testing::Message() << "format " << format);
+        const int stride = kWidth + 5;
+        expectComposed(compose(layers, format, stride), stride, format, reference);
+    }
+}
+
+TEST_P(CpuComposerTest, TransformsAndScaling) {
+    const TestBuffer buffer = makeBuffer(20, 20, HAL_PIXEL_FORMAT_RGBA_8888, 4);
+    const uint32_t transforms[] = { 0, HAL_TRANSFORM_FLIP_H, HAL_TRANSFORM_FLIP_V,
+            HAL_TRANSFORM_ROT_90, HAL_TRANSFORM_ROT_180, HAL_TRANSFORM_ROT_270,
+            HAL_TRANSFORM_FLIP_H | HAL_TRANSFORM_ROT_90 };
+    // Crop and frame sizes of ratios no destination pixel center falls between two source
+    // pixels for: same size, upscaled, downscaled and stretched.
+    const struct {
+        hwc_frect_t crop;
+        hwc_rect_t frame;
+    } placements[] = {
+        { { 4, 4, 12, 12 }, { 5, 6, 13, 14 } },
+        { { 4, 4, 12, 12 }, { 2, 3, 18, 19 } },
+        { { 2, 5, 14, 17 }, { 9, 1, 17, 9 } },
+        { { 2, 3, 14, 11 }, { 20, 10, 28, 26 } },
+    };
+    for (uint32_t transform : transforms) {
+        for (const auto &placement : placements) {
+            SCOPED_TRACE(testing::Message() << "transform " << transform << ", frame "
+                    << placement.frame.left << "," << placement.frame.top << ","
+                    << placement.frame.right << "," << placement.frame.bottom);
+            const std::vector<CpuLayer> layers = {
+                makeLayer(buffer, placement.crop, placement.frame, transform),
+            };
+            expectComposed(compose(layers, HAL_PIXEL_FORMAT_RGBA_8888, kWidth), kWidth,
+                    HAL_PIXEL_FORMAT_RGBA_8888,
+                    referenceCompose({ &buffer }, layers, kWidth, kHeight));
+        }
+    }
+}
+
+TEST_P(CpuComposerTest, PartialRects) {
+    const TestBuffer bottom = makeBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGB_565, 5);
+    const TestBuffer top = makeBuffer(8, 8, HAL_PIXEL_FORMAT_BGRA_8888, 6);
+    const std::vector<CpuLayer> layers = {
+        makeLayer(bottom, { 0, 0, kWidth, kHeight }, { 0, 0, kWidth, kHeight }),
+        makeLayer(top, { 0, 0, 8, 8 }, { 10, 5, 26, 21 }, HAL_TRANSFORM_ROT_90,
+                HWC_BLENDING_PREMULT, 180),
+    };
+    const std::vector<uint32_t> reference =
+            referenceCompose({ &bottom, &top }, layers, kWidth, kHeight);
+    // Overlapping, and over the edges of the destination.
+    const std::vector<hwc_rect_t> rects = {
+        { 3, 2, 11, 9 }, { 8, 7, 20, 25 }, { -5, -5, 2, 3 }, { 30, 24, 50, 40 },
+    };
+    expectComposed(compose(layers, HAL_PIXEL_FORMAT_RGBA_8888, kWidth, rects), kWidth,
+            HAL_PIXEL_FORMAT_RGBA_8888, reference, rects);
+}
+
+// A YUV 4:2:0 destination with padded planes, filled with kSentinel.
+struct YuvBuffer {
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> cb;
+    std::vector<uint8_t> cr;
+    android_ycbcr ycbcr;
+
+    // Planar with a chroma step of 1, or Cr and Cb interleaved with a step of 2.
+    explicit YuvBuffer(bool interleaved) {
+        const size_t chromaHeight = (kHeight + 1) / 2;
+        ycbcr = android_ycbcr();
+        ycbcr.ystride = kWidth + 7;
+        y.assign(ycbcr.ystride * kHeight, kSentinel);
+        if (interleaved) {
+            ycbcr.cstride = ycbcr.ystride;
+            ycbcr.chroma_step = 2;
+            cr.assign(ycbcr.cstride * chromaHeight, kSentinel);
+            ycbcr.cr = cr.data();
+            ycbcr.cb = cr.data() + 1;
+        } else {
+            ycbcr.cstride = (kWidth + 1) / 2 + 5;
+            ycbcr.chroma_step = 1;
+            cb.assign(ycbcr.cstride * chromaHeight, kSentinel);
+            cr.assign(ycbcr.cstride * chromaHeight, kSentinel);
+            ycbcr.cb = cb.data();
+            ycbcr.cr = cr.data();
+        }
+        ycbcr.y = y.data();
+    }
+
+    uint8_t luma(int x, int py) const {
+        return y[(size_t)py * ycbcr.ystride + x];
+    }
+    uint8_t chroma(const void *plane, int x, int py) const {
+        return static_cast<const uint8_t *>(plane)[(size_t)py * ycbcr.cstride +
+                x * ycbcr.chroma_step];
+    }
+};
+
+// BT.601 limited range, the chroma of 2x2 blocks, the last row or column repeated where the
+// block is cut by the edge of the destination.
+void expectYuv(const YuvBuffer &dst, const std::vector<uint32_t> &reference,
+        const std::vector<hwc_rect_t> &rects = {})
+{
+    auto rgb = [&](int x, int y, int32_t *r, int32_t *g, int32_t *b) {
+        const uint32_t p = reference[(size_t)y * kWidth + x];
+        *r = channel(p, 0);
+        *g = channel(p, 1);
+        *b = channel(p, 2);
+    };
+    for (int y = 0; y < kHeight; y++) {
+        for (int x = 0; x < kWidth; x++) {
+            int32_t r, g, b;
+            rgb(x, y, &r, &g, &b);
+            const uint8_t expected = rects.empty() || inRects(rects, x, y) ?
+                    ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16 : kSentinel;
+            ASSERT_EQ(expected, dst.luma(x, y)) << "luma at (" << x << ", " << y << ")";
+        }
+    }
+    for (int y = 0; y < kHeight; y += 2) {
+        for (int x = 0; x < kWidth; x += 2) {
+            int32_t r = 0, g = 0, b = 0;
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    int32_t pr, pg, pb;
+                    rgb(std::min(x + dx, kWidth - 1), std::min(y + dy, kHeight - 1),
+                            &pr, &pg, &pb);
+                    r += pr;
+                    g += pg;
+                    b += pb;
+                }
+            }
+            const bool composed = rects.empty() || inRects(rects, x, y);
+            const uint8_t cb = composed ?
+                    ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128 : kSentinel;
+            const uint8_t cr = composed ?
+                    ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128 : kSentinel;
+            ASSERT_EQ(cb, dst.chroma(dst.ycbcr.cb, x / 2, y / 2))
+                    << "cb at (" << x << ", " << y << ")";
+            ASSERT_EQ(cr, dst.chroma(dst.ycbcr.cr, x / 2, y / 2))
+                    << "cr at (" << x << ", " << y << ")";
+        }
+    }
+}
+
+TEST_P(CpuComposerTest, ComposeYuv) {
+    const TestBuffer bottom = makeBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBX_8888, 7);
+    const TestBuffer top = makeBuffer(12, 12, HAL_PIXEL_FORMAT_RGBA_8888, 8);
+    const std::vector<CpuLayer> layers = {
+        makeLayer(bottom, { 0, 0, kWidth, kHeight }, { 0, 0, kWidth, kHeight }),
+        makeLayer(top, { 0, 0, 12, 12 }, { 7, 3, 31, 27 }, HAL_TRANSFORM_FLIP_V,
+                HWC_BLENDING_COVERAGE),
+    };
+    const std::vector<uint32_t> reference =
+            referenceCompose({ &bottom, &top }, layers, kWidth, kHeight);
+    for (bool interleaved : { false, true }) {
+        SCOPED_TRACE(testing::Message() << "interleaved " << interleaved);
+        YuvBuffer dst(interleaved);
+        mComposer.composeYuv(layers, dst.ycbcr, kWidth, kHeight);
+        expectYuv(dst, reference);
+    }
+}
+
+TEST_P(CpuComposerTest, ComposeYuvRoundsRectsToEvenBounds) {
+    const TestBuffer buffer = makeBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888, 9);
+    const std::vector<CpuLayer> layers = {
+        makeLayer(buffer, { 0, 0, kWidth, kHeight }, { 0, 0, kWidth, kHeight }, 0,
+                HWC_BLENDING_PREMULT),
+    };
+    const std::vector<uint32_t> reference =
+            referenceCompose({ &buffer }, layers, kWidth, kHeight);
+    // Odd bounds, the last one over the odd right and bottom edges.
+    const std::vector<hwc_rect_t> rects = { { 3, 5, 8, 10 }, { 13, 1, 14, 2 },
+            { 33, 25, 37, 29 } };
+    const std::vector<hwc_rect_t> evenRects = { { 2, 4, 8, 10 }, { 12, 0, 14, 2 },
+            { 32, 24, 38, 30 } };
+    YuvBuffer dst(false);
+    mComposer.composeYuv(layers, dst.ycbcr, kWidth, kHeight, rects.data(), rects.size());
+    expectYuv(dst, reference, evenRects);
+}
+
+INSTANTIATE_TEST_SUITE_P(Threads, CpuComposerTest, testing::Values(1, 4),
+        [](const testing::TestParamInfo<size_t> &info) {
+            return std::to_string(info.param);
+        });
+
+}  // namespace
+}  // namespace android
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the damage the DamageTracker finds against the pixels the CpuComposer changes.
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "CpuComposer.h"
+#include "DamageTracker.h"
+
+namespace android {
+namespace {
+
+const int kWidth = 37;
+const int kHeight = 29;
+const int kSourceSize = 20;
+
+// The tracker only compares the handles.
+buffer_handle_t fakeHandle(uintptr_t id)
+{
+    return reinterpret_cast<buffer_handle_t>(id);
+}
+
+hwc_layer_1_t makeLayer(buffer_handle_t handle, hwc_frect_t crop, hwc_rect_t frame,
+        uint32_t transform = 0, const std::vector<hwc_rect_t> *damage = nullptr)
+{
+    hwc_layer_1_t layer;
+    memset(&layer, 0, sizeof(layer));
+    layer.compositionType = HWC_OVERLAY;
+    layer.handle = handle;
+    layer.transform = transform;
+    layer.blending = HWC_BLENDING_NONE;
+    layer.sourceCropf = crop;
+    layer.displayFrame = frame;
+    layer.planeAlpha = 255;
+    if (damage) {
+        layer.surfaceDamage.numRects = damage->size();
+        layer.surfaceDamage.rects = damage->data();
+    }
+    return layer;
+}
+
+bool inRects(const std::vector<hwc_rect_t> &rects, int x, int y)
+{
+    for (const hwc_rect_t &r : rects) {
+        if (x >= r.left && x < r.right && y >= r.top && y < r.bottom) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<uint32_t> compose(CpuComposer *composer, const std::vector<uint32_t> &source,
+        const hwc_layer_1_t &l)
+{
+    CpuLayer layer;
+    layer.pixels = reinterpret_cast<const uint8_t *>(source.data());
+    layer.stride = kSourceSize;
+    layer.format = HAL_PIXEL_FORMAT_RGBA_8888;
+    layer.crop = l.sourceCropf;
+    layer.frame = l.displayFrame;
+    layer.transform = l.transform;
+    layer.blending = l.blending;
+    layer.planeAlpha = l.planeAlpha;
+    std::vector<uint32_t> dst((size_t)kWidth * kHeight);
+    composer->compose({ layer }, reinterpret_cast<uint8_t *>(dst.data()), kWidth,
+            HAL_PIXEL_FORMAT_RGBA_8888, kWidth, kHeight);
+    return dst;
+}
+
+void expectRects(const std::vector<hwc_rect_t> &expected, const std::vector<hwc_rect_t> &rects)
+{
+    ASSERT_EQ(expected.size(), rects.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(expected[i].left, rects[i].left) << "rect " << i;
+        EXPECT_EQ(expected[i].top, rects[i].top) << "rect " << i;
+        EXPECT_EQ(expected[i].right, rects[i].right) << "rect " << i;
+        EXPECT_EQ(expected[i].bottom, rects[i].bottom) << "rect " << i;
+    }
+}
+
+// The surface damage covers the pixels the composer samples from the damaged source pixels,
+// through the crop, the flips and the rotation, and little more.
+TEST(DamageTrackerTest, SurfaceDamageMatchesComposedPixels) {
+    const uint32_t transforms[] = { 0, HAL_TRANSFORM_FLIP_H, HAL_TRANSFORM_FLIP_V,
+            HAL_TRANSFORM_ROT_90, HAL_TRANSFORM_ROT_180, HAL_TRANSFORM_ROT_270,
+            HAL_TRANSFORM_FLIP_H | HAL_TRANSFORM_ROT_90,
+            HAL_TRANSFORM_FLIP_V | HAL_TRANSFORM_ROT_90 };
+    // Same size, upscaled, downscaled and stretched.
+    const struct {
+        hwc_frect_t crop;
+        hwc_rect_t frame;
+    } placements[] = {
+        { { 4, 4, 12, 12 }, { 5, 6, 13, 14 } },
+        { { 4, 4, 12, 12 }, { 2, 3, 18, 19 } },
+        { { 2, 5, 14, 17 }, { 9, 1, 17, 9 } },
+        { { 2, 3, 14, 11 }, { 20, 10, 28, 26 } },
+    };
+    const std::vector<hwc_rect_t> damage = { { 5, 6, 8, 9 } };
+
+    std::vector<uint32_t> before((size_t)kSourceSize * kSourceSize);
+    std::mt19937 random(1);
+    for (uint32_t &p : before) {
+        p = random() | 0xFF000000;
+    }
+    std::vector<uint32_t> after = before;
+    for (int y = damage[0].top; y < damage[0].bottom; y++) {
+        for (int x = damage[0].left; x < damage[0].right; x++) {
+            after[(size_t)y * kSourceSize + x] ^= 0x00FFFFFF;
+        }
+    }
+
+    CpuComposer composer(1);
+    for (uint32_t transform : transforms) {
+        for (const auto &placement : placements) {
+            SCOPED_TRACE(testing::Message() << "transform " << transform << ", frame "
+                    << placement.frame.left << "," << placement.frame.top << ","
+                    << placement.frame.right << "," << placement.frame.bottom);
+            DamageTracker tracker(1, kWidth, kHeight);
+            const hwc_layer_1_t first =
+                    makeLayer(fakeHandle(1), placement.crop, placement.frame, transform);
+            const hwc_layer_1_t second = makeLayer(fakeHandle(2), placement.crop,
+                    placement.frame, transform, &damage);
+            ASSERT_TRUE(tracker.update({ &first }));
+            ASSERT_TRUE(tracker.update({ &second }));
+            const std::vector<hwc_rect_t> &rects = tracker.frameDamage();
+
+            const std::vector<uint32_t> a = compose(&composer, before, first);
+            const std::vector<uint32_t> b = compose(&composer, after, second);
+            hwc_rect_t changed = { kWidth, kHeight, 0, 0 };
+            for (int y = 0; y < kHeight; y++) {
+                for (int x = 0; x < kWidth; x++) {
+                    if (a[(size_t)y * kWidth + x] == b[(size_t)y * kWidth + x]) {
+                        continue;
+                    }
+                    ASSERT_TRUE(inRects(rects, x, y)) << "at (" << x << ", " << y << ")";
+                    changed.left = std::min(changed.left, x);
+                    changed.top = std::min(changed.top, y);
+                    changed.right = std::max(changed.right, x + 1);
+                    changed.bottom = std::max(changed.bottom, y + 1);
+                }
+            }
+            ASSERT_LT(changed.left, changed.right);
+            // A pixel of margin on each side, and one more for the rounding of scaled frames.
+            for (const hwc_rect_t &r : rects) {
+                EXPECT_GE(r.left, changed.left - 2);
+                EXPECT_GE(r.top, changed.top - 2);
+                EXPECT_LE(r.right, changed.right + 2);
+                EXPECT_LE(r.bottom, changed.bottom + 2);
+            }
+        }
+    }
+}
+
+// A single empty rect means unchanged contents, except with a new buffer, which it can't vouch
+// for.
+TEST(DamageTrackerTest, EmptySurfaceDamage) {
+    const std::vector<hwc_rect_t> empty = { { 0, 0, 0, 0 } };
+    const hwc_frect_t crop = { 0, 0, 10, 10 };
+    const hwc_rect_t frame = { 3, 4, 13, 14 };
+    DamageTracker tracker(1, kWidth, kHeight);
+    const hwc_layer_1_t first = makeLayer(fakeHandle(1), crop, frame);
+    ASSERT_TRUE(tracker.update({ &first }));
+
+    const hwc_layer_1_t sameBuffer = makeLayer(fakeHandle(1), crop, frame, 0, &empty);
+    EXPECT_FALSE(tracker.update({ &sameBuffer }));
+    EXPECT_TRUE(tracker.frameDamage().empty());
+
+    const hwc_layer_1_t newBuffer = makeLayer(fakeHandle(2), crop, frame, 0, &empty);
+    EXPECT_TRUE(tracker.update({ &newBuffer }));
+    expectRects({ frame }, tracker.frameDamage());
+}
+
+// Each output buffer is recomposed with the damage of the frames since it was last composed.
+TEST(DamageTrackerTest, BufferDamageAccumulatesPerBuffer) {
+    const hwc_frect_t crop = { 0, 0, kWidth, kHeight };
+    const hwc_rect_t screen = { 0, 0, kWidth, kHeight };
+    const std::vector<hwc_rect_t> damages[] = {
+        { { 1, 1, 5, 5 } },
+        { { 10, 12, 14, 20 } },
+        { { 30, 2, 35, 6 } },
+    };
+    // The damage of the frames, a pixel larger than the surface damage on each side.
+    const hwc_rect_t frames[] = { { 0, 0, 6, 6 }, { 9, 11, 15, 21 }, { 29, 1, 36, 7 } };
+    DamageTracker tracker(2, kWidth, kHeight);
+    std::vector<hwc_rect_t> rects;
+
+    const hwc_layer_1_t first = makeLayer(fakeHandle(1), crop, screen);
+    ASSERT_TRUE(tracker.update({ &first }));
+    tracker.takeBufferDamage(0, &rects);
+    expectRects({ screen }, rects);
+
+    // The second buffer was never composed.
+    const hwc_layer_1_t second = makeLayer(fakeHandle(2), crop, screen, 0, &damages[0]);
+    ASSERT_TRUE(tracker.update({ &second }));
+    expectRects({ frames[0] }, tracker.frameDamage());
+    tracker.takeBufferDamage(1, &rects);
+    expectRects({ screen }, rects);
+
+    const hwc_layer_1_t third = makeLayer(fakeHandle(3), crop, screen, 0, &damages[1]);
+    ASSERT_TRUE(tracker.update({ &third }));
+    tracker.takeBufferDamage(0, &rects);
+    expectRects({ frames[0], frames[1] }, rects);
+
+    const hwc_layer_1_t fourth = makeLayer(fakeHandle(4), crop, screen, 0, &damages[2]);
+    ASSERT_TRUE(tracker.update({ &fourth }));
+    tracker.takeBufferDamage(1, &rects);
+    expectRects({ frames[1], frames[2] }, rects);
+
+    // Invalidating damages both buffers in full.
+    tracker.invalidate();
+    tracker.takeBufferDamage(0, &rects);
+    expectRects({ screen }, rects);
+    tracker.takeBufferDamage(1, &rects);
+    expectRects({ screen }, rects);
+}
+
+}  // namespace
+}  // namespace android
@@ -0,0 +1,474 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// To run this test (as root):
+// 1) Build it, along with hwcomposer.headless
+// 2) adb push to /vendor/bin
+// 3) adb shell /vendor/bin/hwc2_headless_tests
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cutils/native_handle.h>
+#include <gtest/gtest.h>
+#include <hardware/hardware.h>
+#include <hardware/hwcomposer2.h>
+#include <sync/sync.h>
+
+namespace {
+
+#if defined(__LP64__)
+const char kModulePath[] = "/vendor/lib64/hw/hwcomposer.headless.so";
+#else
+const char kModulePath[] = "/vendor/lib/hw/hwcomposer.headless.so";
+#endif
+
+const hwc2_display_t kBadDisplay = 0x7fff;
+const hwc2_layer_t kBadLayer = 0x7fff;
+
+class Hwc2HeadlessTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        // Loaded whatever ro.hardware.hwcomposer selects.
+        mDevice = nullptr;
+        mLibrary = dlopen(kModulePath, RTLD_NOW);
+        ASSERT_NE(nullptr, mLibrary) << dlerror();
+        const hw_module_t* module =
+                static_cast<const hw_module_t*>(dlsym(mLibrary, HAL_MODULE_INFO_SYM_AS_STR));
+        ASSERT_NE(nullptr, module);
+        hw_device_t* device;
+        ASSERT_EQ(0, module->methods->open(module, HWC_HARDWARE_COMPOSER, &device));
+        mDevice = reinterpret_cast<hwc2_device_t*>(device);
+
+        auto registerCallback = get<HWC2_PFN_REGISTER_CALLBACK>(
+                HWC2_FUNCTION_REGISTER_CALLBACK);
+        ASSERT_EQ(HWC2_ERROR_NONE, registerCallback(mDevice, HWC2_CALLBACK_HOTPLUG, this,
+                reinterpret_cast<hwc2_function_pointer_t>(onHotplug)));
+        ASSERT_TRUE(mConnected);
+    }
+
+    void TearDown() override {
+        for (native_handle_t* handle : mHandles) {
+            native_handle_delete(handle);
+        }
+        if (mDevice) {
+            ASSERT_EQ(0, mDevice->common.close(&mDevice->common));
+        }
+        if (mLibrary) {
+            dlclose(mLibrary);
+        }
+    }
+
+    template <typename PFN>
+    PFN get(hwc2_function_descriptor_t descriptor) {
+        PFN function = reinterpret_cast<PFN>(mDevice->getFunction(mDevice, descriptor));
+        EXPECT_NE(nullptr, function) << "function " << descriptor;
+        return function;
+    }
+
+    static void onHotplug(hwc2_callback_data_t data, hwc2_display_t display, int32_t connection) {
+        Hwc2HeadlessTest* test = static_cast<Hwc2HeadlessTest*>(data);
+        test->mDisplay = display;
+        test->mConnected = connection == HWC2_CONNECTION_CONNECTED;
+    }
+
+    // A handle gralloc didn't allocate, which the device can't compose.
+    buffer_handle_t foreignBuffer() {
+        native_handle_t* handle = native_handle_create(0, 0);
+        mHandles.push_back(handle);
+        return handle;
+    }
+
+    hwc2_layer_t createColorLayer(hwc_color_t color) {
+        hwc2_layer_t layer = 0;
+        EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_CREATE_LAYER>(HWC2_FUNCTION_CREATE_LAYER)(
+                mDevice, mDisplay, &layer));
+        EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_COMPOSITION_TYPE>(
+                HWC2_FUNCTION_SET_LAYER_COMPOSITION_TYPE)(mDevice, mDisplay, layer,
+                HWC2_COMPOSITION_SOLID_COLOR));
+        EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_COLOR>(HWC2_FUNCTION_SET_LAYER_COLOR)(
+                mDevice, mDisplay, layer, color));
+        EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(
+                HWC2_FUNCTION_SET_LAYER_DISPLAY_FRAME)(mDevice, mDisplay, layer,
+                hwc_rect_t{0, 0, 64, 64}));
+        return layer;
+    }
+
+    int32_t validate(uint32_t* outNumTypes = nullptr) {
+        uint32_t numTypes, numRequests;
+        int32_t err = get<HWC2_PFN_VALIDATE_DISPLAY>(HWC2_FUNCTION_VALIDATE_DISPLAY)(
+                mDevice, mDisplay, &numTypes, &numRequests);
+        if (outNumTypes) {
+            *outNumTypes = numTypes;
+        }
+        EXPECT_EQ(0U, numRequests);
+        return err;
+    }
+
+    int32_t present(int32_t* outFence = nullptr) {
+        int32_t fence = -1;
+        int32_t err = get<HWC2_PFN_PRESENT_DISPLAY>(HWC2_FUNCTION_PRESENT_DISPLAY)(
+                mDevice, mDisplay, &fence);
+        if (outFence) {
+            *outFence = fence;
+        } else if (fence >= 0) {
+            close(fence);
+        }
+        return err;
+    }
+
+    std::string dump() {
+        auto dumpFunction = get<HWC2_PFN_DUMP>(HWC2_FUNCTION_DUMP);
+        uint32_t size = 0;
+        dumpFunction(mDevice, &size, nullptr);
+        std::string text(size, '\0');
+        dumpFunction(mDevice, &size, &text[0]);
+        text.resize(size);
+        return text;
+    }
+
+    void* mLibrary = nullptr;
+    hwc2_device_t* mDevice;
+    hwc2_display_t mDisplay = 0;
+    bool mConnected = false;
+    std::vector<native_handle_t*> mHandles;
+};
+
+TEST_F(Hwc2HeadlessTest, Capabilities) {
+    uint32_t count = 0;
+    mDevice->getCapabilities(mDevice, &count, nullptr);
+    ASSERT_EQ(1U, count);
+    int32_t capability;
+    mDevice->getCapabilities(mDevice, &count, &capability);
+    EXPECT_EQ(HWC2_CAPABILITY_SKIP_VALIDATE, capability);
+}
+
+TEST_F(Hwc2HeadlessTest, BadDisplay) {
+    uint32_t numTypes, numRequests;
+    int32_t fence;
+    hwc2_layer_t layer;
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_VALIDATE_DISPLAY>(
+            HWC2_FUNCTION_VALIDATE_DISPLAY)(mDevice, kBadDisplay, &numTypes, &numRequests));
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_PRESENT_DISPLAY>(
+            HWC2_FUNCTION_PRESENT_DISPLAY)(mDevice, kBadDisplay, &fence));
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_ACCEPT_DISPLAY_CHANGES>(
+            HWC2_FUNCTION_ACCEPT_DISPLAY_CHANGES)(mDevice, kBadDisplay));
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_CREATE_LAYER>(HWC2_FUNCTION_CREATE_LAYER)(
+            mDevice, kBadDisplay, &layer));
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_SET_VSYNC_ENABLED>(
+            HWC2_FUNCTION_SET_VSYNC_ENABLED)(mDevice, kBadDisplay, HWC2_VSYNC_ENABLE));
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_SET_CLIENT_TARGET>(
+            HWC2_FUNCTION_SET_CLIENT_TARGET)(mDevice, kBadDisplay, nullptr, -1,
+            HAL_DATASPACE_UNKNOWN, hwc_region_t{0, nullptr}));
+
+    // Layers belong to the display they were created on.
+    layer = createColorLayer(hwc_color_t{255, 0, 0, 255});
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_SET_LAYER_Z_ORDER>(
+            HWC2_FUNCTION_SET_LAYER_Z_ORDER)(mDevice, kBadDisplay, layer, 1));
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_DESTROY_LAYER>(HWC2_FUNCTION_DESTROY_LAYER)(
+            mDevice, kBadDisplay, layer));
+}
+
+TEST_F(Hwc2HeadlessTest, BadLayer) {
+    EXPECT_EQ(HWC2_ERROR_BAD_LAYER, get<HWC2_PFN_SET_LAYER_COLOR>(
+            HWC2_FUNCTION_SET_LAYER_COLOR)(mDevice, mDisplay, kBadLayer,
+            hwc_color_t{0, 0, 0, 255}));
+    EXPECT_EQ(HWC2_ERROR_BAD_LAYER, get<HWC2_PFN_SET_LAYER_BUFFER>(
+            HWC2_FUNCTION_SET_LAYER_BUFFER)(mDevice, mDisplay, kBadLayer, nullptr, -1));
+    EXPECT_EQ(HWC2_ERROR_BAD_LAYER, get<HWC2_PFN_DESTROY_LAYER>(HWC2_FUNCTION_DESTROY_LAYER)(
+            mDevice, mDisplay, kBadLayer));
+
+    // Only cursor layers move with setCursorPosition.
+    hwc2_layer_t layer = createColorLayer(hwc_color_t{255, 0, 0, 255});
+    EXPECT_EQ(HWC2_ERROR_BAD_LAYER, get<HWC2_PFN_SET_CURSOR_POSITION>(
+            HWC2_FUNCTION_SET_CURSOR_POSITION)(mDevice, mDisplay, layer, 10, 10));
+
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_DESTROY_LAYER>(HWC2_FUNCTION_DESTROY_LAYER)(
+            mDevice, mDisplay, layer));
+    EXPECT_EQ(HWC2_ERROR_BAD_LAYER, get<HWC2_PFN_DESTROY_LAYER>(HWC2_FUNCTION_DESTROY_LAYER)(
+            mDevice, mDisplay, layer));
+}
+
+TEST_F(Hwc2HeadlessTest, BadParameter) {
+    hwc2_layer_t layer = createColorLayer(hwc_color_t{255, 0, 0, 255});
+    EXPECT_EQ(HWC2_ERROR_BAD_PARAMETER, get<HWC2_PFN_SET_LAYER_COMPOSITION_TYPE>(
+            HWC2_FUNCTION_SET_LAYER_COMPOSITION_TYPE)(mDevice, mDisplay, layer, 100));
+    EXPECT_EQ(HWC2_ERROR_BAD_PARAMETER, get<HWC2_PFN_SET_LAYER_BLEND_MODE>(
+            HWC2_FUNCTION_SET_LAYER_BLEND_MODE)(mDevice, mDisplay, layer, 100));
+    EXPECT_EQ(HWC2_ERROR_BAD_PARAMETER, get<HWC2_PFN_SET_VSYNC_ENABLED>(
+            HWC2_FUNCTION_SET_VSYNC_ENABLED)(mDevice, mDisplay, 100));
+    EXPECT_EQ(HWC2_ERROR_BAD_PARAMETER, get<HWC2_PFN_REGISTER_CALLBACK>(
+            HWC2_FUNCTION_REGISTER_CALLBACK)(mDevice, 100, nullptr, nullptr));
+}
+
+TEST_F(Hwc2HeadlessTest, PresentNeedsValidate) {
+    createColorLayer(hwc_color_t{255, 0, 0, 255});
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, present());
+
+    uint32_t numElements;
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, get<HWC2_PFN_GET_CHANGED_COMPOSITION_TYPES>(
+            HWC2_FUNCTION_GET_CHANGED_COMPOSITION_TYPES)(mDevice, mDisplay, &numElements,
+            nullptr, nullptr));
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, get<HWC2_PFN_ACCEPT_DISPLAY_CHANGES>(
+            HWC2_FUNCTION_ACCEPT_DISPLAY_CHANGES)(mDevice, mDisplay));
+
+    uint32_t numTypes;
+    ASSERT_EQ(HWC2_ERROR_NONE, validate(&numTypes));
+    EXPECT_EQ(0U, numTypes);
+    EXPECT_EQ(HWC2_ERROR_NONE, present());
+
+    // A new layer changes the geometry.
+    createColorLayer(hwc_color_t{0, 255, 0, 255});
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, present());
+}
+
+TEST_F(Hwc2HeadlessTest, ForeignBufferFallsBackToClient) {
+    hwc2_layer_t color = createColorLayer(hwc_color_t{255, 0, 0, 255});
+    hwc2_layer_t layer;
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_CREATE_LAYER>(HWC2_FUNCTION_CREATE_LAYER)(
+            mDevice, mDisplay, &layer));
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_COMPOSITION_TYPE>(
+            HWC2_FUNCTION_SET_LAYER_COMPOSITION_TYPE)(mDevice, mDisplay, layer,
+            HWC2_COMPOSITION_DEVICE));
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(
+            HWC2_FUNCTION_SET_LAYER_DISPLAY_FRAME)(mDevice, mDisplay, layer,
+            hwc_rect_t{0, 0, 64, 64}));
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_SOURCE_CROP>(
+            HWC2_FUNCTION_SET_LAYER_SOURCE_CROP)(mDevice, mDisplay, layer,
+            hwc_frect_t{0.0f, 0.0f, 64.0f, 64.0f}));
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_BUFFER>(HWC2_FUNCTION_SET_LAYER_BUFFER)(
+            mDevice, mDisplay, layer, foreignBuffer(), -1));
+
+    // Everything goes to the client, not only the layer the device can't compose.
+    uint32_t numTypes;
+    ASSERT_EQ(HWC2_ERROR_HAS_CHANGES, validate(&numTypes));
+    ASSERT_EQ(2U, numTypes);
+    auto getChanges = get<HWC2_PFN_GET_CHANGED_COMPOSITION_TYPES>(
+            HWC2_FUNCTION_GET_CHANGED_COMPOSITION_TYPES);
+    uint32_t numElements = 0;
+    ASSERT_EQ(HWC2_ERROR_NONE, getChanges(mDevice, mDisplay, &numElements, nullptr, nullptr));
+    ASSERT_EQ(2U, numElements);
+    hwc2_layer_t layers[2];
+    int32_t types[2];
+    ASSERT_EQ(HWC2_ERROR_NONE, getChanges(mDevice, mDisplay, &numElements, layers, types));
+    ASSERT_EQ(2U, numElements);
+    EXPECT_EQ(color, layers[0]);
+    EXPECT_EQ(layer, layers[1]);
+    EXPECT_EQ(HWC2_COMPOSITION_CLIENT, types[0]);
+    EXPECT_EQ(HWC2_COMPOSITION_CLIENT, types[1]);
+
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_ACCEPT_DISPLAY_CHANGES>(
+            HWC2_FUNCTION_ACCEPT_DISPLAY_CHANGES)(mDevice, mDisplay));
+    ASSERT_EQ(HWC2_ERROR_NONE, getChanges(mDevice, mDisplay, &numElements, nullptr, nullptr));
+    EXPECT_EQ(0U, numElements);
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_CLIENT_TARGET>(
+            HWC2_FUNCTION_SET_CLIENT_TARGET)(mDevice, mDisplay, foreignBuffer(), -1,
+            HAL_DATASPACE_UNKNOWN, hwc_region_t{0, nullptr}));
+    EXPECT_EQ(HWC2_ERROR_NONE, present());
+    EXPECT_NE(std::string::npos, dump().find("client composition"));
+}
+
+TEST_F(Hwc2HeadlessTest, SkipValidateWhileGeometryIsUnchanged) {
+    const hwc_color_t red = {255, 0, 0, 255};
+    hwc2_layer_t layer = createColorLayer(red);
+    ASSERT_EQ(HWC2_ERROR_NONE, validate());
+    ASSERT_EQ(HWC2_ERROR_NONE, present());
+
+    // Setting what is already set changes nothing to validate.
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_COLOR>(HWC2_FUNCTION_SET_LAYER_COLOR)(
+            mDevice, mDisplay, layer, red));
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(
+            HWC2_FUNCTION_SET_LAYER_DISPLAY_FRAME)(mDevice, mDisplay, layer,
+            hwc_rect_t{0, 0, 64, 64}));
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_PLANE_ALPHA>(
+            HWC2_FUNCTION_SET_LAYER_PLANE_ALPHA)(mDevice, mDisplay, layer, 1.0f));
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_BLEND_MODE>(
+            HWC2_FUNCTION_SET_LAYER_BLEND_MODE)(mDevice, mDisplay, layer,
+            HWC2_BLEND_MODE_PREMULTIPLIED));
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_TRANSFORM>(
+            HWC2_FUNCTION_SET_LAYER_TRANSFORM)(mDevice, mDisplay, layer, 0));
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_SOURCE_CROP>(
+            HWC2_FUNCTION_SET_LAYER_SOURCE_CROP)(mDevice, mDisplay, layer,
+            hwc_frect_t{0.0f, 0.0f, 0.0f, 0.0f}));
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_Z_ORDER>(
+            HWC2_FUNCTION_SET_LAYER_Z_ORDER)(mDevice, mDisplay, layer, 0));
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_COMPOSITION_TYPE>(
+            HWC2_FUNCTION_SET_LAYER_COMPOSITION_TYPE)(mDevice, mDisplay, layer,
+            HWC2_COMPOSITION_SOLID_COLOR));
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_COLOR_TRANSFORM>(
+            HWC2_FUNCTION_SET_COLOR_TRANSFORM)(mDevice, mDisplay, nullptr,
+            HAL_COLOR_TRANSFORM_IDENTITY));
+    EXPECT_EQ(HWC2_ERROR_NONE, present());
+    EXPECT_EQ(HWC2_ERROR_NONE, present());
+    EXPECT_NE(std::string::npos, dump().find("2 without validating"));
+
+    // Any change needs validating again.
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_COLOR>(HWC2_FUNCTION_SET_LAYER_COLOR)(
+            mDevice, mDisplay, layer, hwc_color_t{0, 0, 255, 255}));
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, present());
+    ASSERT_EQ(HWC2_ERROR_NONE, validate());
+    EXPECT_EQ(HWC2_ERROR_NONE, present());
+
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_PLANE_ALPHA>(
+            HWC2_FUNCTION_SET_LAYER_PLANE_ALPHA)(mDevice, mDisplay, layer, 0.5f));
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, present());
+    ASSERT_EQ(HWC2_ERROR_NONE, validate());
+
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(
+            HWC2_FUNCTION_SET_LAYER_DISPLAY_FRAME)(mDevice, mDisplay, layer,
+            hwc_rect_t{0, 0, 32, 32}));
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, present());
+    ASSERT_EQ(HWC2_ERROR_NONE, validate());
+
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_BLEND_MODE>(
+            HWC2_FUNCTION_SET_LAYER_BLEND_MODE)(mDevice, mDisplay, layer,
+            HWC2_BLEND_MODE_NONE));
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, present());
+    ASSERT_EQ(HWC2_ERROR_NONE, validate());
+
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_TRANSFORM>(
+            HWC2_FUNCTION_SET_LAYER_TRANSFORM)(mDevice, mDisplay, layer, HWC_TRANSFORM_ROT_90));
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, present());
+    ASSERT_EQ(HWC2_ERROR_NONE, validate());
+
+    EXPECT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_COLOR_TRANSFORM>(
+            HWC2_FUNCTION_SET_COLOR_TRANSFORM)(mDevice, mDisplay, nullptr,
+            HAL_COLOR_TRANSFORM_ARBITRARY_MATRIX));
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, present());
+    EXPECT_EQ(HWC2_ERROR_HAS_CHANGES, validate());
+}
+
+TEST_F(Hwc2HeadlessTest, VsyncCallbacks) {
+    static std::atomic<int> sVsyncs;
+    static std::atomic<int64_t> sTimestamp;
+    static std::atomic<hwc2_display_t> sDisplay;
+    sVsyncs = 0;
+    sTimestamp = 0;
+    struct Callback {
+        static void onVsync(hwc2_callback_data_t, hwc2_display_t display, int64_t timestamp) {
+            // Timestamps only move forward.
+            EXPECT_GT(timestamp, sTimestamp.load());
+            sTimestamp = timestamp;
+            sDisplay = display;
+            sVsyncs++;
+        }
+    };
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_REGISTER_CALLBACK>(HWC2_FUNCTION_REGISTER_CALLBACK)(
+            mDevice, HWC2_CALLBACK_VSYNC, nullptr,
+            reinterpret_cast<hwc2_function_pointer_t>(Callback::onVsync)));
+    auto setVsyncEnabled = get<HWC2_PFN_SET_VSYNC_ENABLED>(HWC2_FUNCTION_SET_VSYNC_ENABLED);
+
+    ASSERT_EQ(HWC2_ERROR_NONE, setVsyncEnabled(mDevice, mDisplay, HWC2_VSYNC_ENABLE));
+    for (int i = 0; i < 100 && sVsyncs < 3; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(HWC2_ERROR_NONE, setVsyncEnabled(mDevice, mDisplay, HWC2_VSYNC_DISABLE));
+    EXPECT_GE(sVsyncs, 3);
+    EXPECT_EQ(mDisplay, sDisplay.load());
+
+    // A callback in flight may still land after disabling, none after that.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const int vsyncs = sVsyncs;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(vsyncs, sVsyncs);
+}
+
+TEST_F(Hwc2HeadlessTest, PresentAndReleaseFences) {
+    hwc2_layer_t layer;
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_CREATE_LAYER>(HWC2_FUNCTION_CREATE_LAYER)(
+            mDevice, mDisplay, &layer));
+    ASSERT_EQ(HWC2_ERROR_NONE, get<HWC2_PFN_SET_LAYER_COMPOSITION_TYPE>(
+            HWC2_FUNCTION_SET_LAYER_COMPOSITION_TYPE)(mDevice, mDisplay, layer,
+            HWC2_COMPOSITION_CLIENT));
+    auto setBuffer = get<HWC2_PFN_SET_LAYER_BUFFER>(HWC2_FUNCTION_SET_LAYER_BUFFER);
+    auto getReleaseFences = get<HWC2_PFN_GET_RELEASE_FENCES>(HWC2_FUNCTION_GET_RELEASE_FENCES);
+    ASSERT_EQ(HWC2_ERROR_NONE, setBuffer(mDevice, mDisplay, layer, foreignBuffer(), -1));
+    ASSERT_EQ(HWC2_ERROR_NONE, validate());
+
+    int32_t presentFence;
+    ASSERT_EQ(HWC2_ERROR_NONE, present(&presentFence));
+    if (presentFence < 0) {
+        GTEST_SKIP() << "sw_sync is not available";
+    }
+    // Signalled at the vsync that displays the frame.
+    EXPECT_EQ(0, sync_wait(presentFence, 1000));
+    close(presentFence);
+
+    // The first buffer released nothing.
+    uint32_t numElements = 0;
+    ASSERT_EQ(HWC2_ERROR_NONE, getReleaseFences(mDevice, mDisplay, &numElements, nullptr,
+            nullptr));
+    EXPECT_EQ(0U, numElements);
+
+    ASSERT_EQ(HWC2_ERROR_NONE, setBuffer(mDevice, mDisplay, layer, foreignBuffer(), -1));
+    ASSERT_EQ(HWC2_ERROR_NONE, present(&presentFence));
+    ASSERT_GE(presentFence, 0);
+    ASSERT_EQ(HWC2_ERROR_NONE, getReleaseFences(mDevice, mDisplay, &numElements, nullptr,
+            nullptr));
+    ASSERT_EQ(1U, numElements);
+    hwc2_layer_t released;
+    int32_t releaseFence = -1;
+    ASSERT_EQ(HWC2_ERROR_NONE, getReleaseFences(mDevice, mDisplay, &numElements, &released,
+            &releaseFence));
+    ASSERT_EQ(1U, numElements);
+    EXPECT_EQ(layer, released);
+    ASSERT_GE(releaseFence, 0);
+    EXPECT_EQ(0, sync_wait(releaseFence, 1000));
+    EXPECT_EQ(0, sync_wait(presentFence, 0));
+    close(releaseFence);
+    close(presentFence);
+
+    // The caller owns the fences returned, they aren't returned again.
+    ASSERT_EQ(HWC2_ERROR_NONE, getReleaseFences(mDevice, mDisplay, &numElements, nullptr,
+            nullptr));
+    EXPECT_EQ(0U, numElements);
+}
+
+TEST_F(Hwc2HeadlessTest, NoVirtualDisplays) {
+    EXPECT_EQ(0U, get<HWC2_PFN_GET_MAX_VIRTUAL_DISPLAY_COUNT>(
+            HWC2_FUNCTION_GET_MAX_VIRTUAL_DISPLAY_COUNT)(mDevice));
+    int32_t format = HAL_PIXEL_FORMAT_RGBA_8888;
+    hwc2_display_t display;
+    EXPECT_EQ(HWC2_ERROR_NO_RESOURCES, get<HWC2_PFN_CREATE_VIRTUAL_DISPLAY>(
+            HWC2_FUNCTION_CREATE_VIRTUAL_DISPLAY)(mDevice, 64, 64, &format, &display));
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, get<HWC2_PFN_DESTROY_VIRTUAL_DISPLAY>(
+            HWC2_FUNCTION_DESTROY_VIRTUAL_DISPLAY)(mDevice, mDisplay));
+
+    // The output buffer's release fence is closed whatever the error.
+    auto setOutputBuffer = get<HWC2_PFN_SET_OUTPUT_BUFFER>(HWC2_FUNCTION_SET_OUTPUT_BUFFER);
+    int fence = dup(STDERR_FILENO);
+    ASSERT_GE(fence, 0);
+    EXPECT_EQ(HWC2_ERROR_UNSUPPORTED, setOutputBuffer(mDevice, mDisplay, foreignBuffer(),
+            fence));
+    EXPECT_EQ(-1, fcntl(fence, F_GETFD));
+    EXPECT_EQ(EBADF, errno);
+    fence = dup(STDERR_FILENO);
+    ASSERT_GE(fence, 0);
+    EXPECT_EQ(HWC2_ERROR_BAD_DISPLAY, setOutputBuffer(mDevice, kBadDisplay, foreignBuffer(),
+            fence));
+    EXPECT_EQ(-1, fcntl(fence, F_GETFD));
+    EXPECT_EQ(EBADF, errno);
+}
+
+}  // namespace
@@ -22,6 +22,7 @@
 #include <thread>
 
 #include <assert.h>
+#include <unistd.h>
 #include <hardware/hardware.h>
 #include <hardware/input.h>
 
@@ -34,6 +35,8 @@
 namespace android {
 
 static const char kDevInput[] = "/dev/input";
+static const char kCapabilityCacheDir[] = "/data/vendor/input";
+static const char kCapabilityCacheFile[] = "/data/vendor/input/evdev_capabilities";
 
 class EvdevModule {
 public:
@@ -62,6 +65,10 @@ EvdevModule::EvdevModule(InputHostInterface* inputHost) :
 void EvdevModule::init() {
     ALOGV("%s", __func__);
 
+    // The cache is only worth it where it outlives the process.
+    if (access(kCapabilityCacheDir, W_OK) == 0) {
+        mInputHub->enableCapabilityCache(kCapabilityCacheFile);
+    }
     mInputHub->registerDevicePath(kDevInput);
     mPollThread = std::thread(&EvdevModule::loop, this);
 }
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Records the input devices and events of /dev/input to a trace that
+// InputTracePlayer can replay, until interrupted or for the given number of
+// seconds:
+//
+//   evdev_record <trace file> [seconds]
+
+#define LOG_TAG "evdev_record"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include "InputHub.h"
+#include "InputTrace.h"
+
+using namespace android;
+
+static volatile sig_atomic_t gStop = 0;
+
+static void onSignal(int) {
+    gStop = 1;
+}
+
+// The recorder only needs the events, not to map them.
+class NullInputCallback : public InputCallbackInterface {
+public:
+    virtual void onInputEvent(const std::shared_ptr<InputDeviceNode>& node, InputEvent& event,
+            nsecs_t event_time) override {}
+    virtual void onInputFrame(const std::shared_ptr<InputDeviceNode>& node, InputEvent* events,
+            size_t count, nsecs_t event_time) override {}
+    virtual void onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) override {
+        fprintf(stderr, "recording %s (%s)\n", node->getPath().c_str(), node->getName().c_str());
+    }
+    virtual void onDeviceRemoved(const std::shared_ptr<InputDeviceNode>& node) override {}
+};
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <trace file> [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = TEMP_FAILURE_RETRY(open(argv[1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (fd < 0) {
+        fprintf(stderr, "could not create %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    // Without SA_RESTART, the signals interrupt the poll of the InputHub.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGALRM, &action, nullptr);
+    if (argc == 3) {
+        alarm(atoi(argv[2]));
+    }
+
+    auto recorder = std::make_shared<InputTraceRecorder>(
+            std::make_shared<NullInputCallback>(), fd);
+    {
+        InputHub hub(recorder);
+        hub.registerDevicePath("/dev/input");
+        while (!gStop) {
+            hub.poll();
+        }
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputCapabilityCache"
+//#define LOG_NDEBUG 0
+
+#include "InputCapabilityCache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+static const uint32_t kMagic = 0x50414345;  // "ECAP"
+static const uint32_t kVersion = 2;
+// Files written with other kernel headers have other bitmask sizes.
+static const uint32_t kBitmaskSize = KEY_CNT / 8 + ABS_CNT / 8 + REL_CNT / 8 + SW_CNT / 8 +
+        LED_CNT / 8 + FF_CNT / 8 + INPUT_PROP_CNT / 8;
+// More axes than a device can have, to catch corrupted files.
+static const uint32_t kMaxAxes = ABS_CNT;
+
+namespace {
+
+class Writer {
+public:
+    void put(const void* data, size_t size) {
+        mBuffer.append(static_cast<const char*>(data), size);
+    }
+    template<typename T>
+    void put(T value) { put(&value, sizeof(value)); }
+    void putString(const std::string& s) {
+        put(static_cast<uint32_t>(s.size()));
+        put(s.data(), s.size());
+    }
+
+    const std::string& buffer() const { return mBuffer; }
+
+private:
+    std::string mBuffer;
+};
+
+class Reader {
+public:
+    explicit Reader(const std::string& buffer) : mBuffer(buffer) {}
+
+    bool get(void* data, size_t size) {
+        if (mBuffer.size() - mPos < size) {
+            return false;
+        }
+        memcpy(data, mBuffer.data() + mPos, size);
+        mPos += size;
+        return true;
+    }
+    template<typename T>
+    bool get(T* value) { return get(value, sizeof(*value)); }
+    bool getString(std::string* s) {
+        uint32_t size;
+        if (!get(&size) || mBuffer.size() - mPos < size) {
+            return false;
+        }
+        s->assign(mBuffer, mPos, size);
+        mPos += size;
+        return true;
+    }
+
+    bool done() const { return mPos == mBuffer.size(); }
+
+private:
+    const std::string& mBuffer;
+    size_t mPos = 0;
+};
+
+}  // namespace
+
+static std::string getKernelRelease() {
+    struct utsname info;
+    if (uname(&info)) {
+        ALOGW("could not get the kernel release. errno=%d", errno);
+        return std::string();
+    }
+    return info.release;
+}
+
+InputCapabilityCache::InputCapabilityCache(const std::string& path) :
+    mPath(path), mKernelRelease(getKernelRelease()) {}
+
+status_t InputCapabilityCache::load() {
+    int fd = TEMP_FAILURE_RETRY(::open(mPath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        ALOGV("no capability cache at %s. errno=%d", mPath.c_str(), errno);
+        return -errno;
+    }
+    std::string buffer;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = TEMP_FAILURE_RETRY(::read(fd, chunk, sizeof(chunk)))) > 0) {
+        buffer.append(chunk, n);
+    }
+    ::close(fd);
+    if (n < 0) {
+        ALOGW("could not read capability cache %s. errno=%d", mPath.c_str(), errno);
+        return -errno;
+    }
+
+    status_t ret = parse(buffer);
+    if (ret != OK) {
+        // Nothing in the file is of use any more.
+        ::unlink(mPath.c_str());
+    }
+    return ret;
+}
+
+status_t InputCapabilityCache::parse(const std::string& buffer) {
+    Reader reader(buffer);
+    uint32_t magic, version, bitmaskSize, count;
+    std::string kernelRelease;
+    if (!reader.get(&magic) || magic != kMagic || !reader.get(&version) ||
+            version != kVersion || !reader.get(&bitmaskSize) || bitmaskSize != kBitmaskSize ||
+            !reader.getString(&kernelRelease) || !reader.get(&count)) {
+        ALOGW("ignoring capability cache %s from another version", mPath.c_str());
+        return BAD_VALUE;
+    }
+    if (mKernelRelease.empty() || kernelRelease != mKernelRelease) {
+        ALOGI("ignoring capability cache %s of kernel %s", mPath.c_str(), kernelRelease.c_str());
+        return BAD_VALUE;
+    }
+
+    std::map<InputCapabilityKey, InputCapabilities> entries;
+    for (uint32_t i = 0; i < count; ++i) {
+        InputCapabilityKey key;
+        InputCapabilities caps;
+        uint32_t numAxes;
+        if (!reader.get(&key.busType) || !reader.get(&key.vendorId) ||
+                !reader.get(&key.productId) || !reader.get(&key.version) ||
+                !reader.get(&key.driverVersion) || !reader.getString(&key.location) ||
+                !reader.getString(&key.name) || !reader.get(&caps.keyBitmask) ||
+                !reader.get(&caps.absBitmask) || !reader.get(&caps.relBitmask) ||
+                !reader.get(&caps.swBitmask) || !reader.get(&caps.ledBitmask) ||
+                !reader.get(&caps.ffBitmask) || !reader.get(&caps.propBitmask) ||
+                !reader.get(&numAxes) || numAxes > kMaxAxes) {
+            ALOGW("ignoring corrupted capability cache %s", mPath.c_str());
+            return BAD_VALUE;
+        }
+        caps.absInfo.resize(numAxes);
+        for (auto& axis : caps.absInfo) {
+            if (!reader.get(&axis.first) || !reader.get(&axis.second.minValue) ||
+                    !reader.get(&axis.second.maxValue) || !reader.get(&axis.second.flat) ||
+                    !reader.get(&axis.second.fuzz) || !reader.get(&axis.second.resolution)) {
+                ALOGW("ignoring corrupted capability cache %s", mPath.c_str());
+                return BAD_VALUE;
+            }
+        }
+        entries[key] = std::move(caps);
+    }
+    if (!reader.done()) {
+        ALOGW("ignoring corrupted capability cache %s", mPath.c_str());
+        return BAD_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries = std::move(entries);
+    mDirty = false;
+    ALOGV("loaded %zu devices from capability cache %s", mEntries.size(), mPath.c_str());
+    return OK;
+}
+
+status_t InputCapabilityCache::save() {
+    Writer writer;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!mDirty) {
+            return OK;
+        }
+        writer.put(kMagic);
+        writer.put(kVersion);
+        writer.put(kBitmaskSize);
+        writer.putString(mKernelRelease);
+        writer.put(static_cast<uint32_t>(mEntries.size()));
+        for (const auto& entry : mEntries) {
+            const InputCapabilityKey& key = entry.first;
+            const InputCapabilities& caps = entry.second;
+            writer.put(key.busType);
+            writer.put(key.vendorId);
+            writer.put(key.productId);
+            writer.put(key.version);
+            writer.put(key.driverVersion);
+            writer.putString(key.location);
+            writer.putString(key.name);
+            writer.put(caps.keyBitmask, sizeof(caps.keyBitmask));
+            writer.put(caps.absBitmask, sizeof(caps.absBitmask));
+            writer.put(caps.relBitmask, sizeof(caps.relBitmask));
+            writer.put(caps.swBitmask, sizeof(caps.swBitmask));
+            writer.put(caps.ledBitmask, sizeof(caps.ledBitmask));
+            writer.put(caps.ffBitmask, sizeof(caps.ffBitmask));
+            writer.put(caps.propBitmask, sizeof(caps.propBitmask));
+            writer.put(static_cast<uint32_t>(caps.absInfo.size()));
+            for (const auto& axis : caps.absInfo) {
+                writer.put(axis.first);
+                writer.put(axis.second.minValue);
+                writer.put(axis.second.maxValue);
+                writer.put(axis.second.flat);
+                writer.put(axis.second.fuzz);
+                writer.put(axis.second.resolution);
+            }
+        }
+        mDirty = false;
+    }
+
+    // Write a new file and rename it over the old one, so that a crash never
+    // leaves a partial cache behind. The file isn't synced: the cache is saved
+    // on the thread polling for input, and a file lost or cut short by a
+    // power loss is only a cache miss, as load() rejects it.
+    std::string tmpPath = mPath + ".tmp";
+    int fd = TEMP_FAILURE_RETRY(::open(tmpPath.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (fd < 0) {
+        status_t ret = -errno;
+        ALOGW("could not create capability cache %s. errno=%d", tmpPath.c_str(), errno);
+        markDirty();
+        return ret;
+    }
+    const std::string& buffer = writer.buffer();
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t n = TEMP_FAILURE_RETRY(::write(fd, buffer.data() + written,
+                buffer.size() - written));
+        if (n < 0) {
+            status_t ret = -errno;
+            ALOGW("could not write capability cache %s. errno=%d", tmpPath.c_str(), errno);
+            ::close(fd);
+            ::unlink(tmpPath.c_str());
+            markDirty();
+            return ret;
+        }
+        written += n;
+    }
+    ::close(fd);
+    if (::rename(tmpPath.c_str(), mPath.c_str())) {
+        status_t ret = -errno;
+        ALOGW("could not replace capability cache %s. errno=%d", mPath.c_str(), errno);
+        ::unlink(tmpPath.c_str());
+        markDirty();
+        return ret;
+    }
+    return OK;
+}
+
+bool InputCapabilityCache::lookup(const InputCapabilityKey& key,
+        InputCapabilities* outCaps) const {
+    if (key.location.empty()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    auto iter = mEntries.find(key);
+    if (iter == mEntries.end()) {
+        return false;
+    }
+    *outCaps = iter->second;
+    return true;
+}
+
+void InputCapabilityCache::insert(const InputCapabilityKey& key,
+        const InputCapabilities& caps) {
+    if (key.location.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries[key] = caps;
+    mDirty = true;
+}
+
+// Keeps the entries to be saved again after a failed save.
+void InputCapabilityCache::markDirty() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mDirty = true;
+}
+
+size_t InputCapabilityCache::size() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mEntries.size();
+}
+
+}  // namespace android
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INPUT_CAPABILITY_CACHE_H_
+#define ANDROID_INPUT_CAPABILITY_CACHE_H_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <linux/input.h>
+
+#include <utils/Errors.h>
+
+#include "InputHub.h"
+
+namespace android {
+
+/** Identifies a model of device, as far as its capabilities go. */
+struct InputCapabilityKey {
+    uint16_t busType = 0;
+    uint16_t vendorId = 0;
+    uint16_t productId = 0;
+    uint16_t version = 0;
+    // The evdev protocol version, from EVIOCGVERSION
+    int32_t driverVersion = 0;
+    std::string location;
+    std::string name;
+
+    bool operator<(const InputCapabilityKey& rhs) const {
+        return std::tie(busType, vendorId, productId, version, driverVersion, location, name) <
+                std::tie(rhs.busType, rhs.vendorId, rhs.productId, rhs.version,
+                        rhs.driverVersion, rhs.location, rhs.name);
+    }
+};
+
+/** What probing a device with the EVIOCGBIT, EVIOCGPROP and EVIOCGABS ioctls returns. */
+struct InputCapabilities {
+    uint8_t keyBitmask[KEY_CNT / 8] = {};
+    uint8_t absBitmask[ABS_CNT / 8] = {};
+    uint8_t relBitmask[REL_CNT / 8] = {};
+    uint8_t swBitmask[SW_CNT / 8] = {};
+    uint8_t ledBitmask[LED_CNT / 8] = {};
+    uint8_t ffBitmask[FF_CNT / 8] = {};
+    uint8_t propBitmask[INPUT_PROP_CNT / 8] = {};
+    std::vector<std::pair<int32_t, AbsoluteAxisInfo>> absInfo;
+};
+
+/**
+ * InputCapabilityCache remembers the capabilities of the devices the InputHub
+ * has probed, so that opening them again only needs the ioctls that identify
+ * them. It can be saved to a file, to be reloaded on the next boot.
+ *
+ * Devices without a location are not cached, as nothing tells those with the
+ * same ids apart. A driver update can change the capabilities of a device
+ * without changing its ids, so the cache only holds for the kernel release it
+ * was saved with. This class is threadsafe.
+ */
+class InputCapabilityCache {
+public:
+    /** Caches the capabilities of the devices of the running kernel. */
+    explicit InputCapabilityCache(const std::string& path);
+    /** Caches the capabilities of the devices of another kernel release. */
+    InputCapabilityCache(const std::string& path, const std::string& kernelRelease) :
+        mPath(path), mKernelRelease(kernelRelease) {}
+
+    /**
+     * Loads the cache from its file, replacing its contents. A file of another
+     * version or kernel release, or a corrupted one, is removed.
+     */
+    status_t load();
+    /** Saves the cache to its file if it changed since it was loaded. */
+    status_t save();
+
+    bool lookup(const InputCapabilityKey& key, InputCapabilities* outCaps) const;
+    void insert(const InputCapabilityKey& key, const InputCapabilities& caps);
+
+    size_t size() const;
+
+private:
+    status_t parse(const std::string& buffer);
+    void markDirty();
+
+    const std::string mPath;
+    const std::string mKernelRelease;
+
+    mutable std::mutex mLock;
+    std::map<InputCapabilityKey, InputCapabilities> mEntries;
+    bool mDirty = false;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_INPUT_CAPABILITY_CACHE_H_
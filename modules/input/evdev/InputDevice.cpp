@@ -33,7 +33,9 @@
 
 #include "InputHost.h"
 #include "InputHub.h"
+#include "InputLatencyStats.h"
 #include "MouseInputMapper.h"
+#include "MultiTouchInputMapper.h"
 #include "SwitchInputMapper.h"
 
 
@@ -139,7 +141,7 @@ void EvdevDevice::createMappers() {
         // touch screen.
         if (mDeviceNode->hasKey(BTN_TOUCH) || !haveGamepadButtons) {
             mClasses |= INPUT_DEVICE_CLASS_TOUCH | INPUT_DEVICE_CLASS_TOUCH_MT;
-            //mMappers.push_back(std::make_unique<MultiTouchInputMapper>());
+            mMappers.push_back(std::make_unique<MultiTouchInputMapper>());
         }
     // Is this an old style single-touch driver?
     } else if (mDeviceNode->hasKey(BTN_TOUCH)
@@ -212,6 +214,10 @@ void EvdevDevice::configureDevice() {
         auto reportDef = mHost->createInputReportDefinition();
         if (mapper->configureInputReport(mDeviceNode.get(), reportDef)) {
             mDeviceDefinition->addReport(reportDef);
+            // A mapper sends one report at a time.
+            mReportPool.reserve(reportDef, 1);
+            mapper->setReportPool(&mReportPool);
+            mapper->setLatencyStats(mDeviceNode->getLatencyStats());
         } else {
             mHost->freeReportDefinition(reportDef);
         }
@@ -225,7 +231,7 @@ void EvdevDevice::configureDevice() {
     }
 }
 
-void EvdevDevice::processInput(InputEvent& event, nsecs_t currentTime) {
+void EvdevDevice::checkEventTime(InputEvent& event, nsecs_t currentTime) {
 #if DEBUG_INPUT_EVENTS
     std::string log;
     log.append("---InputEvent for device %s---\n");
@@ -268,10 +274,34 @@ void EvdevDevice::processInput(InputEvent& event, nsecs_t currentTime) {
                     ", call time %" PRId64 ".", event.when, time, currentTime);
         }
     }
+}
+
+void EvdevDevice::processInput(InputEvent& event, nsecs_t currentTime) {
+    checkEventTime(event, currentTime);
 
+    auto stats = mDeviceNode->getLatencyStats();
+    if (stats != nullptr) {
+        stats->beginFrame(event.when);
+    }
     for (size_t i = 0; i < mMappers.size(); ++i) {
         mMappers[i]->process(event);
     }
 }
 
+void EvdevDevice::processInputFrame(InputEvent* events, size_t count, nsecs_t currentTime) {
+    for (size_t i = 0; i < count; ++i) {
+        checkEventTime(events[i], currentTime);
+    }
+
+    // Reports are timed from the SYN_REPORT that ends the frame.
+    auto stats = mDeviceNode->getLatencyStats();
+    if (stats != nullptr && count > 0) {
+        stats->beginFrame(events[count - 1].when);
+    }
+
+    for (size_t i = 0; i < mMappers.size(); ++i) {
+        mMappers[i]->processFrame(events, count);
+    }
+}
+
 }  // namespace android
@@ -23,6 +23,7 @@
 #include <utils/Timers.h>
 
 #include "InputMapper.h"
+#include "InputReportPool.h"
 
 struct input_device_handle;
 struct input_device_identifier;
@@ -43,6 +44,8 @@ using InputDeviceIdentifier = struct input_device_identifier;
 class InputDeviceInterface {
 public:
     virtual void processInput(InputEvent& event, nsecs_t currentTime) = 0;
+    /** Processes the events of one frame, ending with an EV_SYN/SYN_REPORT. */
+    virtual void processInputFrame(InputEvent* events, size_t count, nsecs_t currentTime) = 0;
 
     virtual uint32_t getInputClasses() = 0;
 protected:
@@ -59,10 +62,15 @@ public:
     virtual ~EvdevDevice() override = default;
 
     virtual void processInput(InputEvent& event, nsecs_t currentTime) override;
+    virtual void processInputFrame(InputEvent* events, size_t count,
+            nsecs_t currentTime) override;
 
     virtual uint32_t getInputClasses() override { return mClasses; }
+
+    const InputReportPool& getReportPool() const { return mReportPool; }
 private:
     void createMappers();
+    void checkEventTime(InputEvent& event, nsecs_t currentTime);
     void configureDevice();
 
     InputHostInterface* mHost = nullptr;
@@ -70,6 +78,8 @@ private:
     InputDeviceIdentifier* mInputId = nullptr;
     InputDeviceDefinition* mDeviceDefinition = nullptr;
     InputDeviceHandle* mDeviceHandle = nullptr;
+    // Declared before the mappers, which take their reports from it.
+    InputReportPool mReportPool;
     std::vector<std::unique_ptr<InputMapper>> mMappers;
     uint32_t mClasses = 0;
 };
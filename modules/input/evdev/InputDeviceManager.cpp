@@ -34,6 +34,16 @@ void InputDeviceManager::onInputEvent(const std::shared_ptr<InputDeviceNode>& no
     mDevices[node]->processInput(event, event_time);
 }
 
+void InputDeviceManager::onInputFrame(const std::shared_ptr<InputDeviceNode>& node,
+        InputEvent* events, size_t count, nsecs_t event_time) {
+    auto device = mDevices.find(node);
+    if (device == mDevices.end() || device->second == nullptr) {
+        ALOGE("got input frame for unknown node %s", node->getPath().c_str());
+        return;
+    }
+    device->second->processInputFrame(events, count, event_time);
+}
+
 void InputDeviceManager::onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) {
     mDevices[node] = std::make_shared<EvdevDevice>(mHost, node);
 }
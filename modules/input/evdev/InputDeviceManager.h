@@ -42,6 +42,8 @@ public:
 
     virtual void onInputEvent(const std::shared_ptr<InputDeviceNode>& node, InputEvent& event,
             nsecs_t event_time) override;
+    virtual void onInputFrame(const std::shared_ptr<InputDeviceNode>& node, InputEvent* events,
+            size_t count, nsecs_t event_time) override;
     virtual void onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) override;
     virtual void onDeviceRemoved(const std::shared_ptr<InputDeviceNode>& node) override;
 
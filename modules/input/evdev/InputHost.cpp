@@ -53,6 +53,11 @@ InputReport* InputReportDefinition::allocateReport() {
             mCallbacks.input_allocate_report(mHost, mReportDefinition));
 }
 
+void InputReportDefinition::freeReport(InputReport* report) {
+    // The host owns the underlying report, and has no callback to free it.
+    delete report;
+}
+
 void InputDeviceDefinition::addReport(InputReportDefinition* r) {
     mCallbacks.input_device_definition_add_report(mHost, mDeviceDefinition, *r);
 }
@@ -82,6 +82,7 @@ public:
     virtual void declareUsages(InputCollectionId id, InputUsage* usage, size_t usageCount);
 
     virtual InputReport* allocateReport();
+    virtual void freeReport(InputReport* report);
 
     operator input_report_definition_t*() { return mReportDefinition; }
 
@@ -33,6 +33,9 @@
 #include <sys/utsname.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include <android/input.h>
@@ -42,13 +45,19 @@
 #include <utils/Log.h>
 
 #include "BitUtils.h"
+#include "InputCapabilityCache.h"
+#include "InputLatencyStats.h"
 
 namespace android {
 
 static const char WAKE_LOCK_ID[] = "KeyEvents";
 static const int NO_TIMEOUT = -1;
-static const int EPOLL_MAX_EVENTS = 16;
-static const int INPUT_MAX_EVENTS = 128;
+static const int EPOLL_MAX_EVENTS = 32;
+static const int INPUT_MAX_EVENTS = 256;
+static const size_t MIN_READ_BUDGET = 16;
+static const int MAX_READ_ROUNDS = 8;
+static const size_t MAX_PROBE_THREADS = 4;
+static const size_t MAX_PARTIAL_FRAME_EVENTS = 512;
 
 static constexpr bool testBit(int bit, const uint8_t arr[]) {
     return arr[bit / 8] & (1 << (bit % 8));
@@ -58,6 +67,24 @@ static constexpr size_t sizeofBitArray(size_t bits) {
     return (bits + 7) / 8;
 }
 
+static bool testBit(int bit, const std::atomic<uint8_t> arr[]) {
+    return arr[bit / 8].load(std::memory_order_relaxed) & (1 << (bit % 8));
+}
+
+static void setBit(int bit, std::atomic<uint8_t> arr[], bool value) {
+    if (value) {
+        arr[bit / 8].fetch_or(1 << (bit % 8), std::memory_order_relaxed);
+    } else {
+        arr[bit / 8].fetch_and(~(1 << (bit % 8)), std::memory_order_relaxed);
+    }
+}
+
+// The kernel keeps the values of these axes per slot, and only reports those
+// of the current slot through EVIOCGABS.
+static constexpr bool isMtSlotAxis(int32_t axis) {
+    return axis >= ABS_MT_TOUCH_MAJOR && axis <= ABS_MT_TOOL_Y;
+}
+
 static void getLinuxRelease(int* major, int* minor) {
     struct utsname info;
     if (uname(&info) || sscanf(info.release, "%d.%d", major, minor) <= 0) {
@@ -68,7 +95,7 @@ static void getLinuxRelease(int* major, int* minor) {
 
 class EvdevDeviceNode : public InputDeviceNode {
 public:
-    static EvdevDeviceNode* openDeviceNode(const std::string& path);
+    static EvdevDeviceNode* openDeviceNode(const std::string& path, InputCapabilityCache* cache);
 
     virtual ~EvdevDeviceNode() {
         ALOGV("closing %s (fd=%d)", mPath.c_str(), mFd);
@@ -100,18 +127,29 @@ public:
     virtual int32_t getSwitchState(int32_t sw) const override;
     virtual const AbsoluteAxisInfo* getAbsoluteAxisInfo(int32_t axis) const override;
     virtual status_t getAbsoluteAxisValue(int32_t axis, int32_t* outValue) const override;
+    virtual status_t getAbsoluteMtSlotValues(int32_t axis, int32_t* outValues,
+            size_t numSlots) const override;
 
     virtual void vibrate(nsecs_t duration) override;
     virtual void cancelVibrate() override;
 
     virtual void disableDriverKeyRepeat() override;
 
+    virtual InputLatencyStats* getLatencyStats() override { return &mLatencyStats; }
+
+    /** Updates the shadow state with an event read from the node. */
+    virtual void updateState(const InputEvent& event) override;
+
 private:
     EvdevDeviceNode(const std::string& path, int fd) :
-        mFd(fd), mPath(path) {}
+        mFd(fd), mPath(path), mLatencyStats(path) {}
 
-    status_t queryProperties();
+    status_t queryProperties(InputCapabilityCache* cache);
+    void queryCapabilities();
     void queryAxisInfo();
+    void loadCapabilities(const InputCapabilities& caps);
+    void saveCapabilities(InputCapabilities* caps) const;
+    void syncState();
 
     int mFd;
     std::string mPath;
@@ -135,11 +173,29 @@ private:
 
     std::unordered_map<uint32_t, std::unique_ptr<AbsoluteAxisInfo>> mAbsInfo;
 
+    // Shadow state of the keys, switches and axes, kept from the events read
+    // by the InputHub so that querying it takes no syscall. It is only written
+    // by the poll thread, or before the node is added, and read from any
+    // thread.
+    std::atomic<uint8_t> mKeyState[KEY_CNT / 8];
+    std::atomic<uint8_t> mSwState[SW_CNT / 8];
+    // The axes the driver could not be asked for, and those it keeps per
+    // multi-touch slot, are not valid and are read from the driver when
+    // queried.
+    std::atomic<int32_t> mAbsValues[ABS_CNT];
+    std::atomic<uint64_t> mAbsValuesValid;
+    static_assert(ABS_CNT <= 64, "mAbsValuesValid is too small");
+    // Whether events were dropped since the last SYN_REPORT
+    bool mDropped = false;
+
+    InputLatencyStats mLatencyStats;
+
     bool mFfEffectPlaying = false;
     int16_t mFfEffectId = -1;
 };
 
-EvdevDeviceNode* EvdevDeviceNode::openDeviceNode(const std::string& path) {
+EvdevDeviceNode* EvdevDeviceNode::openDeviceNode(const std::string& path,
+        InputCapabilityCache* cache) {
     auto fd = TEMP_FAILURE_RETRY(::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC));
     if (fd < 0) {
         ALOGE("could not open evdev device %s. err=%d", path.c_str(), errno);
@@ -158,17 +214,18 @@ EvdevDeviceNode* EvdevDeviceNode::openDeviceNode(const std::string& path) {
     }
 
     auto node = new EvdevDeviceNode(path, fd);
-    status_t ret = node->queryProperties();
+    status_t ret = node->queryProperties(cache);
     if (ret != OK) {
         ALOGE("could not open evdev device %s: failed to read properties. errno=%d",
                 path.c_str(), ret);
         delete node;
         return nullptr;
     }
+    node->syncState();
     return node;
 }
 
-status_t EvdevDeviceNode::queryProperties() {
+status_t EvdevDeviceNode::queryProperties(InputCapabilityCache* cache) {
     char buffer[80];
 
     if (TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGNAME(sizeof(buffer) - 1), buffer)) < 1) {
@@ -222,6 +279,33 @@ status_t EvdevDeviceNode::queryProperties() {
         mName.c_str(), mLocation.c_str(), mUniqueId.c_str(),
         driverVersion >> 16, (driverVersion >> 8) & 0xff, (driverVersion >> 16) & 0xff);
 
+    // The ids above are all it takes to find the capabilities of a device
+    // already probed, saving the ioctls for each of its axes.
+    InputCapabilityKey key;
+    key.busType = mBusType;
+    key.vendorId = mVendorId;
+    key.productId = mProductId;
+    key.version = mVersion;
+    key.driverVersion = driverVersion;
+    key.location = mLocation;
+    key.name = mName;
+    InputCapabilities caps;
+    if (cache != nullptr && cache->lookup(key, &caps)) {
+        ALOGV("  capabilities from cache");
+        loadCapabilities(caps);
+        return OK;
+    }
+
+    queryCapabilities();
+    if (cache != nullptr) {
+        saveCapabilities(&caps);
+        cache->insert(key, caps);
+    }
+
+    return OK;
+}
+
+void EvdevDeviceNode::queryCapabilities() {
     TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGBIT(EV_KEY, sizeof(mKeyBitmask)), mKeyBitmask));
     TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGBIT(EV_ABS, sizeof(mAbsBitmask)), mAbsBitmask));
     TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGBIT(EV_REL, sizeof(mRelBitmask)), mRelBitmask));
@@ -231,8 +315,6 @@ status_t EvdevDeviceNode::queryProperties() {
     TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGPROP(sizeof(mPropBitmask)), mPropBitmask));
 
     queryAxisInfo();
-
-    return OK;
 }
 
 void EvdevDeviceNode::queryAxisInfo() {
@@ -256,6 +338,34 @@ void EvdevDeviceNode::queryAxisInfo() {
     }
 }
 
+void EvdevDeviceNode::loadCapabilities(const InputCapabilities& caps) {
+    memcpy(mKeyBitmask, caps.keyBitmask, sizeof(mKeyBitmask));
+    memcpy(mAbsBitmask, caps.absBitmask, sizeof(mAbsBitmask));
+    memcpy(mRelBitmask, caps.relBitmask, sizeof(mRelBitmask));
+    memcpy(mSwBitmask, caps.swBitmask, sizeof(mSwBitmask));
+    memcpy(mLedBitmask, caps.ledBitmask, sizeof(mLedBitmask));
+    memcpy(mFfBitmask, caps.ffBitmask, sizeof(mFfBitmask));
+    memcpy(mPropBitmask, caps.propBitmask, sizeof(mPropBitmask));
+    for (const auto& axis : caps.absInfo) {
+        mAbsInfo[axis.first] = std::unique_ptr<AbsoluteAxisInfo>(
+                new AbsoluteAxisInfo(axis.second));
+    }
+}
+
+void EvdevDeviceNode::saveCapabilities(InputCapabilities* caps) const {
+    memcpy(caps->keyBitmask, mKeyBitmask, sizeof(mKeyBitmask));
+    memcpy(caps->absBitmask, mAbsBitmask, sizeof(mAbsBitmask));
+    memcpy(caps->relBitmask, mRelBitmask, sizeof(mRelBitmask));
+    memcpy(caps->swBitmask, mSwBitmask, sizeof(mSwBitmask));
+    memcpy(caps->ledBitmask, mLedBitmask, sizeof(mLedBitmask));
+    memcpy(caps->ffBitmask, mFfBitmask, sizeof(mFfBitmask));
+    memcpy(caps->propBitmask, mPropBitmask, sizeof(mPropBitmask));
+    caps->absInfo.clear();
+    for (const auto& axis : mAbsInfo) {
+        caps->absInfo.emplace_back(axis.first, *axis.second);
+    }
+}
+
 bool EvdevDeviceNode::hasKey(int32_t key) const {
     if (key >= 0 && key <= KEY_MAX) {
         return testBit(key, mKeyBitmask);
@@ -317,11 +427,7 @@ bool EvdevDeviceNode::hasInputProperty(int property) const {
 int32_t EvdevDeviceNode::getKeyState(int32_t key) const {
     if (key >= 0 && key <= KEY_MAX) {
         if (testBit(key, mKeyBitmask)) {
-            uint8_t keyState[sizeofBitArray(KEY_CNT)];
-            memset(keyState, 0, sizeof(keyState));
-            if (TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGKEY(sizeof(keyState)), keyState)) >= 0) {
-                return testBit(key, keyState) ? AKEY_STATE_DOWN : AKEY_STATE_UP;
-            }
+            return testBit(key, mKeyState) ? AKEY_STATE_DOWN : AKEY_STATE_UP;
         }
     }
     return AKEY_STATE_UNKNOWN;
@@ -330,11 +436,7 @@ int32_t EvdevDeviceNode::getKeyState(int32_t key) const {
 int32_t EvdevDeviceNode::getSwitchState(int32_t sw) const {
     if (sw >= 0 && sw <= SW_MAX) {
         if (testBit(sw, mSwBitmask)) {
-            uint8_t swState[sizeofBitArray(SW_CNT)];
-            memset(swState, 0, sizeof(swState));
-            if (TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGSW(sizeof(swState)), swState)) >= 0) {
-                return testBit(sw, swState) ? AKEY_STATE_DOWN : AKEY_STATE_UP;
-            }
+            return testBit(sw, mSwState) ? AKEY_STATE_DOWN : AKEY_STATE_UP;
         }
     }
     return AKEY_STATE_UNKNOWN;
@@ -345,6 +447,12 @@ status_t EvdevDeviceNode::getAbsoluteAxisValue(int32_t axis, int32_t* outValue)
 
     if (axis >= 0 && axis <= ABS_MAX) {
         if (testBit(axis, mAbsBitmask)) {
+            const uint64_t axisBit = 1ULL << axis;
+            if (mAbsValuesValid.load(std::memory_order_acquire) & axisBit) {
+                *outValue = mAbsValues[axis].load(std::memory_order_relaxed);
+                return OK;
+            }
+
             struct input_absinfo info;
             if (TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGABS(axis), &info))) {
                 ALOGW("Error reading absolute controller %d for device %s fd %d, errno=%d",
@@ -359,6 +467,96 @@ status_t EvdevDeviceNode::getAbsoluteAxisValue(int32_t axis, int32_t* outValue)
     return -1;
 }
 
+status_t EvdevDeviceNode::getAbsoluteMtSlotValues(int32_t axis, int32_t* outValues,
+        size_t numSlots) const {
+    if (axis < ABS_MT_SLOT || axis > ABS_MAX || !testBit(axis, mAbsBitmask)) {
+        return -1;
+    }
+
+    // The request is the axis code followed by one value per slot.
+    std::vector<int32_t> request(numSlots + 1);
+    request[0] = axis;
+    size_t size = request.size() * sizeof(int32_t);
+    if (TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGMTSLOTS(size), request.data()))) {
+        ALOGW("Error reading slots of multi-touch axis %d for device %s fd %d, errno=%d",
+                axis, mPath.c_str(), mFd, errno);
+        return -errno;
+    }
+
+    memcpy(outValues, &request[1], numSlots * sizeof(int32_t));
+    return OK;
+}
+
+void EvdevDeviceNode::updateState(const InputEvent& event) {
+    if (event.type == EV_SYN) {
+        // After a SYN_DROPPED, the events up to the next SYN_REPORT are
+        // incomplete and the driver has to be asked for its state.
+        if (event.code == SYN_DROPPED) {
+            mDropped = true;
+        } else if (event.code == SYN_REPORT && mDropped) {
+            mDropped = false;
+            syncState();
+        }
+        return;
+    }
+    if (mDropped) {
+        return;
+    }
+
+    switch (event.type) {
+        case EV_KEY:
+            if (event.code <= KEY_MAX) {
+                // Autorepeats (value 2) leave the key down.
+                setBit(event.code, mKeyState, event.value != 0);
+            }
+            break;
+        case EV_SW:
+            if (event.code <= SW_MAX) {
+                setBit(event.code, mSwState, event.value != 0);
+            }
+            break;
+        case EV_ABS:
+            if (event.code <= ABS_MAX && !isMtSlotAxis(event.code)) {
+                mAbsValues[event.code].store(event.value, std::memory_order_relaxed);
+                mAbsValuesValid.fetch_or(1ULL << event.code, std::memory_order_release);
+            }
+            break;
+    }
+}
+
+void EvdevDeviceNode::syncState() {
+    uint8_t keyState[sizeofBitArray(KEY_CNT)] = {};
+    if (TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGKEY(sizeof(keyState)), keyState)) < 0) {
+        ALOGW("could not get key state for %s. errno=%d", mPath.c_str(), errno);
+    }
+    for (size_t i = 0; i < sizeof(keyState); ++i) {
+        mKeyState[i].store(keyState[i], std::memory_order_relaxed);
+    }
+
+    uint8_t swState[sizeofBitArray(SW_CNT)] = {};
+    if (TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGSW(sizeof(swState)), swState)) < 0) {
+        ALOGW("could not get switch state for %s. errno=%d", mPath.c_str(), errno);
+    }
+    for (size_t i = 0; i < sizeof(swState); ++i) {
+        mSwState[i].store(swState[i], std::memory_order_relaxed);
+    }
+
+    uint64_t absValuesValid = 0;
+    for (int32_t axis = 0; axis <= ABS_MAX; ++axis) {
+        if (!testBit(axis, mAbsBitmask) || isMtSlotAxis(axis)) {
+            continue;
+        }
+        struct input_absinfo info;
+        if (TEMP_FAILURE_RETRY(ioctl(mFd, EVIOCGABS(axis), &info))) {
+            ALOGW("could not get axis %d state for %s. errno=%d", axis, mPath.c_str(), errno);
+            continue;
+        }
+        mAbsValues[axis].store(info.value, std::memory_order_relaxed);
+        absValuesValid |= 1ULL << axis;
+    }
+    mAbsValuesValid.store(absValuesValid, std::memory_order_release);
+}
+
 void EvdevDeviceNode::vibrate(nsecs_t duration) {
     ff_effect effect{};
     effect.type = FF_RUMBLE;
@@ -459,10 +657,6 @@ InputHub::InputHub(const std::shared_ptr<InputCallbackInterface>& cb) :
     int result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mINotifyFd, &eventItem);
     LOG_ALWAYS_FATAL_IF(result != 0, "Could not add INotify to epoll instance. errno=%d", errno);
 
-    int wakeFds[2];
-    result = pipe(wakeFds);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not create wake pipe. errno=%d", errno);
-
     mWakeEventFd = eventfd(0, EFD_NONBLOCK);
     LOG_ALWAYS_FATAL_IF(mWakeEventFd == -1, "Could not create wake event fd. errno=%d", errno);
 
@@ -493,6 +687,21 @@ status_t InputHub::registerDevicePath(const std::string& path) {
     return OK;
 }
 
+status_t InputHub::enableCapabilityCache(const std::string& path) {
+    auto cache = std::make_unique<InputCapabilityCache>(path);
+    status_t ret = cache->load();
+    if (ret != OK && ret != -ENOENT) {
+        ALOGW("starting with an empty capability cache. err=%d", ret);
+    }
+    mCapabilityCache = std::move(cache);
+    return OK;
+}
+
+void InputHub::setEdgeTriggered(bool enabled) {
+    LOG_ALWAYS_FATAL_IF(!mDeviceNodes.empty(), "setEdgeTriggered called with open devices");
+    mEdgeTriggered = enabled;
+}
+
 status_t InputHub::unregisterDevicePath(const std::string& path) {
     int wd = -1;
     for (const auto& pair : mWatchedPaths) {
@@ -515,7 +724,10 @@ status_t InputHub::unregisterDevicePath(const std::string& path) {
 status_t InputHub::poll() {
     bool deviceChange = false;
 
-    if (manageWakeLocks()) {
+    // Devices left with input by the last poll are read without waiting.
+    bool hasPendingInput = !mReadyFds.empty();
+
+    if (manageWakeLocks() && !hasPendingInput) {
         // Mind the wake lock dance!
         // If we're relying on wake locks, we hold a wake lock at all times
         // except during epoll_wait(). This works due to some subtle
@@ -530,13 +742,14 @@ status_t InputHub::poll() {
     }
 
     struct epoll_event pendingEventItems[EPOLL_MAX_EVENTS];
-    int pollResult = epoll_wait(mEpollFd, pendingEventItems, EPOLL_MAX_EVENTS, NO_TIMEOUT);
+    int pollResult = epoll_wait(mEpollFd, pendingEventItems, EPOLL_MAX_EVENTS,
+            hasPendingInput ? 0 : NO_TIMEOUT);
 
-    if (manageWakeLocks()) {
+    if (manageWakeLocks() && !hasPendingInput) {
         acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
     }
 
-    if (pollResult == 0) {
+    if (pollResult == 0 && !hasPendingInput) {
         ALOGW("epoll_wait should not return 0 with no timeout");
         return UNKNOWN_ERROR;
     }
@@ -547,11 +760,9 @@ status_t InputHub::poll() {
         return -errno;
     }
 
-    // pollResult > 0: there are events to process
+    // pollResult > 0 or hasPendingInput: there are events to process
     nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
     std::vector<int> removedDeviceFds;
-    int inputFd = -1;
-    std::shared_ptr<InputDeviceNode> deviceNode;
     for (int i = 0; i < pollResult; ++i) {
         const struct epoll_event& eventItem = pendingEventItems[i];
 
@@ -580,52 +791,32 @@ status_t InputHub::poll() {
             continue;
         }
 
-        // Update the fd and device node when the fd changes. When several
-        // events are read back-to-back with the same fd, this saves many reads
-        // from the hash table.
-        if (inputFd != dataFd) {
-            inputFd = dataFd;
-            deviceNode = mDeviceNodes[inputFd];
-        }
-        if (deviceNode == nullptr) {
-            ALOGE("could not find device node for fd %d", inputFd);
-            continue;
-        }
         if (eventItem.events & EPOLLIN) {
-            struct input_event ievs[INPUT_MAX_EVENTS];
-            for (;;) {
-                ssize_t readSize = TEMP_FAILURE_RETRY(read(inputFd, ievs, sizeof(ievs)));
-                if (readSize == 0 || (readSize < 0 && errno == ENODEV)) {
-                    ALOGW("could not get event, removed? (fd: %d, size: %zd errno: %d)",
-                            inputFd, readSize, errno);
-
-                    removedDeviceFds.push_back(inputFd);
-                    break;
-                } else if (readSize < 0) {
-                    if (errno != EAGAIN && errno != EINTR) {
-                        ALOGW("could not get event. errno=%d", errno);
-                    }
-                    break;
-                } else if (readSize % sizeof(input_event) != 0) {
-                    ALOGE("could not get event. wrong size=%zd", readSize);
-                    break;
-                } else {
-                    size_t count = static_cast<size_t>(readSize) / sizeof(struct input_event);
-                    for (size_t i = 0; i < count; ++i) {
-                        auto& iev = ievs[i];
-                        auto when = s2ns(iev.time.tv_sec) + us2ns(iev.time.tv_usec);
-                        InputEvent inputEvent = { when, iev.type, iev.code, iev.value };
-                        mInputCallback->onInputEvent(deviceNode, inputEvent, now);
-                    }
-                }
+            if (std::find(mReadyFds.begin(), mReadyFds.end(), dataFd) == mReadyFds.end()) {
+                mReadyFds.push_back(dataFd);
             }
         } else if (eventItem.events & EPOLLHUP) {
-            ALOGI("Removing device fd %d due to epoll hangup event.", inputFd);
-            removedDeviceFds.push_back(inputFd);
+            ALOGI("Removing device fd %d due to epoll hangup event.", dataFd);
+            removedDeviceFds.push_back(dataFd);
         } else {
             ALOGW("Received unexpected epoll event 0x%08x for device fd %d",
-                    eventItem.events, inputFd);
+                    eventItem.events, dataFd);
+        }
+    }
+
+    // Read the devices with input in rounds, one read per device and round,
+    // so that a device with a lot of input cannot hold back the others. The
+    // devices still left with input after the last round are read first by
+    // the next poll.
+    for (int round = 0; round < MAX_READ_ROUNDS && !mReadyFds.empty(); ++round) {
+        size_t stillReady = 0;
+        for (size_t i = 0; i < mReadyFds.size(); ++i) {
+            int fd = mReadyFds[i];
+            if (readDevice(fd, now, &removedDeviceFds)) {
+                mReadyFds[stillReady++] = fd;
+            }
         }
+        mReadyFds.resize(stillReady);
     }
 
     if (removedDeviceFds.size()) {
@@ -649,6 +840,69 @@ status_t InputHub::poll() {
     return OK;
 }
 
+bool InputHub::readDevice(int fd, nsecs_t now, std::vector<int>* removedDeviceFds) {
+    auto iter = mDeviceNodes.find(fd);
+    if (iter == mDeviceNodes.end()) {
+        ALOGE("could not find device node for fd %d", fd);
+        return false;
+    }
+    const auto& node = iter->second;
+
+    // The budget of a device grows while its reads fill it, and shrinks back
+    // when they stop doing so.
+    size_t& budget = mReadBudgets[fd];
+    if (budget == 0) {
+        budget = MIN_READ_BUDGET;
+    }
+
+    struct input_event ievs[INPUT_MAX_EVENTS];
+    InputEvent inputEvents[INPUT_MAX_EVENTS];
+    ssize_t readSize = TEMP_FAILURE_RETRY(read(fd, ievs, budget * sizeof(struct input_event)));
+    if (readSize == 0 || (readSize < 0 && errno == ENODEV)) {
+        ALOGW("could not get event, removed? (fd: %d, size: %zd errno: %d)",
+                fd, readSize, errno);
+        removedDeviceFds->push_back(fd);
+        return false;
+    } else if (readSize < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return false;
+    } else if (readSize < 0 || readSize % sizeof(input_event) != 0) {
+        if (readSize < 0) {
+            ALOGW("could not get event. errno=%d", errno);
+        } else {
+            ALOGE("could not get event. wrong size=%zd", readSize);
+        }
+        // Edge-triggered epoll would not report the device again while it
+        // still has input, so rather than stall it, it is removed.
+        if (mEdgeTriggered) {
+            removedDeviceFds->push_back(fd);
+        }
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(readSize) / sizeof(struct input_event);
+    for (size_t i = 0; i < count; ++i) {
+        auto& iev = ievs[i];
+        auto when = s2ns(iev.time.tv_sec) + us2ns(iev.time.tv_usec);
+        inputEvents[i] = { when, iev.type, iev.code, iev.value };
+        node->updateState(inputEvents[i]);
+    }
+    if (auto stats = node->getLatencyStats()) {
+        stats->recordRead(inputEvents, count, now);
+    }
+    deliverFrames(fd, node, inputEvents, count, now);
+
+    if (count == budget) {
+        // The device may have more input.
+        budget = std::min(budget * 2, static_cast<size_t>(INPUT_MAX_EVENTS));
+        return true;
+    }
+    // A short read drained the device, as edge-triggered epoll requires.
+    if (count < budget / 4) {
+        budget = std::max(budget / 2, MIN_READ_BUDGET);
+    }
+    return false;
+}
+
 status_t InputHub::wake() {
     ALOGV("wake() called");
 
@@ -663,7 +917,64 @@ status_t InputHub::wake() {
 }
 
 void InputHub::dump(String8& dump) {
-    // TODO
+    dump.append("InputHub:\n");
+    for (const auto& pair : mDeviceNodes) {
+        const auto& node = pair.second;
+        dump.appendFormat("  %s (%s):\n", node->getPath().c_str(), node->getName().c_str());
+        if (auto stats = node->getLatencyStats()) {
+            stats->dump(dump);
+        }
+    }
+}
+
+static bool isDroppedFrame(const std::vector<InputEvent>& frame) {
+    return frame.size() == 1 && frame[0].type == EV_SYN && frame[0].code == SYN_DROPPED;
+}
+
+void InputHub::deliverFrames(int fd, const std::shared_ptr<InputDeviceNode>& node,
+        InputEvent* events, size_t count, nsecs_t now) {
+    // Only the first frame of a read can have started in an earlier read.
+    std::vector<InputEvent>* partial = nullptr;
+    auto it = mPartialFrames.find(fd);
+    if (it != mPartialFrames.end() && !it->second.empty()) {
+        partial = &it->second;
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (events[i].type != EV_SYN || events[i].code != SYN_REPORT) {
+            continue;
+        }
+        if (partial != nullptr) {
+            // Events after a SYN_DROPPED are stale up to the SYN_REPORT.
+            size_t from = isDroppedFrame(*partial) ? i : start;
+            partial->insert(partial->end(), events + from, events + i + 1);
+            mInputCallback->onInputFrame(node, partial->data(), partial->size(), now);
+            partial->clear();
+            partial = nullptr;
+        } else {
+            mInputCallback->onInputFrame(node, events + start, i + 1 - start, now);
+        }
+        start = i + 1;
+    }
+
+    if (start < count) {
+        auto& frame = mPartialFrames[fd];
+        if (isDroppedFrame(frame)) {
+            return;
+        }
+        if (frame.size() + count - start > MAX_PARTIAL_FRAME_EVENTS) {
+            // A device that never ends its frame is dropped as the kernel
+            // drops events: the rest of the frame is replaced by a
+            // SYN_DROPPED, after which the device is resynced at the
+            // SYN_REPORT.
+            ALOGW("dropping a frame of more than %zu events from %s",
+                    MAX_PARTIAL_FRAME_EVENTS, node->getPath().c_str());
+            frame.assign(1, InputEvent{ events[start].when, EV_SYN, SYN_DROPPED, 0 });
+            return;
+        }
+        frame.insert(frame.end(), events + start, events + count);
+    }
 }
 
 status_t InputHub::readNotify() {
@@ -676,6 +987,9 @@ status_t InputHub::readNotify() {
         return -errno;
     }
 
+    // Devices created together, as on a hub being plugged in, are probed
+    // together. They are added before any later removal is handled.
+    std::vector<std::string> createdPaths;
     size_t event_pos = 0;
     while (res >= static_cast<int>(sizeof(*event))) {
         event = reinterpret_cast<struct inotify_event*>(event_buf + event_pos);
@@ -685,13 +999,10 @@ status_t InputHub::readNotify() {
             ALOGV("inotify event for path %s", path.c_str());
 
             if (event->mask & IN_CREATE) {
-                auto deviceNode = openNode(path);
-                if (deviceNode == nullptr) {
-                    ALOGE("could not open device node %s. err=%zd", path.c_str(), res);
-                } else {
-                    mInputCallback->onDeviceAdded(deviceNode);
-                }
+                createdPaths.push_back(path);
             } else {
+                addNodes(createdPaths);
+                createdPaths.clear();
                 auto deviceNode = findNodeByPath(path);
                 if (deviceNode != nullptr) {
                     status_t ret = closeNode(deviceNode.get());
@@ -709,6 +1020,7 @@ status_t InputHub::readNotify() {
         res -= event_size;
         event_pos += event_size;
     }
+    addNodes(createdPaths);
 
     return OK;
 }
@@ -720,41 +1032,98 @@ status_t InputHub::scanDir(const std::string& path) {
         return -errno;
     }
 
+    std::vector<std::string> paths;
     while (auto dirent = readdir(dir)) {
         if (strcmp(dirent->d_name, ".") == 0 ||
             strcmp(dirent->d_name, "..") == 0) {
             continue;
         }
-        std::string filename = path + "/" + dirent->d_name;
-        auto node = openNode(filename);
+        paths.push_back(path + "/" + dirent->d_name);
+    }
+    ::closedir(dir);
+    addNodes(paths);
+    return OK;
+}
+
+void InputHub::addNodes(const std::vector<std::string>& paths) {
+    if (paths.empty()) {
+        return;
+    }
+    auto nodes = probeNodes(paths);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        auto node = nodes[i] == nullptr ? nullptr : addNode(nodes[i]);
         if (node == nullptr) {
-            ALOGE("could not open device node %s", filename.c_str());
+            ALOGE("could not open device node %s", paths[i].c_str());
         } else {
             mInputCallback->onDeviceAdded(node);
         }
     }
-    ::closedir(dir);
-    return OK;
+    if (mCapabilityCache != nullptr) {
+        mCapabilityCache->save();
+    }
 }
 
-std::shared_ptr<InputDeviceNode> InputHub::openNode(const std::string& path) {
-    ALOGV("opening %s...", path.c_str());
-    auto evdevNode = std::shared_ptr<EvdevDeviceNode>(EvdevDeviceNode::openDeviceNode(path));
-    if (evdevNode == nullptr) {
-        return nullptr;
+std::vector<std::shared_ptr<EvdevDeviceNode>> InputHub::probeNodes(
+        const std::vector<std::string>& paths) {
+    // Probing takes a few dozen ioctls per device, each of which can block on
+    // a slow driver, so the devices are probed on a few threads at once. The
+    // nodes are only added to the hub once they are all back.
+    std::vector<std::shared_ptr<EvdevDeviceNode>> nodes(paths.size());
+    InputCapabilityCache* cache = mCapabilityCache.get();
+    std::atomic<size_t> next(0);
+    auto probe = [&]() {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            ALOGV("opening %s...", paths[i].c_str());
+            nodes[i].reset(EvdevDeviceNode::openDeviceNode(paths[i], cache));
+        }
+    };
+
+    size_t numThreads = std::min(paths.size(), MAX_PROBE_THREADS);
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (size_t i = 1; i < numThreads; ++i) {
+        threads.emplace_back(probe);
+    }
+    probe();
+    for (auto& thread : threads) {
+        thread.join();
     }
+    return nodes;
+}
 
-    auto fd = evdevNode->getFd();
-    ALOGV("opened %s with fd %d", path.c_str(), fd);
-    mDeviceNodes[fd] = evdevNode;
+status_t InputHub::addDeviceNode(int fd, const std::shared_ptr<InputDeviceNode>& node) {
+    ALOGV("adding %s with fd %d", node->getPath().c_str(), fd);
+    status_t ret = watchNode(fd, node);
+    if (ret != OK) {
+        return ret;
+    }
+    mInputCallback->onDeviceAdded(node);
+    return OK;
+}
+
+status_t InputHub::watchNode(int fd, const std::shared_ptr<InputDeviceNode>& node) {
     struct epoll_event eventItem{};
     eventItem.events = EPOLLIN;
     if (mWakeupMechanism == WakeMechanism::EPOLL_WAKEUP) {
         eventItem.events |= EPOLLWAKEUP;
     }
+    if (mEdgeTriggered) {
+        eventItem.events |= EPOLLET;
+    }
     eventItem.data.u32 = fd;
     if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &eventItem)) {
         ALOGE("Could not add device fd to epoll instance. errno=%d", errno);
+        return -errno;
+    }
+    mDeviceNodes[fd] = node;
+    return OK;
+}
+
+std::shared_ptr<InputDeviceNode> InputHub::addNode(
+        const std::shared_ptr<EvdevDeviceNode>& evdevNode) {
+    auto fd = evdevNode->getFd();
+    ALOGV("opened %s with fd %d", evdevNode->getPath().c_str(), fd);
+    if (watchNode(fd, evdevNode) != OK) {
         return nullptr;
     }
 
@@ -796,6 +1165,9 @@ status_t InputHub::closeNodeByFd(int fd) {
         ret = -errno;
     }
     mDeviceNodes.erase(fd);
+    mPartialFrames.erase(fd);
+    mReadBudgets.erase(fd);
+    mReadyFds.erase(std::remove(mReadyFds.begin(), mReadyFds.end(), fd), mReadyFds.end());
     ::close(fd);
     return ret;
 }
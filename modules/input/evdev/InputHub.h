@@ -20,12 +20,17 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <utils/String8.h>
 #include <utils/Timers.h>
 
 namespace android {
 
+class EvdevDeviceNode;
+class InputCapabilityCache;
+class InputLatencyStats;
+
 /**
  * InputEvent represents an event from the kernel. The fields largely mirror
  * those found in linux/input.h.
@@ -98,6 +103,12 @@ public:
     virtual const AbsoluteAxisInfo* getAbsoluteAxisInfo(int32_t axis) const = 0;
     /** Returns the value of the absolute axis. */
     virtual status_t getAbsoluteAxisValue(int32_t axis, int32_t* outValue) const = 0;
+    /**
+     * Returns the values of a multi-touch axis for the first numSlots slots,
+     * as EVIOCGMTSLOTS does.
+     */
+    virtual status_t getAbsoluteMtSlotValues(int32_t axis, int32_t* outValues,
+            size_t numSlots) const = 0;
 
     /** Vibrate the device for duration ns. */
     virtual void vibrate(nsecs_t duration) = 0;
@@ -107,6 +118,16 @@ public:
     /** Disable key repeat for the device in the driver. */
     virtual void disableDriverKeyRepeat() = 0;
 
+    /** Returns the latency stats of the device, if it keeps any. */
+    virtual InputLatencyStats* getLatencyStats() { return nullptr; }
+
+    /**
+     * Updates the state the node keeps, if any, with an event read from the
+     * device. Called on the thread polling for input, before the event is
+     * delivered.
+     */
+    virtual void updateState(const InputEvent& /*event*/) {}
+
 protected:
     InputDeviceNode() = default;
     virtual ~InputDeviceNode() = default;
@@ -117,6 +138,17 @@ class InputCallbackInterface {
 public:
     virtual void onInputEvent(const std::shared_ptr<InputDeviceNode>& node, InputEvent& event,
             nsecs_t event_time) = 0;
+    /**
+     * Receives the events of one frame from a device, up to and including the
+     * EV_SYN/SYN_REPORT that ends it. The default delivers each event to
+     * onInputEvent.
+     */
+    virtual void onInputFrame(const std::shared_ptr<InputDeviceNode>& node, InputEvent* events,
+            size_t count, nsecs_t event_time) {
+        for (size_t i = 0; i < count; ++i) {
+            onInputEvent(node, events[i], event_time);
+        }
+    }
     virtual void onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) = 0;
     virtual void onDeviceRemoved(const std::shared_ptr<InputDeviceNode>& node) = 0;
 
@@ -166,10 +198,39 @@ public:
 
     virtual void dump(String8& dump) override;
 
+    /**
+     * Remembers the capabilities of the devices probed in the file at path, so
+     * that they are not probed again when next opened, even after a reboot.
+     * Call before registering any device path.
+     */
+    status_t enableCapabilityCache(const std::string& path);
+
+    /**
+     * Registers the devices with edge-triggered epoll, so that a device is
+     * only reported again once it has new input. poll() still drains each
+     * device, in bounded rounds. Call before registering any device path.
+     */
+    void setEdgeTriggered(bool enabled);
+
+    /**
+     * Adds a device whose events are read from fd as struct input_event
+     * rather than from an evdev node, such as a ReplayDeviceNode fed through
+     * a pipe. On success the hub owns fd, and removes the device once the
+     * other end is closed.
+     */
+    status_t addDeviceNode(int fd, const std::shared_ptr<InputDeviceNode>& node);
+
 private:
     status_t readNotify();
+    bool readDevice(int fd, nsecs_t now, std::vector<int>* removedDeviceFds);
+    void deliverFrames(int fd, const std::shared_ptr<InputDeviceNode>& node, InputEvent* events,
+            size_t count, nsecs_t now);
     status_t scanDir(const std::string& path);
-    std::shared_ptr<InputDeviceNode> openNode(const std::string& path);
+    void addNodes(const std::vector<std::string>& paths);
+    std::vector<std::shared_ptr<EvdevDeviceNode>> probeNodes(
+            const std::vector<std::string>& paths);
+    std::shared_ptr<InputDeviceNode> addNode(const std::shared_ptr<EvdevDeviceNode>& evdevNode);
+    status_t watchNode(int fd, const std::shared_ptr<InputDeviceNode>& node);
     status_t closeNode(const InputDeviceNode* node);
     status_t closeNodeByFd(int fd);
     std::shared_ptr<InputDeviceNode> findNodeByPath(const std::string& path);
@@ -209,6 +270,7 @@ private:
     WakeMechanism mWakeupMechanism = WakeMechanism::LEGACY_EVDEV_EXPLICIT_WAKE_LOCKS;
     bool manageWakeLocks() const;
     bool mNeedToCheckSuspendBlockIoctl = true;
+    bool mEdgeTriggered = false;
 
     int mEpollFd;
     int mINotifyFd;
@@ -221,6 +283,16 @@ private:
     std::unordered_map<int, std::string> mWatchedPaths;
     // Map from file descriptors to InputDeviceNodes
     std::unordered_map<int, std::shared_ptr<InputDeviceNode>> mDeviceNodes;
+    // Map from file descriptors to the events of a frame not yet ended by a
+    // SYN_REPORT, carried over to the next read. A frame that grows too long
+    // is replaced by a SYN_DROPPED.
+    std::unordered_map<int, std::vector<InputEvent>> mPartialFrames;
+    // Map from file descriptors to the number of events read at once
+    std::unordered_map<int, size_t> mReadBudgets;
+    // File descriptors of the devices that may have input left to read
+    std::vector<int> mReadyFds;
+    // Capabilities of the devices already probed, if enabled
+    std::unique_ptr<InputCapabilityCache> mCapabilityCache;
 };
 
 }  // namespace android
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputLatencyStats"
+#define ATRACE_TAG ATRACE_TAG_INPUT
+//#define LOG_NDEBUG 0
+
+#include "InputLatencyStats.h"
+
+#include <inttypes.h>
+
+#include <linux/input.h>
+
+#include <utils/Trace.h>
+
+#include "InputHub.h"
+
+namespace android {
+
+static uint64_t latencyUs(nsecs_t from, nsecs_t to) {
+    // Clocks that jump backwards are clamped, rather than wrapping around.
+    return to > from ? ns2us(to - from) : 0;
+}
+
+void Log2Histogram::record(uint64_t value) {
+    size_t bucket = 0;
+    while (value != 0 && bucket < kNumBuckets - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Log2Histogram::getCount() const {
+    uint64_t count = 0;
+    for (const auto& bucket : mBuckets) {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t Log2Histogram::getBucketCount(size_t bucket) const {
+    return bucket < kNumBuckets ? mBuckets[bucket].load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t Log2Histogram::getPercentile(uint32_t percent) const {
+    uint64_t total = getCount();
+    if (total == 0) {
+        return 0;
+    }
+    // The rank of the value, rounded up so that percent 0 finds the smallest.
+    uint64_t rank = (total * percent + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return i == 0 ? 0 : (1ULL << i) - 1;
+        }
+    }
+    return (1ULL << (kNumBuckets - 1)) - 1;
+}
+
+void Log2Histogram::dump(String8& dump, const char* name, const char* unit) const {
+    uint64_t count = getCount();
+    dump.appendFormat("    %s: count=%" PRIu64, name, count);
+    if (count == 0) {
+        dump.append("\n");
+        return;
+    }
+    dump.appendFormat(" p50<=%" PRIu64 "%s p90<=%" PRIu64 "%s p99<=%" PRIu64 "%s\n",
+            getPercentile(50), unit, getPercentile(90), unit, getPercentile(99), unit);
+    dump.append("     ");
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        uint64_t bucketCount = mBuckets[i].load(std::memory_order_relaxed);
+        if (bucketCount != 0) {
+            dump.appendFormat(" <%" PRIu64 ":%" PRIu64, 1ULL << i, bucketCount);
+        }
+    }
+    dump.append("\n");
+}
+
+InputLatencyStats::InputLatencyStats(const std::string& deviceName) :
+    mWakeCounterName("evdev wake latency us " + deviceName),
+    mReportCounterName("evdev report latency us " + deviceName),
+    mDroppedCounterName("evdev dropped " + deviceName) {}
+
+void InputLatencyStats::recordRead(const InputEvent* events, size_t count, nsecs_t now) {
+    mBatchSize.record(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (events[i].type != EV_SYN) {
+            continue;
+        }
+        if (events[i].code == SYN_REPORT) {
+            uint64_t latency = latencyUs(events[i].when, now);
+            mWakeLatency.record(latency);
+            ATRACE_INT64(mWakeCounterName.c_str(), latency);
+        } else if (events[i].code == SYN_DROPPED) {
+            uint64_t dropped = mDroppedCount.fetch_add(1, std::memory_order_relaxed) + 1;
+            ATRACE_INT64(mDroppedCounterName.c_str(), dropped);
+        }
+    }
+}
+
+void InputLatencyStats::recordReport(nsecs_t now) {
+    uint64_t latency = latencyUs(mFrameTime, now);
+    mReportLatency.record(latency);
+    ATRACE_INT64(mReportCounterName.c_str(), latency);
+}
+
+void InputLatencyStats::dump(String8& dump) const {
+    mWakeLatency.dump(dump, "wake latency", "us");
+    mReportLatency.dump(dump, "report latency", "us");
+    mBatchSize.dump(dump, "events per read", "");
+    dump.appendFormat("    SYN_DROPPED: %" PRIu64 "\n", getDroppedCount());
+}
+
+}  // namespace android
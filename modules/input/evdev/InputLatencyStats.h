@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INPUT_LATENCY_STATS_H_
+#define ANDROID_INPUT_LATENCY_STATS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+struct InputEvent;
+
+/**
+ * A histogram with power of two buckets: bucket 0 counts the values of 0, and
+ * bucket i the values in [2^(i-1), 2^i). The last bucket also counts all the
+ * larger values. Recording and reading are lock-free.
+ */
+class Log2Histogram {
+public:
+    static const size_t kNumBuckets = 24;
+
+    Log2Histogram() = default;
+
+    void record(uint64_t value);
+
+    uint64_t getCount() const;
+    uint64_t getBucketCount(size_t bucket) const;
+    /**
+     * Returns the upper bound of the bucket holding the given percentile of
+     * the values, or 0 if there are none.
+     */
+    uint64_t getPercentile(uint32_t percent) const;
+
+    void dump(String8& dump, const char* name, const char* unit) const;
+
+    Log2Histogram(const Log2Histogram& rhs) = delete;
+    Log2Histogram& operator=(const Log2Histogram& rhs) = delete;
+
+private:
+    std::atomic<uint64_t> mBuckets[kNumBuckets] = {};
+};
+
+/**
+ * InputLatencyStats measures how long the input of a device takes to go
+ * through the HAL, from the kernel timestamp of each frame to the poll thread
+ * waking up for it, and to the report sent for it. It also counts the events
+ * read at once and the SYN_DROPPED events.
+ *
+ * The latencies are also exported as atrace counters, named after the device,
+ * when input tracing is enabled.
+ *
+ * Recording is done from the poll thread only. The stats can be dumped from
+ * any thread.
+ */
+class InputLatencyStats {
+public:
+    explicit InputLatencyStats(const std::string& deviceName);
+
+    /** Records a batch of events, read from the device at time now. */
+    void recordRead(const InputEvent* events, size_t count, nsecs_t now);
+
+    /** Marks the start of the processing of a frame with the given timestamp. */
+    void beginFrame(nsecs_t when) { mFrameTime = when; }
+    /** Records that a report for the current frame was sent at time now. */
+    void recordReport(nsecs_t now);
+
+    const Log2Histogram& getWakeLatency() const { return mWakeLatency; }
+    const Log2Histogram& getReportLatency() const { return mReportLatency; }
+    const Log2Histogram& getBatchSize() const { return mBatchSize; }
+    uint64_t getDroppedCount() const { return mDroppedCount.load(std::memory_order_relaxed); }
+
+    void dump(String8& dump) const;
+
+private:
+    const std::string mWakeCounterName;
+    const std::string mReportCounterName;
+    const std::string mDroppedCounterName;
+
+    Log2Histogram mWakeLatency;
+    Log2Histogram mReportLatency;
+    Log2Histogram mBatchSize;
+    std::atomic<uint64_t> mDroppedCount{0};
+
+    nsecs_t mFrameTime = 0;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_INPUT_LATENCY_STATS_H_
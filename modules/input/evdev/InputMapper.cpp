@@ -17,14 +17,39 @@
 #include "InputMapper.h"
 
 #include "InputHost.h"
+#include "InputHub.h"
+#include "InputLatencyStats.h"
+#include "InputReportPool.h"
 
 namespace android {
 
+void InputMapper::processFrame(const InputEvent* events, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        process(events[i]);
+    }
+}
+
 InputReport* InputMapper::getInputReport() {
     if (mReport) return mReport;
     if (mInputReportDef == nullptr) return nullptr;
-    mReport = mInputReportDef->allocateReport();
+    if (mReportPool != nullptr) {
+        mReport = mReportPool->acquire(mInputReportDef);
+    } else {
+        mReport = mInputReportDef->allocateReport();
+    }
     return mReport;
 }
 
+void InputMapper::sendInputReport() {
+    InputReport* report = getInputReport();
+    report->reportEvent(mDeviceHandle);
+    if (mLatencyStats != nullptr) {
+        mLatencyStats->recordReport(systemTime(SYSTEM_TIME_MONOTONIC));
+    }
+    if (mReportPool != nullptr) {
+        mReportPool->release(report);
+        mReport = nullptr;
+    }
+}
+
 }  // namespace android
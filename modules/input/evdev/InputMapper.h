@@ -17,13 +17,17 @@
 #ifndef ANDROID_INPUT_MAPPER_H_
 #define ANDROID_INPUT_MAPPER_H_
 
+#include <cstddef>
+
 struct input_device_handle;
 
 namespace android {
 
 class InputDeviceNode;
+class InputLatencyStats;
 class InputReport;
 class InputReportDefinition;
+class InputReportPool;
 struct InputEvent;
 using InputDeviceHandle = struct input_device_handle;
 
@@ -61,8 +65,14 @@ public:
 
     // Set the InputDeviceHandle after registering the device with the host.
     virtual void setDeviceHandle(InputDeviceHandle* handle) { mDeviceHandle = handle; }
+    // Set the pool to take the input report from, instead of allocating it.
+    virtual void setReportPool(InputReportPool* pool) { mReportPool = pool; }
+    // Set the stats to record the latency of the input reports in.
+    virtual void setLatencyStats(InputLatencyStats* stats) { mLatencyStats = stats; }
     // Process the InputEvent.
     virtual void process(const InputEvent& event) = 0;
+    // Process the InputEvents of one frame, ending with an EV_SYN/SYN_REPORT.
+    virtual void processFrame(const InputEvent* events, size_t count);
 
 protected:
     virtual void setInputReportDefinition(InputReportDefinition* reportDef) final {
@@ -75,12 +85,16 @@ protected:
     virtual InputReportDefinition* getOutputReportDefinition() final { return mOutputReportDef; }
     virtual InputDeviceHandle* getDeviceHandle() final { return mDeviceHandle; }
     virtual InputReport* getInputReport() final;
+    // Report the input report, returning it to the pool.
+    virtual void sendInputReport() final;
 
 private:
     InputReportDefinition* mInputReportDef = nullptr;
     InputReportDefinition* mOutputReportDef = nullptr;
     InputDeviceHandle* mDeviceHandle = nullptr;
     InputReport* mReport = nullptr;
+    InputReportPool* mReportPool = nullptr;
+    InputLatencyStats* mLatencyStats = nullptr;
 };
 
 }  // namespace android
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputReportPool"
+//#define LOG_NDEBUG 0
+
+#include "InputReportPool.h"
+
+#include <utils/Log.h>
+
+#include "InputHost.h"
+
+namespace android {
+
+InputReportPool::~InputReportPool() {
+    for (const auto& entry : mEntries) {
+        entry.reportDef->freeReport(entry.report);
+    }
+}
+
+void InputReportPool::reserve(InputReportDefinition* reportDef, size_t count) {
+    mEntries.reserve(mEntries.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        allocate(reportDef, false);
+    }
+}
+
+InputReport* InputReportPool::acquire(InputReportDefinition* reportDef) {
+    for (auto& entry : mEntries) {
+        if (entry.reportDef == reportDef && !entry.inUse) {
+            entry.inUse = true;
+            return entry.report;
+        }
+    }
+    ALOGV("no free report, allocating one");
+    return allocate(reportDef, true);
+}
+
+void InputReportPool::release(InputReport* report) {
+    for (auto& entry : mEntries) {
+        if (entry.report == report) {
+            entry.inUse = false;
+            return;
+        }
+    }
+    ALOGW("released a report that is not from the pool");
+}
+
+InputReport* InputReportPool::allocate(InputReportDefinition* reportDef, bool inUse) {
+    InputReport* report = reportDef->allocateReport();
+    if (report == nullptr) {
+        ALOGE("could not allocate a report");
+        return nullptr;
+    }
+    mEntries.push_back({ reportDef, report, inUse });
+    mAllocationCount++;
+    return report;
+}
+
+}  // namespace android
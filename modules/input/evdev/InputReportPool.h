@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INPUT_REPORT_POOL_H_
+#define ANDROID_INPUT_REPORT_POOL_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace android {
+
+class InputReport;
+class InputReportDefinition;
+
+/**
+ * InputReportPool keeps the InputReports of a device, allocated from their
+ * definitions when the device is configured and recycled after each
+ * reportEvent, so that processing input allocates nothing.
+ *
+ * The reports are freed through their definitions with the pool, so the
+ * definitions must outlive it.
+ */
+class InputReportPool {
+public:
+    InputReportPool() = default;
+    ~InputReportPool();
+
+    /** Allocates count reports for the definition ahead of their use. */
+    void reserve(InputReportDefinition* reportDef, size_t count);
+
+    /**
+     * Returns a free report for the definition, only allocating one if all of
+     * them are in use.
+     */
+    InputReport* acquire(InputReportDefinition* reportDef);
+    /** Returns the report to the pool once it has been reported. */
+    void release(InputReport* report);
+
+    /** Returns the number of reports allocated so far. */
+    size_t getAllocationCount() const { return mAllocationCount; }
+
+    InputReportPool(const InputReportPool& rhs) = delete;
+    InputReportPool& operator=(const InputReportPool& rhs) = delete;
+
+private:
+    struct Entry {
+        InputReportDefinition* reportDef;
+        InputReport* report;
+        bool inUse;
+    };
+
+    InputReport* allocate(InputReportDefinition* reportDef, bool inUse);
+
+    std::vector<Entry> mEntries;
+    size_t mAllocationCount = 0;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_INPUT_REPORT_POOL_H_
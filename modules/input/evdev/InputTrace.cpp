@@ -0,0 +1,621 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputTrace"
+//#define LOG_NDEBUG 0
+
+#include "InputTrace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android/input.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+static constexpr bool isMtSlotAxis(int32_t axis) {
+    return axis >= ABS_MT_TOUCH_MAJOR && axis <= ABS_MT_TOOL_Y;
+}
+
+// Strings are written up to the end of their line.
+static std::string sanitize(const std::string& s) {
+    std::string result = s;
+    std::replace(result.begin(), result.end(), '\n', ' ');
+    return result;
+}
+
+template<typename Predicate>
+static void appendCodes(String8& record, const char* tag, int id, int32_t max, Predicate has) {
+    String8 codes;
+    for (int32_t code = 0; code <= max; ++code) {
+        if (has(code)) {
+            codes.appendFormat(" %d", code);
+        }
+    }
+    if (codes.length() > 0) {
+        record.appendFormat("%s %d%s\n", tag, id, codes.string());
+    }
+}
+
+InputTraceRecorder::InputTraceRecorder(const std::shared_ptr<InputCallbackInterface>& callback,
+        int fd) :
+    mCallback(callback), mFd(fd) {}
+
+void InputTraceRecorder::onInputEvent(const std::shared_ptr<InputDeviceNode>& node,
+        InputEvent& event, nsecs_t event_time) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        int id = getDeviceId(node.get());
+        if (id >= 0) {
+            String8 record;
+            record.appendFormat("event %d %" PRId64 " %d %d %d\n", id, event.when, event.type,
+                    event.code, event.value);
+            write(record);
+        }
+    }
+    mCallback->onInputEvent(node, event, event_time);
+}
+
+void InputTraceRecorder::onInputFrame(const std::shared_ptr<InputDeviceNode>& node,
+        InputEvent* events, size_t count, nsecs_t event_time) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        int id = getDeviceId(node.get());
+        if (id >= 0) {
+            String8 record;
+            for (size_t i = 0; i < count; ++i) {
+                record.appendFormat("event %d %" PRId64 " %d %d %d\n", id, events[i].when,
+                        events[i].type, events[i].code, events[i].value);
+            }
+            write(record);
+        }
+    }
+    mCallback->onInputFrame(node, events, count, event_time);
+}
+
+void InputTraceRecorder::onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        int id = mNextDeviceId++;
+        mDeviceIds[node.get()] = id;
+
+        String8 record;
+        record.appendFormat("device %d %u %04x %04x %04x\n", id, node->getBusType(),
+                node->getVendorId(), node->getProductId(), node->getVersion());
+        record.appendFormat("path %d %s\n", id, sanitize(node->getPath()).c_str());
+        record.appendFormat("name %d %s\n", id, sanitize(node->getName()).c_str());
+        record.appendFormat("location %d %s\n", id, sanitize(node->getLocation()).c_str());
+        record.appendFormat("uniqueid %d %s\n", id, sanitize(node->getUniqueId()).c_str());
+        appendCodes(record, "keys", id, KEY_MAX, [&](int32_t c) { return node->hasKey(c); });
+        appendCodes(record, "rel", id, REL_MAX,
+                [&](int32_t c) { return node->hasRelativeAxis(c); });
+        appendCodes(record, "sw", id, SW_MAX, [&](int32_t c) { return node->hasSwitch(c); });
+        appendCodes(record, "ff", id, FF_MAX,
+                [&](int32_t c) { return node->hasForceFeedback(c); });
+        appendCodes(record, "props", id, INPUT_PROP_MAX,
+                [&](int32_t c) { return node->hasInputProperty(c); });
+        for (int32_t axis = 0; axis <= ABS_MAX; ++axis) {
+            const AbsoluteAxisInfo* info = node->getAbsoluteAxisInfo(axis);
+            if (info != nullptr) {
+                record.appendFormat("abs %d %d %d %d %d %d %d\n", id, axis, info->minValue,
+                        info->maxValue, info->flat, info->fuzz, info->resolution);
+            }
+        }
+        write(record);
+    }
+    mCallback->onDeviceAdded(node);
+}
+
+void InputTraceRecorder::onDeviceRemoved(const std::shared_ptr<InputDeviceNode>& node) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        int id = getDeviceId(node.get());
+        if (id >= 0) {
+            String8 record;
+            record.appendFormat("remove %d\n", id);
+            write(record);
+            mDeviceIds.erase(node.get());
+        }
+    }
+    mCallback->onDeviceRemoved(node);
+}
+
+int InputTraceRecorder::getDeviceId(const InputDeviceNode* node) {
+    auto iter = mDeviceIds.find(node);
+    if (iter == mDeviceIds.end()) {
+        ALOGW("not recording the input of an unknown device");
+        return -1;
+    }
+    return iter->second;
+}
+
+void InputTraceRecorder::write(const String8& record) {
+    const char* data = record.string();
+    size_t size = record.length();
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(::write(mFd, data, size));
+        if (n < 0) {
+            ALOGE("could not write input trace. errno=%d", errno);
+            return;
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+ReplayDeviceNode::ReplayDeviceNode(const InputTraceDevice& device) :
+    mDevice(device), mLatencyStats(device.path) {}
+
+bool ReplayDeviceNode::hasKey(int32_t key) const {
+    return key >= 0 && key <= KEY_MAX && mDevice.keys[key];
+}
+
+bool ReplayDeviceNode::hasKeyInRange(int32_t startKey, int32_t endKey) const {
+    for (int32_t key = std::max(startKey, 0); key < endKey && key <= KEY_MAX; ++key) {
+        if (mDevice.keys[key]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ReplayDeviceNode::hasRelativeAxis(int32_t axis) const {
+    return axis >= 0 && axis <= REL_MAX && mDevice.relAxes[axis];
+}
+
+bool ReplayDeviceNode::hasAbsoluteAxis(int32_t axis) const {
+    return mDevice.absAxes.count(axis) != 0;
+}
+
+bool ReplayDeviceNode::hasSwitch(int32_t sw) const {
+    return sw >= 0 && sw <= SW_MAX && mDevice.switches[sw];
+}
+
+bool ReplayDeviceNode::hasForceFeedback(int32_t ff) const {
+    return ff >= 0 && ff <= FF_MAX && mDevice.forceFeedback[ff];
+}
+
+bool ReplayDeviceNode::hasInputProperty(int property) const {
+    return property >= 0 && property <= INPUT_PROP_MAX && mDevice.properties[property];
+}
+
+int32_t ReplayDeviceNode::getKeyState(int32_t key) const {
+    if (!hasKey(key)) {
+        return AKEY_STATE_UNKNOWN;
+    }
+    return mKeyState[key] ? AKEY_STATE_DOWN : AKEY_STATE_UP;
+}
+
+int32_t ReplayDeviceNode::getSwitchState(int32_t sw) const {
+    if (!hasSwitch(sw)) {
+        return AKEY_STATE_UNKNOWN;
+    }
+    return mSwState[sw] ? AKEY_STATE_DOWN : AKEY_STATE_UP;
+}
+
+const AbsoluteAxisInfo* ReplayDeviceNode::getAbsoluteAxisInfo(int32_t axis) const {
+    auto iter = mDevice.absAxes.find(axis);
+    return iter != mDevice.absAxes.end() ? &iter->second : nullptr;
+}
+
+status_t ReplayDeviceNode::getAbsoluteAxisValue(int32_t axis, int32_t* outValue) const {
+    *outValue = 0;
+    if (!hasAbsoluteAxis(axis)) {
+        return -1;
+    }
+    if (isMtSlotAxis(axis)) {
+        // Like the driver, report the value of the current slot.
+        *outValue = getMtSlotValue(axis, mAbsValues[ABS_MT_SLOT]);
+    } else {
+        *outValue = mAbsValues[axis];
+    }
+    return OK;
+}
+
+status_t ReplayDeviceNode::getAbsoluteMtSlotValues(int32_t axis, int32_t* outValues,
+        size_t numSlots) const {
+    if (!hasAbsoluteAxis(axis) || !isMtSlotAxis(axis)) {
+        return BAD_VALUE;
+    }
+    for (size_t slot = 0; slot < numSlots; ++slot) {
+        outValues[slot] = getMtSlotValue(axis, slot);
+    }
+    return OK;
+}
+
+int32_t ReplayDeviceNode::getMtSlotValue(int32_t axis, int32_t slot) const {
+    auto iter = mMtSlotValues.find(axis);
+    if (iter != mMtSlotValues.end() && slot >= 0 &&
+            static_cast<size_t>(slot) < iter->second.size()) {
+        return iter->second[slot];
+    }
+    // Slots not replayed yet have no contact.
+    return axis == ABS_MT_TRACKING_ID ? -1 : 0;
+}
+
+void ReplayDeviceNode::updateState(const InputEvent& event) {
+    switch (event.type) {
+        case EV_KEY:
+            if (event.code >= 0 && event.code <= KEY_MAX) {
+                mKeyState[event.code] = event.value != 0;
+            }
+            break;
+        case EV_SW:
+            if (event.code >= 0 && event.code <= SW_MAX) {
+                mSwState[event.code] = event.value != 0;
+            }
+            break;
+        case EV_ABS:
+            if (event.code == ABS_MT_SLOT) {
+                // Like the kernel, ignore a slot the device does not have.
+                auto iter = mDevice.absAxes.find(ABS_MT_SLOT);
+                if (iter != mDevice.absAxes.end() && event.value >= 0 &&
+                        event.value <= iter->second.maxValue) {
+                    mAbsValues[ABS_MT_SLOT] = event.value;
+                }
+            } else if (isMtSlotAxis(event.code)) {
+                int32_t slot = mAbsValues[ABS_MT_SLOT];
+                if (slot < 0) {
+                    break;
+                }
+                auto& values = mMtSlotValues[event.code];
+                if (values.size() <= static_cast<size_t>(slot)) {
+                    values.resize(slot + 1, event.code == ABS_MT_TRACKING_ID ? -1 : 0);
+                }
+                values[slot] = event.value;
+            } else if (event.code >= 0 && event.code <= ABS_MAX) {
+                mAbsValues[event.code] = event.value;
+            }
+            break;
+    }
+}
+
+status_t InputTracePlayer::load(const std::string& path) {
+    int fd = TEMP_FAILURE_RETRY(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        ALOGE("could not open input trace %s. errno=%d", path.c_str(), errno);
+        return -errno;
+    }
+    std::string trace;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = TEMP_FAILURE_RETRY(::read(fd, buffer, sizeof(buffer)))) > 0) {
+        trace.append(buffer, n);
+    }
+    ::close(fd);
+    if (n < 0) {
+        ALOGE("could not read input trace %s. errno=%d", path.c_str(), errno);
+        return -errno;
+    }
+    return parse(trace);
+}
+
+status_t InputTracePlayer::parse(const std::string& trace) {
+    mDevices.clear();
+    mRecords.clear();
+    mEventCount = 0;
+
+    size_t lineNumber = 0;
+    size_t pos = 0;
+    while (pos < trace.size()) {
+        size_t end = trace.find('\n', pos);
+        if (end == std::string::npos) {
+            end = trace.size();
+        }
+        std::string line = trace.substr(pos, end - pos);
+        pos = end + 1;
+        lineNumber++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        char tag[16];
+        int id;
+        int consumed = 0;
+        if (sscanf(line.c_str(), "%15s %d%n", tag, &id, &consumed) != 2) {
+            ALOGE("malformed input trace at line %zu", lineNumber);
+            return BAD_VALUE;
+        }
+        // The rest of the line, without the space that separates it.
+        const char* rest = line.c_str() + consumed;
+        if (*rest == ' ') {
+            rest++;
+        }
+
+        if (strcmp(tag, "device") == 0) {
+            unsigned int bus, vendor, product, version;
+            if (mDevices.count(id) != 0 ||
+                    sscanf(rest, "%u %x %x %x", &bus, &vendor, &product, &version) != 4) {
+                ALOGE("malformed input trace device at line %zu", lineNumber);
+                return BAD_VALUE;
+            }
+            InputTraceDevice& device = mDevices[id];
+            device.busType = bus;
+            device.vendorId = vendor;
+            device.productId = product;
+            device.version = version;
+            mRecords.push_back({ Record::Type::ADD, id, {} });
+            continue;
+        }
+
+        auto deviceIter = mDevices.find(id);
+        if (deviceIter == mDevices.end()) {
+            ALOGE("input trace refers to unknown device %d at line %zu", id, lineNumber);
+            return BAD_VALUE;
+        }
+        InputTraceDevice& device = deviceIter->second;
+
+        if (strcmp(tag, "event") == 0) {
+            InputEvent event;
+            if (sscanf(rest, "%" SCNd64 " %d %d %d", &event.when, &event.type, &event.code,
+                    &event.value) != 4) {
+                ALOGE("malformed input trace event at line %zu", lineNumber);
+                return BAD_VALUE;
+            }
+            if (event.type == EV_ABS && event.code == ABS_MT_SLOT) {
+                auto axisIter = device.absAxes.find(ABS_MT_SLOT);
+                if (axisIter == device.absAxes.end() || event.value < 0 ||
+                        event.value > axisIter->second.maxValue) {
+                    ALOGE("input trace slot %d out of range at line %zu", event.value,
+                            lineNumber);
+                    return BAD_VALUE;
+                }
+            }
+            mRecords.push_back({ Record::Type::EVENT, id, event });
+            mEventCount++;
+        } else if (strcmp(tag, "remove") == 0) {
+            mRecords.push_back({ Record::Type::REMOVE, id, {} });
+        } else if (strcmp(tag, "path") == 0) {
+            device.path = rest;
+        } else if (strcmp(tag, "name") == 0) {
+            device.name = rest;
+        } else if (strcmp(tag, "location") == 0) {
+            device.location = rest;
+        } else if (strcmp(tag, "uniqueid") == 0) {
+            device.uniqueId = rest;
+        } else if (strcmp(tag, "abs") == 0) {
+            int32_t axis;
+            AbsoluteAxisInfo info;
+            if (sscanf(rest, "%d %d %d %d %d %d", &axis, &info.minValue, &info.maxValue,
+                    &info.flat, &info.fuzz, &info.resolution) != 6 ||
+                    axis < 0 || axis > ABS_MAX) {
+                ALOGE("malformed input trace axis at line %zu", lineNumber);
+                return BAD_VALUE;
+            }
+            device.absAxes[axis] = info;
+        } else {
+            std::vector<int32_t> codes;
+            char* next = const_cast<char*>(rest);
+            while (*next != '\0') {
+                char* codeEnd;
+                long code = strtol(next, &codeEnd, 10);
+                if (codeEnd == next) {
+                    break;
+                }
+                codes.push_back(code);
+                next = codeEnd;
+            }
+
+            bool valid = true;
+            for (int32_t code : codes) {
+                if (strcmp(tag, "keys") == 0 && code >= 0 && code <= KEY_MAX) {
+                    device.keys.set(code);
+                } else if (strcmp(tag, "rel") == 0 && code >= 0 && code <= REL_MAX) {
+                    device.relAxes.set(code);
+                } else if (strcmp(tag, "sw") == 0 && code >= 0 && code <= SW_MAX) {
+                    device.switches.set(code);
+                } else if (strcmp(tag, "ff") == 0 && code >= 0 && code <= FF_MAX) {
+                    device.forceFeedback.set(code);
+                } else if (strcmp(tag, "props") == 0 && code >= 0 && code <= INPUT_PROP_MAX) {
+                    device.properties.set(code);
+                } else {
+                    valid = false;
+                }
+            }
+            if (!valid || codes.empty()) {
+                ALOGE("malformed input trace record \"%s\" at line %zu", tag, lineNumber);
+                return BAD_VALUE;
+            }
+        }
+    }
+    ALOGV("parsed input trace of %zu devices and %zu events", mDevices.size(), mEventCount);
+    return OK;
+}
+
+static void sleepUntil(nsecs_t when) {
+    struct timespec ts;
+    ts.tv_sec = when / 1000000000LL;
+    ts.tv_nsec = when % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+}
+
+namespace {
+
+// Passes on what the InputHub reports, counting the frames and removals so
+// that the player knows when the hub is done with what it wrote.
+class ReplayCallback : public InputCallbackInterface {
+public:
+    explicit ReplayCallback(InputCallbackInterface* callback) : mCallback(callback) {}
+
+    virtual void onInputEvent(const std::shared_ptr<InputDeviceNode>& node, InputEvent& event,
+            nsecs_t event_time) override {
+        mCallback->onInputEvent(node, event, event_time);
+    }
+    virtual void onInputFrame(const std::shared_ptr<InputDeviceNode>& node, InputEvent* events,
+            size_t count, nsecs_t event_time) override {
+        frameCount++;
+        mCallback->onInputFrame(node, events, count, event_time);
+    }
+    virtual void onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) override {
+        mCallback->onDeviceAdded(node);
+    }
+    virtual void onDeviceRemoved(const std::shared_ptr<InputDeviceNode>& node) override {
+        removedCount++;
+        mCallback->onDeviceRemoved(node);
+    }
+
+    size_t frameCount = 0;
+    size_t removedCount = 0;
+
+private:
+    InputCallbackInterface* mCallback;
+};
+
+}  // namespace
+
+// Writes a frame to fd, in writes small enough for the pipe not to split an
+// event, polling the hub whenever the pipe is full.
+static status_t writeFrame(int fd, const std::vector<InputEvent>& frame, InputHub* hub) {
+    std::vector<struct input_event> ievs(frame.size());
+    for (size_t i = 0; i < frame.size(); ++i) {
+        ievs[i].time.tv_sec = frame[i].when / 1000000000LL;
+        ievs[i].time.tv_usec = (frame[i].when % 1000000000LL) / 1000;
+        ievs[i].type = frame[i].type;
+        ievs[i].code = frame[i].code;
+        ievs[i].value = frame[i].value;
+    }
+
+    const size_t maxEvents = PIPE_BUF / sizeof(struct input_event);
+    size_t written = 0;
+    while (written < ievs.size()) {
+        size_t count = std::min(ievs.size() - written, maxEvents);
+        ssize_t n = TEMP_FAILURE_RETRY(::write(fd, &ievs[written],
+                count * sizeof(struct input_event)));
+        if (n < 0 && errno == EAGAIN) {
+            hub->poll();
+        } else if (n < 0) {
+            ALOGE("could not write replayed events. errno=%d", errno);
+            return -errno;
+        } else {
+            written += n / sizeof(struct input_event);
+        }
+    }
+    return OK;
+}
+
+status_t InputTracePlayer::replay(InputCallbackInterface* callback, double speed) {
+    mNodes.clear();
+    auto replayCallback = std::make_shared<ReplayCallback>(callback);
+    InputHub hub(replayCallback);
+    // Write ends of the pipes the devices are read from, by device id
+    std::map<int, int> fds;
+    std::map<int, std::vector<InputEvent>> frames;
+    size_t framesWritten = 0;
+    size_t devicesRemoved = 0;
+    status_t status = OK;
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t firstWhen = -1;
+    for (const auto& record : mRecords) {
+        switch (record.type) {
+            case Record::Type::ADD: {
+                auto node = std::make_shared<ReplayDeviceNode>(mDevices[record.deviceId]);
+                int pipeFds[2];
+                if (pipe2(pipeFds, O_NONBLOCK | O_CLOEXEC)) {
+                    ALOGE("could not create a pipe for %s. errno=%d", node->getPath().c_str(),
+                            errno);
+                    break;
+                }
+                if (hub.addDeviceNode(pipeFds[0], node) != OK) {
+                    ::close(pipeFds[0]);
+                    ::close(pipeFds[1]);
+                    break;
+                }
+                fds[record.deviceId] = pipeFds[1];
+                mNodes.push_back(node);
+                break;
+            }
+            case Record::Type::REMOVE: {
+                auto iter = fds.find(record.deviceId);
+                if (iter != fds.end()) {
+                    // The hub removes the device once it reads the end of
+                    // the pipe.
+                    ::close(iter->second);
+                    fds.erase(iter);
+                    frames.erase(record.deviceId);
+                    devicesRemoved++;
+                    while (replayCallback->removedCount < devicesRemoved) {
+                        hub.poll();
+                    }
+                }
+                break;
+            }
+            case Record::Type::EVENT: {
+                auto iter = fds.find(record.deviceId);
+                if (iter == fds.end()) {
+                    break;
+                }
+                InputEvent event = record.event;
+                if (speed > 0) {
+                    if (firstWhen < 0) {
+                        firstWhen = event.when;
+                    }
+                    event.when = start + static_cast<nsecs_t>((event.when - firstWhen) / speed);
+                }
+                auto& frame = frames[record.deviceId];
+                frame.push_back(event);
+                if (event.type != EV_SYN || event.code != SYN_REPORT) {
+                    break;
+                }
+
+                if (speed > 0) {
+                    sleepUntil(event.when);
+                } else {
+                    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+                    for (auto& frameEvent : frame) {
+                        frameEvent.when = now;
+                    }
+                }
+                status = writeFrame(iter->second, frame, &hub);
+                if (status != OK) {
+                    // The frame will never be delivered.
+                    break;
+                }
+                frame.clear();
+                framesWritten++;
+                while (replayCallback->frameCount < framesWritten) {
+                    hub.poll();
+                }
+                break;
+            }
+        }
+        if (status != OK) {
+            break;
+        }
+    }
+
+    for (const auto& pair : fds) {
+        ::close(pair.second);
+        devicesRemoved++;
+    }
+    while (replayCallback->removedCount < devicesRemoved) {
+        hub.poll();
+    }
+    return status;
+}
+
+}  // namespace android
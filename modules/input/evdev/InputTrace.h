@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INPUT_TRACE_H_
+#define ANDROID_INPUT_TRACE_H_
+
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <linux/input.h>
+
+#include <utils/Errors.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "InputHub.h"
+#include "InputLatencyStats.h"
+
+namespace android {
+
+/**
+ * What an input trace records about a device: what the InputDeviceNode
+ * interface tells about it.
+ */
+struct InputTraceDevice {
+    std::string path;
+    std::string name;
+    std::string location;
+    std::string uniqueId;
+    uint16_t busType = 0;
+    uint16_t vendorId = 0;
+    uint16_t productId = 0;
+    uint16_t version = 0;
+
+    std::bitset<KEY_CNT> keys;
+    std::bitset<REL_CNT> relAxes;
+    std::bitset<SW_CNT> switches;
+    std::bitset<FF_CNT> forceFeedback;
+    std::bitset<INPUT_PROP_CNT> properties;
+    std::map<int32_t, AbsoluteAxisInfo> absAxes;
+};
+
+/**
+ * InputTraceRecorder records the devices and events an InputHub reports to a
+ * trace file, passing them on to the callback it wraps. The trace is a text
+ * file of one record per line:
+ *
+ *   device <id> <bus> <vendor> <product> <version>
+ *   path|name|location|uniqueid <id> <rest of the line>
+ *   keys|rel|sw|ff|props <id> <code>...
+ *   abs <id> <axis> <min> <max> <flat> <fuzz> <resolution>
+ *   event <id> <when> <type> <code> <value>
+ *   remove <id>
+ *
+ * The ids, bus and codes are decimal, the vendor, product and version
+ * hexadecimal, and the times in nanoseconds.
+ */
+class InputTraceRecorder : public InputCallbackInterface {
+public:
+    /** Writes the trace to fd, which the recorder does not own. */
+    InputTraceRecorder(const std::shared_ptr<InputCallbackInterface>& callback, int fd);
+    virtual ~InputTraceRecorder() override = default;
+
+    virtual void onInputEvent(const std::shared_ptr<InputDeviceNode>& node, InputEvent& event,
+            nsecs_t event_time) override;
+    virtual void onInputFrame(const std::shared_ptr<InputDeviceNode>& node, InputEvent* events,
+            size_t count, nsecs_t event_time) override;
+    virtual void onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) override;
+    virtual void onDeviceRemoved(const std::shared_ptr<InputDeviceNode>& node) override;
+
+private:
+    int getDeviceId(const InputDeviceNode* node);
+    void write(const String8& record);
+
+    std::shared_ptr<InputCallbackInterface> mCallback;
+    int mFd;
+
+    std::mutex mLock;
+    std::unordered_map<const InputDeviceNode*, int> mDeviceIds;
+    int mNextDeviceId = 0;
+};
+
+/**
+ * ReplayDeviceNode is an InputDeviceNode for a device of a trace. Its state
+ * follows the events replayed through it.
+ */
+class ReplayDeviceNode : public InputDeviceNode {
+public:
+    explicit ReplayDeviceNode(const InputTraceDevice& device);
+    virtual ~ReplayDeviceNode() override = default;
+
+    virtual const std::string& getPath() const override { return mDevice.path; }
+    virtual const std::string& getName() const override { return mDevice.name; }
+    virtual const std::string& getLocation() const override { return mDevice.location; }
+    virtual const std::string& getUniqueId() const override { return mDevice.uniqueId; }
+
+    virtual uint16_t getBusType() const override { return mDevice.busType; }
+    virtual uint16_t getVendorId() const override { return mDevice.vendorId; }
+    virtual uint16_t getProductId() const override { return mDevice.productId; }
+    virtual uint16_t getVersion() const override { return mDevice.version; }
+
+    virtual bool hasKey(int32_t key) const override;
+    virtual bool hasKeyInRange(int32_t startKey, int32_t endKey) const override;
+    virtual bool hasRelativeAxis(int32_t axis) const override;
+    virtual bool hasAbsoluteAxis(int32_t axis) const override;
+    virtual bool hasSwitch(int32_t sw) const override;
+    virtual bool hasForceFeedback(int32_t ff) const override;
+    virtual bool hasInputProperty(int property) const override;
+
+    virtual int32_t getKeyState(int32_t key) const override;
+    virtual int32_t getSwitchState(int32_t sw) const override;
+    virtual const AbsoluteAxisInfo* getAbsoluteAxisInfo(int32_t axis) const override;
+    virtual status_t getAbsoluteAxisValue(int32_t axis, int32_t* outValue) const override;
+    virtual status_t getAbsoluteMtSlotValues(int32_t axis, int32_t* outValues,
+            size_t numSlots) const override;
+
+    virtual void vibrate(nsecs_t duration) override {}
+    virtual void cancelVibrate() override {}
+
+    virtual void disableDriverKeyRepeat() override {}
+
+    virtual InputLatencyStats* getLatencyStats() override { return &mLatencyStats; }
+
+    /** Updates the state of the device with a replayed event. */
+    virtual void updateState(const InputEvent& event) override;
+
+private:
+    int32_t getMtSlotValue(int32_t axis, int32_t slot) const;
+
+    const InputTraceDevice mDevice;
+
+    std::bitset<KEY_CNT> mKeyState;
+    std::bitset<SW_CNT> mSwState;
+    int32_t mAbsValues[ABS_CNT] = {};
+    // Values of the multi-touch axes, by slot
+    std::map<int32_t, std::vector<int32_t>> mMtSlotValues;
+
+    InputLatencyStats mLatencyStats;
+};
+
+/**
+ * InputTracePlayer replays a trace recorded by InputTraceRecorder to an
+ * InputCallbackInterface, such as the InputDeviceManager, through an InputHub:
+ * a device is added as a ReplayDeviceNode read from a pipe, and its events are
+ * written to the pipe a SYN_REPORT frame at a time.
+ */
+class InputTracePlayer {
+public:
+    InputTracePlayer() = default;
+
+    status_t load(const std::string& path);
+    status_t parse(const std::string& trace);
+
+    /**
+     * Replays the trace. With a speed of 1, the frames are delivered as far
+     * apart as they were recorded, with a speed of 2 twice as fast, and so on.
+     * With a speed of 0, they are delivered as fast as they are processed.
+     *
+     * The events are given the times they are written at, so that the
+     * latency stats of the devices measure the hub and the callback. Each
+     * frame is delivered before the next one is written. The devices still
+     * present at the end of the trace are removed.
+     *
+     * Returns OK, or the error of a write to a device that failed, which
+     * stops the replay.
+     */
+    status_t replay(InputCallbackInterface* callback, double speed);
+
+    size_t getDeviceCount() const { return mDevices.size(); }
+    size_t getEventCount() const { return mEventCount; }
+
+    /** Returns the nodes of the last replay, in the order they were added. */
+    const std::vector<std::shared_ptr<ReplayDeviceNode>>& getNodes() const { return mNodes; }
+
+private:
+    struct Record {
+        enum class Type { ADD, REMOVE, EVENT };
+        Type type;
+        int deviceId;
+        InputEvent event;
+    };
+
+    std::map<int, InputTraceDevice> mDevices;
+    std::vector<Record> mRecords;
+    size_t mEventCount = 0;
+
+    std::vector<std::shared_ptr<ReplayDeviceNode>> mNodes;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_INPUT_TRACE_H_
@@ -172,7 +172,7 @@ void MouseInputMapper::sync(nsecs_t when) {
     }
 
     // Report and reset.
-    getInputReport()->reportEvent(getDeviceHandle());
+    sendInputReport();
     mUpdatedButtonMask.clear();
     mButtonValues.clear();
     mRelX = 0;
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MultiTouchInputMapper"
+//#define LOG_NDEBUG 0
+
+#include "MultiTouchInputMapper.h"
+
+#include <linux/input.h>
+#include <hardware/input.h>
+#include <utils/Log.h>
+#include <utils/misc.h>
+
+#include "InputHost.h"
+#include "InputHub.h"
+
+namespace android {
+
+// Map multi-touch axes to input HAL usages. The index of an axis in this table
+// is the index of its value in a slot.
+static const struct {
+    int32_t code;
+    InputUsage usage;
+} axisMap[] = {
+    {ABS_MT_POSITION_X, INPUT_USAGE_AXIS_X},
+    {ABS_MT_POSITION_Y, INPUT_USAGE_AXIS_Y},
+    {ABS_MT_PRESSURE, INPUT_USAGE_AXIS_PRESSURE},
+    {ABS_MT_TOUCH_MAJOR, INPUT_USAGE_AXIS_TOUCH_MAJOR},
+    {ABS_MT_TOUCH_MINOR, INPUT_USAGE_AXIS_TOUCH_MINOR},
+    {ABS_MT_WIDTH_MAJOR, INPUT_USAGE_AXIS_TOOL_MAJOR},
+    {ABS_MT_WIDTH_MINOR, INPUT_USAGE_AXIS_TOOL_MINOR},
+    {ABS_MT_ORIENTATION, INPUT_USAGE_AXIS_ORIENTATION},
+};
+static_assert(NELEM(axisMap) == MultiTouchInputMapper::kNumAxes,
+        "kNumAxes must match the axis map");
+
+static int axisIndex(int32_t code) {
+    for (size_t i = 0; i < NELEM(axisMap); ++i) {
+        if (axisMap[i].code == code) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool MultiTouchInputMapper::configureInputReport(InputDeviceNode* devNode,
+        InputReportDefinition* report) {
+    auto slotInfo = devNode->getAbsoluteAxisInfo(ABS_MT_SLOT);
+    if (slotInfo == nullptr || slotInfo->maxValue < 0) {
+        ALOGW("Device %s has no multi-touch slots. Only protocol B is supported.",
+                devNode->getPath().c_str());
+        return false;
+    }
+    if (devNode->getAbsoluteAxisInfo(ABS_MT_POSITION_X) == nullptr ||
+            devNode->getAbsoluteAxisInfo(ABS_MT_POSITION_Y) == nullptr) {
+        ALOGE("Device %s is missing a multi-touch x or y axis. Device cannot be configured.",
+                devNode->getPath().c_str());
+        return false;
+    }
+
+    mDeviceNode = devNode;
+    mNumSlots = static_cast<size_t>(slotInfo->maxValue) + 1;
+    if (mNumSlots > kMaxSlots) {
+        ALOGW("Device %s has %zu slots. Only tracking the first %zu.",
+                devNode->getPath().c_str(), mNumSlots, kMaxSlots);
+        mNumSlots = kMaxSlots;
+    }
+
+    setInputReportDefinition(report);
+    getInputReportDefinition()->addCollection(INPUT_COLLECTION_ID_TOUCH, mNumSlots);
+    for (size_t i = 0; i < NELEM(axisMap); ++i) {
+        auto info = devNode->getAbsoluteAxisInfo(axisMap[i].code);
+        if (info == nullptr) {
+            continue;
+        }
+        mAxes.markBit(i);
+        getInputReportDefinition()->declareUsage(INPUT_COLLECTION_ID_TOUCH, axisMap[i].usage,
+                info->minValue, info->maxValue, info->resolution);
+    }
+    InputUsage usages[] = { INPUT_USAGE_BUTTON_PRIMARY };
+    getInputReportDefinition()->declareUsages(INPUT_COLLECTION_ID_TOUCH, usages, NELEM(usages));
+
+    devNode->getAbsoluteAxisValue(ABS_MT_SLOT, &mCurrentSlot);
+    return true;
+}
+
+void MultiTouchInputMapper::process(const InputEvent& event) {
+    ALOGV("processing multi-touch event. type=%d code=%d value=%d",
+            event.type, event.code, event.value);
+    switch (event.type) {
+        case EV_ABS:
+            // Everything up to the next SYN_REPORT is stale after a drop.
+            if (!mDropped) {
+                processAbs(event.code, event.value);
+            }
+            break;
+        case EV_SYN:
+            if (event.code == SYN_REPORT) {
+                if (mDropped) {
+                    resync();
+                }
+                sync(event.when);
+            } else if (event.code == SYN_DROPPED) {
+                ALOGW("Events dropped by %s. Resyncing at the next SYN_REPORT.",
+                        mDeviceNode->getPath().c_str());
+                mDropped = true;
+            }
+            break;
+        default:
+            ALOGV("unknown multi-touch event type: %d", event.type);
+    }
+}
+
+void MultiTouchInputMapper::processAbs(int32_t code, int32_t value) {
+    if (code == ABS_MT_SLOT) {
+        mCurrentSlot = value;
+        return;
+    }
+    if (mCurrentSlot < 0 || static_cast<size_t>(mCurrentSlot) >= mNumSlots) {
+        // An untracked slot. Ignore.
+        return;
+    }
+
+    Slot& slot = mSlots[mCurrentSlot];
+    if (code == ABS_MT_TRACKING_ID) {
+        slot.trackingId = value;
+        mDirty = true;
+        return;
+    }
+    int index = axisIndex(code);
+    if (index >= 0) {
+        slot.values[index] = value;
+        mDirty = true;
+    }
+}
+
+// Reads the state of every slot back from the driver, as the events that
+// would have described it were dropped.
+void MultiTouchInputMapper::resync() {
+    int32_t values[kMaxSlots];
+    if (mDeviceNode->getAbsoluteMtSlotValues(ABS_MT_TRACKING_ID, values, mNumSlots) == OK) {
+        for (size_t i = 0; i < mNumSlots; ++i) {
+            mSlots[i].trackingId = values[i];
+        }
+    } else {
+        // Lift every contact rather than keep ones that may have ended.
+        for (size_t i = 0; i < mNumSlots; ++i) {
+            mSlots[i].trackingId = -1;
+        }
+    }
+    for (size_t axis = 0; axis < NELEM(axisMap); ++axis) {
+        if (!mAxes.hasBit(axis) ||
+                mDeviceNode->getAbsoluteMtSlotValues(axisMap[axis].code, values,
+                        mNumSlots) != OK) {
+            continue;
+        }
+        for (size_t i = 0; i < mNumSlots; ++i) {
+            mSlots[i].values[axis] = values[i];
+        }
+    }
+    mDeviceNode->getAbsoluteAxisValue(ABS_MT_SLOT, &mCurrentSlot);
+
+    mDropped = false;
+    mDirty = true;
+}
+
+void MultiTouchInputMapper::sync(nsecs_t when) {
+    if (!mDirty) {
+        return;
+    }
+
+    mDirty = false;
+    bool changed = false;
+    for (size_t i = 0; i < mNumSlots; ++i) {
+        const Slot& slot = mSlots[i];
+        bool down = slot.trackingId >= 0;
+        if (!down && !mReportedSlots.hasBit(i)) {
+            continue;
+        }
+        changed = true;
+        if (down) {
+            for (size_t axis = 0; axis < NELEM(axisMap); ++axis) {
+                if (mAxes.hasBit(axis)) {
+                    getInputReport()->setIntUsage(INPUT_COLLECTION_ID_TOUCH,
+                            axisMap[axis].usage, slot.values[axis], i);
+                }
+            }
+            mReportedSlots.markBit(i);
+        } else {
+            mReportedSlots.clearBit(i);
+        }
+        getInputReport()->setBoolUsage(INPUT_COLLECTION_ID_TOUCH, INPUT_USAGE_BUTTON_PRIMARY,
+                down, i);
+    }
+
+    // Nothing to report if only contacts that are up changed.
+    if (changed) {
+        sendInputReport();
+    }
+}
+
+}  // namespace android
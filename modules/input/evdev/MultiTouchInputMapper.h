@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_MULTI_TOUCH_INPUT_MAPPER_H_
+#define ANDROID_MULTI_TOUCH_INPUT_MAPPER_H_
+
+#include <cstdint>
+
+#include <utils/BitSet.h>
+#include <utils/Timers.h>
+
+#include "InputMapper.h"
+
+namespace android {
+
+/**
+ * MultiTouchInputMapper handles touchscreens using the slot-based multi-touch
+ * protocol (type B). Each slot is a contact of the INPUT_COLLECTION_ID_TOUCH
+ * collection, at the arity index of the slot. A contact is down while its
+ * INPUT_USAGE_BUTTON_PRIMARY is set, and its axes are only reported while it is
+ * down. All the contacts of a frame go into a single report at its
+ * SYN_REPORT.
+ */
+class MultiTouchInputMapper : public InputMapper {
+public:
+    // The most contacts tracked, as for Android's MotionEvents.
+    static const size_t kMaxSlots = 16;
+    // The per-contact axes, in the order of the table in the source.
+    static const size_t kNumAxes = 8;
+
+    virtual ~MultiTouchInputMapper() = default;
+
+    virtual bool configureInputReport(InputDeviceNode* devNode,
+            InputReportDefinition* report) override;
+    virtual void process(const InputEvent& event) override;
+
+private:
+    struct Slot {
+        int32_t trackingId = -1;
+        int32_t values[kNumAxes] = {};
+    };
+
+    void processAbs(int32_t code, int32_t value);
+    void resync();
+    void sync(nsecs_t when);
+
+    InputDeviceNode* mDeviceNode = nullptr;
+
+    Slot mSlots[kMaxSlots];
+    size_t mNumSlots = 0;
+    int32_t mCurrentSlot = 0;
+
+    // The axes the device reports.
+    BitSet32 mAxes;
+    // The slots whose contacts were down in the last report.
+    BitSet32 mReportedSlots;
+    // Whether a contact changed since the last report.
+    bool mDirty = false;
+    // Whether events were dropped, after a SYN_DROPPED until the next
+    // SYN_REPORT.
+    bool mDropped = false;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_MULTI_TOUCH_INPUT_MAPPER_H_
@@ -140,7 +140,7 @@ void SwitchInputMapper::sync(nsecs_t when) {
                 mSwitchValues.hasBit(bit), 0);
         mUpdatedSwitchMask.clearBit(bit);
     }
-    getInputReport()->reportEvent(getDeviceHandle());
+    sendInputReport();
     mUpdatedSwitchMask.clear();
     mSwitchValues.clear();
 }
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Startup benchmark of hw_preload_modules: measures the time a process
+ * takes to get a set of modules, one after the other with hw_get_module, or
+ * after preloading them all with hw_preload_modules. Each measurement runs
+ * in a new process, where no module is loaded yet.
+ *
+ *   hw-preload-bench [-n runs] [module id...]
+ *
+ * The modules default to the hwpreload0 to hwpreload7 stub modules. The
+ * ro.hw.preload_threads property sets the threads hw_preload_modules loads
+ * them on. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hardware/hardware.h>
+
+#define MAX_RUNS 1000
+
+static const char *const stub_ids[] = {
+    "hwpreload0", "hwpreload1", "hwpreload2", "hwpreload3",
+    "hwpreload4", "hwpreload5", "hwpreload6", "hwpreload7",
+};
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Gets the modules, preloading them first if asked to.
+ * @return the time it took in ns, or <0 if a module could not be loaded. */
+static int64_t get_modules(const char *const *ids, size_t n, int preload)
+{
+    const struct hw_module_t *module;
+    size_t i;
+    int64_t start = now_ns();
+
+    if (preload && hw_preload_modules(ids, n) != 0)
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (hw_get_module(ids[i], &module) != 0) {
+            fprintf(stderr, "could not load %s\n", ids[i]);
+            return -1;
+        }
+    }
+    return now_ns() - start;
+}
+
+/* Runs get_modules in a new process.
+ * @return the time it took in ns, or <0 on failure. */
+static int64_t run(const char *const *ids, size_t n, int preload)
+{
+    int fds[2];
+    int64_t elapsed = -1;
+    int status;
+    pid_t pid;
+
+    if (pipe(fds) != 0)
+        return -1;
+    pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        elapsed = get_modules(ids, n, preload);
+        _exit(write(fds[1], &elapsed, sizeof(elapsed)) == sizeof(elapsed) ?
+                0 : 1);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+            elapsed = -1;
+        waitpid(pid, &status, 0);
+    }
+    close(fds[0]);
+    return elapsed;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+    int64_t lhs = *(const int64_t *)a, rhs = *(const int64_t *)b;
+    return lhs < rhs ? -1 : lhs > rhs;
+}
+
+static void print_times(const char *mode, int64_t *times, int runs)
+{
+    qsort(times, runs, sizeof(*times), compare_times);
+    printf("%-8s min %6" PRId64 "us  median %6" PRId64 "us  max %6" PRId64 "us\n",
+            mode, times[0] / 1000, times[runs / 2] / 1000,
+            times[runs - 1] / 1000);
+}
+
+int main(int argc, char **argv)
+{
+    static int64_t serial_times[MAX_RUNS], preload_times[MAX_RUNS];
+    const char *const *ids = stub_ids;
+    size_t n = sizeof(stub_ids) / sizeof(stub_ids[0]);
+    int runs = 20;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt != 'n' || (runs = atoi(optarg)) < 1 || runs > MAX_RUNS) {
+            fprintf(stderr, "usage: %s [-n runs] [module id...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        ids = (const char *const *)&argv[optind];
+        n = argc - optind;
+    }
+
+    /* Alternated, so that both modes see the same state of the page cache. */
+    for (i = 0; i < runs; i++) {
+        serial_times[i] = run(ids, n, 0);
+        preload_times[i] = run(ids, n, 1);
+        if (serial_times[i] < 0 || preload_times[i] < 0) {
+            fprintf(stderr, "could not get the modules\n");
+            return 1;
+        }
+    }
+
+    printf("%zu modules, %d runs\n", n, runs);
+    print_times("serial", serial_times, runs);
+    print_times("preload", preload_times, runs);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of looking up a HAL module with hw_get_module, cold, as
+// resolved from the properties and the file system, and warm, as cached. The
+// cold lookups set a debug property first, which invalidates the cache as
+// any property change does, so they only measure lookups on devices: the
+// host has no properties.
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <cutils/properties.h>
+#include <hardware/gralloc.h>
+#include <hardware/hardware.h>
+
+// A module no device installs, to measure the lookups that fail.
+static const char* const kMissingModuleId = "hw_benchmark_missing";
+
+static void setLabel(benchmark::State& state, int status) {
+    state.SetLabel(status == 0 ? "found" : "not found");
+}
+
+static void BM_GetModuleCold(benchmark::State& state, const char* id) {
+    const hw_module_t* module;
+    int status = 0;
+    // Each run sets values of its own.
+    static int serial = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        property_set("debug.hardware.benchmark", std::to_string(++serial).c_str());
+        state.ResumeTiming();
+        status = hw_get_module(id, &module);
+        benchmark::DoNotOptimize(module);
+    }
+    setLabel(state, status);
+}
+BENCHMARK_CAPTURE(BM_GetModuleCold, missing, kMissingModuleId);
+BENCHMARK_CAPTURE(BM_GetModuleCold, gralloc, GRALLOC_HARDWARE_MODULE_ID);
+
+static void BM_GetModuleWarm(benchmark::State& state, const char* id) {
+    const hw_module_t* module;
+    int status = hw_get_module(id, &module);
+    for (auto _ : state) {
+        hw_get_module(id, &module);
+        benchmark::DoNotOptimize(module);
+    }
+    setLabel(state, status);
+}
+BENCHMARK_CAPTURE(BM_GetModuleWarm, missing, kMissingModuleId);
+BENCHMARK_CAPTURE(BM_GetModuleWarm, gralloc, GRALLOC_HARDWARE_MODULE_ID);
+
+BENCHMARK_MAIN();
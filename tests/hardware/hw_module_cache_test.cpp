@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks which lookups hw_get_module caches, with libhardware built to look
+// for the modules in HAL_LIBRARY_PATH2, where the tests install them. The
+// modules installed are not libraries, so that finding one fails to load it:
+// -ENOENT means the module wasn't found, -EINVAL that it was.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <cutils/properties.h>
+#include <gtest/gtest.h>
+#include <hardware/hardware.h>
+
+namespace {
+
+class HwModuleCacheTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        ASSERT_TRUE(mkdir(HAL_LIBRARY_PATH2, 0755) == 0 || errno == EEXIST);
+        // The cache lives as long as the process, each test looks up its own module.
+        const testing::TestInfo* info = testing::UnitTest::GetInstance()->current_test_info();
+        mId = std::string("hw_cache_test_") + info->name();
+        mPath = std::string(HAL_LIBRARY_PATH2) + "/" + mId + ".default.so";
+    }
+
+    void TearDown() override { unlink(mPath.c_str()); }
+
+    void InstallModule() {
+        const int fd = open(mPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(4, write(fd, "junk", 4));
+        close(fd);
+    }
+
+    int GetModule() {
+        const hw_module_t* module = nullptr;
+        return hw_get_module(mId.c_str(), &module);
+    }
+
+    std::string mId;
+    std::string mPath;
+};
+
+// A module not found is still not found once installed, until the properties change.
+TEST_F(HwModuleCacheTest, MissingModuleIsCached) {
+    EXPECT_EQ(-ENOENT, GetModule());
+    InstallModule();
+    EXPECT_EQ(-ENOENT, GetModule());
+}
+
+// A module found and failing to load is resolved again on the next lookup.
+TEST_F(HwModuleCacheTest, FailedLoadIsNotCached) {
+    InstallModule();
+    EXPECT_EQ(-EINVAL, GetModule());
+    EXPECT_EQ(-EINVAL, GetModule());
+    ASSERT_EQ(0, unlink(mPath.c_str()));
+    EXPECT_EQ(-ENOENT, GetModule());
+}
+
+// Any property change invalidates the cache, as it may select another variant.
+TEST_F(HwModuleCacheTest, PropertyChangeInvalidatesCache) {
+#if defined(__ANDROID__)
+    EXPECT_EQ(-ENOENT, GetModule());
+    InstallModule();
+    ASSERT_EQ(-ENOENT, GetModule());
+    const std::string serial = std::to_string(getpid()) + "." + std::to_string(time(nullptr));
+    ASSERT_EQ(0, property_set("debug.hardware.cache_test", serial.c_str()));
+    EXPECT_EQ(-EINVAL, GetModule());
+#else
+    GTEST_SKIP() << "the host has no system properties";
+#endif
+}
+
+}  // namespace
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Stub HAL module for hw-preload-bench, built once per id, which STUB_ID
+ * sets. Its table of methods gives the linker relocations to process as it
+ * loads the module, as the method tables of real HALs do. */
+
+#include <errno.h>
+
+#include <hardware/hardware.h>
+
+#ifndef STUB_ID
+#error "STUB_ID must be set to the id of the module"
+#endif
+
+#define STUB_METHOD(n) \
+    static int stub_method_##n(int arg) { return arg + n; }
+#define STUB_METHODS_8(n) \
+    STUB_METHOD(n##0) STUB_METHOD(n##1) STUB_METHOD(n##2) STUB_METHOD(n##3) \
+    STUB_METHOD(n##4) STUB_METHOD(n##5) STUB_METHOD(n##6) STUB_METHOD(n##7)
+#define STUB_ENTRIES_8(n) \
+    stub_method_##n##0, stub_method_##n##1, stub_method_##n##2, \
+    stub_method_##n##3, stub_method_##n##4, stub_method_##n##5, \
+    stub_method_##n##6, stub_method_##n##7,
+
+STUB_METHODS_8(1) STUB_METHODS_8(2) STUB_METHODS_8(3) STUB_METHODS_8(4)
+STUB_METHODS_8(5) STUB_METHODS_8(6) STUB_METHODS_8(7) STUB_METHODS_8(8)
+
+int (*const stub_methods[])(int) = {
+    STUB_ENTRIES_8(1) STUB_ENTRIES_8(2) STUB_ENTRIES_8(3) STUB_ENTRIES_8(4)
+    STUB_ENTRIES_8(5) STUB_ENTRIES_8(6) STUB_ENTRIES_8(7) STUB_ENTRIES_8(8)
+};
+
+static int stub_open(const struct hw_module_t *module, const char *id,
+        struct hw_device_t **device)
+{
+    return -ENODEV;
+}
+
+static struct hw_module_methods_t stub_module_methods = {
+    .open = stub_open,
+};
+
+struct hw_module_t HAL_MODULE_INFO_SYM = {
+    .tag = HARDWARE_MODULE_TAG,
+    .module_api_version = HARDWARE_MODULE_API_VERSION(1, 0),
+    .hal_api_version = HARDWARE_HAL_API_VERSION,
+    .id = STUB_ID,
+    .name = "Preload benchmark stub module",
+    .author = "The Android Open Source Project",
+    .methods = &stub_module_methods,
+};
@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Frame pacing benchmark: producers draw with the CPU into the buffers of a
+ * CNativeWindow and queue them to the composer at the refresh rate, as apps
+ * would. Needs no GPU, so it runs with the software gralloc and hwcomposer.
+ *
+ * Measured for each frame: the time to dequeue a buffer, fence included, the
+ * time queueBuffer takes, composition or framebuffer post included, and the
+ * interval since the previous frame of the same producer was queued, in vsync
+ * periods. Neither waits for the frame to be displayed: queue_us is not the
+ * present latency, as the JSON states. Frames later than 1.5 periods are
+ * janky, and each period missed is a dropped frame. The results are printed
+ * as JSON on stdout, a summary on stderr. */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hardware/gralloc.h>
+#include <hardware/hardware.h>
+#include <sync/sync.h>
+#include <system/window.h>
+
+#include "cnativewindow.h"
+
+#define MAX_PRODUCERS 16
+
+// Upper bounds of the latency buckets, the last bucket being unbounded.
+static const int64_t latency_bounds_us[] = {
+	250, 500, 1000, 2000, 4000, 8000, 16000, 33000, 50000, 100000,
+};
+#define NUM_LATENCY_BUCKETS \
+	(sizeof(latency_bounds_us) / sizeof(latency_bounds_us[0]) + 1)
+
+// Frame intervals of 0 (early), 1, 2, 3, and 4 or more periods.
+#define NUM_INTERVAL_BUCKETS 5
+
+typedef struct producer {
+	pthread_t thread;
+	int index;
+	int frames;
+	// in microseconds, one per frame
+	int64_t *dequeue_us;
+	int64_t *queue_us;
+	uint64_t intervals[NUM_INTERVAL_BUCKETS];
+	uint64_t janky;
+	uint64_t dropped;
+	int failed;
+} producer;
+
+static struct ANativeWindow *window;
+static const gralloc_module_t *gralloc;
+static int64_t period_ns;
+static int paced = 1;
+
+static int64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t deadline) {
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000000LL;
+	ts.tv_nsec = deadline % 1000000000LL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+// Clears the buffer to a color of the producer, with a bar moving down.
+static int draw(producer *p, struct ANativeWindowBuffer *buf, int frame) {
+	const int bpp = buf->format == HAL_PIXEL_FORMAT_RGB_565 ? 2 : 4;
+	const uint32_t color = 0xFF000000 | (0x3F << (8 * (p->index % 3)));
+	const int bar = (frame * 4) % buf->height;
+	uint8_t *pixels;
+	int x, y;
+
+	if (gralloc->lock(gralloc, buf->handle, GRALLOC_USAGE_SW_WRITE_OFTEN,
+			0, 0, buf->width, buf->height, (void **)&pixels))
+		return -1;
+	for (y = 0; y < buf->height; y++) {
+		uint8_t *row = pixels + (size_t)y * buf->stride * bpp;
+		const uint32_t c = y >= bar && y < bar + 16 ? 0xFFFFFFFF : color;
+		if (bpp == 2) {
+			uint16_t *out = (uint16_t *)row;
+			for (x = 0; x < buf->width; x++)
+				out[x] = (uint16_t)c;
+		} else {
+			uint32_t *out = (uint32_t *)row;
+			for (x = 0; x < buf->width; x++)
+				out[x] = c;
+		}
+	}
+	gralloc->unlock(gralloc, buf->handle);
+	return 0;
+}
+
+static void *produce(void *arg) {
+	producer *p = arg;
+	int64_t next = now_ns();
+	int64_t last_queued = 0;
+	int i;
+
+	for (i = 0; i < p->frames; i++) {
+		struct ANativeWindowBuffer *buf;
+		int64_t start, queued;
+		int fence = -1;
+
+		// Behind schedule, the next frame starts right away.
+		if (paced) {
+			next += period_ns;
+			if (next > now_ns())
+				sleep_until(next);
+			else
+				next = now_ns();
+		}
+
+		start = now_ns();
+		if (window->dequeueBuffer(window, &buf, &fence)) {
+			p->failed = 1;
+			break;
+		}
+		if (fence >= 0) {
+			sync_wait(fence, -1);
+			close(fence);
+		}
+		p->dequeue_us[i] = (now_ns() - start) / 1000;
+
+		if (draw(p, buf, i)) {
+			window->cancelBuffer(window, buf, -1);
+			p->failed = 1;
+			break;
+		}
+
+		start = now_ns();
+		if (window->queueBuffer(window, buf, -1)) {
+			p->failed = 1;
+			break;
+		}
+		queued = now_ns();
+		p->queue_us[i] = (queued - start) / 1000;
+		if (last_queued) {
+			// in periods, rounded to nearest
+			const int64_t interval = queued - last_queued;
+			int64_t periods = (interval + period_ns / 2) / period_ns;
+			if (interval * 2 > period_ns * 3)
+				p->janky++;
+			if (periods > 1)
+				p->dropped += periods - 1;
+			if (periods >= NUM_INTERVAL_BUCKETS)
+				periods = NUM_INTERVAL_BUCKETS - 1;
+			p->intervals[periods]++;
+		}
+		last_queued = queued;
+	}
+	p->frames = i;
+	return NULL;
+}
+
+static int compare_int64(const void *a, const void *b) {
+	const int64_t x = *(const int64_t *)a;
+	const int64_t y = *(const int64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int64_t percentile(const int64_t *sorted, int count, int pct) {
+	if (count == 0)
+		return 0;
+	return sorted[(int)((int64_t)(count - 1) * pct / 100)];
+}
+
+// Prints the distribution of the samples of all the producers, sorting them.
+static void print_latency(const char *name, int64_t *samples, int count,
+		const char *sep) {
+	uint64_t buckets[NUM_LATENCY_BUCKETS];
+	unsigned b;
+	int i;
+
+	memset(buckets, 0, sizeof(buckets));
+	qsort(samples, count, sizeof(samples[0]), compare_int64);
+	for (i = 0; i < count; i++) {
+		for (b = 0; b < NUM_LATENCY_BUCKETS - 1; b++)
+			if (samples[i] <= latency_bounds_us[b])
+				break;
+		buckets[b]++;
+	}
+
+	printf("  \"%s\": {\"p50\": %" PRId64 ", \"p90\": %" PRId64
+		", \"p99\": %" PRId64 ", \"max\": %" PRId64 ", \"histogram\": [",
+		name, percentile(samples, count, 50),
+		percentile(samples, count, 90), percentile(samples, count, 99),
+		count ? samples[count - 1] : 0);
+	for (b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+		if (b < NUM_LATENCY_BUCKETS - 1)
+			printf("{\"le_us\": %" PRId64 ", ", latency_bounds_us[b]);
+		else
+			printf("{\"le_us\": null, ");
+		printf("\"count\": %" PRIu64 "}%s", buckets[b],
+			b < NUM_LATENCY_BUCKETS - 1 ? ", " : "");
+	}
+	printf("]}%s\n", sep);
+
+	fprintf(stderr, "%s: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", name,
+		percentile(samples, count, 50) / 1000.0,
+		percentile(samples, count, 99) / 1000.0,
+		count ? samples[count - 1] / 1000.0 : 0.0);
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-n producers] [-f frames] [-b buffers] [-u]\n"
+		"  -n  producers queueing to the window, 1 by default\n"
+		"  -f  frames of each producer, 600 by default\n"
+		"  -b  buffers of the window, 3 by default\n"
+		"  -u  unpaced, frames are produced as fast as they are queued\n",
+		name);
+}
+
+int main(int argc, char **argv) {
+	producer producers[MAX_PRODUCERS];
+	struct CNativeWindow *cnw;
+	const hw_module_t *module;
+	int num_producers = 1, frames = 600, buffers = 3;
+	unsigned width, height, format;
+	uint64_t intervals[NUM_INTERVAL_BUCKETS];
+	uint64_t janky = 0, dropped = 0;
+	int64_t *dequeue_us, *queue_us;
+	int64_t start, elapsed;
+	int total = 0, failed = 0;
+	int i, j, c;
+
+	while ((c = getopt(argc, argv, "n:f:b:u")) != -1) {
+		switch (c) {
+		case 'n':
+			num_producers = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'b':
+			buffers = atoi(optarg);
+			break;
+		case 'u':
+			paced = 0;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (num_producers < 1 || num_producers > MAX_PRODUCERS ||
+			frames < 1 || buffers < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module)) {
+		fprintf(stderr, "cannot open gralloc module\n");
+		return 1;
+	}
+	gralloc = (const gralloc_module_t *)module;
+	cnw = cnw_create_buffers(buffers, GRALLOC_USAGE_SW_WRITE_OFTEN);
+	if (!cnw)
+		return 1;
+	window = (struct ANativeWindow *)cnw;
+	cnw_info(cnw, &width, &height, &format);
+	period_ns = cnw_vsync_period(cnw);
+	if (period_ns <= 0)
+		period_ns = 1000000000LL / 60;
+
+	dequeue_us = calloc((size_t)num_producers * frames, sizeof(int64_t));
+	queue_us = calloc((size_t)num_producers * frames, sizeof(int64_t));
+	if (!dequeue_us || !queue_us)
+		return 1;
+
+	start = now_ns();
+	memset(producers, 0, sizeof(producers));
+	for (i = 0; i < num_producers; i++) {
+		producer *p = &producers[i];
+		p->index = i;
+		p->frames = frames;
+		p->dequeue_us = dequeue_us + (size_t)i * frames;
+		p->queue_us = queue_us + (size_t)i * frames;
+		if (pthread_create(&p->thread, NULL, produce, p)) {
+			fprintf(stderr, "cannot start producer %d\n", i);
+			return 1;
+		}
+	}
+	for (i = 0; i < num_producers; i++)
+		pthread_join(producers[i].thread, NULL);
+	elapsed = now_ns() - start;
+
+	// The samples of all the producers, packed.
+	memset(intervals, 0, sizeof(intervals));
+	for (i = 0; i < num_producers; i++) {
+		producer *p = &producers[i];
+		memmove(dequeue_us + total, p->dequeue_us,
+			p->frames * sizeof(int64_t));
+		memmove(queue_us + total, p->queue_us,
+			p->frames * sizeof(int64_t));
+		total += p->frames;
+		for (j = 0; j < NUM_INTERVAL_BUCKETS; j++)
+			intervals[j] += p->intervals[j];
+		janky += p->janky;
+		dropped += p->dropped;
+		failed |= p->failed;
+	}
+
+	printf("{\n");
+	printf("  \"width\": %u, \"height\": %u, \"format\": %u,\n",
+		width, height, format);
+	printf("  \"producers\": %d, \"buffers\": %d, \"paced\": %s,\n",
+		num_producers, buffers, paced ? "true" : "false");
+	printf("  \"vsync_period_ns\": %" PRId64 ", \"elapsed_ns\": %" PRId64
+		", \"frames\": %d, \"failed\": %s,\n", period_ns, elapsed, total,
+		failed ? "true" : "false");
+	printf("  \"queue_us_measures\": "
+		"\"queueBuffer call duration, not present latency\",\n");
+	print_latency("dequeue_us", dequeue_us, total, ",");
+	print_latency("queue_us", queue_us, total, ",");
+	printf("  \"janky\": %" PRIu64 ", \"dropped\": %" PRIu64
+		", \"interval_periods\": [", janky, dropped);
+	for (j = 0; j < NUM_INTERVAL_BUCKETS; j++)
+		printf("%" PRIu64 "%s", intervals[j],
+			j < NUM_INTERVAL_BUCKETS - 1 ? ", " : "");
+	printf("],\n  \"per_producer\": [");
+	for (i = 0; i < num_producers; i++)
+		printf("{\"frames\": %d, \"janky\": %" PRIu64 ", \"dropped\": %"
+			PRIu64 "}%s", producers[i].frames, producers[i].janky,
+			producers[i].dropped, i < num_producers - 1 ? ", " : "");
+	printf("]\n}\n");
+
+	fprintf(stderr, "%d frames in %.2f s, %.1f fps, %" PRIu64 " janky, %"
+		PRIu64 " dropped\n", total, elapsed / 1e9,
+		total * 1e9 / elapsed, janky, dropped);
+
+	free(dequeue_us);
+	free(queue_us);
+	cnw_destroy(cnw);
+	return failed;
+}
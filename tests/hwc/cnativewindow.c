@@ -29,6 +29,8 @@
 #include <system/window.h>
 #include <cutils/native_handle.h>
 
+#include "cnativewindow.h"
+
 // normalize and shorten type names
 typedef struct android_native_base_t aBase;
 typedef struct ANativeWindowBuffer aBuffer;
@@ -62,6 +64,8 @@ typedef struct CNativeWindow {
 
 	pthread_mutex_t lock;
 	pthread_cond_t cvar;
+	// serializes the posts of concurrent producers
+	pthread_mutex_t post_lock;
 
 	aBuffer *front;
 	aBuffer *spare;
@@ -73,6 +77,7 @@ typedef struct CNativeWindow {
 	unsigned xdpi;
 	unsigned ydpi;
 	unsigned format;
+	int64_t vsync_period;
 
 	hwc_display_contents_1_t *dclist[HWC_NUM_PHYSICAL_DISPLAY_TYPES];
 
@@ -151,7 +156,7 @@ static int cnw_lock_buffer0(aWindow *base, aBuffer *buffer) {
 	return 0;
 }
 
-static void set_layer(hwc_layer_1_t *dl, aBuffer *buf, int ffd) {
+static void set_layer(CNativeWindow *win, hwc_layer_1_t *dl, aBuffer *buf, int ffd) {
 	int right = buf->width;
 	int bottom = buf->height;
 
@@ -162,16 +167,27 @@ static void set_layer(hwc_layer_1_t *dl, aBuffer *buf, int ffd) {
 	dl->handle = buf->handle;
 	dl->transform = 0;
 	dl->blending = HWC_BLENDING_NONE;
-	dl->sourceCrop.left = 0;
-	dl->sourceCrop.top = 0;
-	dl->sourceCrop.right = right;
-	dl->sourceCrop.bottom = bottom;
+	dl->planeAlpha = 0xFF;
+	if (win->hwc->common.version >= HWC_DEVICE_API_VERSION_1_3) {
+		dl->sourceCropf.left = 0;
+		dl->sourceCropf.top = 0;
+		dl->sourceCropf.right = right;
+		dl->sourceCropf.bottom = bottom;
+	} else {
+		dl->sourceCrop.left = 0;
+		dl->sourceCrop.top = 0;
+		dl->sourceCrop.right = right;
+		dl->sourceCrop.bottom = bottom;
+	}
 	dl->displayFrame.left = 0;
 	dl->displayFrame.top = 0;
 	dl->displayFrame.right = right;
 	dl->displayFrame.bottom = bottom;
 	dl->visibleRegionScreen.numRects = 1;
 	dl->visibleRegionScreen.rects = &dl->displayFrame;
+	// the whole buffer may have changed
+	dl->surfaceDamage.numRects = 0;
+	dl->surfaceDamage.rects = NULL;
 
 	dl->acquireFenceFd = ffd;
 	dl->releaseFenceFd = -1;
@@ -192,10 +208,10 @@ static void hwc_post(CNativeWindow *win, aBuffer *buf, int ffd) {
 	dc->dpy = (void*) 0xdeadbeef;
 	dc->sur = (void*) 0xdeadbeef;
 
-	set_layer(&dl[0], buf, ffd);
+	set_layer(win, &dl[0], buf, ffd);
 
 	if (QCT_WORKAROUND) {
-		set_layer(&dl[1], win->spare, -1);
+		set_layer(win, &dl[1], win->spare, -1);
 		dl[1].compositionType = HWC_FRAMEBUFFER_TARGET;
 		dc->numHwLayers++;
 	}
@@ -231,6 +247,7 @@ static int cnw_queue_buffer1(aWindow *base, aBuffer *buffer, int ffd) {
 	CNativeWindow *win = from_base(base);
 	int res;
 	LOG(">> queue buffer %p %d\n", buffer, ffd);
+	pthread_mutex_lock(&win->post_lock);
 	if (win->fb) {
 		res = win->fb->post(win->fb, buffer->handle);
 		if (ffd != -1)
@@ -245,6 +262,7 @@ static int cnw_queue_buffer1(aWindow *base, aBuffer *buffer, int ffd) {
 	win->front = buffer;
 	pthread_cond_signal(&win->cvar);
 	pthread_mutex_unlock(&win->lock);
+	pthread_mutex_unlock(&win->post_lock);
 
 	return res;
 }
@@ -415,6 +433,7 @@ static int hwc_init(CNativeWindow *win) {
 
 	win->width = values[0];
 	win->height = values[1];
+	win->vsync_period = values[2];
 	win->xdpi = values[3];
 	win->ydpi = values[4];
 	win->format = HAL_PIXEL_FORMAT_RGBA_8888;
@@ -458,12 +477,12 @@ static aBuffer *cnw_alloc(CNativeWindow *win, unsigned format, unsigned usage) {
 	return buf;
 }
 
-static int cnw_init(CNativeWindow *win) {
+static int cnw_init(CNativeWindow *win, unsigned num_buffers, unsigned extra_usage) {
 	hw_module_t const* module;
 	framebuffer_device_t *fb = NULL;
 	alloc_device_t *gr;
-	int err, i;
-	unsigned usage;
+	int err;
+	unsigned i, usage;
 
 	memset(win, 0, sizeof(CNativeWindow));
 
@@ -487,6 +506,7 @@ static int cnw_init(CNativeWindow *win) {
 		win->format = fb->format;
 		win->xdpi = fb->xdpi;
 		win->ydpi = fb->ydpi;
+		win->vsync_period = 1000000000LL / (fb->fps > 0 ? fb->fps : 60);
 		win->fb = fb;
 	}
 
@@ -500,11 +520,13 @@ static int cnw_init(CNativeWindow *win) {
 	}
 	win->gr = gr;
 
-	usage = GRALLOC_USAGE_HW_FB |
-		GRALLOC_USAGE_HW_COMPOSER |
-		GRALLOC_USAGE_HW_RENDER;
+	// With a hwcomposer the framebuffer pages are its own.
+	usage = GRALLOC_USAGE_HW_COMPOSER |
+		GRALLOC_USAGE_HW_RENDER | extra_usage;
+	if (win->fb)
+		usage |= GRALLOC_USAGE_HW_FB;
 
-	for (i = 0; i < 2; i++) {
+	for (i = 0; i < num_buffers; i++) {
 		aBuffer *buf = cnw_alloc(win, win->format, usage);
 		if (!buf)
 			return -ENOMEM;
@@ -542,6 +564,7 @@ static int cnw_init(CNativeWindow *win) {
 
 	pthread_mutex_init(&win->lock, NULL);
 	pthread_cond_init(&win->cvar, NULL);
+	pthread_mutex_init(&win->post_lock, NULL);
 
 	return 0;
 }
@@ -556,23 +579,34 @@ void cnw_destroy(CNativeWindow *win) {
 	free(win);
 }
 
-CNativeWindow *cnw_create(void) {
+CNativeWindow *cnw_create_buffers(unsigned num_buffers, unsigned extra_usage) {
 	CNativeWindow *win;
 	char *x;
 	if ((x = getenv("CNWDEBUG")))
 		trace_level = atoi(x);
+	// one buffer displayed, at least one to draw into
+	if (num_buffers < 2)
+		num_buffers = 2;
 	if (!(win = malloc(sizeof(CNativeWindow))))
 		return NULL;
-	if (cnw_init(win)) {
+	if (cnw_init(win, num_buffers, extra_usage)) {
 		cnw_destroy(win);
 		return NULL;
 	}
 	return win;
 }
 
+CNativeWindow *cnw_create(void) {
+	return cnw_create_buffers(2, 0);
+}
+
 void cnw_info(CNativeWindow *win, unsigned *w, unsigned *h, unsigned *fmt) {
 	*w = win->width;
 	*h = win->height;
 	*fmt = win->format;
 }
 
+int64_t cnw_vsync_period(CNativeWindow *win) {
+	return win->vsync_period;
+}
+
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CNATIVEWINDOW_H_
+#define _CNATIVEWINDOW_H_
+
+#include <stdint.h>
+
+/* A native window posting its buffers to the hwcomposer, or to the fb HAL
+ * without one. It can be cast to an ANativeWindow. */
+
+struct CNativeWindow;
+struct CNativeWindow *cnw_create(void);
+/* num_buffers buffers, 2 at least, allocated with extra_usage on top of
+ * the composer and render usages */
+struct CNativeWindow *cnw_create_buffers(unsigned num_buffers,
+	unsigned extra_usage);
+void cnw_destroy(struct CNativeWindow *win);
+void cnw_info(struct CNativeWindow *win,
+	unsigned *w, unsigned *h, unsigned *fmt);
+/* in nanoseconds */
+int64_t cnw_vsync_period(struct CNativeWindow *win);
+
+#endif
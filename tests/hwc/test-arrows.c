@@ -16,6 +16,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <EGL/egl.h>
 #include <GLES2/gl2.h>
@@ -137,10 +138,28 @@ void render() {
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
+// Frames between two reports of the frame times.
+#define REPORT_FRAMES 120
+
+static double now_ms(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Wall time per frame, and CPU time of all the threads of the process,
+// hwcomposer composition included.
+static void report(int frames, double wall, double cpu) {
+	if (frames > 0)
+		fprintf(stderr, "%d frames: %.2f ms wall, %.2f ms cpu per frame\n",
+			frames, wall / frames, cpu / frames);
+}
+
 int main(int argc, char **argv) {
 	EGLDisplay display;
 	EGLSurface surface;
-	int w, h, count = 0;
+	int w, h, count = 0, frames = 0;
+	double wall, cpu;
 
 	if (argc > 1)
 		count = atoi(argv[1]);
@@ -151,13 +170,25 @@ int main(int argc, char **argv) {
 	if (prepare(w, h))
 		return -1;
 
+	wall = now_ms(CLOCK_MONOTONIC);
+	cpu = now_ms(CLOCK_PROCESS_CPUTIME_ID);
 	for (;;) {
 		render();
 		eglSwapBuffers(display, surface);
+		if (++frames == REPORT_FRAMES) {
+			double nwall = now_ms(CLOCK_MONOTONIC);
+			double ncpu = now_ms(CLOCK_PROCESS_CPUTIME_ID);
+			report(frames, nwall - wall, ncpu - cpu);
+			frames = 0;
+			wall = nwall;
+			cpu = ncpu;
+		}
 		if (count > 0)
 			if (--count == 0)
 				break;
 	}
+	report(frames, now_ms(CLOCK_MONOTONIC) - wall,
+		now_ms(CLOCK_PROCESS_CPUTIME_ID) - cpu);
 
 	egl_destroy(display, surface);
 	return 0;
@@ -29,10 +29,6 @@ void egl_destroy(EGLDisplay display, EGLSurface surface);
 
 /* internals needed by util.c */
 
-struct CNativeWindow;
-struct CNativeWindow *cnw_create(void);
-void cnw_destroy(struct CNativeWindow *win);
-void cnw_info(struct CNativeWindow *win,
-	unsigned *w, unsigned *h, unsigned *fmt);
+#include "cnativewindow.h"
 
 #endif
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "InputCapabilityCache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <linux/input.h>
+
+#include <gtest/gtest.h>
+
+#include "TestHelpers.h"
+
+namespace android {
+namespace tests {
+
+class InputCapabilityCacheTest : public ::testing::Test {
+protected:
+    virtual void SetUp() override {
+        mPath = std::string(mTempDir.getName()) + "/capabilities";
+
+        mKey.busType = BUS_USB;
+        mKey.vendorId = 0x18d1;
+        mKey.productId = 0x2c42;
+        mKey.version = 0x0101;
+        mKey.driverVersion = 0x010001;
+        mKey.location = "usb-0000:00:14.0-1/input0";
+        mKey.name = "Test touchscreen";
+
+        mCaps.keyBitmask[BTN_TOUCH / 8] |= 1 << (BTN_TOUCH % 8);
+        mCaps.absBitmask[ABS_MT_POSITION_X / 8] |= 1 << (ABS_MT_POSITION_X % 8);
+        mCaps.propBitmask[INPUT_PROP_DIRECT / 8] |= 1 << (INPUT_PROP_DIRECT % 8);
+        mCaps.absInfo.emplace_back(ABS_MT_POSITION_X, AbsoluteAxisInfo{
+                .minValue = 0, .maxValue = 1079, .flat = 0, .fuzz = 0, .resolution = 12 });
+    }
+
+    virtual void TearDown() override {
+        unlink(mPath.c_str());
+    }
+
+    TempDir mTempDir;
+    std::string mPath;
+    InputCapabilityKey mKey;
+    InputCapabilities mCaps;
+};
+
+TEST_F(InputCapabilityCacheTest, testSaveAndLoad) {
+    {
+        InputCapabilityCache cache(mPath);
+        EXPECT_NE(OK, cache.load());
+        cache.insert(mKey, mCaps);
+        ASSERT_EQ(OK, cache.save());
+    }
+
+    InputCapabilityCache cache(mPath);
+    ASSERT_EQ(OK, cache.load());
+    EXPECT_EQ(1U, cache.size());
+
+    InputCapabilities caps;
+    ASSERT_TRUE(cache.lookup(mKey, &caps));
+    EXPECT_EQ(0, memcmp(mCaps.keyBitmask, caps.keyBitmask, sizeof(caps.keyBitmask)));
+    EXPECT_EQ(0, memcmp(mCaps.absBitmask, caps.absBitmask, sizeof(caps.absBitmask)));
+    EXPECT_EQ(0, memcmp(mCaps.propBitmask, caps.propBitmask, sizeof(caps.propBitmask)));
+    ASSERT_EQ(1U, caps.absInfo.size());
+    EXPECT_EQ(ABS_MT_POSITION_X, caps.absInfo[0].first);
+    EXPECT_EQ(1079, caps.absInfo[0].second.maxValue);
+    EXPECT_EQ(12, caps.absInfo[0].second.resolution);
+
+    // Another version of the device, or of its driver, does not match.
+    InputCapabilityKey key = mKey;
+    key.version++;
+    EXPECT_FALSE(cache.lookup(key, &caps));
+    key = mKey;
+    key.driverVersion++;
+    EXPECT_FALSE(cache.lookup(key, &caps));
+}
+
+TEST_F(InputCapabilityCacheTest, testOtherKernelRelease) {
+    {
+        InputCapabilityCache cache(mPath, "4.19.1");
+        cache.insert(mKey, mCaps);
+        ASSERT_EQ(OK, cache.save());
+    }
+    {
+        InputCapabilityCache cache(mPath, "4.19.1");
+        ASSERT_EQ(OK, cache.load());
+        EXPECT_EQ(1U, cache.size());
+    }
+
+    // A kernel update may have changed the drivers: the file is dropped.
+    InputCapabilityCache cache(mPath, "5.10.2");
+    EXPECT_EQ(BAD_VALUE, cache.load());
+    EXPECT_EQ(0U, cache.size());
+    EXPECT_NE(0, access(mPath.c_str(), F_OK));
+}
+
+TEST_F(InputCapabilityCacheTest, testNoLocation) {
+    InputCapabilityCache cache(mPath);
+    mKey.location.clear();
+    cache.insert(mKey, mCaps);
+    EXPECT_EQ(0U, cache.size());
+
+    InputCapabilities caps;
+    EXPECT_FALSE(cache.lookup(mKey, &caps));
+}
+
+TEST_F(InputCapabilityCacheTest, testCorruptedFile) {
+    {
+        InputCapabilityCache cache(mPath);
+        cache.insert(mKey, mCaps);
+        ASSERT_EQ(OK, cache.save());
+    }
+    // Cut the file short, as if it was written by a crashing process.
+    ASSERT_EQ(0, truncate(mPath.c_str(), 64));
+
+    InputCapabilityCache cache(mPath);
+    EXPECT_EQ(BAD_VALUE, cache.load());
+    EXPECT_EQ(0U, cache.size());
+    EXPECT_NE(0, access(mPath.c_str(), F_OK));
+}
+
+}  // namespace tests
+}  // namespace android
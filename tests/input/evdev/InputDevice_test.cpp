@@ -97,6 +97,54 @@ TEST_F(EvdevDeviceTest, testClockCorrectionOk) {
     EXPECT_NEAR(now, event.when, ms2ns(TIMING_TOLERANCE_MS));
 }
 
+TEST_F(EvdevDeviceTest, testFrameClockCorrection) {
+    auto node = std::make_shared<MockInputDeviceNode>();
+    auto device = std::make_unique<EvdevDevice>(&mHost, node);
+    ASSERT_TRUE(device != nullptr);
+
+    auto now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    // Every event of a frame from the wrong clock gets corrected.
+    InputEvent events[] = {
+        { now + s2ns(60), EV_KEY, KEY_HOME, 1 },
+        { now + s2ns(60), EV_SYN, SYN_REPORT, 0 },
+    };
+
+    device->processInputFrame(events, 2, now);
+
+    EXPECT_NEAR(now, events[0].when, ms2ns(TIMING_TOLERANCE_MS));
+    EXPECT_NEAR(now, events[1].when, ms2ns(TIMING_TOLERANCE_MS));
+}
+
+TEST_F(EvdevDeviceTest, testReportAllocations) {
+    auto node = std::make_shared<MockInputDeviceNode>();
+    node->addKeys(BTN_MOUSE, BTN_LEFT);
+    node->addRelAxis(REL_X);
+    node->addRelAxis(REL_Y);
+
+    // The report is allocated once, when the device is configured, and freed
+    // with the device.
+    NiceMock<MockInputReport> report;
+    EXPECT_CALL(mReportDef, allocateReport())
+        .WillOnce(Return(&report));
+    EXPECT_CALL(mReportDef, freeReport(&report));
+    EXPECT_CALL(report, reportEvent(_)).Times(5000);
+
+    auto device = std::make_unique<EvdevDevice>(&mHost, node);
+    EXPECT_EQ(1u, device->getReportPool().getAllocationCount());
+
+    // 10k events, as frames of motion.
+    auto now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < 5000; ++i) {
+        InputEvent events[] = {
+            { now, EV_REL, i % 2 ? REL_X : REL_Y, 1 },
+            { now, EV_SYN, SYN_REPORT, 0 },
+        };
+        device->processInputFrame(events, 2, now);
+    }
+    EXPECT_EQ(1u, device->getReportPool().getAllocationCount());
+}
+
 TEST_F(EvdevDeviceTest, testN7v2Touchscreen) {
     auto node = std::shared_ptr<MockInputDeviceNode>(MockNexus7v2::getElanTouchscreen());
     auto device = std::make_unique<EvdevDevice>(&mHost, node);
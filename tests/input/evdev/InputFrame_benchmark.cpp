@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the throughput of delivering evdev events from the InputHub to the
+// mappers one at a time and a SYN_REPORT frame at a time, for a mouse moving
+// and clicking as fast as a read of the InputHub can return its events.
+
+#include <memory>
+#include <vector>
+
+#include <linux/input.h>
+
+#include <benchmark/benchmark.h>
+#include <utils/Timers.h>
+
+#include "InputDeviceManager.h"
+#include "InputHub.h"
+#include "InputMocks.h"
+#include "MockInputHost.h"
+
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace android {
+namespace tests {
+
+// The events returned by one read of the InputHub.
+static const size_t kEventsPerRead = 128;
+
+class MouseFixture {
+public:
+    MouseFixture() : mManager(&mHost), mNode(std::make_shared<MockInputDeviceNode>()) {
+        ON_CALL(mHost, createDeviceDefinition()).WillByDefault(Return(&mDeviceDef));
+        ON_CALL(mHost, createInputReportDefinition()).WillByDefault(Return(&mReportDef));
+        ON_CALL(mReportDef, allocateReport()).WillByDefault(Return(&mReport));
+
+        mNode->setPath("/dev/input/event0");
+        mNode->addKeys(BTN_MOUSE, BTN_LEFT, BTN_RIGHT, BTN_MIDDLE);
+        mNode->addRelAxis(REL_X);
+        mNode->addRelAxis(REL_Y);
+        mManager.onDeviceAdded(mNode);
+
+        // Alternate motion frames with button frames, as during a drag.
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int frame = 0; mEvents.size() + 4 <= kEventsPerRead; frame++) {
+            if (frame % 4 == 3) {
+                mEvents.push_back({ now, EV_KEY, BTN_LEFT, (frame / 4) % 2 });
+            } else {
+                mEvents.push_back({ now, EV_REL, REL_X, frame % 7 - 3 });
+                mEvents.push_back({ now, EV_REL, REL_Y, frame % 5 - 2 });
+            }
+            mEvents.push_back({ now, EV_SYN, SYN_REPORT, 0 });
+        }
+    }
+
+    InputDeviceManager& manager() { return mManager; }
+    std::shared_ptr<InputDeviceNode> node() const { return mNode; }
+    std::vector<InputEvent>& events() { return mEvents; }
+
+private:
+    NiceMock<MockInputHost> mHost;
+    NiceMock<MockInputReportDefinition> mReportDef;
+    NiceMock<MockInputDeviceDefinition> mDeviceDef;
+    NiceMock<MockInputReport> mReport;
+    InputDeviceManager mManager;
+    std::shared_ptr<MockInputDeviceNode> mNode;
+    std::vector<InputEvent> mEvents;
+};
+
+static void BM_DeliverPerEvent(benchmark::State& state) {
+    MouseFixture fixture;
+    std::shared_ptr<InputDeviceNode> node = fixture.node();
+    std::vector<InputEvent>& events = fixture.events();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (auto _ : state) {
+        for (InputEvent& event : events) {
+            fixture.manager().onInputEvent(node, event, now);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_DeliverPerEvent);
+
+static void BM_DeliverPerFrame(benchmark::State& state) {
+    MouseFixture fixture;
+    std::shared_ptr<InputDeviceNode> node = fixture.node();
+    std::vector<InputEvent>& events = fixture.events();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (auto _ : state) {
+        size_t start = 0;
+        for (size_t i = 0; i < events.size(); i++) {
+            if (events[i].type == EV_SYN && events[i].code == SYN_REPORT) {
+                fixture.manager().onInputFrame(node, &events[start], i + 1 - start, now);
+                start = i + 1;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_DeliverPerFrame);
+
+}  // namespace tests
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -16,10 +16,15 @@
 
 #include "InputHub.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <vector>
 
+#include <android/input.h>
 #include <linux/input.h>
 
 #include <gtest/gtest.h>
@@ -27,6 +32,7 @@
 #include <utils/StopWatch.h>
 #include <utils/Timers.h>
 
+#include "InputMocks.h"
 #include "TestHelpers.h"
 
 // # of milliseconds to fudge stopwatch measurements
@@ -39,6 +45,8 @@ namespace tests {
 using namespace std::literals::chrono_literals;
 
 using InputCbFunc = std::function<void(const std::shared_ptr<InputDeviceNode>&, InputEvent&, nsecs_t)>;
+using InputFrameCbFunc = std::function<void(const std::shared_ptr<InputDeviceNode>&, InputEvent*,
+        size_t, nsecs_t)>;
 using DeviceCbFunc = std::function<void(const std::shared_ptr<InputDeviceNode>&)>;
 
 static const InputCbFunc kNoopInputCb = [](const std::shared_ptr<InputDeviceNode>&, InputEvent&, nsecs_t){};
@@ -51,6 +59,7 @@ public:
     virtual ~TestInputCallback() = default;
 
     void setInputCallback(const InputCbFunc& cb) { mInputCb = cb; }
+    void setInputFrameCallback(const InputFrameCbFunc& cb) { mInputFrameCb = cb; }
     void setDeviceAddedCallback(const DeviceCbFunc& cb) { mDeviceAddedCb = cb; }
     void setDeviceRemovedCallback(const DeviceCbFunc& cb) { mDeviceRemovedCb = cb; }
 
@@ -58,6 +67,14 @@ public:
             nsecs_t event_time) override {
         mInputCb(node, event, event_time);
     }
+    virtual void onInputFrame(const std::shared_ptr<InputDeviceNode>& node, InputEvent* events,
+            size_t count, nsecs_t event_time) override {
+        if (mInputFrameCb) {
+            mInputFrameCb(node, events, count, event_time);
+        } else {
+            InputCallbackInterface::onInputFrame(node, events, count, event_time);
+        }
+    }
     virtual void onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) override {
         mDeviceAddedCb(node);
     }
@@ -67,6 +84,7 @@ public:
 
 private:
     InputCbFunc mInputCb;
+    InputFrameCbFunc mInputFrameCb;
     DeviceCbFunc mDeviceAddedCb;
     DeviceCbFunc mDeviceRemovedCb;
 };
@@ -78,8 +96,96 @@ class InputHubTest : public ::testing::Test {
          mInputHub = std::make_shared<InputHub>(mCallback);
      }
 
+     virtual void TearDown() {
+         for (int fd : mWriteFds) {
+             close(fd);
+         }
+         if (!mDeviceLink.empty()) {
+             unlink(mDeviceLink.c_str());
+         }
+     }
+
+     // Adds the evdev node of device, linked from a temp dir so that no other
+     // device is opened.
+     std::shared_ptr<InputDeviceNode> addUinputDevice(const UinputDevice& device) {
+         mTempDir = std::make_unique<TempDir>();
+         mDeviceLink = std::string(mTempDir->getName()) + "/event";
+         if (symlink(device.getDevicePath().c_str(), mDeviceLink.c_str())) {
+             return nullptr;
+         }
+         std::shared_ptr<InputDeviceNode> added;
+         mCallback->setDeviceAddedCallback([&](const std::shared_ptr<InputDeviceNode>& node) {
+             added = node;
+         });
+         mInputHub->registerDevicePath(mTempDir->getName());
+         mCallback->setDeviceAddedCallback(kNoopDeviceCb);
+         return added;
+     }
+
+     // Polls until done() is true, or nothing was read for half a second.
+     void pollUntil(const std::function<bool()>& done) {
+         while (!done()) {
+             auto f = delay_async(500ms, [&]() { mInputHub->wake(); });
+             nsecs_t start = systemTime(CLOCK_MONOTONIC);
+             ASSERT_EQ(OK, mInputHub->poll());
+             ASSERT_LT(systemTime(CLOCK_MONOTONIC) - start, ms2ns(500));
+         }
+     }
+
+     // Adds a device read from a pipe, and returns the end to write its
+     // events to, or -1.
+     int addPipeDevice(const std::shared_ptr<InputDeviceNode>& node) {
+         int fds[2];
+         if (pipe2(fds, O_NONBLOCK | O_CLOEXEC)) {
+             return -1;
+         }
+         if (mInputHub->addDeviceNode(fds[0], node) != OK) {
+             close(fds[0]);
+             close(fds[1]);
+             return -1;
+         }
+         mWriteFds.push_back(fds[1]);
+         return fds[1];
+     }
+
+     static void writeEvents(int fd, const std::vector<input_event>& events) {
+         size_t size = events.size() * sizeof(input_event);
+         ASSERT_EQ(static_cast<ssize_t>(size), write(fd, events.data(), size));
+     }
+
      std::shared_ptr<TestInputCallback> mCallback;
      std::shared_ptr<InputHub> mInputHub;
+     std::vector<int> mWriteFds;
+     std::unique_ptr<TempDir> mTempDir;
+     std::string mDeviceLink;
+};
+
+static input_event makeEvent(uint16_t type, uint16_t code, int32_t value) {
+    input_event event{};
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    return event;
+}
+
+// Records the number of events of each read, as the events a read updates
+// the state with before delivering its frames.
+class ReadRecordingDeviceNode : public MockInputDeviceNode {
+public:
+    virtual void updateState(const InputEvent&) override {
+        if (mNewRead) {
+            reads.push_back(0);
+            mNewRead = false;
+        }
+        reads.back()++;
+    }
+
+    void onFrame() { mNewRead = true; }
+
+    std::vector<size_t> reads;
+
+private:
+    bool mNewRead = true;
 };
 
 TEST_F(InputHubTest, testWake) {
@@ -161,32 +267,43 @@ TEST_F(InputHubTest, DISABLED_testInputEvent) {
     auto deviceFile = std::unique_ptr<TempFile>(tempDir->newTempFile());
     std::string tempFileName(deviceFile->getName());
 
-    // Send a key event corresponding to HOME.
-    struct input_event iev;
-    iev.time = { 1, 0 };
-    iev.type = EV_KEY;
-    iev.code = KEY_HOME;
-    iev.value = 0x01;
+    // Send a key event corresponding to HOME, and the SYN_REPORT that ends
+    // its frame.
+    struct input_event ievs[2];
+    ievs[0].time = { 1, 0 };
+    ievs[0].type = EV_KEY;
+    ievs[0].code = KEY_HOME;
+    ievs[0].value = 0x01;
+    ievs[1].time = { 1, 0 };
+    ievs[1].type = EV_SYN;
+    ievs[1].code = SYN_REPORT;
+    ievs[1].value = 0;
 
     auto inputDelayMs = 100ms;
     auto f = delay_async(inputDelayMs, [&] {
-                ssize_t nWrite = TEMP_FAILURE_RETRY(write(deviceFile->getFd(), &iev, sizeof(iev)));
+                ssize_t nWrite = TEMP_FAILURE_RETRY(write(deviceFile->getFd(), ievs, sizeof(ievs)));
 
-                ASSERT_EQ(static_cast<ssize_t>(sizeof(iev)), nWrite) << "could not write to "
+                ASSERT_EQ(static_cast<ssize_t>(sizeof(ievs)), nWrite) << "could not write to "
                     << deviceFile->getFd() << ". errno: " << errno;
             });
 
     // Expect this callback to run when the input event is read.
     nsecs_t expectedWhen = systemTime(CLOCK_MONOTONIC) + ms2ns(inputDelayMs.count());
+    int eventCount = 0;
     mCallback->setInputCallback(
             [&](const std::shared_ptr<InputDeviceNode>& node, InputEvent& event,
                 nsecs_t event_time) {
                 EXPECT_NEAR(expectedWhen, event_time, ms2ns(TIMING_TOLERANCE_MS));
                 EXPECT_EQ(s2ns(1), event.when);
                 EXPECT_EQ(tempFileName, node->getPath());
-                EXPECT_EQ(EV_KEY, event.type);
-                EXPECT_EQ(KEY_HOME, event.code);
-                EXPECT_EQ(0x01, event.value);
+                if (eventCount++ == 0) {
+                    EXPECT_EQ(EV_KEY, event.type);
+                    EXPECT_EQ(KEY_HOME, event.code);
+                    EXPECT_EQ(0x01, event.value);
+                } else {
+                    EXPECT_EQ(EV_SYN, event.type);
+                    EXPECT_EQ(SYN_REPORT, event.code);
+                }
             });
     ASSERT_EQ(OK, mInputHub->registerDevicePath(tempDir->getName()));
 
@@ -195,6 +312,352 @@ TEST_F(InputHubTest, DISABLED_testInputEvent) {
     int32_t elapsedMillis = ns2ms(stopWatch.elapsedTime());
 
     EXPECT_NEAR(100, elapsedMillis, TIMING_TOLERANCE_MS);
+    EXPECT_EQ(2, eventCount);
+}
+
+TEST_F(InputHubTest, DISABLED_testInputFrame) {
+    auto tempDir = std::make_unique<TempDir>();
+    auto deviceFile = std::unique_ptr<TempFile>(tempDir->newTempFile());
+
+    // A motion frame, then the start of a second one that has not been ended
+    // by a SYN_REPORT yet.
+    struct input_event ievs[5] = {
+        { { 1, 0 }, EV_ABS, ABS_X, 10 },
+        { { 1, 0 }, EV_ABS, ABS_Y, 20 },
+        { { 1, 0 }, EV_SYN, SYN_REPORT, 0 },
+        { { 2, 0 }, EV_ABS, ABS_X, 11 },
+        { { 2, 0 }, EV_SYN, SYN_REPORT, 0 },
+    };
+
+    std::vector<size_t> frameSizes;
+    mCallback->setInputFrameCallback(
+            [&](const std::shared_ptr<InputDeviceNode>&, InputEvent* events, size_t count,
+                nsecs_t) {
+                ASSERT_LT(0u, count);
+                EXPECT_EQ(EV_SYN, events[count - 1].type);
+                EXPECT_EQ(SYN_REPORT, events[count - 1].code);
+                frameSizes.push_back(count);
+            });
+    ASSERT_EQ(OK, mInputHub->registerDevicePath(tempDir->getName()));
+
+    auto f = delay_async(100ms, [&] {
+                size_t size = 4 * sizeof(struct input_event);
+                ssize_t nWrite = TEMP_FAILURE_RETRY(write(deviceFile->getFd(), ievs, size));
+                ASSERT_EQ(static_cast<ssize_t>(size), nWrite);
+            });
+    EXPECT_EQ(OK, mInputHub->poll());
+    f.wait();
+    ASSERT_EQ(1u, frameSizes.size());
+    EXPECT_EQ(3u, frameSizes[0]);
+
+    // The rest of the second frame completes it.
+    f = delay_async(100ms, [&] {
+                size_t size = sizeof(struct input_event);
+                ssize_t nWrite = TEMP_FAILURE_RETRY(write(deviceFile->getFd(), &ievs[4], size));
+                ASSERT_EQ(static_cast<ssize_t>(size), nWrite);
+            });
+    EXPECT_EQ(OK, mInputHub->poll());
+    ASSERT_EQ(2u, frameSizes.size());
+    EXPECT_EQ(2u, frameSizes[1]);
+}
+
+TEST_F(InputHubTest, testDefaultInputFrameDelivery) {
+    auto node = std::make_shared<MockInputDeviceNode>();
+    InputEvent events[] = {
+        { 1, EV_KEY, KEY_HOME, 1 },
+        { 1, EV_SYN, SYN_REPORT, 0 },
+    };
+
+    // Without a frame callback, each event of the frame goes to onInputEvent.
+    std::vector<int32_t> types;
+    mCallback->setInputCallback(
+            [&](const std::shared_ptr<InputDeviceNode>& n, InputEvent& event, nsecs_t) {
+                EXPECT_EQ(node, n);
+                types.push_back(event.type);
+            });
+    mCallback->onInputFrame(node, events, 2, 1);
+
+    ASSERT_EQ(2u, types.size());
+    EXPECT_EQ(EV_KEY, types[0]);
+    EXPECT_EQ(EV_SYN, types[1]);
+}
+
+TEST_F(InputHubTest, testLongPartialFrameIsDropped) {
+    auto node = std::make_shared<MockInputDeviceNode>();
+    int fd = addPipeDevice(node);
+    ASSERT_GE(fd, 0);
+
+    std::vector<std::vector<InputEvent>> frames;
+    mCallback->setInputFrameCallback(
+            [&](const std::shared_ptr<InputDeviceNode>& n, InputEvent* events, size_t count,
+                    nsecs_t) {
+                EXPECT_EQ(node, n);
+                frames.emplace_back(events, events + count);
+            });
+
+    // A frame the device never ends isn't kept whole, and the device is
+    // resynced at its SYN_REPORT as after a kernel SYN_DROPPED.
+    std::vector<input_event> motion;
+    for (int i = 0; i < 256; ++i) {
+        motion.push_back(makeEvent(EV_ABS, ABS_X, i));
+    }
+    for (int i = 0; i < 16; ++i) {
+        writeEvents(fd, motion);
+        EXPECT_EQ(OK, mInputHub->poll());
+    }
+    EXPECT_TRUE(frames.empty());
+    writeEvents(fd, { makeEvent(EV_ABS, ABS_X, 1), makeEvent(EV_SYN, SYN_REPORT, 0),
+            makeEvent(EV_KEY, KEY_A, 1), makeEvent(EV_SYN, SYN_REPORT, 0) });
+    EXPECT_EQ(OK, mInputHub->poll());
+
+    ASSERT_EQ(2u, frames.size());
+    ASSERT_EQ(2u, frames[0].size());
+    EXPECT_EQ(SYN_DROPPED, frames[0][0].code);
+    EXPECT_EQ(SYN_REPORT, frames[0][1].code);
+    ASSERT_EQ(2u, frames[1].size());
+    EXPECT_EQ(KEY_A, frames[1][0].code);
+}
+
+TEST_F(InputHubTest, testPartialFrameCarriedOver) {
+    auto node = std::make_shared<MockInputDeviceNode>();
+    int fd = addPipeDevice(node);
+    ASSERT_GE(fd, 0);
+
+    std::vector<std::vector<InputEvent>> frames;
+    mCallback->setInputFrameCallback(
+            [&](const std::shared_ptr<InputDeviceNode>&, InputEvent* events, size_t count,
+                    nsecs_t) {
+                frames.emplace_back(events, events + count);
+            });
+
+    writeEvents(fd, { makeEvent(EV_ABS, ABS_X, 1), makeEvent(EV_ABS, ABS_Y, 2) });
+    EXPECT_EQ(OK, mInputHub->poll());
+    EXPECT_TRUE(frames.empty());
+    writeEvents(fd, { makeEvent(EV_SYN, SYN_REPORT, 0) });
+    EXPECT_EQ(OK, mInputHub->poll());
+
+    ASSERT_EQ(1u, frames.size());
+    ASSERT_EQ(3u, frames[0].size());
+    EXPECT_EQ(ABS_X, frames[0][0].code);
+    EXPECT_EQ(ABS_Y, frames[0][1].code);
+    EXPECT_EQ(SYN_REPORT, frames[0][2].code);
+}
+
+TEST_F(InputHubTest, testPipeDeviceRemovedOnClose) {
+    auto node = std::make_shared<MockInputDeviceNode>();
+    std::shared_ptr<InputDeviceNode> added, removed;
+    mCallback->setDeviceAddedCallback([&](const std::shared_ptr<InputDeviceNode>& n) {
+        added = n;
+    });
+    mCallback->setDeviceRemovedCallback([&](const std::shared_ptr<InputDeviceNode>& n) {
+        removed = n;
+    });
+    int fd = addPipeDevice(node);
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(node, added);
+
+    close(fd);
+    mWriteFds.clear();
+    EXPECT_EQ(OK, mInputHub->poll());
+    EXPECT_EQ(node, removed);
+}
+
+TEST_F(InputHubTest, testFloodingDeviceDoesNotHoldBackOthers) {
+    auto flooding = std::make_shared<MockInputDeviceNode>();
+    auto quiet = std::make_shared<MockInputDeviceNode>();
+    int floodingFd = addPipeDevice(flooding);
+    int quietFd = addPipeDevice(quiet);
+    ASSERT_GE(floodingFd, 0);
+    ASSERT_GE(quietFd, 0);
+
+    size_t floodingEvents = 0;
+    size_t floodingEventsBeforeQuiet = 0;
+    bool quietDelivered = false;
+    mCallback->setInputFrameCallback(
+            [&](const std::shared_ptr<InputDeviceNode>& n, InputEvent*, size_t count, nsecs_t) {
+                if (n == quiet) {
+                    quietDelivered = true;
+                    floodingEventsBeforeQuiet = floodingEvents;
+                } else {
+                    floodingEvents += count;
+                }
+            });
+
+    std::vector<input_event> flood(2000, makeEvent(EV_SYN, SYN_REPORT, 0));
+    writeEvents(floodingFd, flood);
+    writeEvents(quietFd, { makeEvent(EV_KEY, KEY_A, 1), makeEvent(EV_SYN, SYN_REPORT, 0) });
+    EXPECT_EQ(OK, mInputHub->poll());
+
+    // The quiet device is read in the first round, after at most one read of
+    // the flooding device at its initial budget.
+    EXPECT_TRUE(quietDelivered);
+    EXPECT_LE(floodingEventsBeforeQuiet, 16u);
+    EXPECT_LT(floodingEvents, flood.size());
+}
+
+TEST_F(InputHubTest, testReadBudgetGrowsAndShrinks) {
+    auto node = std::make_shared<ReadRecordingDeviceNode>();
+    int fd = addPipeDevice(node);
+    ASSERT_GE(fd, 0);
+    mCallback->setInputFrameCallback(
+            [&](const std::shared_ptr<InputDeviceNode>&, InputEvent*, size_t, nsecs_t) {
+                node->onFrame();
+            });
+
+    // Each read that fills the budget doubles it, up to 256 events.
+    writeEvents(fd, std::vector<input_event>(1000, makeEvent(EV_SYN, SYN_REPORT, 0)));
+    EXPECT_EQ(OK, mInputHub->poll());
+    EXPECT_EQ(std::vector<size_t>({ 16, 32, 64, 128, 256, 256, 248 }), node->reads);
+
+    // Each read of less than a quarter of the budget halves it.
+    node->reads.clear();
+    for (int i = 0; i < 2; ++i) {
+        writeEvents(fd, std::vector<input_event>(10, makeEvent(EV_SYN, SYN_REPORT, 0)));
+        EXPECT_EQ(OK, mInputHub->poll());
+    }
+    writeEvents(fd, std::vector<input_event>(100, makeEvent(EV_SYN, SYN_REPORT, 0)));
+    EXPECT_EQ(OK, mInputHub->poll());
+    EXPECT_EQ(std::vector<size_t>({ 10, 10, 64, 36 }), node->reads);
+}
+
+TEST_F(InputHubTest, testEdgeTriggeredDeviceLeftWithInputIsReadByNextPoll) {
+    mInputHub->setEdgeTriggered(true);
+    auto node = std::make_shared<MockInputDeviceNode>();
+    int fd = addPipeDevice(node);
+    ASSERT_GE(fd, 0);
+
+    size_t events = 0;
+    mCallback->setInputFrameCallback(
+            [&](const std::shared_ptr<InputDeviceNode>&, InputEvent*, size_t count, nsecs_t) {
+                events += count;
+            });
+
+    // The first poll stops after its last round with input left, which epoll
+    // won't report again since no more is written.
+    writeEvents(fd, std::vector<input_event>(2000, makeEvent(EV_SYN, SYN_REPORT, 0)));
+    EXPECT_EQ(OK, mInputHub->poll());
+    EXPECT_LT(events, 2000u);
+    pollUntil([&]() { return events == 2000; });
+
+    // Once drained, the device is reported again for new input.
+    writeEvents(fd, { makeEvent(EV_KEY, KEY_A, 1), makeEvent(EV_SYN, SYN_REPORT, 0) });
+    pollUntil([&]() { return events == 2002; });
+}
+
+TEST_F(InputHubTest, testEdgeTriggeredDeviceRemovedOnTruncatedEvent) {
+    mInputHub->setEdgeTriggered(true);
+    auto node = std::make_shared<MockInputDeviceNode>();
+    std::shared_ptr<InputDeviceNode> removed;
+    mCallback->setDeviceRemovedCallback([&](const std::shared_ptr<InputDeviceNode>& n) {
+        removed = n;
+    });
+    int fd = addPipeDevice(node);
+    ASSERT_GE(fd, 0);
+
+    // The rest of the input is misaligned, and would never be reported again.
+    input_event events[2] = { makeEvent(EV_KEY, KEY_A, 1), makeEvent(EV_SYN, SYN_REPORT, 0) };
+    size_t size = sizeof(events) - sizeof(input_event) / 2;
+    ASSERT_EQ(static_cast<ssize_t>(size), write(fd, events, size));
+    EXPECT_EQ(OK, mInputHub->poll());
+    EXPECT_EQ(node, removed);
+}
+
+TEST_F(InputHubTest, testShadowStateFollowsEvents) {
+    UinputDevice device("InputHub shadow test", {KEY_A}, {SW_LID}, {ABS_X});
+    if (!device.isValid()) {
+        GTEST_SKIP() << "uinput is not available";
+    }
+    auto node = addUinputDevice(device);
+    ASSERT_NE(nullptr, node);
+
+    int32_t value = -1;
+    EXPECT_EQ(AKEY_STATE_UP, node->getKeyState(KEY_A));
+    EXPECT_EQ(AKEY_STATE_UP, node->getSwitchState(SW_LID));
+    EXPECT_EQ(OK, node->getAbsoluteAxisValue(ABS_X, &value));
+    EXPECT_EQ(0, value);
+
+    size_t reports = 0;
+    mCallback->setInputFrameCallback(
+            [&](const std::shared_ptr<InputDeviceNode>&, InputEvent*, size_t, nsecs_t) {
+                reports++;
+            });
+    ASSERT_TRUE(device.injectEvents({
+            makeEvent(EV_KEY, KEY_A, 1),
+            makeEvent(EV_SW, SW_LID, 1),
+            makeEvent(EV_ABS, ABS_X, 42),
+            makeEvent(EV_SYN, SYN_REPORT, 0),
+    }));
+    pollUntil([&]() { return reports == 1; });
+    EXPECT_EQ(AKEY_STATE_DOWN, node->getKeyState(KEY_A));
+    EXPECT_EQ(AKEY_STATE_DOWN, node->getSwitchState(SW_LID));
+    EXPECT_EQ(OK, node->getAbsoluteAxisValue(ABS_X, &value));
+    EXPECT_EQ(42, value);
+
+    // The state is that of the events read so far, not that of the driver.
+    ASSERT_TRUE(device.injectEvents({
+            makeEvent(EV_KEY, KEY_A, 0),
+            makeEvent(EV_ABS, ABS_X, 7),
+            makeEvent(EV_SYN, SYN_REPORT, 0),
+    }));
+    EXPECT_EQ(AKEY_STATE_DOWN, node->getKeyState(KEY_A));
+    EXPECT_EQ(OK, node->getAbsoluteAxisValue(ABS_X, &value));
+    EXPECT_EQ(42, value);
+
+    pollUntil([&]() { return reports == 2; });
+    EXPECT_EQ(AKEY_STATE_UP, node->getKeyState(KEY_A));
+    EXPECT_EQ(AKEY_STATE_DOWN, node->getSwitchState(SW_LID));
+    EXPECT_EQ(OK, node->getAbsoluteAxisValue(ABS_X, &value));
+    EXPECT_EQ(7, value);
+}
+
+TEST_F(InputHubTest, testShadowStateResyncedAfterDrop) {
+    UinputDevice device("InputHub resync test", {KEY_A}, {}, {ABS_X});
+    if (!device.isValid()) {
+        GTEST_SKIP() << "uinput is not available";
+    }
+    auto node = addUinputDevice(device);
+    ASSERT_NE(nullptr, node);
+
+    bool dropped = false;
+    bool reportAfterDrop = false;
+    bool lastFrame = false;
+    mCallback->setInputFrameCallback(
+            [&](const std::shared_ptr<InputDeviceNode>&, InputEvent* events, size_t count,
+                    nsecs_t) {
+                for (size_t i = 0; i < count; ++i) {
+                    if (events[i].type == EV_SYN && events[i].code == SYN_DROPPED) {
+                        dropped = true;
+                    } else if (events[i].type == EV_ABS && events[i].value == 50) {
+                        lastFrame = true;
+                    } else if (dropped && events[i].type == EV_SYN
+                            && events[i].code == SYN_REPORT) {
+                        reportAfterDrop = true;
+                    }
+                }
+            });
+
+    // Overflow the evdev buffer, so that the key press is dropped with the
+    // first motions. The axis alternates since the kernel filters out
+    // repeated values.
+    std::vector<input_event> events = {
+            makeEvent(EV_KEY, KEY_A, 1),
+            makeEvent(EV_SYN, SYN_REPORT, 0),
+    };
+    for (int i = 0; i < 1024; ++i) {
+        events.push_back(makeEvent(EV_ABS, ABS_X, i % 2));
+        events.push_back(makeEvent(EV_SYN, SYN_REPORT, 0));
+    }
+    events.push_back(makeEvent(EV_ABS, ABS_X, 50));
+    events.push_back(makeEvent(EV_SYN, SYN_REPORT, 0));
+    ASSERT_TRUE(device.injectEvents(events));
+
+    pollUntil([&]() { return reportAfterDrop && lastFrame; });
+    EXPECT_TRUE(dropped);
+    // The key press was only seen by resyncing with the driver.
+    EXPECT_EQ(AKEY_STATE_DOWN, node->getKeyState(KEY_A));
+    int32_t value = -1;
+    EXPECT_EQ(OK, node->getAbsoluteAxisValue(ABS_X, &value));
+    EXPECT_EQ(50, value);
 }
 
 TEST_F(InputHubTest, DISABLED_testCallbackOrder) {
@@ -232,15 +695,19 @@ TEST_F(InputHubTest, DISABLED_testCallbackOrder) {
                 deviceFile2.reset();
 
                 // Then inject an input event into the first device.
-                struct input_event iev;
-                iev.time = { 1, 0 };
-                iev.type = EV_KEY;
-                iev.code = KEY_HOME;
-                iev.value = 0x01;
-
-                ssize_t nWrite = TEMP_FAILURE_RETRY(write(deviceFile1->getFd(), &iev, sizeof(iev)));
-
-                ASSERT_EQ(static_cast<ssize_t>(sizeof(iev)), nWrite) << "could not write to "
+                struct input_event ievs[2];
+                ievs[0].time = { 1, 0 };
+                ievs[0].type = EV_KEY;
+                ievs[0].code = KEY_HOME;
+                ievs[0].value = 0x01;
+                ievs[1].time = { 1, 0 };
+                ievs[1].type = EV_SYN;
+                ievs[1].code = SYN_REPORT;
+                ievs[1].value = 0;
+
+                ssize_t nWrite = TEMP_FAILURE_RETRY(write(deviceFile1->getFd(), ievs, sizeof(ievs)));
+
+                ASSERT_EQ(static_cast<ssize_t>(sizeof(ievs)), nWrite) << "could not write to "
                     << deviceFile1->getFd() << ". errno: " << errno;
             });
 
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "InputLatencyStats.h"
+
+#include <string.h>
+
+#include <linux/input.h>
+
+#include <gtest/gtest.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "InputHub.h"
+
+namespace android {
+namespace tests {
+
+TEST(Log2HistogramTest, testBuckets) {
+    Log2Histogram histogram;
+    histogram.record(0);
+    histogram.record(1);
+    histogram.record(2);
+    histogram.record(3);
+    histogram.record(1000);
+    histogram.record(UINT64_MAX);
+
+    EXPECT_EQ(6U, histogram.getCount());
+    EXPECT_EQ(1U, histogram.getBucketCount(0));
+    EXPECT_EQ(1U, histogram.getBucketCount(1));
+    EXPECT_EQ(2U, histogram.getBucketCount(2));
+    // 512 <= 1000 < 1024
+    EXPECT_EQ(1U, histogram.getBucketCount(10));
+    EXPECT_EQ(1U, histogram.getBucketCount(Log2Histogram::kNumBuckets - 1));
+}
+
+TEST(Log2HistogramTest, testPercentiles) {
+    Log2Histogram histogram;
+    EXPECT_EQ(0U, histogram.getPercentile(50));
+
+    for (int i = 0; i < 90; ++i) {
+        histogram.record(100);
+    }
+    for (int i = 0; i < 10; ++i) {
+        histogram.record(5000);
+    }
+    EXPECT_EQ(127U, histogram.getPercentile(50));
+    EXPECT_EQ(127U, histogram.getPercentile(90));
+    EXPECT_EQ(8191U, histogram.getPercentile(99));
+}
+
+TEST(InputLatencyStatsTest, testRecord) {
+    InputLatencyStats stats("/dev/input/event0");
+
+    InputEvent events[] = {
+        {ms2ns(10), EV_REL, REL_X, 1},
+        {ms2ns(10), EV_SYN, SYN_REPORT, 0},
+        {ms2ns(11), EV_SYN, SYN_DROPPED, 0},
+        {ms2ns(12), EV_SYN, SYN_REPORT, 0},
+    };
+    stats.recordRead(events, 4, ms2ns(13));
+    // A timestamp from the future does not wrap around.
+    stats.recordRead(events, 2, ms2ns(9));
+
+    EXPECT_EQ(3U, stats.getWakeLatency().getCount());
+    // 3ms and 1ms
+    EXPECT_EQ(1U, stats.getWakeLatency().getBucketCount(12));
+    EXPECT_EQ(1U, stats.getWakeLatency().getBucketCount(10));
+    EXPECT_EQ(1U, stats.getWakeLatency().getBucketCount(0));
+    EXPECT_EQ(2U, stats.getBatchSize().getCount());
+    EXPECT_EQ(1U, stats.getDroppedCount());
+
+    stats.beginFrame(ms2ns(12));
+    stats.recordReport(ms2ns(12) + us2ns(40));
+    EXPECT_EQ(1U, stats.getReportLatency().getCount());
+    EXPECT_EQ(63U, stats.getReportLatency().getPercentile(50));
+
+    String8 dump;
+    stats.dump(dump);
+    EXPECT_NE(nullptr, strstr(dump.c_str(), "SYN_DROPPED: 1"));
+}
+
+}  // namespace tests
+}  // namespace android
@@ -20,6 +20,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <linux/input.h>
 
@@ -89,9 +90,26 @@ public:
         return nullptr;
     }
     virtual status_t getAbsoluteAxisValue(int32_t axis, int32_t* outValue) const override {
-        // TODO
+        auto iter = mAbsValues.find(axis);
+        *outValue = iter != mAbsValues.end() ? iter->second : 0;
         return 0;
     }
+    virtual status_t getAbsoluteMtSlotValues(int32_t axis, int32_t* outValues,
+            size_t numSlots) const override {
+        auto iter = mMtSlotValues.find(axis);
+        if (iter == mMtSlotValues.end()) {
+            return -1;
+        }
+        for (size_t i = 0; i < numSlots; ++i) {
+            outValues[i] = i < iter->second.size() ? iter->second[i] : 0;
+        }
+        return 0;
+    }
+
+    void setAbsAxisValue(int32_t axis, int32_t value) { mAbsValues[axis] = value; }
+    void setMtSlotValues(int32_t axis, const std::vector<int32_t>& values) {
+        mMtSlotValues[axis] = values;
+    }
 
     virtual void vibrate(nsecs_t duration) override {}
     virtual void cancelVibrate() override {}
@@ -114,6 +132,8 @@ private:
     std::set<int32_t> mKeys;
     std::set<int32_t> mRelAxes;
     std::map<int32_t, AbsoluteAxisInfo*> mAbsAxes;
+    std::map<int32_t, int32_t> mAbsValues;
+    std::map<int32_t, std::vector<int32_t>> mMtSlotValues;
     std::set<int32_t> mSwitches;
     std::set<int32_t> mForceFeedbacks;
     std::set<int32_t> mInputProperties;
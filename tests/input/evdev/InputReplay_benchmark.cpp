@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays an input trace through the InputHub, reading it from pipes, and the
+// InputDeviceManager, the devices and their mappers, measuring the throughput
+// of the input stack and the latency of its reports. The trace is the one
+// recorded with evdev_record at the path in the INPUT_TRACE environment
+// variable, or else a touchscreen and a mouse used at the same time.
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+
+#include <linux/input.h>
+
+#include <benchmark/benchmark.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+
+#include "InputDeviceManager.h"
+#include "InputLatencyStats.h"
+#include "InputMocks.h"
+#include "InputTrace.h"
+#include "MockInputHost.h"
+
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace android {
+namespace tests {
+
+static const int kFrames = 2000;
+// 1ms apart, as from a 1kHz gaming mouse
+static const nsecs_t kFrameInterval = ms2ns(1);
+
+static std::string makeTrace() {
+    String8 trace;
+    trace.append("device 0 24 18d1 0001 0100\n"
+            "path 0 /dev/input/event0\n"
+            "name 0 Replay touchscreen\n"
+            "location 0 replay/0\n"
+            "props 0 1\n"
+            "abs 0 47 0 9 0 0 0\n"
+            "abs 0 53 0 1079 0 0 12\n"
+            "abs 0 54 0 1919 0 0 12\n"
+            "abs 0 57 0 65535 0 0 0\n"
+            "abs 0 58 0 255 0 0 0\n");
+    trace.append("device 1 3 046d c08b 0111\n"
+            "path 1 /dev/input/event1\n"
+            "name 1 Replay mouse\n"
+            "location 1 replay/1\n"
+            "keys 1 272 273 274\n"
+            "rel 1 0 1\n");
+
+    // Two fingers down on the touchscreen for the whole trace, moving on every
+    // other frame, while the mouse moves on every frame and clicks now and
+    // then.
+    nsecs_t when = s2ns(1);
+    for (int frame = 0; frame < kFrames; ++frame, when += kFrameInterval) {
+        if (frame % 2 == 0) {
+            for (int slot = 0; slot < 2; ++slot) {
+                trace.appendFormat("event 0 %" PRId64 " %d %d %d\n", when, EV_ABS,
+                        ABS_MT_SLOT, slot);
+                if (frame == 0) {
+                    trace.appendFormat("event 0 %" PRId64 " %d %d %d\n", when, EV_ABS,
+                            ABS_MT_TRACKING_ID, slot + 1);
+                }
+                trace.appendFormat("event 0 %" PRId64 " %d %d %d\n", when, EV_ABS,
+                        ABS_MT_POSITION_X, 100 + slot * 500 + frame % 400);
+                trace.appendFormat("event 0 %" PRId64 " %d %d %d\n", when, EV_ABS,
+                        ABS_MT_POSITION_Y, 200 + frame % 1600);
+                trace.appendFormat("event 0 %" PRId64 " %d %d %d\n", when, EV_ABS,
+                        ABS_MT_PRESSURE, 50 + frame % 100);
+            }
+            trace.appendFormat("event 0 %" PRId64 " %d %d %d\n", when, EV_SYN,
+                    SYN_REPORT, 0);
+        }
+        if (frame % 50 == 0) {
+            trace.appendFormat("event 1 %" PRId64 " %d %d %d\n", when, EV_KEY, BTN_LEFT,
+                    (frame / 50) % 2);
+        }
+        trace.appendFormat("event 1 %" PRId64 " %d %d %d\n", when, EV_REL, REL_X,
+                frame % 7 - 3);
+        trace.appendFormat("event 1 %" PRId64 " %d %d %d\n", when, EV_REL, REL_Y,
+                frame % 5 - 2);
+        trace.appendFormat("event 1 %" PRId64 " %d %d %d\n", when, EV_SYN, SYN_REPORT, 0);
+    }
+    return trace.string();
+}
+
+class ReplayFixture {
+public:
+    ReplayFixture() : mManager(&mHost) {
+        ON_CALL(mHost, createDeviceDefinition()).WillByDefault(Return(&mDeviceDef));
+        ON_CALL(mHost, createInputReportDefinition()).WillByDefault(Return(&mReportDef));
+        ON_CALL(mReportDef, allocateReport()).WillByDefault(Return(&mReport));
+
+        const char* path = getenv("INPUT_TRACE");
+        status_t ret = path != nullptr ? mPlayer.load(path) : mPlayer.parse(makeTrace());
+        LOG_ALWAYS_FATAL_IF(ret != OK, "could not load the input trace");
+    }
+
+    InputDeviceManager& manager() { return mManager; }
+    InputTracePlayer& player() { return mPlayer; }
+
+private:
+    NiceMock<MockInputHost> mHost;
+    NiceMock<MockInputReportDefinition> mReportDef;
+    NiceMock<MockInputDeviceDefinition> mDeviceDef;
+    NiceMock<MockInputReport> mReport;
+    InputDeviceManager mManager;
+    InputTracePlayer mPlayer;
+};
+
+// Reports the latency of the reports of the last replay, in microseconds.
+static void setLatencyCounters(benchmark::State& state, const InputTracePlayer& player) {
+    uint64_t p50 = 0, p99 = 0;
+    for (const auto& node : player.getNodes()) {
+        const Log2Histogram& latency = node->getLatencyStats()->getReportLatency();
+        p50 = std::max(p50, latency.getPercentile(50));
+        p99 = std::max(p99, latency.getPercentile(99));
+    }
+    state.counters["report_p50_us"] = p50;
+    state.counters["report_p99_us"] = p99;
+}
+
+// As fast as the stack processes the input.
+static void BM_ReplayUnpaced(benchmark::State& state) {
+    ReplayFixture fixture;
+    for (auto _ : state) {
+        if (fixture.player().replay(&fixture.manager(), 0) != OK) {
+            state.SkipWithError("replay failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * fixture.player().getEventCount());
+    setLatencyCounters(state, fixture.player());
+}
+BENCHMARK(BM_ReplayUnpaced);
+
+// At ten times the recorded speed, with the timing of real input.
+static void BM_ReplayPaced(benchmark::State& state) {
+    ReplayFixture fixture;
+    for (auto _ : state) {
+        if (fixture.player().replay(&fixture.manager(), 10) != OK) {
+            state.SkipWithError("replay failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * fixture.player().getEventCount());
+    setLatencyCounters(state, fixture.player());
+}
+BENCHMARK(BM_ReplayPaced)->Iterations(3)->UseRealTime();
+
+}  // namespace tests
+}  // namespace android
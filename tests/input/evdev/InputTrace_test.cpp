@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "InputTrace.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android/input.h>
+#include <linux/input.h>
+
+#include <gtest/gtest.h>
+
+#include <utils/StopWatch.h>
+#include <utils/Timers.h>
+
+#include "InputMocks.h"
+
+namespace android {
+namespace tests {
+
+// Keeps the frames and devices it is called back with.
+class FrameCollector : public InputCallbackInterface {
+public:
+    virtual void onInputEvent(const std::shared_ptr<InputDeviceNode>& node, InputEvent& event,
+            nsecs_t event_time) override {
+        frames.push_back({ event });
+    }
+    virtual void onInputFrame(const std::shared_ptr<InputDeviceNode>& node, InputEvent* events,
+            size_t count, nsecs_t event_time) override {
+        frames.emplace_back(events, events + count);
+        // The state of the node is up to date with the frame.
+        if (node->hasKey(BTN_LEFT)) {
+            buttonStates.push_back(node->getKeyState(BTN_LEFT));
+        }
+    }
+    virtual void onDeviceAdded(const std::shared_ptr<InputDeviceNode>& node) override {
+        added.push_back(node);
+    }
+    virtual void onDeviceRemoved(const std::shared_ptr<InputDeviceNode>& node) override {
+        removed.push_back(node);
+    }
+
+    std::vector<std::vector<InputEvent>> frames;
+    std::vector<int32_t> buttonStates;
+    std::vector<std::shared_ptr<InputDeviceNode>> added;
+    std::vector<std::shared_ptr<InputDeviceNode>> removed;
+};
+
+class InputTraceTest : public ::testing::Test {
+protected:
+    virtual void SetUp() override {
+        ASSERT_EQ(0, pipe(mPipe));
+        mXInfo.maxValue = 1079;
+        mXInfo.resolution = 12;
+    }
+
+    virtual void TearDown() override {
+        close(mPipe[0]);
+        close(mPipe[1]);
+    }
+
+    std::string readTrace() {
+        close(mPipe[1]);
+        mPipe[1] = -1;
+        std::string trace;
+        char buffer[1024];
+        ssize_t n;
+        while ((n = read(mPipe[0], buffer, sizeof(buffer))) > 0) {
+            trace.append(buffer, n);
+        }
+        return trace;
+    }
+
+    int mPipe[2];
+    AbsoluteAxisInfo mXInfo;
+};
+
+TEST_F(InputTraceTest, testRecordAndReplay) {
+    auto collector = std::make_shared<FrameCollector>();
+    InputTraceRecorder recorder(collector, mPipe[1]);
+
+    auto node = std::make_shared<MockInputDeviceNode>();
+    node->setPath("/dev/input/event4");
+    node->setName("Test mouse");
+    node->setVendorId(0x18d1);
+    node->addKeys(BTN_MOUSE, BTN_LEFT);
+    node->addRelAxis(REL_X);
+    node->addAbsAxis(ABS_X, &mXInfo);
+    node->addInputProperty(INPUT_PROP_POINTER);
+    recorder.onDeviceAdded(node);
+
+    InputEvent events[] = {
+        {ms2ns(10), EV_KEY, BTN_LEFT, 1},
+        {ms2ns(10), EV_REL, REL_X, -3},
+        {ms2ns(10), EV_SYN, SYN_REPORT, 0},
+        {ms2ns(20), EV_KEY, BTN_LEFT, 0},
+        {ms2ns(20), EV_SYN, SYN_REPORT, 0},
+    };
+    recorder.onInputFrame(node, events, 3, ms2ns(11));
+    recorder.onInputFrame(node, events + 3, 2, ms2ns(21));
+    recorder.onDeviceRemoved(node);
+
+    // The recorder passes everything on.
+    EXPECT_EQ(1U, collector->added.size());
+    EXPECT_EQ(2U, collector->frames.size());
+    EXPECT_EQ(1U, collector->removed.size());
+
+    InputTracePlayer player;
+    ASSERT_EQ(OK, player.parse(readTrace()));
+    EXPECT_EQ(1U, player.getDeviceCount());
+    EXPECT_EQ(5U, player.getEventCount());
+
+    FrameCollector replayed;
+    ASSERT_EQ(OK, player.replay(&replayed, 0));
+    ASSERT_EQ(1U, replayed.added.size());
+    EXPECT_EQ(1U, replayed.removed.size());
+    ASSERT_EQ(2U, replayed.frames.size());
+    EXPECT_EQ(3U, replayed.frames[0].size());
+    EXPECT_EQ(REL_X, replayed.frames[0][1].code);
+    EXPECT_EQ(-3, replayed.frames[0][1].value);
+    EXPECT_EQ(2U, replayed.frames[1].size());
+    EXPECT_EQ((std::vector<int32_t>{ AKEY_STATE_DOWN, AKEY_STATE_UP }), replayed.buttonStates);
+
+    const auto& replayNode = replayed.added[0];
+    EXPECT_EQ("/dev/input/event4", replayNode->getPath());
+    EXPECT_EQ("Test mouse", replayNode->getName());
+    EXPECT_EQ(0x18d1, replayNode->getVendorId());
+    EXPECT_TRUE(replayNode->hasKey(BTN_LEFT));
+    EXPECT_FALSE(replayNode->hasKey(BTN_RIGHT));
+    EXPECT_TRUE(replayNode->hasKeyInRange(BTN_MOUSE, BTN_JOYSTICK));
+    EXPECT_TRUE(replayNode->hasRelativeAxis(REL_X));
+    EXPECT_FALSE(replayNode->hasRelativeAxis(REL_Y));
+    EXPECT_TRUE(replayNode->hasInputProperty(INPUT_PROP_POINTER));
+    const AbsoluteAxisInfo* info = replayNode->getAbsoluteAxisInfo(ABS_X);
+    ASSERT_NE(nullptr, info);
+    EXPECT_EQ(1079, info->maxValue);
+    EXPECT_EQ(12, info->resolution);
+
+    EXPECT_EQ(2U, player.getNodes()[0]->getLatencyStats()->getWakeLatency().getCount());
+}
+
+TEST_F(InputTraceTest, testPacedReplay) {
+    InputTracePlayer player;
+    ASSERT_EQ(OK, player.parse(
+            "device 0 3 0000 0000 0000\n"
+            "sw 0 2\n"
+            "event 0 1000000000 5 2 1\n"
+            "event 0 1000000000 0 0 0\n"
+            "event 0 1080000000 5 2 0\n"
+            "event 0 1080000000 0 0 0\n"));
+
+    // 80ms of input, replayed twice as fast.
+    FrameCollector replayed;
+    StopWatch stopWatch("paced replay");
+    ASSERT_EQ(OK, player.replay(&replayed, 2));
+    EXPECT_GE(ns2ms(stopWatch.elapsedTime()), 40);
+    ASSERT_EQ(2U, replayed.frames.size());
+    EXPECT_EQ(ms2ns(40), replayed.frames[1][0].when - replayed.frames[0][0].when);
+    EXPECT_EQ(AKEY_STATE_UP, player.getNodes()[0]->getSwitchState(SW_HEADPHONE_INSERT));
+}
+
+TEST_F(InputTraceTest, testMalformedTrace) {
+    InputTracePlayer player;
+    EXPECT_EQ(BAD_VALUE, player.parse("bogus 0\n"));
+    // Events of a device never added
+    EXPECT_EQ(BAD_VALUE, player.parse("event 3 0 0 0 0\n"));
+    EXPECT_EQ(BAD_VALUE, player.parse("device 0 3 0000 0000 0000\nevent 0 0 1\n"));
+}
+
+TEST_F(InputTraceTest, testSlotOutOfRange) {
+    const std::string device = "device 0 24 0000 0000 0000\nabs 0 47 0 9 0 0 0\n";
+    InputTracePlayer player;
+    EXPECT_EQ(OK, player.parse(device + "event 0 0 3 47 9\n"));
+    EXPECT_EQ(BAD_VALUE, player.parse(device + "event 0 0 3 47 10\n"));
+    EXPECT_EQ(BAD_VALUE, player.parse(device + "event 0 0 3 47 -1\n"));
+    // A device without slots
+    EXPECT_EQ(BAD_VALUE, player.parse("device 0 24 0000 0000 0000\nevent 0 0 3 47 0\n"));
+
+    // A node ignores the slots its device does not have, as the kernel does.
+    InputTraceDevice traceDevice;
+    AbsoluteAxisInfo slotInfo;
+    slotInfo.maxValue = 1;
+    traceDevice.absAxes[ABS_MT_SLOT] = slotInfo;
+    traceDevice.absAxes[ABS_MT_POSITION_X] = mXInfo;
+    ReplayDeviceNode node(traceDevice);
+    node.updateState({ 0, EV_ABS, ABS_MT_SLOT, 1 });
+    node.updateState({ 0, EV_ABS, ABS_MT_SLOT, 1000000 });
+    node.updateState({ 0, EV_ABS, ABS_MT_POSITION_X, 42 });
+    int32_t values[2] = {};
+    ASSERT_EQ(OK, node.getAbsoluteMtSlotValues(ABS_MT_POSITION_X, values, 2));
+    EXPECT_EQ(0, values[0]);
+    EXPECT_EQ(42, values[1]);
+}
+
+}  // namespace tests
+}  // namespace android
@@ -43,6 +43,7 @@ public:
                 int32_t max, float resolution));
     MOCK_METHOD3(declareUsages, void(InputCollectionId id, InputUsage* usage, size_t usageCount));
     MOCK_METHOD0(allocateReport, InputReport*());
+    MOCK_METHOD1(freeReport, void(InputReport* report));
 };
 
 class MockInputDeviceDefinition : public InputDeviceDefinition {
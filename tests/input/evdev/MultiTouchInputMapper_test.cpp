@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+
+#include <linux/input.h>
+
+#include <gtest/gtest.h>
+
+#include "InputMocks.h"
+#include "MockInputHost.h"
+#include "MultiTouchInputMapper.h"
+
+using ::testing::_;
+using ::testing::InSequence;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace android {
+namespace tests {
+
+class MultiTouchInputMapperTest : public ::testing::Test {
+protected:
+     virtual void SetUp() override {
+         mMapper = std::make_unique<MultiTouchInputMapper>();
+
+         mSlotInfo.maxValue = 9;
+         mXInfo.maxValue = 1079;
+         mYInfo.maxValue = 1919;
+         mPressureInfo.maxValue = 255;
+         mDeviceNode.addAbsAxis(ABS_MT_SLOT, &mSlotInfo);
+         mDeviceNode.addAbsAxis(ABS_MT_TRACKING_ID, &mTrackingIdInfo);
+         mDeviceNode.addAbsAxis(ABS_MT_POSITION_X, &mXInfo);
+         mDeviceNode.addAbsAxis(ABS_MT_POSITION_Y, &mYInfo);
+         mDeviceNode.addAbsAxis(ABS_MT_PRESSURE, &mPressureInfo);
+     }
+
+     // Configures the mapper, ignoring the declared usages.
+     void configure(NiceMock<MockInputReportDefinition>* reportDef, MockInputReport* report) {
+         EXPECT_CALL(*reportDef, allocateReport())
+             .WillOnce(Return(report));
+         ASSERT_TRUE(mMapper->configureInputReport(&mDeviceNode, reportDef));
+     }
+
+     MockInputHost mHost;
+     std::unique_ptr<MultiTouchInputMapper> mMapper;
+
+     MockInputDeviceNode mDeviceNode;
+     AbsoluteAxisInfo mSlotInfo;
+     AbsoluteAxisInfo mTrackingIdInfo;
+     AbsoluteAxisInfo mXInfo;
+     AbsoluteAxisInfo mYInfo;
+     AbsoluteAxisInfo mPressureInfo;
+};
+
+TEST_F(MultiTouchInputMapperTest, testConfigureDevice) {
+    MockInputReportDefinition reportDef;
+
+    const auto id = INPUT_COLLECTION_ID_TOUCH;
+    EXPECT_CALL(reportDef, addCollection(id, 10));
+    EXPECT_CALL(reportDef, declareUsage(id, INPUT_USAGE_AXIS_X, 0, 1079, _));
+    EXPECT_CALL(reportDef, declareUsage(id, INPUT_USAGE_AXIS_Y, 0, 1919, _));
+    EXPECT_CALL(reportDef, declareUsage(id, INPUT_USAGE_AXIS_PRESSURE, 0, 255, _));
+    EXPECT_CALL(reportDef, declareUsages(id, _, 1));
+
+    EXPECT_TRUE(mMapper->configureInputReport(&mDeviceNode, &reportDef));
+}
+
+TEST_F(MultiTouchInputMapperTest, testConfigureDevice_noSlots) {
+    MockInputReportDefinition reportDef;
+    MockInputDeviceNode deviceNode;
+    deviceNode.addAbsAxis(ABS_MT_POSITION_X, &mXInfo);
+    deviceNode.addAbsAxis(ABS_MT_POSITION_Y, &mYInfo);
+
+    EXPECT_CALL(reportDef, addCollection(_, _)).Times(0);
+    EXPECT_CALL(reportDef, declareUsage(_, _, _, _, _)).Times(0);
+
+    EXPECT_FALSE(mMapper->configureInputReport(&deviceNode, &reportDef));
+}
+
+TEST_F(MultiTouchInputMapperTest, testProcessInput) {
+    NiceMock<MockInputReportDefinition> reportDef;
+    MockInputReport report;
+    configure(&reportDef, &report);
+
+    {
+        InSequence s;
+        const auto id = INPUT_COLLECTION_ID_TOUCH;
+        // Both fingers go down in the same frame, and get a single report.
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_X, 100, 0));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_Y, 200, 0));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_PRESSURE, 50, 0));
+        EXPECT_CALL(report, setBoolUsage(id, INPUT_USAGE_BUTTON_PRIMARY, true, 0));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_X, 300, 1));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_Y, 400, 1));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_PRESSURE, 60, 1));
+        EXPECT_CALL(report, setBoolUsage(id, INPUT_USAGE_BUTTON_PRIMARY, true, 1));
+        EXPECT_CALL(report, reportEvent(_));
+        // The first finger moves while the second one lifts.
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_X, 110, 0));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_Y, 200, 0));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_PRESSURE, 50, 0));
+        EXPECT_CALL(report, setBoolUsage(id, INPUT_USAGE_BUTTON_PRIMARY, true, 0));
+        EXPECT_CALL(report, setBoolUsage(id, INPUT_USAGE_BUTTON_PRIMARY, false, 1));
+        EXPECT_CALL(report, reportEvent(_));
+    }
+
+    InputEvent events[] = {
+        {0, EV_ABS, ABS_MT_SLOT, 0},
+        {0, EV_ABS, ABS_MT_TRACKING_ID, 1},
+        {0, EV_ABS, ABS_MT_POSITION_X, 100},
+        {0, EV_ABS, ABS_MT_POSITION_Y, 200},
+        {0, EV_ABS, ABS_MT_PRESSURE, 50},
+        {0, EV_ABS, ABS_MT_SLOT, 1},
+        {0, EV_ABS, ABS_MT_TRACKING_ID, 2},
+        {0, EV_ABS, ABS_MT_POSITION_X, 300},
+        {0, EV_ABS, ABS_MT_POSITION_Y, 400},
+        {0, EV_ABS, ABS_MT_PRESSURE, 60},
+        {0, EV_SYN, SYN_REPORT, 0},
+        {1, EV_ABS, ABS_MT_TRACKING_ID, -1},
+        {1, EV_ABS, ABS_MT_SLOT, 0},
+        {1, EV_ABS, ABS_MT_POSITION_X, 110},
+        {1, EV_SYN, SYN_REPORT, 0},
+        // Nothing changed, so nothing is reported.
+        {2, EV_SYN, SYN_REPORT, 0},
+    };
+    mMapper->processFrame(events, sizeof(events) / sizeof(events[0]));
+}
+
+TEST_F(MultiTouchInputMapperTest, testSynDropped) {
+    NiceMock<MockInputReportDefinition> reportDef;
+    MockInputReport report;
+    configure(&reportDef, &report);
+
+    // The driver's state once the events have been dropped: the finger in
+    // slot 0 lifted and another one went down in slot 2.
+    mDeviceNode.setMtSlotValues(ABS_MT_TRACKING_ID, { -1, -1, 7, -1, -1, -1, -1, -1, -1, -1 });
+    mDeviceNode.setMtSlotValues(ABS_MT_POSITION_X, { 0, 0, 500 });
+    mDeviceNode.setMtSlotValues(ABS_MT_POSITION_Y, { 0, 0, 600 });
+    mDeviceNode.setMtSlotValues(ABS_MT_PRESSURE, { 0, 0, 70 });
+    mDeviceNode.setAbsAxisValue(ABS_MT_SLOT, 2);
+
+    {
+        InSequence s;
+        const auto id = INPUT_COLLECTION_ID_TOUCH;
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_X, 100, 0));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_Y, 200, 0));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_PRESSURE, 0, 0));
+        EXPECT_CALL(report, setBoolUsage(id, INPUT_USAGE_BUTTON_PRIMARY, true, 0));
+        EXPECT_CALL(report, reportEvent(_));
+        // Resynced from the driver.
+        EXPECT_CALL(report, setBoolUsage(id, INPUT_USAGE_BUTTON_PRIMARY, false, 0));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_X, 500, 2));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_Y, 600, 2));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_PRESSURE, 70, 2));
+        EXPECT_CALL(report, setBoolUsage(id, INPUT_USAGE_BUTTON_PRIMARY, true, 2));
+        EXPECT_CALL(report, reportEvent(_));
+        // The current slot is resynced too.
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_X, 510, 2));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_Y, 600, 2));
+        EXPECT_CALL(report, setIntUsage(id, INPUT_USAGE_AXIS_PRESSURE, 70, 2));
+        EXPECT_CALL(report, setBoolUsage(id, INPUT_USAGE_BUTTON_PRIMARY, true, 2));
+        EXPECT_CALL(report, reportEvent(_));
+    }
+
+    InputEvent events[] = {
+        {0, EV_ABS, ABS_MT_SLOT, 0},
+        {0, EV_ABS, ABS_MT_TRACKING_ID, 1},
+        {0, EV_ABS, ABS_MT_POSITION_X, 100},
+        {0, EV_ABS, ABS_MT_POSITION_Y, 200},
+        {0, EV_SYN, SYN_REPORT, 0},
+        {1, EV_SYN, SYN_DROPPED, 0},
+        // Stale events, up to the next SYN_REPORT.
+        {1, EV_ABS, ABS_MT_POSITION_X, 999},
+        {1, EV_SYN, SYN_REPORT, 0},
+        {2, EV_ABS, ABS_MT_POSITION_X, 510},
+        {2, EV_SYN, SYN_REPORT, 0},
+    };
+    mMapper->processFrame(events, sizeof(events) / sizeof(events[0]));
+}
+
+}  // namespace tests
+}  // namespace android
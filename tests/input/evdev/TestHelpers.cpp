@@ -21,11 +21,17 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <chrono>
+
+#include <linux/uinput.h>
+
 #include <utils/Log.h>
 
 namespace android {
@@ -90,4 +96,80 @@ TempFile* TempDir::newTempFile() {
     return new TempFile(mName);
 }
 
+UinputDevice::UinputDevice(const char* name, const std::vector<int>& keys,
+        const std::vector<int>& switches, const std::vector<int>& axes) {
+    mFd = TEMP_FAILURE_RETRY(open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC));
+    if (mFd < 0) {
+        ALOGW("could not open /dev/uinput. errno=%d", errno);
+        return;
+    }
+
+    struct uinput_user_dev dev = {};
+    snprintf(dev.name, sizeof(dev.name), "%s", name);
+    dev.id.bustype = BUS_VIRTUAL;
+    ioctl(mFd, UI_SET_EVBIT, EV_SYN);
+    if (!keys.empty()) {
+        ioctl(mFd, UI_SET_EVBIT, EV_KEY);
+    }
+    for (int key : keys) {
+        ioctl(mFd, UI_SET_KEYBIT, key);
+    }
+    if (!switches.empty()) {
+        ioctl(mFd, UI_SET_EVBIT, EV_SW);
+    }
+    for (int sw : switches) {
+        ioctl(mFd, UI_SET_SWBIT, sw);
+    }
+    if (!axes.empty()) {
+        ioctl(mFd, UI_SET_EVBIT, EV_ABS);
+    }
+    for (int axis : axes) {
+        ioctl(mFd, UI_SET_ABSBIT, axis);
+        dev.absmax[axis] = 100;
+    }
+    if (TEMP_FAILURE_RETRY(write(mFd, &dev, sizeof(dev))) != sizeof(dev)
+            || ioctl(mFd, UI_DEV_CREATE) < 0) {
+        ALOGW("could not create uinput device %s. errno=%d", name, errno);
+        return;
+    }
+
+    // The evdev node is named after the only event handler of the input
+    // device, and is created asynchronously.
+    char sysName[32];
+    if (ioctl(mFd, UI_GET_SYSNAME(sizeof(sysName)), sysName) < 0) {
+        ALOGW("could not get the name of uinput device %s. errno=%d", name, errno);
+        return;
+    }
+    std::string sysPath = std::string("/sys/devices/virtual/input/") + sysName;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (mDevicePath.empty() && std::chrono::steady_clock::now() < deadline) {
+        if (auto dir = opendir(sysPath.c_str())) {
+            while (auto entry = readdir(dir)) {
+                std::string path = std::string("/dev/input/") + entry->d_name;
+                if (strncmp(entry->d_name, "event", 5) == 0 && access(path.c_str(), R_OK) == 0) {
+                    mDevicePath = path;
+                    break;
+                }
+            }
+            closedir(dir);
+        }
+        if (mDevicePath.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    ALOGW_IF(mDevicePath.empty(), "no evdev node for uinput device %s", name);
+}
+
+UinputDevice::~UinputDevice() {
+    if (mFd >= 0) {
+        ioctl(mFd, UI_DEV_DESTROY);
+        close(mFd);
+    }
+}
+
+bool UinputDevice::injectEvents(const std::vector<struct input_event>& events) {
+    size_t size = events.size() * sizeof(struct input_event);
+    return TEMP_FAILURE_RETRY(write(mFd, events.data(), size)) == static_cast<ssize_t>(size);
+}
+
 }  // namespace android
@@ -18,7 +18,11 @@
 #define ANDROID_TEST_HELPERS_H_
 
 #include <future>
+#include <string>
 #include <thread>
+#include <vector>
+
+#include <linux/input.h>
 
 namespace android {
 
@@ -78,6 +82,32 @@ private:
     char* mName;
 };
 
+/**
+ * Creates a virtual evdev device through uinput, with the given keys, switches
+ * and absolute axes (ranging from 0 to 100). The device is destroyed in the
+ * destructor. Needs root, and a kernel with uinput.
+ */
+class UinputDevice {
+public:
+    UinputDevice(const char* name, const std::vector<int>& keys,
+            const std::vector<int>& switches, const std::vector<int>& axes);
+    ~UinputDevice();
+
+    // No copy or assign
+    UinputDevice(const UinputDevice&) = delete;
+    UinputDevice& operator=(const UinputDevice&) = delete;
+
+    bool isValid() const { return !mDevicePath.empty(); }
+    // Path of the evdev node of the device, once it exists.
+    const std::string& getDevicePath() const { return mDevicePath; }
+
+    bool injectEvents(const std::vector<struct input_event>& events);
+
+private:
+    int mFd;
+    std::string mDevicePath;
+};
+
 }  // namespace android
 
 #endif  // ANDROID_TEST_HELPERS_H_